@@ -0,0 +1,102 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+#include "CpuFeatures.h"
+
+#if defined(CPU_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(CPU_X86)
+namespace
+{
+	void CpuId(int leaf, int subleaf, unsigned int regs[4])
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuidex(info, leaf, subleaf);
+		for (int i = 0; i < 4; i++)
+			regs[i] = static_cast<unsigned int>(info[i]);
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	unsigned long long XGetBv()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned int eax = 0;
+		unsigned int edx = 0;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+	}
+
+	bool DetectSsse3()
+	{
+		unsigned int regs[4] = { 0, 0, 0, 0 };
+
+		CpuId(1, 0, regs);
+		return (regs[2] & (1u << 9)) != 0;
+	}
+
+	bool DetectAvx2()
+	{
+		unsigned int regs[4] = { 0, 0, 0, 0 };
+
+		CpuId(0, 0, regs);
+		if (regs[0] < 7)
+			return false;
+
+		// the OS must save the YMM registers (OSXSAVE, then XCR0 bits 1 and 2)
+		CpuId(1, 0, regs);
+		const bool osxsave = (regs[2] & (1u << 27)) != 0;
+		const bool avx = (regs[2] & (1u << 28)) != 0;
+		if (!osxsave || !avx || (XGetBv() & 0x6) != 0x6)
+			return false;
+
+		CpuId(7, 0, regs);
+		return (regs[1] & (1u << 5)) != 0;
+	}
+}
+#endif
+
+bool CpuHasSsse3()
+{
+#if defined(CPU_X86)
+	static const bool hasSsse3 = DetectSsse3();
+	return hasSsse3;
+#else
+	return false;
+#endif
+}
+
+bool CpuHasAvx2()
+{
+#if defined(CPU_X86)
+	static const bool hasAvx2 = DetectAvx2();
+	return hasAvx2;
+#else
+	return false;
+#endif
+}
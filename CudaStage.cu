@@ -0,0 +1,438 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+
+#ifdef USE_CUDA
+
+#include "CudaStage.h"
+#include "Deinterleave.h"
+#include "Stokes.h"
+#include <cuda_runtime.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#define TAB1 "  "
+
+// threads per block of every kernel, one pixel each
+#define CUDA_BLOCK_SIZE 256
+
+// the scaling of QuantizeDolpAolp() in Stokes.cpp
+#define AOLP_OFFSET 1.57079633f
+#define AOLP_SCALE (255.0f / 3.14159265f)
+
+namespace
+{
+	// throws with the CUDA runtime's description of an error
+	void CheckCuda(cudaError_t result, const char* what)
+	{
+		if (result != cudaSuccess)
+			throw std::runtime_error(std::string("CUDA could not ") + what + ": " + cudaGetErrorString(result));
+	}
+
+	// half of atan2(y, x) by the polynomial of the host's fast kernels
+	__device__ inline float FastAolp(float y, float x)
+	{
+		float ax = fabsf(x);
+		float ay = fabsf(y);
+		float larger = fmaxf(ax, ay);
+		float a = larger > 0.0f ? fminf(ax, ay) / larger : 0.0f;
+		float a2 = a * a;
+
+		float r = a * (0.9998660f + a2 * (-0.3302995f + a2 * (0.1801410f + a2 * (-0.0851330f + a2 * 0.0208351f))));
+
+		if (ay > ax)
+			r = 1.57079633f - r;
+		if (x < 0.0f)
+			r = 3.14159265f - r;
+		if (y < 0.0f)
+			r = -r;
+
+		return 0.5f * r;
+	}
+
+	// splits interleaved pixels into four planes, each value repeated
+	// bytesPerPixel times
+	template <int bytesPerPixel>
+	__global__ void DemuxKernel(const uchar4* __restrict__ pSrc, unsigned int numPixels, uint8_t* pDst0, uint8_t* pDst45, uint8_t* pDst90, uint8_t* pDst135)
+	{
+		unsigned int i = blockIdx.x * blockDim.x + threadIdx.x;
+
+		if (i >= numPixels)
+			return;
+
+		uchar4 pixel = pSrc[i];
+
+		for (int b = 0; b < bytesPerPixel; b++)
+		{
+			pDst0[i * bytesPerPixel + b] = pixel.x;
+			pDst45[i * bytesPerPixel + b] = pixel.y;
+			pDst90[i * bytesPerPixel + b] = pixel.z;
+			pDst135[i * bytesPerPixel + b] = pixel.w;
+		}
+	}
+
+	// 8-bit DoLP and AoLP straight from interleaved pixels
+	//    The float Stokes parameters only ever live in registers.
+	template <int bytesPerPixel, bool fastAolp>
+	__global__ void DolpAolpKernel(const uchar4* __restrict__ pSrc, unsigned int numPixels, uint8_t* pDolp, uint8_t* pAolp)
+	{
+		unsigned int i = blockIdx.x * blockDim.x + threadIdx.x;
+
+		if (i >= numPixels)
+			return;
+
+		uchar4 pixel = pSrc[i];
+
+		float s0 = (static_cast<float>(pixel.x) + pixel.y + pixel.z + pixel.w) * 0.5f;
+		float s1 = static_cast<float>(pixel.x) - pixel.z;
+		float s2 = static_cast<float>(pixel.y) - pixel.w;
+
+		float dolp = s0 > 0.0f ? fminf(sqrtf(s1 * s1 + s2 * s2) / s0, 1.0f) : 0.0f;
+		float aolp = fastAolp ? FastAolp(s2, s1) : 0.5f * atan2f(s2, s1);
+
+		uint8_t dolp8 = static_cast<uint8_t>(fminf(dolp * 255.0f + 0.5f, 255.0f));
+		uint8_t aolp8 = static_cast<uint8_t>(fminf((aolp + AOLP_OFFSET) * AOLP_SCALE + 0.5f, 255.0f));
+
+		for (int b = 0; b < bytesPerPixel; b++)
+		{
+			pDolp[i * bytesPerPixel + b] = dolp8;
+			pAolp[i * bytesPerPixel + b] = aolp8;
+		}
+	}
+
+	template <int bytesPerPixel>
+	void LaunchKernels(cudaStream_t stream, const uint8_t* pFrame, unsigned int numPixels, uint8_t* const pAngles[4], uint8_t* pDolp, uint8_t* pAolp, bool fastAolp)
+	{
+		const unsigned int numBlocks = (numPixels + CUDA_BLOCK_SIZE - 1) / CUDA_BLOCK_SIZE;
+		const uchar4* pSrc = reinterpret_cast<const uchar4*>(pFrame);
+
+		DemuxKernel<bytesPerPixel><<<numBlocks, CUDA_BLOCK_SIZE, 0, stream>>>(pSrc, numPixels, pAngles[0], pAngles[1], pAngles[2], pAngles[3]);
+
+		if (pDolp == NULL || pAolp == NULL)
+			return;
+
+		if (fastAolp)
+			DolpAolpKernel<bytesPerPixel, true><<<numBlocks, CUDA_BLOCK_SIZE, 0, stream>>>(pSrc, numPixels, pDolp, pAolp);
+		else
+			DolpAolpKernel<bytesPerPixel, false><<<numBlocks, CUDA_BLOCK_SIZE, 0, stream>>>(pSrc, numPixels, pDolp, pAolp);
+	}
+}
+
+// allocates the streams and buffers
+// (1) a stream, an upload event and a pinned staging buffer per slice
+//     buffer, written by the host only, so write-combined
+// (2) device frame
+// (3) device planes, unless they are written to the caller's device memory
+CudaStage::CudaStage(size_t width, size_t height, size_t bytesPerPixel, bool stokes, bool fastAolp, bool deviceOutput)
+	: m_width(width)
+	, m_height(height)
+	, m_bytesPerPixel(bytesPerPixel)
+	, m_stokes(stokes)
+	, m_fastAolp(fastAolp)
+	, m_deviceOutput(deviceOutput)
+	, m_slicePixels((width * height + CUDA_NUM_SLICES - 1) / CUDA_NUM_SLICES)
+	, m_device(0)
+	, m_pFrame(NULL)
+	, m_pPlanes(NULL)
+{
+	if (bytesPerPixel != 1 && bytesPerPixel != 3)
+		throw std::runtime_error("CUDA stage writes Mono8 or BGR8 planes only");
+
+	for (size_t b = 0; b < 2; b++)
+	{
+		m_streams[b] = NULL;
+		m_pStaging[b] = NULL;
+		m_uploaded[b] = NULL;
+	}
+
+	try
+	{
+		CheckCuda(cudaGetDevice(&m_device), "find a GPU");
+
+		for (size_t b = 0; b < 2; b++)
+		{
+			cudaStream_t stream = NULL;
+			CheckCuda(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking), "create a stream");
+			m_streams[b] = stream;
+
+			cudaEvent_t event = NULL;
+			CheckCuda(cudaEventCreateWithFlags(&event, cudaEventDisableTiming), "create an event");
+			m_uploaded[b] = event;
+
+			CheckCuda(cudaHostAlloc(reinterpret_cast<void**>(&m_pStaging[b]), 4 * m_slicePixels, cudaHostAllocWriteCombined), "allocate pinned memory");
+		}
+
+		CheckCuda(cudaMalloc(reinterpret_cast<void**>(&m_pFrame), 4 * width * height), "allocate device memory");
+
+		if (!deviceOutput)
+			CheckCuda(cudaMalloc(reinterpret_cast<void**>(&m_pPlanes), 6 * width * height * bytesPerPixel), "allocate device memory");
+	}
+	catch (...)
+	{
+		Release();
+		throw;
+	}
+}
+
+CudaStage::~CudaStage()
+{
+	Release();
+}
+
+// each slice, on alternate streams:
+// (1) waits for the upload that last used its staging buffer
+// (2) stages the slice in pinned memory
+// (3) uploads it
+// (4) runs the demux and DoLP/AoLP kernels over it
+// (5) downloads its part of the planes for host output
+// then waits for both streams
+void CudaStage::Process(const uint8_t* pFrame, size_t numPixels, uint8_t* const pAngles[4], uint8_t* pDolp, uint8_t* pAolp)
+{
+	numPixels = std::min(numPixels, m_width * m_height);
+
+	// host output goes through the stage's own device planes
+	const size_t planeSize = m_width * m_height * m_bytesPerPixel;
+	const size_t numPlanes = m_stokes ? 6 : 4;
+	uint8_t* planes[6] = { pAngles[0], pAngles[1], pAngles[2], pAngles[3], pDolp, pAolp };
+	uint8_t* targets[6];
+
+	for (size_t p = 0; p < 6; p++)
+		targets[p] = m_deviceOutput ? planes[p] : m_pPlanes + p * planeSize;
+
+	for (size_t begin = 0, slice = 0; begin < numPixels; begin += m_slicePixels, slice++)
+	{
+		const size_t count = std::min(m_slicePixels, numPixels - begin);
+		const size_t b = slice % 2;
+		cudaStream_t stream = static_cast<cudaStream_t>(m_streams[b]);
+
+		CheckCuda(cudaEventSynchronize(static_cast<cudaEvent_t>(m_uploaded[b])), "upload a frame");
+
+		memcpy(m_pStaging[b], pFrame + 4 * begin, 4 * count);
+		CheckCuda(cudaMemcpyAsync(m_pFrame + 4 * begin, m_pStaging[b], 4 * count, cudaMemcpyHostToDevice, stream), "upload a frame");
+		CheckCuda(cudaEventRecord(static_cast<cudaEvent_t>(m_uploaded[b]), stream), "upload a frame");
+
+		uint8_t* sliceTargets[6];
+		for (size_t p = 0; p < 6; p++)
+			sliceTargets[p] = targets[p] != NULL ? targets[p] + begin * m_bytesPerPixel : NULL;
+
+		uint8_t* pDolpTarget = m_stokes ? sliceTargets[4] : NULL;
+		uint8_t* pAolpTarget = m_stokes ? sliceTargets[5] : NULL;
+
+		if (m_bytesPerPixel == 1)
+			LaunchKernels<1>(stream, m_pFrame + 4 * begin, static_cast<unsigned int>(count), sliceTargets, pDolpTarget, pAolpTarget, m_fastAolp);
+		else
+			LaunchKernels<3>(stream, m_pFrame + 4 * begin, static_cast<unsigned int>(count), sliceTargets, pDolpTarget, pAolpTarget, m_fastAolp);
+
+		CheckCuda(cudaGetLastError(), "run the demux");
+
+		if (!m_deviceOutput)
+		{
+			for (size_t p = 0; p < numPlanes; p++)
+				CheckCuda(cudaMemcpyAsync(planes[p] + begin * m_bytesPerPixel, sliceTargets[p], count * m_bytesPerPixel, cudaMemcpyDeviceToHost, stream), "download a plane");
+		}
+	}
+
+	for (size_t b = 0; b < 2; b++)
+		CheckCuda(cudaStreamSynchronize(static_cast<cudaStream_t>(m_streams[b])), "finish a frame");
+}
+
+std::string CudaStage::GetDeviceName() const
+{
+	cudaDeviceProp properties;
+
+	if (cudaGetDeviceProperties(&properties, m_device) != cudaSuccess)
+		return "unknown GPU";
+
+	return properties.name;
+}
+
+void CudaStage::Release()
+{
+	cudaFree(m_pPlanes);
+	cudaFree(m_pFrame);
+
+	for (size_t b = 0; b < 2; b++)
+	{
+		cudaFreeHost(m_pStaging[b]);
+
+		if (m_uploaded[b] != NULL)
+			cudaEventDestroy(static_cast<cudaEvent_t>(m_uploaded[b]));
+
+		if (m_streams[b] != NULL)
+			cudaStreamDestroy(static_cast<cudaStream_t>(m_streams[b]));
+
+		m_pStaging[b] = NULL;
+		m_uploaded[b] = NULL;
+		m_streams[b] = NULL;
+	}
+
+	m_pPlanes = NULL;
+	m_pFrame = NULL;
+}
+
+CudaDeviceMemory::CudaDeviceMemory(size_t size)
+	: m_pData(NULL)
+{
+	CheckCuda(cudaMalloc(reinterpret_cast<void**>(&m_pData), size), "allocate device memory");
+}
+
+CudaDeviceMemory::~CudaDeviceMemory()
+{
+	cudaFree(m_pData);
+}
+
+uint8_t* CudaDeviceMemory::Get() const
+{
+	return m_pData;
+}
+
+CudaHostRegistration::CudaHostRegistration(void* pData, size_t size)
+	: m_pData(pData)
+{
+	CheckCuda(cudaHostRegister(pData, size, cudaHostRegisterDefault), "pin host memory");
+}
+
+CudaHostRegistration::~CudaHostRegistration()
+{
+	cudaHostUnregister(m_pData);
+}
+
+namespace
+{
+	// runs one frame through a stage and compares the planes with the host's
+	//    numPixels short of the frame checks an incomplete one, whose
+	//    unfilled plane pixels must be left as they were.
+	bool CompareCudaStage(size_t width, size_t height, size_t numPixels, size_t bytesPerPixel, bool fastAolp, bool deviceOutput)
+	{
+		const size_t framePixels = width * height;
+		const size_t planeSize = framePixels * bytesPerPixel;
+
+		// random angles, with every eighth pixel black to cover S0 of 0
+		std::vector<uint8_t> frame(4 * framePixels);
+		uint32_t state = 0x9E3779B9u + static_cast<uint32_t>(numPixels);
+		for (size_t i = 0; i < frame.size(); i++)
+		{
+			state = state * 1664525u + 1013904223u;
+			frame[i] = (i / 4) % 8 == 5 ? 0 : static_cast<uint8_t>(state >> 24);
+		}
+
+		// Host reference
+		//    Plane pixels past numPixels keep the fill value.
+		std::vector<uint8_t> mono(4 * framePixels);
+		std::vector<float> results(5 * framePixels);
+		std::vector<uint8_t> expected(6 * planeSize, 0xA5);
+
+		DeinterleaveScalar(frame.data(), numPixels, &mono[0], &mono[framePixels], &mono[2 * framePixels], &mono[3 * framePixels]);
+
+		for (size_t angle = 0; angle < 4; angle++)
+			for (size_t i = 0; i < numPixels; i++)
+				memset(&expected[angle * planeSize + i * bytesPerPixel], mono[angle * framePixels + i], bytesPerPixel);
+
+		StokesInput in = { { &mono[0], &mono[framePixels], &mono[2 * framePixels], &mono[3 * framePixels] } };
+		StokesOutput out = { &results[0], &results[framePixels], &results[2 * framePixels], &results[3 * framePixels], &results[4 * framePixels] };
+
+		(fastAolp ? StokesFastScalar : StokesScalar)(in, out, 0, numPixels);
+		QuantizeDolpAolp(out, 0, numPixels, &expected[4 * planeSize], &expected[5 * planeSize], bytesPerPixel);
+
+		// GPU
+		std::vector<uint8_t> actual(6 * planeSize, 0xA5);
+		uint8_t* planes[6];
+
+		CudaStage stage(width, height, bytesPerPixel, true, fastAolp, deviceOutput);
+
+		if (deviceOutput)
+		{
+			CudaDeviceMemory device(actual.size());
+			CheckCuda(cudaMemcpy(device.Get(), actual.data(), actual.size(), cudaMemcpyHostToDevice), "upload a plane");
+
+			for (size_t p = 0; p < 6; p++)
+				planes[p] = device.Get() + p * planeSize;
+
+			stage.Process(frame.data(), numPixels, planes, planes[4], planes[5]);
+			CheckCuda(cudaMemcpy(actual.data(), device.Get(), actual.size(), cudaMemcpyDeviceToHost), "download a plane");
+		}
+		else
+		{
+			for (size_t p = 0; p < 6; p++)
+				planes[p] = &actual[p * planeSize];
+
+			stage.Process(frame.data(), numPixels, planes, planes[4], planes[5]);
+		}
+
+		for (size_t i = 0; i < 4 * planeSize; i++)
+			if (actual[i] != expected[i])
+				return false;
+
+		for (size_t i = 4 * planeSize; i < 6 * planeSize; i++)
+			if (std::abs(static_cast<int>(actual[i]) - static_cast<int>(expected[i])) > 1)
+				return false;
+
+		return true;
+	}
+}
+
+bool VerifyCudaStage()
+{
+	int numDevices = 0;
+
+	if (cudaGetDeviceCount(&numDevices) != cudaSuccess || numDevices == 0)
+	{
+		std::cout << TAB1 << "No GPU, CUDA stage not checked\n";
+		return true;
+	}
+
+	// a size whose slices end mid-block, whole and cut off in the fourth slice
+	const size_t width = 61;
+	const size_t height = 37;
+	const size_t pixelCounts[] = { width * height, width * height * 3 / CUDA_NUM_SLICES + 5 };
+	const size_t bytesPerPixels[] = { 1, 3 };
+
+	try
+	{
+		for (size_t c = 0; c < sizeof(pixelCounts) / sizeof(pixelCounts[0]); c++)
+		{
+			for (size_t b = 0; b < sizeof(bytesPerPixels) / sizeof(bytesPerPixels[0]); b++)
+			{
+				for (int fast = 0; fast < 2; fast++)
+				{
+					for (int device = 0; device < 2; device++)
+					{
+						if (!CompareCudaStage(width, height, pixelCounts[c], bytesPerPixels[b], fast != 0, device != 0))
+						{
+							std::cout << TAB1 << "CUDA stage differs from the host kernels for " << (bytesPerPixels[b] == 1 ? "Mono8" : "BGR8") << (fast ? " fast AoLP" : "")
+									<< (device ? " device" : " host") << " planes at " << pixelCounts[c] << " pixels\n";
+							return false;
+						}
+					}
+				}
+			}
+		}
+	}
+	catch (std::exception& ex)
+	{
+		std::cout << TAB1 << "CUDA stage failed: " << ex.what() << "\n";
+		return false;
+	}
+
+	std::cout << TAB1 << "CUDA stage matches the host kernels\n";
+	return true;
+}
+
+#endif
@@ -0,0 +1,131 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#pragma once
+
+#ifdef USE_CUDA
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// slices a frame is uploaded and processed in
+#define CUDA_NUM_SLICES 8
+
+// CudaStage
+//    Demux and DoLP/AoLP on the GPU for hosts whose CPU cannot keep up. Each
+//    frame goes up in CUDA_NUM_SLICES slices through two pinned staging
+//    buffers, each with a stream of its own, so the host copies one slice
+//    while the GPU uploads, processes and returns the one before. On the GPU
+//    one kernel splits a slice into angle planes while a second computes the
+//    8-bit DoLP and AoLP planes straight from the interleaved pixels, with
+//    the scaling of QuantizeDolpAolp(). The planes are written either to
+//    host memory, which should be pinned with CudaHostRegistration so they
+//    come back by DMA as well, or to device memory for NVENC, in which case
+//    they never leave the GPU. Errors are reported as exceptions.
+//
+//    The camera's buffers cannot be pinned, as the driver allocates and
+//    requeues them, so the staging copy stays; the slices hide it behind the
+//    GPU's work rather than add it in front.
+class CudaStage
+{
+public:
+	// bytesPerPixel is the encoders' input size, 1 for Mono8 and 3 for BGR8
+	//    stokes also computes DoLP and AoLP; fastAolp uses the polynomial of
+	//    the host's fast kernels instead of atan2.
+	CudaStage(size_t width, size_t height, size_t bytesPerPixel, bool stokes, bool fastAolp, bool deviceOutput);
+	~CudaStage();
+
+	// uploads the first numPixels interleaved pixels of a frame and writes
+	// the planes
+	//    pDolp and pAolp are only written with stokes. Returns once all
+	//    planes are complete, so they can be handed to the encoders; the
+	//    frame itself is no longer needed once it is in the staging buffer.
+	void Process(const uint8_t* pFrame, size_t numPixels, uint8_t* const pAngles[4], uint8_t* pDolp, uint8_t* pAolp);
+
+	// name of the GPU in use
+	std::string GetDeviceName() const;
+
+private:
+	CudaStage(const CudaStage&);
+	CudaStage& operator=(const CudaStage&);
+
+	void Release();
+
+	const size_t m_width;
+	const size_t m_height;
+	const size_t m_bytesPerPixel;
+	const bool m_stokes;
+	const bool m_fastAolp;
+	const bool m_deviceOutput;
+	const size_t m_slicePixels;
+	int m_device;
+
+	// double buffered slices: a stream, a pinned staging buffer and the
+	// event of its last upload each
+	void* m_streams[2];
+	uint8_t* m_pStaging[2];
+	void* m_uploaded[2];
+
+	uint8_t* m_pFrame;
+
+	// device planes for host output, copied back after the kernels
+	uint8_t* m_pPlanes;
+};
+
+// CudaDeviceMemory
+//    Owns a block of device memory, for instance to back a PlanePool of
+//    planes that stay on the GPU.
+class CudaDeviceMemory
+{
+public:
+	explicit CudaDeviceMemory(size_t size);
+	~CudaDeviceMemory();
+
+	uint8_t* Get() const;
+
+private:
+	CudaDeviceMemory(const CudaDeviceMemory&);
+	CudaDeviceMemory& operator=(const CudaDeviceMemory&);
+
+	uint8_t* m_pData;
+};
+
+// CudaHostRegistration
+//    Pins existing host memory, such as a PlanePool's, for as long as it
+//    lives, so copies to and from the GPU run by DMA at full PCIe speed.
+class CudaHostRegistration
+{
+public:
+	CudaHostRegistration(void* pData, size_t size);
+	~CudaHostRegistration();
+
+private:
+	CudaHostRegistration(const CudaHostRegistration&);
+	CudaHostRegistration& operator=(const CudaHostRegistration&);
+
+	void* m_pData;
+};
+
+// checks the GPU's demux and DoLP/AoLP against the host kernels
+//    Runs whole and incomplete frames through the stage for Mono8 and BGR8
+//    planes, host and device output, and the exact and fast AoLP. The demux
+//    must match DeinterleaveScalar() exactly; DoLP and AoLP may differ from
+//    StokesScalar() and QuantizeDolpAolp() by one count, as the GPU's
+//    sqrtf and atan2f round differently where a value sits on a rounding
+//    boundary. Passes without a GPU, saying so.
+bool VerifyCudaStage();
+
+#endif
@@ -0,0 +1,733 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+#include "Deinterleave.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#if defined(CPU_X86_SSE2)
+#include <emmintrin.h>
+#endif
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
+#if defined(CPU_NEON)
+#include <arm_neon.h>
+#endif
+
+#define TAB1 "  "
+
+void DeinterleaveScalar(const uint8_t* pSrc, size_t numPixels, uint8_t* pDst0, uint8_t* pDst45, uint8_t* pDst90, uint8_t* pDst135)
+{
+	for (size_t i = 0; i < numPixels; i++)
+	{
+		// 0 degree pixels are byte 0
+		pDst0[i] = pSrc[4 * i];
+
+		// 45 degree pixels are byte 1
+		pDst45[i] = pSrc[4 * i + 1];
+
+		// 90 degree pixels are byte 2
+		pDst90[i] = pSrc[4 * i + 2];
+
+		// 135 degree pixels are byte 3
+		pDst135[i] = pSrc[4 * i + 3];
+	}
+}
+
+void DeinterleaveBgr8Scalar(const uint8_t* pSrc, size_t numPixels, uint8_t* pDst0, uint8_t* pDst45, uint8_t* pDst90, uint8_t* pDst135)
+{
+	for (size_t i = 0; i < numPixels; i++)
+	{
+		const uint8_t* pPixel = pSrc + 4 * i;
+
+		pDst0[3 * i] = pDst0[3 * i + 1] = pDst0[3 * i + 2] = pPixel[0];
+		pDst45[3 * i] = pDst45[3 * i + 1] = pDst45[3 * i + 2] = pPixel[1];
+		pDst90[3 * i] = pDst90[3 * i + 1] = pDst90[3 * i + 2] = pPixel[2];
+		pDst135[3 * i] = pDst135[3 * i + 1] = pDst135[3 * i + 2] = pPixel[3];
+	}
+}
+
+#if defined(CPU_X86_SSE2)
+// splits 16 interleaved pixels into one register per angle
+//    Three rounds of byte unpacking turn two registers of interleaved pixels
+//    into eight pixels of each angle, which are then paired up into full
+//    registers with 64-bit unpacks.
+static inline void Deinterleave16Sse2(const uint8_t* pSrc, __m128i out[4])
+{
+	const __m128i* pIn = reinterpret_cast<const __m128i*>(pSrc);
+	__m128i v0 = _mm_loadu_si128(pIn);
+	__m128i v1 = _mm_loadu_si128(pIn + 1);
+	__m128i v2 = _mm_loadu_si128(pIn + 2);
+	__m128i v3 = _mm_loadu_si128(pIn + 3);
+
+	// a0 a4 b0 b4 c0 c4 d0 d4 a1 a5 ... / a2 a6 b2 b6 ...
+	__m128i t0 = _mm_unpacklo_epi8(v0, v1);
+	__m128i t1 = _mm_unpackhi_epi8(v0, v1);
+	__m128i t2 = _mm_unpacklo_epi8(v2, v3);
+	__m128i t3 = _mm_unpackhi_epi8(v2, v3);
+
+	// a0 a2 a4 a6 b0 b2 b4 b6 ... / a1 a3 a5 a7 b1 b3 b5 b7 ...
+	v0 = _mm_unpacklo_epi8(t0, t1);
+	v1 = _mm_unpackhi_epi8(t0, t1);
+	v2 = _mm_unpacklo_epi8(t2, t3);
+	v3 = _mm_unpackhi_epi8(t2, t3);
+
+	// a0..a7 b0..b7 / c0..c7 d0..d7
+	t0 = _mm_unpacklo_epi8(v0, v1);
+	t1 = _mm_unpackhi_epi8(v0, v1);
+	t2 = _mm_unpacklo_epi8(v2, v3);
+	t3 = _mm_unpackhi_epi8(v2, v3);
+
+	out[0] = _mm_unpacklo_epi64(t0, t2);
+	out[1] = _mm_unpackhi_epi64(t0, t2);
+	out[2] = _mm_unpacklo_epi64(t1, t3);
+	out[3] = _mm_unpackhi_epi64(t1, t3);
+}
+
+// 16 pixels per iteration
+static void DeinterleaveSse2(const uint8_t* pSrc, size_t numPixels, uint8_t* pDst0, uint8_t* pDst45, uint8_t* pDst90, uint8_t* pDst135)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= numPixels; i += 16)
+	{
+		__m128i planes[4];
+		Deinterleave16Sse2(pSrc + 4 * i, planes);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst0 + i), planes[0]);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst45 + i), planes[1]);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst90 + i), planes[2]);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst135 + i), planes[3]);
+	}
+
+	DeinterleaveScalar(pSrc + 4 * i, numPixels - i, pDst0 + i, pDst45 + i, pDst90 + i, pDst135 + i);
+}
+
+// writes 16 gray pixels as 48 bytes of BGR8
+TARGET_SSSE3 static inline void StoreGrayAsBgr8Ssse3(__m128i gray, uint8_t* pDst)
+{
+	const __m128i expand0 = _mm_setr_epi8(0, 0, 0, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4, 4, 5);
+	const __m128i expand1 = _mm_setr_epi8(5, 5, 6, 6, 6, 7, 7, 7, 8, 8, 8, 9, 9, 9, 10, 10);
+	const __m128i expand2 = _mm_setr_epi8(10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15);
+
+	__m128i* pOut = reinterpret_cast<__m128i*>(pDst);
+	_mm_storeu_si128(pOut, _mm_shuffle_epi8(gray, expand0));
+	_mm_storeu_si128(pOut + 1, _mm_shuffle_epi8(gray, expand1));
+	_mm_storeu_si128(pOut + 2, _mm_shuffle_epi8(gray, expand2));
+}
+
+// 16 pixels per iteration
+//    The SSE2 demux followed by a byte shuffle that triples each pixel.
+TARGET_SSSE3 static void DeinterleaveBgr8Ssse3(const uint8_t* pSrc, size_t numPixels, uint8_t* pDst0, uint8_t* pDst45, uint8_t* pDst90, uint8_t* pDst135)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= numPixels; i += 16)
+	{
+		__m128i planes[4];
+		Deinterleave16Sse2(pSrc + 4 * i, planes);
+
+		StoreGrayAsBgr8Ssse3(planes[0], pDst0 + 3 * i);
+		StoreGrayAsBgr8Ssse3(planes[1], pDst45 + 3 * i);
+		StoreGrayAsBgr8Ssse3(planes[2], pDst90 + 3 * i);
+		StoreGrayAsBgr8Ssse3(planes[3], pDst135 + 3 * i);
+	}
+
+	DeinterleaveBgr8Scalar(pSrc + 4 * i, numPixels - i, pDst0 + 3 * i, pDst45 + 3 * i, pDst90 + 3 * i, pDst135 + 3 * i);
+}
+#endif
+
+#if defined(CPU_X86)
+// 32 pixels per iteration
+//    A byte shuffle groups each 128-bit lane by angle, a dword permute gathers
+//    eight pixels of each angle into one 64-bit element, and a 64-bit
+//    transpose across the four registers yields 32 pixels per angle.
+TARGET_AVX2 static void DeinterleaveAvx2(const uint8_t* pSrc, size_t numPixels, uint8_t* pDst0, uint8_t* pDst45, uint8_t* pDst90, uint8_t* pDst135)
+{
+	const __m256i groupByAngle = _mm256_setr_epi8(
+		0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+		0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+	const __m256i pairLanes = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	size_t i = 0;
+
+	for (; i + 32 <= numPixels; i += 32)
+	{
+		const __m256i* pIn = reinterpret_cast<const __m256i*>(pSrc + 4 * i);
+
+		// each 64-bit element now holds eight pixels of one angle
+		__m256i v0 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_loadu_si256(pIn), groupByAngle), pairLanes);
+		__m256i v1 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_loadu_si256(pIn + 1), groupByAngle), pairLanes);
+		__m256i v2 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_loadu_si256(pIn + 2), groupByAngle), pairLanes);
+		__m256i v3 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(_mm256_loadu_si256(pIn + 3), groupByAngle), pairLanes);
+
+		// 0 and 90 degrees / 45 and 135 degrees, half the pixels each
+		__m256i t0 = _mm256_unpacklo_epi64(v0, v1);
+		__m256i t1 = _mm256_unpackhi_epi64(v0, v1);
+		__m256i t2 = _mm256_unpacklo_epi64(v2, v3);
+		__m256i t3 = _mm256_unpackhi_epi64(v2, v3);
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst0 + i), _mm256_permute2x128_si256(t0, t2, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst45 + i), _mm256_permute2x128_si256(t1, t3, 0x20));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst90 + i), _mm256_permute2x128_si256(t0, t2, 0x31));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst135 + i), _mm256_permute2x128_si256(t1, t3, 0x31));
+	}
+
+	DeinterleaveScalar(pSrc + 4 * i, numPixels - i, pDst0 + i, pDst45 + i, pDst90 + i, pDst135 + i);
+}
+#endif
+
+#if defined(CPU_NEON)
+// 16 pixels per iteration
+//    vld4q_u8 deinterleaves four ways on load.
+static void DeinterleaveNeon(const uint8_t* pSrc, size_t numPixels, uint8_t* pDst0, uint8_t* pDst45, uint8_t* pDst90, uint8_t* pDst135)
+{
+	size_t i = 0;
+
+	for (; i + 16 <= numPixels; i += 16)
+	{
+		uint8x16x4_t v = vld4q_u8(pSrc + 4 * i);
+
+		vst1q_u8(pDst0 + i, v.val[0]);
+		vst1q_u8(pDst45 + i, v.val[1]);
+		vst1q_u8(pDst90 + i, v.val[2]);
+		vst1q_u8(pDst135 + i, v.val[3]);
+	}
+
+	DeinterleaveScalar(pSrc + 4 * i, numPixels - i, pDst0 + i, pDst45 + i, pDst90 + i, pDst135 + i);
+}
+
+// 16 pixels per iteration
+//    vst3q_u8 of the same register three times triples each pixel.
+static void DeinterleaveBgr8Neon(const uint8_t* pSrc, size_t numPixels, uint8_t* pDst0, uint8_t* pDst45, uint8_t* pDst90, uint8_t* pDst135)
+{
+	uint8_t* pDst[4] = { pDst0, pDst45, pDst90, pDst135 };
+	size_t i = 0;
+
+	for (; i + 16 <= numPixels; i += 16)
+	{
+		uint8x16x4_t v = vld4q_u8(pSrc + 4 * i);
+
+		for (int angle = 0; angle < 4; angle++)
+		{
+			uint8x16x3_t bgr;
+			bgr.val[0] = bgr.val[1] = bgr.val[2] = v.val[angle];
+			vst3q_u8(pDst[angle] + 3 * i, bgr);
+		}
+	}
+
+	DeinterleaveBgr8Scalar(pSrc + 4 * i, numPixels - i, pDst0 + 3 * i, pDst45 + 3 * i, pDst90 + 3 * i, pDst135 + 3 * i);
+}
+#endif
+
+std::vector<DeinterleaveKernel> GetDeinterleaveKernels()
+{
+	std::vector<DeinterleaveKernel> kernels;
+
+	DeinterleaveKernel scalar = { "scalar", DeinterleaveScalar };
+	kernels.push_back(scalar);
+
+#if defined(CPU_X86_SSE2)
+	DeinterleaveKernel sse2 = { "sse2", DeinterleaveSse2 };
+	kernels.push_back(sse2);
+#endif
+
+#if defined(CPU_X86)
+	if (CpuHasAvx2())
+	{
+		DeinterleaveKernel avx2 = { "avx2", DeinterleaveAvx2 };
+		kernels.push_back(avx2);
+	}
+#endif
+
+#if defined(CPU_NEON)
+	DeinterleaveKernel neon = { "neon", DeinterleaveNeon };
+	kernels.push_back(neon);
+#endif
+
+	return kernels;
+}
+
+const DeinterleaveKernel& GetDeinterleaveKernel()
+{
+	static const DeinterleaveKernel kernel = GetDeinterleaveKernels().back();
+	return kernel;
+}
+
+std::vector<DeinterleaveKernel> GetDeinterleaveBgr8Kernels()
+{
+	std::vector<DeinterleaveKernel> kernels;
+
+	DeinterleaveKernel scalar = { "scalar", DeinterleaveBgr8Scalar };
+	kernels.push_back(scalar);
+
+#if defined(CPU_X86_SSE2)
+	if (CpuHasSsse3())
+	{
+		DeinterleaveKernel ssse3 = { "ssse3", DeinterleaveBgr8Ssse3 };
+		kernels.push_back(ssse3);
+	}
+#endif
+
+#if defined(CPU_NEON)
+	DeinterleaveKernel neon = { "neon", DeinterleaveBgr8Neon };
+	kernels.push_back(neon);
+#endif
+
+	return kernels;
+}
+
+const DeinterleaveKernel& GetDeinterleaveBgr8Kernel()
+{
+	static const DeinterleaveKernel kernel = GetDeinterleaveBgr8Kernels().back();
+	return kernel;
+}
+
+void DeinterleaveMosaic(const DeinterleaveKernel& kernel, const uint8_t* pSrc, size_t numPixels, size_t width, size_t height, size_t bytesPerPixel, uint8_t* pDst)
+{
+	const size_t rowSize = width * bytesPerPixel;
+	const size_t stride = 2 * rowSize;
+
+	// quadrant origins in the mosaic
+	uint8_t* pTop = pDst;
+	uint8_t* pBottom = pDst + height * stride;
+
+	for (size_t y = 0; y < height && y * width < numPixels; y++)
+	{
+		const size_t rowPixels = std::min(width, numPixels - y * width);
+
+		kernel.function(pSrc + 4 * y * width, rowPixels, pTop + y * stride, pTop + y * stride + rowSize, pBottom + y * stride, pBottom + y * stride + rowSize);
+	}
+}
+
+RegionDemux::RegionDemux(const DeinterleaveKernel& kernel, size_t bytesPerPixel, size_t frameWidth, size_t frameHeight, const FrameRegion& region, size_t scale)
+	: m_kernel(kernel)
+	, m_bytesPerPixel(bytesPerPixel)
+	, m_frameWidth(frameWidth)
+	, m_frameHeight(frameHeight)
+	, m_region(region)
+	, m_scale(scale > 0 ? scale : 1)
+	, m_width(region.width / m_scale)
+	, m_height(region.height / m_scale)
+{
+	if (region.x + region.width > frameWidth || region.y + region.height > frameHeight || m_width == 0 || m_height == 0)
+		throw std::runtime_error("Region " + std::to_string(region.width) + "x" + std::to_string(region.height) + " at " + std::to_string(region.x) + "," + std::to_string(region.y)
+				+ " scaled by 1/" + std::to_string(m_scale) + " does not fit in a " + std::to_string(frameWidth) + "x" + std::to_string(frameHeight) + " frame");
+
+	if (m_scale > 1)
+		m_rows.resize(4 * m_scale * m_width * m_scale);
+}
+
+size_t RegionDemux::GetWidth() const
+{
+	return m_width;
+}
+
+size_t RegionDemux::GetHeight() const
+{
+	return m_height;
+}
+
+bool RegionDemux::IsWholeFrame() const
+{
+	return m_region.x == 0 && m_region.y == 0 && m_width == m_frameWidth && m_height == m_frameHeight;
+}
+
+size_t RegionDemux::Process(const uint8_t* pSrc, size_t numPixels, uint8_t* const pDst[4], size_t dstStride)
+{
+	numPixels = std::min(numPixels, m_frameWidth * m_frameHeight);
+
+	// whole frame into contiguous planes
+	if (IsWholeFrame() && dstStride == m_width * m_bytesPerPixel)
+	{
+		m_kernel.function(pSrc, numPixels, pDst[0], pDst[1], pDst[2], pDst[3]);
+		return numPixels;
+	}
+
+	for (size_t y = 0; y < m_height; y++)
+	{
+		const size_t srcRow = m_region.y + y * m_scale;
+		const size_t rowStart = srcRow * m_frameWidth + m_region.x;
+		const size_t dstOffset = y * dstStride;
+
+		if (m_scale == 1)
+		{
+			if (rowStart >= numPixels)
+				return y * m_width;
+
+			const size_t rowPixels = std::min(m_width, numPixels - rowStart);
+
+			m_kernel.function(pSrc + 4 * rowStart, rowPixels, pDst[0] + dstOffset, pDst[1] + dstOffset, pDst[2] + dstOffset, pDst[3] + dstOffset);
+
+			if (rowPixels < m_width)
+				return y * m_width + rowPixels;
+		}
+		else
+		{
+			// a block is only averaged once all of its rows arrived
+			if ((srcRow + m_scale - 1) * m_frameWidth + m_region.x + m_width * m_scale > numPixels)
+				return y * m_width;
+
+			ShrinkRow(pSrc, srcRow, pDst, dstOffset);
+		}
+	}
+
+	return m_width * m_height;
+}
+
+// averages one row of Scale x Scale blocks of an angle plane
+//    The block rows are rowStride bytes apart. A Scale of 0 takes the scale
+//    at runtime instead; the common ones are compiled with a constant scale,
+//    which unrolls the block and turns the division into a multiplication.
+template <size_t Scale>
+static void ShrinkBlocks(const uint8_t* pRows, size_t rowStride, size_t width, size_t scale, size_t bytesPerPixel, uint8_t* pOut)
+{
+	const size_t n = Scale > 0 ? Scale : scale;
+	const uint32_t area = static_cast<uint32_t>(n * n);
+
+	for (size_t x = 0; x < width; x++)
+	{
+		const uint8_t* pBlock = pRows + x * n;
+		uint32_t sum = area / 2;
+
+		for (size_t j = 0; j < n; j++)
+			for (size_t i = 0; i < n; i++)
+				sum += pBlock[j * rowStride + i];
+
+		const uint8_t value = static_cast<uint8_t>(sum / area);
+
+		for (size_t b = 0; b < bytesPerPixel; b++)
+			pOut[x * bytesPerPixel + b] = value;
+	}
+}
+
+#if defined(CPU_X86_SSE2)
+// halves 16 pixels of a Mono8 plane row per iteration
+//    Even and odd bytes of both rows are added as 16-bit lanes, then rounded
+//    and packed, which is exactly what the scalar loop computes. Returns the
+//    pixels done, leaving the tail to the scalar loop.
+static size_t ShrinkBlocks2Sse2(const uint8_t* pRows, size_t rowStride, size_t width, uint8_t* pOut)
+{
+	const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+	const __m128i two = _mm_set1_epi16(2);
+	size_t x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		__m128i halves[2];
+
+		for (size_t h = 0; h < 2; h++)
+		{
+			const __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRows + 2 * x + 16 * h));
+			const __m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRows + rowStride + 2 * x + 16 * h));
+
+			__m128i sum = _mm_add_epi16(_mm_and_si128(top, lowBytes), _mm_srli_epi16(top, 8));
+			sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_and_si128(bottom, lowBytes), _mm_srli_epi16(bottom, 8)));
+
+			halves[h] = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+		}
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pOut + x), _mm_packus_epi16(halves[0], halves[1]));
+	}
+
+	return x;
+}
+#endif
+
+#if defined(CPU_NEON)
+// halves 16 pixels of a Mono8 plane row per iteration with pairwise adds
+static size_t ShrinkBlocks2Neon(const uint8_t* pRows, size_t rowStride, size_t width, uint8_t* pOut)
+{
+	size_t x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		const uint16x8_t low = vpadalq_u8(vpaddlq_u8(vld1q_u8(pRows + 2 * x)), vld1q_u8(pRows + rowStride + 2 * x));
+		const uint16x8_t high = vpadalq_u8(vpaddlq_u8(vld1q_u8(pRows + 2 * x + 16)), vld1q_u8(pRows + rowStride + 2 * x + 16));
+
+		vst1q_u8(pOut + x, vcombine_u8(vrshrn_n_u16(low, 2), vrshrn_n_u16(high, 2)));
+	}
+
+	return x;
+}
+#endif
+
+void RegionDemux::ShrinkRow(const uint8_t* pSrc, size_t srcRow, uint8_t* const pDst[4], size_t dstOffset)
+{
+	// frame rows are demuxed to Mono8 whatever the planes' pixel size
+	const DeinterleaveKernel& mono = m_bytesPerPixel == 1 ? m_kernel : GetDeinterleaveKernel();
+	const size_t rowPixels = m_width * m_scale;
+	uint8_t* pRows = &m_rows[0];
+
+	// row k of angle a at (4 * k + a) * rowPixels
+	for (size_t k = 0; k < m_scale; k++)
+	{
+		const size_t rowStart = (srcRow + k) * m_frameWidth + m_region.x;
+		uint8_t* pRow = pRows + 4 * k * rowPixels;
+
+		mono.function(pSrc + 4 * rowStart, rowPixels, pRow, pRow + rowPixels, pRow + 2 * rowPixels, pRow + 3 * rowPixels);
+	}
+
+	for (size_t angle = 0; angle < 4; angle++)
+	{
+		const uint8_t* pAngle = pRows + angle * rowPixels;
+		uint8_t* pOut = pDst[angle] + dstOffset;
+
+		switch (m_scale)
+		{
+		case 2:
+		{
+			// Mono8 halving is vectorized, the tail and BGR8 are not
+			size_t done = 0;
+#if defined(CPU_X86_SSE2)
+			if (m_bytesPerPixel == 1)
+				done = ShrinkBlocks2Sse2(pAngle, 4 * rowPixels, m_width, pOut);
+#elif defined(CPU_NEON)
+			if (m_bytesPerPixel == 1)
+				done = ShrinkBlocks2Neon(pAngle, 4 * rowPixels, m_width, pOut);
+#endif
+			ShrinkBlocks<2>(pAngle + 2 * done, 4 * rowPixels, m_width - done, m_scale, m_bytesPerPixel, pOut + done * m_bytesPerPixel);
+			break;
+		}
+		case 3:
+			ShrinkBlocks<3>(pAngle, 4 * rowPixels, m_width, m_scale, m_bytesPerPixel, pOut);
+			break;
+		case 4:
+			ShrinkBlocks<4>(pAngle, 4 * rowPixels, m_width, m_scale, m_bytesPerPixel, pOut);
+			break;
+		default:
+			ShrinkBlocks<0>(pAngle, 4 * rowPixels, m_width, m_scale, m_bytesPerPixel, pOut);
+			break;
+		}
+	}
+}
+
+// the demux loop as originally written in RecordVideo(), kept as the
+// ground truth the kernels are checked against
+static void DeinterleaveReference(const uint8_t* inputBufferPtr, size_t sizeFilled, uint8_t* outputBuffer0, uint8_t* outputBuffer45, uint8_t* outputBuffer90, uint8_t* outputBuffer135)
+{
+	size_t buffer_size = sizeFilled - 1;
+
+	uint32_t bufferIndex = 0;
+
+	for (uint32_t i = 0; i < buffer_size; i += 4)
+	{
+		outputBuffer0[bufferIndex] = inputBufferPtr[i];
+		outputBuffer45[bufferIndex] = inputBufferPtr[i+1];
+		outputBuffer90[bufferIndex] = inputBufferPtr[i+2];
+		outputBuffer135[bufferIndex] = inputBufferPtr[i+3];
+
+		bufferIndex++;
+	}
+}
+
+// checks one kernel family against the reference loop
+//    The reference planes are expanded to the family's output pixel size by
+//    repeating each gray value, which is what converting Mono8 to BGR8 does.
+static bool VerifyKernelFamily(const char* family, const std::vector<DeinterleaveKernel>& kernels, size_t bytesPerPixel)
+{
+	// full frames, odd sizes that leave a tail for every vector width
+	const size_t pixelCounts[] = { 1, 15, 16, 17, 31, 33, 63, 1000, 2448 * 4 + 7 };
+
+	for (size_t k = 0; k < kernels.size(); k++)
+	{
+		for (size_t c = 0; c < sizeof(pixelCounts) / sizeof(pixelCounts[0]); c++)
+		{
+			const size_t numPixels = pixelCounts[c];
+			const size_t planeSize = numPixels * bytesPerPixel;
+
+			// byte pattern without a period that could hide a lane mix-up
+			std::vector<uint8_t> src(4 * numPixels + 1);
+			uint32_t state = 0x12345678u + static_cast<uint32_t>(numPixels);
+			for (size_t i = 0; i < src.size(); i++)
+			{
+				state = state * 1664525u + 1013904223u;
+				src[i] = static_cast<uint8_t>(state >> 24);
+			}
+
+			std::vector<uint8_t> mono(4 * numPixels);
+			DeinterleaveReference(src.data(), 4 * numPixels, &mono[0], &mono[numPixels], &mono[2 * numPixels], &mono[3 * numPixels]);
+
+			// one guard byte after each plane, which must be left alone
+			std::vector<uint8_t> expected(4 * (planeSize + 1), 0xA5);
+			for (size_t angle = 0; angle < 4; angle++)
+				for (size_t i = 0; i < numPixels; i++)
+					for (size_t b = 0; b < bytesPerPixel; b++)
+						expected[angle * (planeSize + 1) + i * bytesPerPixel + b] = mono[angle * numPixels + i];
+
+			std::vector<uint8_t> actual(4 * (planeSize + 1), 0xA5);
+			kernels[k].function(src.data(), numPixels, &actual[0], &actual[planeSize + 1], &actual[2 * (planeSize + 1)], &actual[3 * (planeSize + 1)]);
+
+			if (expected != actual)
+			{
+				std::cout << TAB1 << family << " kernel " << kernels[k].name << " differs from the reference loop at " << numPixels << " pixels\n";
+				return false;
+			}
+		}
+
+		std::cout << TAB1 << family << " kernel " << kernels[k].name << " is bit-exact\n";
+	}
+
+	return true;
+}
+
+// checks the mosaic layout of one kernel against the reference loop
+//    The frame is a few rows of an odd width and ends part way through its
+//    last row, whose remainder must be left alone.
+static bool VerifyMosaic(const char* family, const DeinterleaveKernel& kernel, size_t bytesPerPixel)
+{
+	const size_t width = 37;
+	const size_t height = 5;
+	const size_t numPixels = width * height - 3;
+
+	std::vector<uint8_t> src(4 * numPixels + 1);
+	uint32_t state = 0x9E3779B9u;
+	for (size_t i = 0; i < src.size(); i++)
+	{
+		state = state * 1664525u + 1013904223u;
+		src[i] = static_cast<uint8_t>(state >> 24);
+	}
+
+	std::vector<uint8_t> mono(4 * numPixels);
+	DeinterleaveReference(src.data(), 4 * numPixels, &mono[0], &mono[numPixels], &mono[2 * numPixels], &mono[3 * numPixels]);
+
+	// angle a sits in column a % 2 and row a / 2 of the quadrants
+	const size_t stride = 2 * width * bytesPerPixel;
+	std::vector<uint8_t> expected(2 * height * stride, 0xA5);
+	for (size_t angle = 0; angle < 4; angle++)
+		for (size_t i = 0; i < numPixels; i++)
+			for (size_t b = 0; b < bytesPerPixel; b++)
+				expected[((angle / 2) * height + i / width) * stride + ((angle % 2) * width + i % width) * bytesPerPixel + b] = mono[angle * numPixels + i];
+
+	std::vector<uint8_t> actual(2 * height * stride, 0xA5);
+	DeinterleaveMosaic(kernel, src.data(), numPixels, width, height, bytesPerPixel, actual.data());
+
+	if (expected != actual)
+	{
+		std::cout << TAB1 << family << " mosaic with kernel " << kernel.name << " differs from the reference loop\n";
+		return false;
+	}
+
+	std::cout << TAB1 << family << " mosaic with kernel " << kernel.name << " is bit-exact\n";
+	return true;
+}
+
+// checks region demux of one kernel against cropping and averaging the
+// reference planes
+//    Each region is demuxed at several scales, from whole and incomplete
+//    frames, into planes with a row stride wider than their rows, whose
+//    padding and unwritten pixels must be left alone.
+static bool VerifyRegion(const char* family, const DeinterleaveKernel& kernel, size_t bytesPerPixel)
+{
+	const size_t width = 37;
+	const size_t height = 11;
+	const FrameRegion regions[] = { { 0, 0, width, height }, { 3, 2, 29, 7 }, { 0, 5, width, 6 }, { 36, 10, 1, 1 } };
+	const size_t scales[] = { 1, 2, 3 };
+	const size_t pixelCounts[] = { width * height, width * height - 40 };
+
+	std::vector<uint8_t> src(4 * width * height + 1);
+	uint32_t state = 0x2545F491u;
+	for (size_t i = 0; i < src.size(); i++)
+	{
+		state = state * 1664525u + 1013904223u;
+		src[i] = static_cast<uint8_t>(state >> 24);
+	}
+
+	for (size_t r = 0; r < sizeof(regions) / sizeof(regions[0]); r++)
+	{
+		for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++)
+		{
+			const FrameRegion& region = regions[r];
+			const size_t scale = scales[s];
+
+			if (region.width < scale || region.height < scale)
+				continue;
+
+			for (size_t c = 0; c < sizeof(pixelCounts) / sizeof(pixelCounts[0]); c++)
+			{
+				const size_t numPixels = pixelCounts[c];
+
+				std::vector<uint8_t> mono(4 * numPixels);
+				DeinterleaveReference(src.data(), 4 * numPixels, &mono[0], &mono[numPixels], &mono[2 * numPixels], &mono[3 * numPixels]);
+
+				RegionDemux demux(kernel, bytesPerPixel, width, height, region, scale);
+				const size_t planeWidth = demux.GetWidth();
+				const size_t planeHeight = demux.GetHeight();
+				const size_t stride = (planeWidth + 3) * bytesPerPixel;
+				const size_t planeSize = planeHeight * stride;
+
+				// a plane pixel is written once its whole block arrived
+				std::vector<uint8_t> expected(4 * planeSize, 0xA5);
+				size_t expectedCount = 0;
+
+				for (size_t y = 0; y < planeHeight; y++)
+				{
+					for (size_t x = 0; x < planeWidth; x++)
+					{
+						const size_t lastPixel = (region.y + y * scale + scale - 1) * width + region.x + x * scale + scale - 1;
+
+						if (lastPixel >= numPixels || (scale > 1 && (region.y + y * scale + scale - 1) * width + region.x + planeWidth * scale > numPixels))
+							continue;
+
+						expectedCount = y * planeWidth + x + 1;
+
+						for (size_t angle = 0; angle < 4; angle++)
+						{
+							uint32_t sum = 0;
+							for (size_t j = 0; j < scale; j++)
+								for (size_t i = 0; i < scale; i++)
+									sum += mono[angle * numPixels + (region.y + y * scale + j) * width + region.x + x * scale + i];
+
+							for (size_t b = 0; b < bytesPerPixel; b++)
+								expected[angle * planeSize + y * stride + x * bytesPerPixel + b] = static_cast<uint8_t>((sum + scale * scale / 2) / (scale * scale));
+						}
+					}
+				}
+
+				std::vector<uint8_t> actual(4 * planeSize, 0xA5);
+				uint8_t* planes[4] = { &actual[0], &actual[planeSize], &actual[2 * planeSize], &actual[3 * planeSize] };
+
+				const size_t count = demux.Process(src.data(), numPixels, planes, stride);
+
+				if (expected != actual || count != expectedCount)
+				{
+					std::cout << TAB1 << family << " region demux with kernel " << kernel.name << " differs from the reference loop for "
+							<< region.width << "x" << region.height << " at " << region.x << "," << region.y << " scaled by 1/" << scale << "\n";
+					return false;
+				}
+			}
+		}
+	}
+
+	std::cout << TAB1 << family << " region demux with kernel " << kernel.name << " is bit-exact\n";
+	return true;
+}
+
+bool VerifyDeinterleaveKernels()
+{
+	bool passed = VerifyKernelFamily("Deinterleave", GetDeinterleaveKernels(), 1);
+	passed = VerifyKernelFamily("Deinterleave to BGR8", GetDeinterleaveBgr8Kernels(), 3) && passed;
+	passed = VerifyMosaic("Deinterleave", GetDeinterleaveKernel(), 1) && passed;
+	passed = VerifyMosaic("Deinterleave to BGR8", GetDeinterleaveBgr8Kernel(), 3) && passed;
+	passed = VerifyRegion("Deinterleave", GetDeinterleaveKernel(), 1) && passed;
+	passed = VerifyRegion("Deinterleave to BGR8", GetDeinterleaveBgr8Kernel(), 3) && passed;
+	return passed;
+}
@@ -0,0 +1,126 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Deinterleave
+//    PolarizedAngles_0d_45d_90d_135d_Mono8 packs the four polarization angles
+//    of each pixel into consecutive bytes: byte 0 is the 0 degree pixel, byte
+//    1 the 45 degree pixel, byte 2 the 90 degree pixel and byte 3 the 135
+//    degree pixel. The kernels below split such a buffer into four Mono8
+//    planes. All kernels produce identical output; the vectorized ones only
+//    differ in speed and in the CPU features they need.
+
+// splits numPixels interleaved pixels from pSrc into the four angle planes
+typedef void (*DeinterleaveFn)(const uint8_t* pSrc, size_t numPixels, uint8_t* pDst0, uint8_t* pDst45, uint8_t* pDst90, uint8_t* pDst135);
+
+struct DeinterleaveKernel
+{
+	const char* name;
+	DeinterleaveFn function;
+};
+
+// scalar fallback, one pixel at a time; also finishes the vector kernels' tails
+void DeinterleaveScalar(const uint8_t* pSrc, size_t numPixels, uint8_t* pDst0, uint8_t* pDst45, uint8_t* pDst90, uint8_t* pDst135);
+
+// kernels usable on this CPU, fastest last
+std::vector<DeinterleaveKernel> GetDeinterleaveKernels();
+
+// fastest kernel usable on this CPU
+//    Chosen once on first use from the CPU features detected at runtime.
+const DeinterleaveKernel& GetDeinterleaveKernel();
+
+// fused demux and Mono8 to BGR8 expansion
+//    Writes each angle as BGR8 with all three channels set to the angle's gray
+//    value, ready for a BGR8 video recorder, in a single pass over the source.
+void DeinterleaveBgr8Scalar(const uint8_t* pSrc, size_t numPixels, uint8_t* pDst0, uint8_t* pDst45, uint8_t* pDst90, uint8_t* pDst135);
+
+std::vector<DeinterleaveKernel> GetDeinterleaveBgr8Kernels();
+
+const DeinterleaveKernel& GetDeinterleaveBgr8Kernel();
+
+// demuxes into the quadrants of one 2x2 mosaic picture
+//    Writes the 0 degree plane to the top left quadrant of a picture twice
+//    the width and height, 45 to the top right, 90 to the bottom left and
+//    135 to the bottom right, one row at a time with the given kernel.
+//    bytesPerPixel is the kernel's output size, 1 for Mono8 and 3 for BGR8.
+//    Rows past numPixels are left as they were.
+void DeinterleaveMosaic(const DeinterleaveKernel& kernel, const uint8_t* pSrc, size_t numPixels, size_t width, size_t height, size_t bytesPerPixel, uint8_t* pDst);
+
+// rectangle of a frame, in pixels
+struct FrameRegion
+{
+	size_t x;
+	size_t y;
+	size_t width;
+	size_t height;
+};
+
+// RegionDemux
+//    Demuxes a region of each frame into the four angle planes, optionally
+//    shrunk by an integer factor, so a recording can keep only the part of
+//    the scene it needs. With a scale of N every N x N block of the region is
+//    averaged, with rounding, into one plane pixel; the region's width and
+//    height are rounded down to multiples of N. The whole frame at a scale of
+//    1 is a single kernel call, as without a region.
+class RegionDemux
+{
+public:
+	// bytesPerPixel is the kernel's output size, 1 for Mono8 and 3 for BGR8
+	//    Throws if the region does not fit in the frame or shrinks to nothing.
+	RegionDemux(const DeinterleaveKernel& kernel, size_t bytesPerPixel, size_t frameWidth, size_t frameHeight, const FrameRegion& region, size_t scale);
+
+	// plane size in pixels
+	size_t GetWidth() const;
+	size_t GetHeight() const;
+
+	bool IsWholeFrame() const;
+
+	// demuxes numPixels interleaved pixels of a frame
+	//    Row r of each plane is written to pDst[angle] + r * dstStride bytes.
+	//    Plane pixels whose source lies past numPixels are left as they
+	//    were. Returns the plane pixels written, counted in row order.
+	size_t Process(const uint8_t* pSrc, size_t numPixels, uint8_t* const pDst[4], size_t dstStride);
+
+private:
+	RegionDemux(const RegionDemux&);
+	RegionDemux& operator=(const RegionDemux&);
+
+	// one shrunk plane row from the frame rows starting at srcRow
+	void ShrinkRow(const uint8_t* pSrc, size_t srcRow, uint8_t* const pDst[4], size_t dstOffset);
+
+	const DeinterleaveKernel& m_kernel;
+	const size_t m_bytesPerPixel;
+	const size_t m_frameWidth;
+	const size_t m_frameHeight;
+	const FrameRegion m_region;
+	const size_t m_scale;
+	const size_t m_width;
+	const size_t m_height;
+
+	// with a scale, the Mono8 frame rows of one row of blocks
+	std::vector<uint8_t> m_rows;
+};
+
+// checks every usable kernel against the original demux loop
+//    Runs each kernel over synthetic frames of several sizes, including sizes
+//    that leave a scalar tail, and reports the first mismatch. The mosaic
+//    layout and region demux are checked the same way. Returns true if all
+//    kernels are bit-exact.
+bool VerifyDeinterleaveKernels();
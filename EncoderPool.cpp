@@ -0,0 +1,87 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#include "stdafx.h"
+#include "EncoderPool.h"
+#include "Threading.h"
+#include "VideoWorker.h"
+#include <iostream>
+
+#define TAB1 "  "
+
+EncoderPool::EncoderPool(unsigned int numThreads, const std::vector<int>& cpus)
+	: m_stop(false)
+{
+	if (numThreads == 0)
+		numThreads = 1;
+
+	for (unsigned int i = 0; i < numThreads; i++)
+	{
+		m_threads.push_back(std::thread(&EncoderPool::Run, this));
+
+		if (!cpus.empty() && !PinThread(m_threads.back(), cpus[i % cpus.size()]))
+			std::cout << TAB1 << "Could not pin encoder thread " << i << " to CPU " << cpus[i % cpus.size()] << "\n";
+	}
+}
+
+EncoderPool::~EncoderPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_ready.notify_all();
+
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+}
+
+void EncoderPool::Schedule(VideoWorker* pWorker)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_workers.push_back(pWorker);
+	}
+
+	m_ready.notify_one();
+}
+
+unsigned int EncoderPool::GetNumThreads() const
+{
+	return static_cast<unsigned int>(m_threads.size());
+}
+
+// records one plane of the longest waiting worker at a time
+void EncoderPool::Run()
+{
+	while (true)
+	{
+		VideoWorker* pWorker = NULL;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_ready.wait(lock, [this] { return m_stop || !m_workers.empty(); });
+
+			if (m_workers.empty())
+				return;
+
+			pWorker = m_workers.front();
+			m_workers.pop_front();
+		}
+
+		if (pWorker->RecordNext())
+			Schedule(pWorker);
+	}
+}
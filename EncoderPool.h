@@ -0,0 +1,58 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class VideoWorker;
+
+// EncoderPool
+//    Fixed set of threads shared by every video stream of every camera. A
+//    stream with planes waiting is queued here and recorded one plane at a
+//    time, then queued again behind the others, so streams take turns and a
+//    rig of several cameras needs no more threads than there are cores. A
+//    stream is only ever queued once, so its planes are appended in order
+//    and never by two threads at the same time.
+class EncoderPool
+{
+public:
+	// cpus lists logical CPUs to pin the threads to in turn; empty to leave
+	// them alone
+	EncoderPool(unsigned int numThreads, const std::vector<int>& cpus);
+
+	// all workers must be closed first
+	~EncoderPool();
+
+	// queues a worker that has planes waiting
+	void Schedule(VideoWorker* pWorker);
+
+	unsigned int GetNumThreads() const;
+
+private:
+	EncoderPool(const EncoderPool&);
+	EncoderPool& operator=(const EncoderPool&);
+
+	void Run();
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_ready;
+	std::deque<VideoWorker*> m_workers;
+	bool m_stop;
+};
@@ -0,0 +1,569 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+
+#ifdef USE_FFMPEG
+
+#include "FfmpegEncoder.h"
+#include "FileWriter.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/error.h>
+#include <libavutil/hwcontext.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/rational.h>
+#ifdef USE_CUDA
+#include <libavutil/hwcontext_cuda.h>
+#endif
+}
+
+#ifdef USE_CUDA
+#include <cuda_runtime_api.h>
+#endif
+
+// Write buffers
+//    The container is gathered into buffers of this size before it goes to
+//    disk, up to this many while the disk lags behind. FFmpeg's own buffer
+//    only batches its small writes into calls to the FileWriter.
+#define FFMPEG_WRITE_BUFFER_BYTES (1 << 20)
+#define FFMPEG_WRITE_BUFFERS 32
+#define FFMPEG_IO_BUFFER_BYTES (64 << 10)
+
+// the container's output, appended to a FileWriter
+//    The muxer seeks back to fill in sizes once it knows them; what it
+//    writes behind the end is rewritten in place.
+struct FfmpegOutput
+{
+	std::unique_ptr<FileWriter> pFile;
+	uint64_t position;
+	std::string error;
+};
+
+namespace
+{
+	// throws with FFmpeg's description of a negative return code
+	void Check(int result, const char* what)
+	{
+		if (result < 0)
+		{
+			char message[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+			av_strerror(result, message, sizeof(message));
+			throw std::runtime_error(std::string("FFmpeg could not ") + what + ": " + message);
+		}
+	}
+
+#ifdef USE_CUDA
+	void CheckCuda(cudaError_t result, const char* what)
+	{
+		if (result != cudaSuccess)
+			throw std::runtime_error(std::string("CUDA could not ") + what + ": " + cudaGetErrorString(result));
+	}
+#endif
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+	int WriteOutput(void* pOpaque, const uint8_t* pData, int size)
+#else
+	int WriteOutput(void* pOpaque, uint8_t* pData, int size)
+#endif
+	{
+		FfmpegOutput* pOutput = static_cast<FfmpegOutput*>(pOpaque);
+
+		try
+		{
+			const uint64_t end = pOutput->pFile->GetSize();
+
+			if (pOutput->position > end)
+				return AVERROR(EINVAL);
+
+			const size_t rewritten = static_cast<size_t>(std::min<uint64_t>(size, end - pOutput->position));
+
+			if (rewritten > 0)
+				pOutput->pFile->WriteAt(pOutput->position, pData, rewritten);
+
+			if (static_cast<size_t>(size) > rewritten)
+				pOutput->pFile->Append(pData + rewritten, size - rewritten);
+
+			pOutput->position += size;
+			return size;
+		}
+		catch (std::exception& ex)
+		{
+			// FFmpeg is C, so the error waits for CheckOutput()
+			pOutput->error = ex.what();
+			return AVERROR(EIO);
+		}
+	}
+
+	int64_t SeekOutput(void* pOpaque, int64_t offset, int whence)
+	{
+		FfmpegOutput* pOutput = static_cast<FfmpegOutput*>(pOpaque);
+		const int64_t size = static_cast<int64_t>(pOutput->pFile->GetSize());
+
+		if (whence & AVSEEK_SIZE)
+			return size;
+
+		switch (whence & ~AVSEEK_FORCE)
+		{
+		case SEEK_SET:
+			break;
+		case SEEK_CUR:
+			offset += static_cast<int64_t>(pOutput->position);
+			break;
+		case SEEK_END:
+			offset += size;
+			break;
+		default:
+			return AVERROR(EINVAL);
+		}
+
+		if (offset < 0 || offset > size)
+			return AVERROR(EINVAL);
+
+		pOutput->position = static_cast<uint64_t>(offset);
+		return offset;
+	}
+
+	bool SupportsPixelFormat(const AVCodec* pCodec, AVPixelFormat format)
+	{
+		if (pCodec->pix_fmts == NULL)
+			return false;
+
+		for (const AVPixelFormat* pFormat = pCodec->pix_fmts; *pFormat != AV_PIX_FMT_NONE; pFormat++)
+		{
+			if (*pFormat == format)
+				return true;
+		}
+
+		return false;
+	}
+}
+
+FfmpegEncoder::FfmpegEncoder(const std::string& fileName, size_t width, size_t height, double fps, const char* codecName, bool cudaInput, unsigned int bitDepth, FrameStats* pStats)
+	: m_fileName(fileName)
+	, m_codecName(codecName)
+	, m_width(width)
+	, m_height(height)
+	, m_fps(fps)
+	, m_bitDepth(bitDepth)
+	, m_pCodec(NULL)
+	, m_pixelFormat(AV_PIX_FMT_NONE)
+	, m_hwPixelFormat(AV_PIX_FMT_NONE)
+	, m_pFormat(NULL)
+	, m_pContext(NULL)
+	, m_pStream(NULL)
+	, m_pFrame(NULL)
+	, m_pPacket(NULL)
+	, m_pHwDevice(NULL)
+	, m_pHwFrame(NULL)
+	, m_pStats(pStats)
+	, m_sampleShift(0)
+	, m_pts(0)
+{
+	m_pCodec = avcodec_find_encoder_by_name(codecName);
+
+	if (m_pCodec == NULL)
+		throw std::runtime_error(std::string("no FFmpeg encoder ") + codecName);
+
+	if (cudaInput)
+	{
+#ifdef USE_CUDA
+		if (!SupportsPixelFormat(m_pCodec, AV_PIX_FMT_CUDA))
+			throw std::runtime_error(std::string("FFmpeg encoder ") + codecName + " takes no CUDA frames");
+
+		m_pixelFormat = AV_PIX_FMT_NV12;
+		m_hwPixelFormat = AV_PIX_FMT_CUDA;
+		return;
+#else
+		throw std::runtime_error("CUDA input needs a USE_CUDA build");
+#endif
+	}
+
+	// 12-bit planar takes the samples as they are; 10-bit planar drops
+	// their lowest bits; P010 keeps its samples in the high bits of each
+	// word, as do the P010 VAAPI surfaces are filled from
+	if (bitDepth > 8)
+	{
+		if (SupportsPixelFormat(m_pCodec, AV_PIX_FMT_YUV420P12LE))
+			m_pixelFormat = AV_PIX_FMT_YUV420P12LE;
+		else if (SupportsPixelFormat(m_pCodec, AV_PIX_FMT_YUV420P10LE))
+			m_pixelFormat = AV_PIX_FMT_YUV420P10LE;
+		else if (SupportsPixelFormat(m_pCodec, AV_PIX_FMT_P010LE))
+			m_pixelFormat = AV_PIX_FMT_P010LE;
+		else if (SupportsPixelFormat(m_pCodec, AV_PIX_FMT_VAAPI))
+		{
+			m_pixelFormat = AV_PIX_FMT_P010LE;
+			m_hwPixelFormat = AV_PIX_FMT_VAAPI;
+		}
+		else
+			throw std::runtime_error(std::string("FFmpeg encoder ") + codecName + " takes neither YUV420P12LE, YUV420P10LE, P010LE nor VAAPI surfaces");
+
+		return;
+	}
+
+	// 4:2:0 plays everywhere and its constant chroma costs next to nothing;
+	// NV12 is the same picture with interleaved chroma, which some hardware
+	// encoders want; 4:0:0 gray is only used when the encoder offers nothing
+	// else; VAAPI surfaces are filled from NV12
+	if (SupportsPixelFormat(m_pCodec, AV_PIX_FMT_YUV420P))
+		m_pixelFormat = AV_PIX_FMT_YUV420P;
+	else if (SupportsPixelFormat(m_pCodec, AV_PIX_FMT_NV12))
+		m_pixelFormat = AV_PIX_FMT_NV12;
+	else if (SupportsPixelFormat(m_pCodec, AV_PIX_FMT_GRAY8))
+		m_pixelFormat = AV_PIX_FMT_GRAY8;
+	else if (SupportsPixelFormat(m_pCodec, AV_PIX_FMT_VAAPI))
+	{
+		m_pixelFormat = AV_PIX_FMT_NV12;
+		m_hwPixelFormat = AV_PIX_FMT_VAAPI;
+	}
+	else
+		throw std::runtime_error(std::string("FFmpeg encoder ") + codecName + " takes neither YUV420P, NV12, GRAY8 nor VAAPI surfaces");
+}
+
+FfmpegEncoder::~FfmpegEncoder()
+{
+	Release();
+}
+
+std::string FfmpegEncoder::Probe(const char* codecName, size_t width, size_t height, double fps, bool cudaInput, unsigned int bitDepth)
+{
+	try
+	{
+		FfmpegEncoder encoder("", width, height, fps, codecName, cudaInput, bitDepth);
+		encoder.OpenCodec(false);
+		return "";
+	}
+	catch (std::exception& ex)
+	{
+		return std::string(codecName) + ": " + ex.what();
+	}
+}
+
+std::string FfmpegEncoder::GetDescription() const
+{
+	std::string description = "FFmpeg " + m_codecName + (m_bitDepth > 8 ? " from Mono12 as " : " from Mono8 as ") + av_get_pix_fmt_name(static_cast<AVPixelFormat>(m_pixelFormat));
+
+	if (m_hwPixelFormat != AV_PIX_FMT_NONE)
+		description += std::string(" on ") + av_get_pix_fmt_name(static_cast<AVPixelFormat>(m_hwPixelFormat)) + " surfaces";
+
+	return description;
+}
+
+EncoderInput FfmpegEncoder::GetInput() const
+{
+#ifdef USE_CUDA
+	if (m_hwPixelFormat == AV_PIX_FMT_CUDA)
+		return ENCODER_INPUT_MONO8_CUDA;
+#endif
+
+	return m_bitDepth > 8 ? ENCODER_INPUT_MONO16 : ENCODER_INPUT_MONO8;
+}
+
+// opens the encoder and the container
+// (1) creates container from the file extension
+// (2) opens encoder
+// (3) writes container header
+// (4) prepares frame with constant chroma
+void FfmpegEncoder::Open()
+{
+	Check(avformat_alloc_output_context2(&m_pFormat, NULL, NULL, m_fileName.c_str()), "choose a container");
+
+	m_pStream = avformat_new_stream(m_pFormat, NULL);
+
+	if (m_pStream == NULL)
+		throw std::runtime_error("FFmpeg out of memory");
+
+	OpenCodec((m_pFormat->oformat->flags & AVFMT_GLOBALHEADER) != 0);
+
+	Check(avcodec_parameters_from_context(m_pStream->codecpar, m_pContext), "configure the stream");
+	m_pStream->time_base = m_pContext->time_base;
+
+	if (!(m_pFormat->oformat->flags & AVFMT_NOFILE))
+		OpenOutput();
+
+	CheckOutput(avformat_write_header(m_pFormat, NULL), "write the container header");
+
+	// luma is pointed at each appended plane; chroma never changes
+	m_pFrame->width = m_pContext->width;
+	m_pFrame->height = m_pContext->height;
+	m_pFrame->format = m_pixelFormat;
+	m_pFrame->linesize[0] = m_pContext->width * (m_bitDepth > 8 ? 2 : 1);
+
+	const size_t chromaWidth = (m_width + 1) / 2;
+	const size_t chromaHeight = (m_height + 1) / 2;
+
+	// mid-gray is half the format's range, which is 2^11 in 12-bit, 2^9 in
+	// 10-bit and the top bit of a P010 word
+	if (m_pixelFormat == AV_PIX_FMT_YUV420P12LE || m_pixelFormat == AV_PIX_FMT_YUV420P10LE)
+	{
+		m_sampleShift = m_pixelFormat == AV_PIX_FMT_YUV420P12LE ? 0 : -2;
+
+		m_deepChroma.assign(chromaWidth * chromaHeight, m_pixelFormat == AV_PIX_FMT_YUV420P12LE ? 2048 : 512);
+		m_pFrame->data[1] = reinterpret_cast<uint8_t*>(m_deepChroma.data());
+		m_pFrame->data[2] = reinterpret_cast<uint8_t*>(m_deepChroma.data());
+		m_pFrame->linesize[1] = static_cast<int>(2 * chromaWidth);
+		m_pFrame->linesize[2] = static_cast<int>(2 * chromaWidth);
+	}
+	else if (m_pixelFormat == AV_PIX_FMT_P010LE)
+	{
+		m_sampleShift = 4;
+
+		m_deepChroma.assign(2 * chromaWidth * chromaHeight, 0x8000);
+		m_pFrame->data[1] = reinterpret_cast<uint8_t*>(m_deepChroma.data());
+		m_pFrame->linesize[1] = static_cast<int>(4 * chromaWidth);
+	}
+
+	if (m_sampleShift != 0)
+		m_luma.resize(m_width * m_height);
+
+	if (m_pixelFormat == AV_PIX_FMT_YUV420P)
+	{
+		m_chroma.assign(chromaWidth * chromaHeight, 128);
+		m_pFrame->data[1] = m_chroma.data();
+		m_pFrame->data[2] = m_chroma.data();
+		m_pFrame->linesize[1] = static_cast<int>(chromaWidth);
+		m_pFrame->linesize[2] = static_cast<int>(chromaWidth);
+	}
+	else if (m_pixelFormat == AV_PIX_FMT_NV12)
+	{
+		// U and V interleaved, both mid-gray
+		m_chroma.assign(2 * chromaWidth * chromaHeight, 128);
+		m_pFrame->data[1] = m_chroma.data();
+		m_pFrame->linesize[1] = static_cast<int>(2 * chromaWidth);
+	}
+}
+
+// configures and opens the encoder session
+// (1) allocates context, frame and packet
+// (2) creates hardware device and surface pool if the encoder needs them
+// (3) opens encoder
+void FfmpegEncoder::OpenCodec(bool globalHeader)
+{
+	m_pContext = avcodec_alloc_context3(m_pCodec);
+	m_pFrame = av_frame_alloc();
+	m_pPacket = av_packet_alloc();
+
+	if (m_pContext == NULL || m_pFrame == NULL || m_pPacket == NULL)
+		throw std::runtime_error("FFmpeg out of memory");
+
+	AVRational frameRate = av_d2q(m_fps, 1000000);
+
+	m_pContext->width = static_cast<int>(m_width);
+	m_pContext->height = static_cast<int>(m_height);
+	m_pContext->pix_fmt = static_cast<AVPixelFormat>(m_hwPixelFormat != AV_PIX_FMT_NONE ? m_hwPixelFormat : m_pixelFormat);
+	m_pContext->framerate = frameRate;
+	m_pContext->time_base = av_inv_q(frameRate);
+
+	if (globalHeader)
+		m_pContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+	if (m_hwPixelFormat != AV_PIX_FMT_NONE)
+	{
+		// VAAPI opens the first DRM render node; CUDA shares the runtime's
+		// primary context, so device pointers from the demux are valid in
+		// the encoder's surfaces. A small fixed pool covers the frames the
+		// encoder holds for reordering.
+		if (m_hwPixelFormat == AV_PIX_FMT_VAAPI)
+			Check(av_hwdevice_ctx_create(&m_pHwDevice, AV_HWDEVICE_TYPE_VAAPI, NULL, NULL, 0), "open the VAAPI device");
+#ifdef USE_CUDA
+		else
+			Check(av_hwdevice_ctx_create(&m_pHwDevice, AV_HWDEVICE_TYPE_CUDA, NULL, NULL, AV_CUDA_USE_PRIMARY_CONTEXT), "open the CUDA device");
+#endif
+
+		AVBufferRef* pHwFrames = av_hwframe_ctx_alloc(m_pHwDevice);
+
+		if (pHwFrames == NULL)
+			throw std::runtime_error("FFmpeg out of memory");
+
+		AVHWFramesContext* pFramesContext = reinterpret_cast<AVHWFramesContext*>(pHwFrames->data);
+		pFramesContext->format = static_cast<AVPixelFormat>(m_hwPixelFormat);
+		pFramesContext->sw_format = static_cast<AVPixelFormat>(m_pixelFormat);
+		pFramesContext->width = m_pContext->width;
+		pFramesContext->height = m_pContext->height;
+		pFramesContext->initial_pool_size = 20;
+
+		int result = av_hwframe_ctx_init(pHwFrames);
+
+		if (result >= 0)
+			m_pContext->hw_frames_ctx = av_buffer_ref(pHwFrames);
+
+		av_buffer_unref(&pHwFrames);
+		Check(result, "create the encoder's surfaces");
+
+		m_pHwFrame = av_frame_alloc();
+
+		if (m_pContext->hw_frames_ctx == NULL || m_pHwFrame == NULL)
+			throw std::runtime_error("FFmpeg out of memory");
+	}
+
+	Check(avcodec_open2(m_pContext, m_pCodec, NULL), "open the encoder");
+}
+
+// encodes one Mono8 or Mono12 plane
+//    The frame does not own its planes, so libavcodec copies whatever it
+//    needs to keep before avcodec_send_frame() returns.
+void FfmpegEncoder::AppendImage(const uint8_t* pFrame)
+{
+	m_pFrame->data[0] = const_cast<uint8_t*>(pFrame);
+
+	if (!m_luma.empty())
+	{
+		const uint16_t* pSamples = reinterpret_cast<const uint16_t*>(pFrame);
+
+		if (m_sampleShift > 0)
+		{
+			for (size_t i = 0; i < m_luma.size(); i++)
+				m_luma[i] = static_cast<uint16_t>(pSamples[i] << m_sampleShift);
+		}
+		else
+		{
+			for (size_t i = 0; i < m_luma.size(); i++)
+				m_luma[i] = static_cast<uint16_t>(pSamples[i] >> -m_sampleShift);
+		}
+
+		m_pFrame->data[0] = reinterpret_cast<uint8_t*>(m_luma.data());
+	}
+	m_pFrame->pts = m_pts++;
+
+	if (m_pHwFrame != NULL)
+	{
+		// the encoder keeps its own reference to the surface
+		Check(av_hwframe_get_buffer(m_pContext->hw_frames_ctx, m_pHwFrame, 0), "get a surface");
+
+#ifdef USE_CUDA
+		if (m_hwPixelFormat == AV_PIX_FMT_CUDA)
+		{
+			// the plane is in device memory already; surfaces are recycled,
+			// so their chroma is set again every time
+			const size_t chromaWidth = (m_width + 1) / 2;
+			const size_t chromaHeight = (m_height + 1) / 2;
+
+			CheckCuda(cudaMemcpy2D(m_pHwFrame->data[0], m_pHwFrame->linesize[0], pFrame, m_width, m_width, m_height, cudaMemcpyDeviceToDevice), "copy a plane");
+			CheckCuda(cudaMemset2D(m_pHwFrame->data[1], m_pHwFrame->linesize[1], 128, 2 * chromaWidth, chromaHeight), "set the chroma");
+		}
+		else
+#endif
+			Check(av_hwframe_transfer_data(m_pHwFrame, m_pFrame, 0), "upload a frame");
+
+		m_pHwFrame->pts = m_pFrame->pts;
+
+		int result = avcodec_send_frame(m_pContext, m_pHwFrame);
+		av_frame_unref(m_pHwFrame);
+		Check(result, "encode a frame");
+	}
+	else
+	{
+		Check(avcodec_send_frame(m_pContext, m_pFrame), "encode a frame");
+	}
+
+	WritePackets();
+}
+
+// flushes the encoder and finalizes the container
+void FfmpegEncoder::Close()
+{
+	Check(avcodec_send_frame(m_pContext, NULL), "flush the encoder");
+
+	WritePackets();
+
+	CheckOutput(av_write_trailer(m_pFormat), "write the container trailer");
+
+	if (m_pOutput)
+		m_pOutput->pFile->Close();
+
+	Release();
+}
+
+// points the container at a FileWriter through custom I/O
+void FfmpegEncoder::OpenOutput()
+{
+	m_pOutput.reset(new FfmpegOutput());
+	m_pOutput->pFile.reset(new FileWriter(m_fileName, FFMPEG_WRITE_BUFFER_BYTES, FFMPEG_WRITE_BUFFERS, m_pStats));
+	m_pOutput->pFile->Open();
+	m_pOutput->position = 0;
+
+	unsigned char* pBuffer = static_cast<unsigned char*>(av_malloc(FFMPEG_IO_BUFFER_BYTES));
+
+	if (pBuffer != NULL)
+		m_pFormat->pb = avio_alloc_context(pBuffer, FFMPEG_IO_BUFFER_BYTES, 1, m_pOutput.get(), NULL, WriteOutput, SeekOutput);
+
+	if (m_pFormat->pb == NULL)
+	{
+		av_free(pBuffer);
+		throw std::runtime_error("FFmpeg out of memory");
+	}
+
+	m_pFormat->flags |= AVFMT_FLAG_CUSTOM_IO;
+}
+
+// throws the FileWriter's error behind a failed write, else FFmpeg's
+void FfmpegEncoder::CheckOutput(int result, const char* what)
+{
+	if (result < 0 && m_pOutput && !m_pOutput->error.empty())
+		throw std::runtime_error(m_pOutput->error);
+
+	Check(result, what);
+}
+
+void FfmpegEncoder::WritePackets()
+{
+	for (;;)
+	{
+		int result = avcodec_receive_packet(m_pContext, m_pPacket);
+
+		if (result == AVERROR(EAGAIN) || result == AVERROR_EOF)
+			return;
+
+		Check(result, "encode a frame");
+
+		av_packet_rescale_ts(m_pPacket, m_pContext->time_base, m_pStream->time_base);
+		m_pPacket->stream_index = m_pStream->index;
+
+		// takes ownership of the packet's data
+		CheckOutput(av_interleaved_write_frame(m_pFormat, m_pPacket), "write a packet");
+	}
+}
+
+void FfmpegEncoder::Release()
+{
+	if (m_pFormat != NULL && m_pFormat->pb != NULL)
+	{
+		av_freep(&m_pFormat->pb->buffer);
+		avio_context_free(&m_pFormat->pb);
+	}
+
+	// closes a file that was not closed already, dropping its errors
+	m_pOutput.reset();
+
+	avformat_free_context(m_pFormat);
+	m_pFormat = NULL;
+	m_pStream = NULL;
+
+	avcodec_free_context(&m_pContext);
+	av_frame_free(&m_pFrame);
+	av_packet_free(&m_pPacket);
+	av_frame_free(&m_pHwFrame);
+	av_buffer_unref(&m_pHwDevice);
+}
+
+#endif
@@ -0,0 +1,121 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#pragma once
+
+#ifdef USE_FFMPEG
+
+#include "VideoEncoder.h"
+#include <memory>
+#include <vector>
+
+struct AVBufferRef;
+struct AVCodec;
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVPacket;
+struct AVStream;
+struct FfmpegOutput;
+
+// FfmpegEncoder
+//    Encodes Mono8 angle planes through libavcodec without expanding them to
+//    colour first. The plane becomes the luma of a YUV 4:2:0 picture whose
+//    chroma is a constant mid-gray written once, or the whole picture if the
+//    encoder only takes gray. The container is chosen by FFmpeg from the file
+//    extension.
+//
+//    The same class drives the hardware encoders FFmpeg wraps. NVENC and the
+//    Jetson encoders take system memory pictures like libx264 does; VAAPI
+//    only takes surfaces, so each picture is uploaded into a pool of NV12
+//    surfaces first. With CUDA input, NVENC is fed planes that are already in
+//    GPU memory, copied into its CUDA surfaces without leaving the GPU.
+//
+//    12-bit planes are encoded at the deepest 4:2:0 the encoder takes: 12-bit
+//    as they are, or 10-bit with their two lowest bits dropped.
+//
+//    The container is written through a FileWriter rather than FFmpeg's own
+//    file protocol, so a slow disk is absorbed by its buffers and never
+//    stalls the encoder.
+class FfmpegEncoder : public VideoEncoder
+{
+public:
+	// codecName is an FFmpeg encoder name such as "libx264"
+	//    Throws if the encoder is not available or takes neither YUV 4:2:0
+	//    nor gray input. cudaInput takes planes in CUDA device memory, which
+	//    needs a USE_CUDA build and an encoder that takes CUDA frames. A
+	//    bitDepth of 12 takes ENCODER_INPUT_MONO16 planes and needs an encoder
+	//    with 10 or 12-bit input. pStats, if not NULL, gets the latency of
+	//    the disk writes.
+	FfmpegEncoder(const std::string& fileName, size_t width, size_t height, double fps, const char* codecName, bool cudaInput = false, unsigned int bitDepth = 8, FrameStats* pStats = NULL);
+	~FfmpegEncoder();
+
+	// opens and closes an encoder session without writing a file
+	//    Returns why the encoder cannot be used, or an empty string if it
+	//    can. Hardware encoders are listed by every FFmpeg build but only
+	//    open on a host with the matching GPU and driver, and NVENC also
+	//    refuses sessions beyond the driver's limit.
+	static std::string Probe(const char* codecName, size_t width, size_t height, double fps, bool cudaInput = false, unsigned int bitDepth = 8);
+
+	std::string GetDescription() const;
+
+	EncoderInput GetInput() const;
+
+	void Open();
+
+	void AppendImage(const uint8_t* pFrame);
+
+	void Close();
+
+private:
+	FfmpegEncoder(const FfmpegEncoder&);
+	FfmpegEncoder& operator=(const FfmpegEncoder&);
+
+	void OpenCodec(bool globalHeader);
+	void OpenOutput();
+	void CheckOutput(int result, const char* what);
+	void WritePackets();
+	void Release();
+
+	std::string m_fileName;
+	std::string m_codecName;
+	size_t m_width;
+	size_t m_height;
+	double m_fps;
+	unsigned int m_bitDepth;
+	const AVCodec* m_pCodec;
+	int m_pixelFormat;
+	int m_hwPixelFormat;
+	AVFormatContext* m_pFormat;
+	AVCodecContext* m_pContext;
+	AVStream* m_pStream;
+	AVFrame* m_pFrame;
+	AVPacket* m_pPacket;
+	AVBufferRef* m_pHwDevice;
+	AVFrame* m_pHwFrame;
+	FrameStats* m_pStats;
+	std::unique_ptr<FfmpegOutput> m_pOutput;
+	std::vector<uint8_t> m_chroma;
+
+	// 12-bit planes: chroma, and luma shifted to the encoder's bit depth
+	//    A positive shift moves samples up, a negative one down; no shift
+	//    needs no copy.
+	std::vector<uint16_t> m_deepChroma;
+	std::vector<uint16_t> m_luma;
+	int m_sampleShift;
+	int64_t m_pts;
+};
+
+#endif
@@ -0,0 +1,550 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+#include "FileWriter.h"
+#include "FrameStats.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef USE_IO_URING
+#include <liburing.h>
+#endif
+
+// Write alignment
+//    Buffers start on and are sized in whole pages, so every full buffer is
+//    a page aligned write of whole pages.
+#define FILE_WRITER_ALIGNMENT 4096
+
+// io_uring depth
+//    At most this many buffers are written at once. Local disks gain little
+//    beyond two or three; network storage and striped arrays use the rest.
+#define FILE_WRITER_RING_DEPTH 8
+
+// no buffer being filled, or a write of copied bytes
+#define FILE_WRITER_NO_BUFFER static_cast<size_t>(-1)
+
+namespace
+{
+	size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+FileWriter::FileWriter(const std::string& fileName, size_t bufferSize, size_t numBuffers, FrameStats* pStats)
+	: m_fileName(fileName)
+	, m_bufferSize(AlignUp(std::max<size_t>(bufferSize, 1), FILE_WRITER_ALIGNMENT))
+	, m_numBuffers(std::max<size_t>(numBuffers, 2))
+	, m_pStats(pStats)
+	, m_open(false)
+	, m_current(FILE_WRITER_NO_BUFFER)
+	, m_fill(0)
+	, m_size(0)
+	, m_inFlight(0)
+	, m_closing(false)
+#ifdef _WIN32
+	, m_pFile(NULL)
+#else
+	, m_fd(-1)
+#endif
+{
+	m_storage.reserve(m_numBuffers);
+	m_buffers.reserve(m_numBuffers);
+}
+
+FileWriter::~FileWriter()
+{
+	if (m_open)
+	{
+		try
+		{
+			Close();
+		}
+		catch (...)
+		{
+			// nothing sensible left to do with an error while unwinding
+		}
+	}
+}
+
+void FileWriter::Open()
+{
+#ifdef _WIN32
+	m_pFile = fopen(m_fileName.c_str(), "wb");
+	if (m_pFile == NULL)
+#else
+	m_fd = open(m_fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (m_fd < 0)
+#endif
+		throw std::runtime_error("Could not create " + m_fileName + ": " + strerror(errno));
+
+	m_open = true;
+	m_closing = false;
+
+#ifdef USE_IO_URING
+	m_thread = std::thread(&FileWriter::RunRing, this);
+#else
+	m_thread = std::thread(&FileWriter::Run, this);
+#endif
+}
+
+uint8_t* FileWriter::Reserve(size_t size)
+{
+	CheckError();
+
+	if (size > m_bufferSize)
+		throw std::invalid_argument("Cannot reserve " + std::to_string(size) + " bytes in " + std::to_string(m_bufferSize) + " byte write buffers");
+
+	if (m_current != FILE_WRITER_NO_BUFFER && m_fill + size > m_bufferSize)
+		Flush();
+
+	if (m_current == FILE_WRITER_NO_BUFFER)
+		AcquireBuffer();
+
+	return m_buffers[m_current] + m_fill;
+}
+
+void FileWriter::Commit(size_t size)
+{
+	m_fill += size;
+	m_size += size;
+}
+
+void FileWriter::Append(const void* pData, size_t size)
+{
+	const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+
+	CheckError();
+
+	while (size > 0)
+	{
+		if (m_current != FILE_WRITER_NO_BUFFER && m_fill == m_bufferSize)
+			Flush();
+
+		if (m_current == FILE_WRITER_NO_BUFFER)
+			AcquireBuffer();
+
+		const size_t chunk = std::min(size, m_bufferSize - m_fill);
+		memcpy(m_buffers[m_current] + m_fill, pBytes, chunk);
+		Commit(chunk);
+
+		pBytes += chunk;
+		size -= chunk;
+	}
+}
+
+void FileWriter::WriteAt(uint64_t offset, const void* pData, size_t size)
+{
+	CheckError();
+
+	if (offset + size > m_size)
+		throw std::invalid_argument("Cannot rewrite past the end of " + m_fileName);
+
+	// the buffer holding the bytes goes first, which keeps them in order
+	Flush();
+
+	std::unique_ptr<Write> pWrite(new Write());
+	pWrite->buffer = FILE_WRITER_NO_BUFFER;
+	pWrite->data.assign(static_cast<const uint8_t*>(pData), static_cast<const uint8_t*>(pData) + size);
+	pWrite->pData = pWrite->data.data();
+	pWrite->offset = offset;
+	pWrite->size = size;
+
+	Submit(std::move(pWrite));
+}
+
+void FileWriter::Flush()
+{
+	if (m_current == FILE_WRITER_NO_BUFFER || m_fill == 0)
+		return;
+
+	std::unique_ptr<Write> pWrite(new Write());
+	pWrite->buffer = m_current;
+	pWrite->pData = m_buffers[m_current];
+	pWrite->offset = m_size - m_fill;
+	pWrite->size = m_fill;
+
+	m_current = FILE_WRITER_NO_BUFFER;
+	m_fill = 0;
+
+	Submit(std::move(pWrite));
+}
+
+// writes what is left, stops the writer thread and closes the file
+//    Throws the first error of any write.
+void FileWriter::Close()
+{
+	if (!m_open)
+		return;
+
+	m_open = false;
+
+	Flush();
+	Stop();
+
+#ifdef _WIN32
+	const bool closed = fclose(m_pFile) == 0;
+	m_pFile = NULL;
+#else
+	const bool closed = ::close(m_fd) == 0;
+	m_fd = -1;
+#endif
+
+	if (!closed && m_error.empty())
+		m_error = "Could not close " + m_fileName + ": " + strerror(errno);
+
+	CheckError();
+}
+
+uint64_t FileWriter::GetSize() const
+{
+	return m_size;
+}
+
+size_t FileWriter::GetBufferSize() const
+{
+	return m_bufferSize;
+}
+
+// takes a free buffer to fill, allocating one while there are fewer than
+// numBuffers, else waits until the writer thread is done with one
+void FileWriter::AcquireBuffer()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (m_free.empty() && m_buffers.size() < m_numBuffers)
+	{
+		m_storage.push_back(std::unique_ptr<uint8_t[]>(new uint8_t[m_bufferSize + FILE_WRITER_ALIGNMENT - 1]));
+
+		const uintptr_t address = reinterpret_cast<uintptr_t>(m_storage.back().get());
+		m_buffers.push_back(reinterpret_cast<uint8_t*>(AlignUp(address, FILE_WRITER_ALIGNMENT)));
+		m_free.push_back(m_buffers.size() - 1);
+	}
+
+	if (m_free.empty())
+	{
+		if (m_pStats != NULL)
+			m_pStats->WriteWaited();
+
+		m_completed.wait(lock, [this] { return !m_free.empty() || !m_error.empty(); });
+	}
+
+	if (!m_error.empty())
+	{
+		lock.unlock();
+		CheckError();
+	}
+
+	m_current = m_free.back();
+	m_free.pop_back();
+}
+
+void FileWriter::Submit(std::unique_ptr<Write> pWrite)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	pWrite->done = 0;
+	pWrite->inFlight = ++m_inFlight;
+	pWrite->start = 0.0;
+
+	m_queue.push_back(std::move(pWrite));
+	m_queued.notify_one();
+}
+
+void FileWriter::CheckError()
+{
+	std::string error;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		error = m_error;
+	}
+
+	if (!error.empty())
+		throw std::runtime_error(error);
+}
+
+// lets the writer thread finish the queue and waits for it
+void FileWriter::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closing = true;
+		m_queued.notify_one();
+	}
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+// writes one queued write after the other
+void FileWriter::Run()
+{
+	for (;;)
+	{
+		std::unique_ptr<Write> pWrite;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_queued.wait(lock, [this] { return m_closing || !m_queue.empty(); });
+
+			if (m_queue.empty())
+				return;
+
+			pWrite = std::move(m_queue.front());
+			m_queue.pop_front();
+		}
+
+		// after an error the rest is only handed back
+		std::string error;
+		if (!IsFailed())
+		{
+			pWrite->start = FrameStats::Now();
+			error = WriteAll(*pWrite);
+		}
+
+		Complete(std::move(pWrite), error);
+	}
+}
+
+#ifdef USE_IO_URING
+// keeps up to FILE_WRITER_RING_DEPTH writes in flight through io_uring
+// (1) takes queued writes while the ring has room; a rewrite is only taken
+//     once every earlier write is done, short ones included, and nothing
+//     is taken after it until it is done too
+// (2) submits them
+// (3) waits for a completion, only briefly while more could be taken
+// (4) completes the write, or submits the rest of a short one
+void FileWriter::RunRing()
+{
+	struct io_uring ring;
+
+	// a kernel or container without io_uring gets the plain writer
+	if (io_uring_queue_init(2 * FILE_WRITER_RING_DEPTH, &ring, 0) < 0)
+	{
+		Run();
+		return;
+	}
+
+	std::vector<std::unique_ptr<Write> > running;
+	std::vector<Write*> ready;
+
+	for (;;)
+	{
+		// (1)
+		std::vector<std::unique_ptr<Write> > skipped;
+		bool failed = false;
+		bool held = false;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			if (running.empty())
+				m_queued.wait(lock, [this] { return m_closing || !m_queue.empty(); });
+
+			if (running.empty() && m_queue.empty())
+				break;
+
+			failed = !m_error.empty();
+
+			while (!m_queue.empty() && running.size() < FILE_WRITER_RING_DEPTH)
+			{
+				// a rewrite only ever runs alone
+				held = !failed && !running.empty() && (m_queue.front()->buffer == FILE_WRITER_NO_BUFFER || running.back()->buffer == FILE_WRITER_NO_BUFFER);
+
+				if (held)
+					break;
+
+				if (failed)
+					skipped.push_back(std::move(m_queue.front()));
+				else
+				{
+					running.push_back(std::move(m_queue.front()));
+					ready.push_back(running.back().get());
+				}
+
+				m_queue.pop_front();
+			}
+		}
+
+		for (size_t s = 0; s < skipped.size(); s++)
+			Complete(std::move(skipped[s]), "");
+
+		// (2)
+		for (size_t r = 0; r < ready.size(); r++)
+		{
+			Write* pWrite = ready[r];
+
+			struct io_uring_sqe* pSqe = io_uring_get_sqe(&ring);
+			io_uring_prep_write(pSqe, m_fd, pWrite->pData + pWrite->done, static_cast<unsigned int>(pWrite->size - pWrite->done), pWrite->offset + pWrite->done);
+			io_uring_sqe_set_data(pSqe, pWrite);
+
+			if (pWrite->done == 0)
+				pWrite->start = FrameStats::Now();
+		}
+
+		if (!ready.empty())
+			io_uring_submit(&ring);
+		ready.clear();
+
+		if (running.empty())
+			continue;
+
+		// (3)
+		struct io_uring_cqe* pCqe = NULL;
+		int result;
+
+		if (running.size() < FILE_WRITER_RING_DEPTH && !held)
+		{
+			struct __kernel_timespec timeout;
+			timeout.tv_sec = 0;
+			timeout.tv_nsec = 1000000;
+			result = io_uring_wait_cqe_timeout(&ring, &pCqe, &timeout);
+		}
+		else
+		{
+			result = io_uring_wait_cqe(&ring, &pCqe);
+		}
+
+		if (result == -ETIME || result == -EINTR)
+			continue;
+
+		if (result < 0)
+		{
+			// the ring itself failed, so what is running is lost
+			const std::string error = "Could not write " + m_fileName + ": " + strerror(-result);
+
+			for (size_t r = 0; r < running.size(); r++)
+				Complete(std::move(running[r]), error);
+			running.clear();
+			break;
+		}
+
+		// (4)
+		Write* pWrite = static_cast<Write*>(io_uring_cqe_get_data(pCqe));
+		const int written = pCqe->res;
+		io_uring_cqe_seen(&ring, pCqe);
+
+		if (written == -EINTR || written == -EAGAIN)
+		{
+			ready.push_back(pWrite);
+			continue;
+		}
+
+		if (written > 0)
+			pWrite->done += static_cast<size_t>(written);
+
+		if (written > 0 && pWrite->done < pWrite->size)
+		{
+			ready.push_back(pWrite);
+			continue;
+		}
+
+		std::string error;
+		if (written < 0)
+			error = "Could not write " + m_fileName + ": " + strerror(-written);
+		else if (written == 0)
+			error = "Could not write " + m_fileName + ": no progress";
+
+		for (size_t r = 0; r < running.size(); r++)
+		{
+			if (running[r].get() == pWrite)
+			{
+				Complete(std::move(running[r]), error);
+				running.erase(running.begin() + r);
+				break;
+			}
+		}
+	}
+
+	io_uring_queue_exit(&ring);
+
+	// hands back whatever is still queued after a failed ring
+	Run();
+}
+#endif
+
+bool FileWriter::IsFailed()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return !m_error.empty();
+}
+
+// writes all of a write, returning why it could not
+std::string FileWriter::WriteAll(Write& write)
+{
+#ifdef _WIN32
+	if (_fseeki64(m_pFile, static_cast<__int64>(write.offset), SEEK_SET) != 0 || fwrite(write.pData, 1, write.size, m_pFile) != write.size)
+		return "Could not write " + m_fileName + ": " + strerror(errno);
+
+	write.done = write.size;
+#else
+	while (write.done < write.size)
+	{
+		const ssize_t result = pwrite(m_fd, write.pData + write.done, write.size - write.done, static_cast<off_t>(write.offset + write.done));
+
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result < 0)
+			return "Could not write " + m_fileName + ": " + strerror(errno);
+
+		// a write that moves nothing would otherwise spin forever
+		if (result == 0)
+			return "Could not write " + m_fileName + ": no progress";
+
+		write.done += static_cast<size_t>(result);
+	}
+#endif
+
+	return "";
+}
+
+// starts the writeback of a finished write and hands its buffer back
+//    An empty error with nothing done is a write skipped after an earlier
+//    error.
+void FileWriter::Complete(std::unique_ptr<Write> pWrite, const std::string& error)
+{
+	const bool written = error.empty() && pWrite->done == pWrite->size;
+
+	if (written)
+	{
+		if (m_pStats != NULL)
+			m_pStats->SampleWrite(FrameStats::Now() - pWrite->start, pWrite->size, pWrite->inFlight);
+
+#ifdef __linux__
+		sync_file_range(m_fd, static_cast<off_t>(pWrite->offset), static_cast<off_t>(pWrite->size), SYNC_FILE_RANGE_WRITE);
+#endif
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!error.empty() && m_error.empty())
+		m_error = error;
+
+	if (pWrite->buffer != FILE_WRITER_NO_BUFFER)
+		m_free.push_back(pWrite->buffer);
+
+	m_inFlight--;
+	m_completed.notify_all();
+}
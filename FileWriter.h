@@ -0,0 +1,148 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class FrameStats;
+
+// FileWriter
+//    Appends to a file from a writer thread, so a slow disk or network share
+//    never stalls the thread producing the data. Data is gathered in large
+//    buffers aligned to 4 KiB; each full buffer is handed to the writer and
+//    written in one call while the producer fills the next. The producer
+//    only waits once every buffer is queued or being written, that is once
+//    the disk has been slower than the recording for as long as the buffers
+//    last. Buffers are allocated as they are first needed, so a disk that
+//    keeps up costs two or three.
+//
+//    In a USE_IO_URING build several buffers are in flight at once through
+//    io_uring, which keeps network storage and RAID busy; without it, or if
+//    the kernel refuses io_uring, the writer thread writes them one after
+//    the other with pwrite(). Each written range has its writeback started
+//    right away, so dirty pages do not pile up in the page cache.
+//
+//    Bytes appended already can be rewritten, such as a header holding the
+//    final counts; these writes keep their order with the appends. Errors
+//    of the writer thread are thrown by the producer's next call.
+class FileWriter
+{
+public:
+	// bufferSize is rounded up to 4 KiB; at least two buffers are used
+	//    pStats, if not NULL, gets every write's latency.
+	FileWriter(const std::string& fileName, size_t bufferSize, size_t numBuffers, FrameStats* pStats);
+	~FileWriter();
+
+	// creates or truncates the file and starts the writer thread
+	void Open();
+
+	// returns room for size bytes at the end of the file to fill in place
+	//    size is at most GetBufferSize().
+	uint8_t* Reserve(size_t size);
+
+	// appends the first size bytes of the room reserved last
+	void Commit(size_t size);
+
+	// appends a copy of the data
+	void Append(const void* pData, size_t size);
+
+	// rewrites bytes appended earlier
+	void WriteAt(uint64_t offset, const void* pData, size_t size);
+
+	// hands what was appended so far to the writer thread
+	void Flush();
+
+	// writes everything still queued and closes the file
+	void Close();
+
+	// bytes appended so far, which is the offset of the next one
+	uint64_t GetSize() const;
+
+	size_t GetBufferSize() const;
+
+private:
+	FileWriter(const FileWriter&);
+	FileWriter& operator=(const FileWriter&);
+
+	// one write handed to the writer thread
+	struct Write
+	{
+		// a buffer, or a copy of rewritten bytes in data
+		size_t buffer;
+		uint8_t* pData;
+		std::vector<uint8_t> data;
+
+		uint64_t offset;
+		size_t size;
+		size_t done;
+
+		// writes queued or running when this one was handed over
+		size_t inFlight;
+		double start;
+	};
+
+	void AcquireBuffer();
+	void Submit(std::unique_ptr<Write> pWrite);
+	void CheckError();
+	void Stop();
+
+	// writer thread
+	void Run();
+#ifdef USE_IO_URING
+	void RunRing();
+#endif
+	bool IsFailed();
+	std::string WriteAll(Write& write);
+	void Complete(std::unique_ptr<Write> pWrite, const std::string& error);
+
+	std::string m_fileName;
+	size_t m_bufferSize;
+	size_t m_numBuffers;
+	FrameStats* m_pStats;
+	bool m_open;
+
+	// producer side: the buffer being filled, or none
+	std::vector<std::unique_ptr<uint8_t[]> > m_storage;
+	std::vector<uint8_t*> m_buffers;
+	size_t m_current;
+	size_t m_fill;
+	uint64_t m_size;
+
+	// shared with the writer thread
+	std::mutex m_mutex;
+	std::condition_variable m_queued;
+	std::condition_variable m_completed;
+	std::deque<std::unique_ptr<Write> > m_queue;
+	std::vector<size_t> m_free;
+	size_t m_inFlight;
+	bool m_closing;
+	std::string m_error;
+	std::thread m_thread;
+
+#ifdef _WIN32
+	FILE* m_pFile;
+#else
+	int m_fd;
+#endif
+};
@@ -0,0 +1,85 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#include "stdafx.h"
+#include "FrameMetadata.h"
+#include <cstring>
+
+// Write buffers
+//    Records are gathered into buffers of this size, 4096 frames each, so
+//    the file is written in few large calls.
+#define METADATA_BUFFER_BYTES (256u << 10)
+#define METADATA_BUFFERS 4
+
+MetadataWriter::MetadataWriter(const std::string& fileName, double fps, FrameStats* pStats)
+	: m_fileName(fileName)
+	, m_pStats(pStats)
+	, m_open(false)
+{
+	memset(&m_header, 0, sizeof(m_header));
+	memcpy(m_header.magic, METADATA_FILE_MAGIC, sizeof(m_header.magic));
+	m_header.version = METADATA_FILE_VERSION;
+	m_header.headerSize = METADATA_HEADER_SIZE;
+	m_header.recordSize = METADATA_RECORD_SIZE;
+	m_header.fps = fps;
+}
+
+MetadataWriter::~MetadataWriter()
+{
+	if (m_open)
+	{
+		try
+		{
+			Close();
+		}
+		catch (...)
+		{
+			// nothing sensible left to do with an error while unwinding
+		}
+	}
+}
+
+void MetadataWriter::Open()
+{
+	m_pFile.reset(new FileWriter(m_fileName, METADATA_BUFFER_BYTES, METADATA_BUFFERS, m_pStats));
+	m_pFile->Open();
+	m_open = true;
+
+	// the header is rewritten with the final count on close
+	m_pFile->Append(&m_header, sizeof(m_header));
+}
+
+void MetadataWriter::Append(const FrameMetadata& frame)
+{
+	FrameMetadata* pRecord = reinterpret_cast<FrameMetadata*>(m_pFile->Reserve(sizeof(FrameMetadata)));
+
+	memcpy(pRecord, &frame, sizeof(frame));
+	pRecord->index = m_header.frameCount;
+
+	m_pFile->Commit(sizeof(FrameMetadata));
+	m_header.frameCount++;
+}
+
+void MetadataWriter::Close()
+{
+	m_open = false;
+
+	m_pFile->WriteAt(0, &m_header, sizeof(m_header));
+	m_pFile->Close();
+}
+
+uint64_t MetadataWriter::GetFrameCount() const
+{
+	return m_header.frameCount;
+}
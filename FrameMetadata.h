@@ -0,0 +1,128 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#pragma once
+
+#include "FileWriter.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Frame metadata file
+//    A sidecar of one fixed-size record per frame, in the order the frames
+//    are in the videos or raw file next to it, so record n describes video
+//    frame n: the camera's frame ID and timestamp, the exposure time and gain
+//    the camera reported in the image's chunk data, its input lines and the
+//    host's wall clock when the image was grabbed. All fields are in host
+//    byte order (little endian on every platform the example supports).
+//
+//    offset 0                                MetadataFileHeader
+//    headerSize + n * recordSize             FrameMetadata of frame n
+//
+//    The header is written when the file is opened and again with the final
+//    frame count when it is closed; a file that was never closed has a frame
+//    count of 0, and its records run to the end of the file.
+
+#define METADATA_FILE_MAGIC "LUCIDMET"
+#define METADATA_FILE_VERSION 1
+
+#define METADATA_HEADER_SIZE 64
+#define METADATA_RECORD_SIZE 64
+
+// record flags
+//    A field without its flag was not in the image's chunk data, such as
+//    that of an incomplete image.
+#define METADATA_FRAME_INCOMPLETE 0x1u
+#define METADATA_HAS_EXPOSURE 0x2u
+#define METADATA_HAS_GAIN 0x4u
+#define METADATA_HAS_LINE_STATUS 0x8u
+
+#pragma pack(push, 1)
+
+struct MetadataFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint32_t recordSize;
+	uint32_t reserved0;
+
+	uint64_t frameCount;
+
+	double fps;
+
+	uint8_t reserved[24];
+};
+
+struct FrameMetadata
+{
+	// position in the recording, counted from 0
+	uint64_t index;
+
+	// frame ID and timestamp reported by the camera; the timestamp is PTP
+	// time with -sync
+	uint64_t frameId;
+	uint64_t timestampNs;
+
+	// host wall clock when the image was grabbed, in ns since 1970
+	uint64_t hostTimeNs;
+
+	// ChunkExposureTime in microseconds, ChunkGain in dB
+	double exposureTime;
+	double gain;
+
+	// ChunkLineStatusAll, one bit per input line
+	int64_t lineStatus;
+
+	// METADATA_ flags
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(MetadataFileHeader) == METADATA_HEADER_SIZE, "MetadataFileHeader layout changed");
+static_assert(sizeof(FrameMetadata) == METADATA_RECORD_SIZE, "FrameMetadata layout changed");
+
+// MetadataWriter
+//    Writes a frame metadata file through a FileWriter, so the disk never
+//    holds up the recorder; a record costs it a copy into the current
+//    buffer. Errors are reported as exceptions.
+class MetadataWriter
+{
+public:
+	// pStats, if not NULL, gets the latency of the disk writes
+	MetadataWriter(const std::string& fileName, double fps, FrameStats* pStats);
+	~MetadataWriter();
+
+	void Open();
+
+	// appends the record of the next frame, numbering it
+	void Append(const FrameMetadata& frame);
+
+	// writes the final header
+	void Close();
+
+	uint64_t GetFrameCount() const;
+
+private:
+	MetadataWriter(const MetadataWriter&);
+	MetadataWriter& operator=(const MetadataWriter&);
+
+	std::string m_fileName;
+	MetadataFileHeader m_header;
+	FrameStats* m_pStats;
+	std::unique_ptr<FileWriter> m_pFile;
+	bool m_open;
+};
@@ -0,0 +1,147 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// FrameQueue
+//    Bounded blocking queue that hands frames from one pipeline stage to the
+//    next. Push() blocks while the queue is full, so a slow consumer throttles
+//    the producer instead of growing memory. Close() wakes every waiter: pushes
+//    fail from then on, while Pop() keeps draining until the queue is empty.
+//    Producers that must never wait can instead drop the oldest item or skip
+//    the new one when the queue is full.
+template <typename T>
+class FrameQueue
+{
+public:
+	explicit FrameQueue(size_t capacity)
+		: m_capacity(capacity > 0 ? capacity : 1)
+		, m_closed(false)
+	{
+	}
+
+	// blocks until there is room for the item
+	// returns false if the queue was closed, in which case the caller still
+	// owns the item
+	bool Push(const T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+
+		if (m_closed)
+			return false;
+
+		m_items.push_back(item);
+		m_notEmpty.notify_one();
+		return true;
+	}
+
+	// adds the item without waiting, dropping the oldest item if the queue
+	// is full
+	//    Returns false if the queue was closed, in which case the caller still
+	//    owns the item. A dropped item is handed back through pDropped, which
+	//    the caller then owns; the result tells whether there was one.
+	bool PushDropOldest(const T& item, T* pDropped, bool* pHasDropped)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		*pHasDropped = false;
+
+		if (m_closed)
+			return false;
+
+		if (m_items.size() >= m_capacity)
+		{
+			*pDropped = m_items.front();
+			*pHasDropped = true;
+			m_items.pop_front();
+		}
+
+		m_items.push_back(item);
+		m_notEmpty.notify_one();
+		return true;
+	}
+
+	// adds the item only if there is room, without waiting
+	//    Returns false if the queue is full or closed, in which case the
+	//    caller still owns the item; IsClosed() tells the two apart.
+	bool TryPush(const T& item)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_closed || m_items.size() >= m_capacity)
+			return false;
+
+		m_items.push_back(item);
+		m_notEmpty.notify_one();
+		return true;
+	}
+
+	// blocks until an item is available
+	// returns false once the queue is closed and empty
+	bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+
+		if (m_items.empty())
+			return false;
+
+		item = m_items.front();
+		m_items.pop_front();
+		m_notFull.notify_one();
+		return true;
+	}
+
+	// stops accepting items and releases all blocked threads
+	void Close()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_closed = true;
+		m_notFull.notify_all();
+		m_notEmpty.notify_all();
+	}
+
+	bool IsClosed() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_closed;
+	}
+
+	size_t Size() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_items.size();
+	}
+
+	size_t Capacity() const
+	{
+		return m_capacity;
+	}
+
+private:
+	FrameQueue(const FrameQueue&);
+	FrameQueue& operator=(const FrameQueue&);
+
+	const size_t m_capacity;
+	bool m_closed;
+	std::deque<T> m_items;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_notFull;
+	std::condition_variable m_notEmpty;
+};
@@ -0,0 +1,383 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+#include "FrameStats.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+	const char* const stageNames[NUM_FRAME_STAGES + 1] = { "grab", "queue", "demux", "convert", "encode", "total" };
+
+	// lower edge of the first histogram bucket past the underflow one
+	const double HISTOGRAM_MIN_SECONDS = 1e-6;
+}
+
+const char* GetFrameStageName(FrameStage stage)
+{
+	return stageNames[stage];
+}
+
+FrameStats::LatencyHistogram::LatencyHistogram()
+{
+	Clear();
+}
+
+void FrameStats::LatencyHistogram::Clear()
+{
+	count = 0;
+	std::fill(buckets, buckets + NUM_BUCKETS, 0);
+}
+
+void FrameStats::LatencyHistogram::Add(double seconds)
+{
+	size_t bucket = 0;
+
+	if (seconds >= HISTOGRAM_MIN_SECONDS)
+	{
+		const double octaves = std::log2(seconds / HISTOGRAM_MIN_SECONDS);
+		bucket = std::min(NUM_BUCKETS - 1, 1 + static_cast<size_t>(octaves * BUCKETS_PER_OCTAVE));
+	}
+
+	buckets[bucket]++;
+	count++;
+}
+
+double FrameStats::LatencyHistogram::Percentile(double fraction) const
+{
+	if (count == 0)
+		return 0.0;
+
+	const uint64_t rank = static_cast<uint64_t>(fraction * (count - 1) + 0.5);
+	uint64_t below = 0;
+	size_t bucket = 0;
+
+	while (below + buckets[bucket] <= rank)
+		below += buckets[bucket++];
+
+	if (bucket == 0)
+		return 1000.0 * HISTOGRAM_MIN_SECONDS / 2;
+
+	// geometric middle of the bucket
+	return 1000.0 * HISTOGRAM_MIN_SECONDS * std::exp2((bucket - 0.5) / BUCKETS_PER_OCTAVE);
+}
+
+FrameStats::Interval::Interval()
+{
+	Clear(0.0);
+}
+
+void FrameStats::Interval::Clear(double now)
+{
+	start = now;
+	frames = 0;
+	gaps = 0;
+	incomplete = 0;
+	skipped = 0;
+	maxQueueDepth = 0;
+	queueDepthSum = 0;
+	queueDepthSamples = 0;
+
+	for (size_t stage = 0; stage <= NUM_FRAME_STAGES; stage++)
+		latencies[stage].Clear();
+
+	writeBytes = 0;
+	writeWaits = 0;
+	maxWritesInFlight = 0;
+	writesInFlightSum = 0;
+	writeLatencies.Clear();
+}
+
+FrameStats::FrameStats(const std::string& label, size_t numStreams, const std::string& fileName)
+	: m_label(label)
+	, m_numStreams(numStreams)
+	, m_json(fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0)
+	, m_nextSequence(0)
+	, m_haveFrameId(false)
+	, m_lastFrameId(0)
+{
+	const double now = Now();
+	m_interval.Clear(now);
+	m_total.Clear(now);
+
+	if (fileName.empty())
+		return;
+
+	m_file.open(fileName.c_str());
+	if (!m_file)
+		throw std::runtime_error("Could not create " + fileName);
+
+	if (!m_json)
+	{
+		m_file << "sequence,frameId,incomplete";
+		for (size_t stage = 0; stage < NUM_FRAME_STAGES; stage++)
+			m_file << "," << stageNames[stage] << "Ms";
+		m_file << ",totalMs\n";
+	}
+}
+
+double FrameStats::Now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// (1) counts frame ID gaps and incomplete images
+// (2) starts the frame's record
+//    A frame ID that does not move forward means the camera restarted its
+//    count, which is not a gap.
+uint64_t FrameStats::Grabbed(uint64_t frameId, bool incomplete, double grabStart)
+{
+	const double now = Now();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_haveFrameId && frameId > m_lastFrameId + 1)
+	{
+		m_interval.gaps += frameId - m_lastFrameId - 1;
+		m_total.gaps += frameId - m_lastFrameId - 1;
+	}
+
+	m_haveFrameId = true;
+	m_lastFrameId = frameId;
+
+	if (incomplete)
+	{
+		m_interval.incomplete++;
+		m_total.incomplete++;
+	}
+
+	FrameRecord& record = m_inFlight[m_nextSequence];
+	record.frameId = frameId;
+	record.incomplete = incomplete;
+	record.stamps[0] = grabStart;
+	record.stamps[FRAME_STAGE_GRAB + 1] = now;
+	record.encodedStreams = 0;
+
+	// stages a recording skips take no time
+	for (size_t stage = FRAME_STAGE_GRAB + 2; stage <= NUM_FRAME_STAGES; stage++)
+		record.stamps[stage] = now;
+
+	return m_nextSequence++;
+}
+
+void FrameStats::Stamp(uint64_t sequence, FrameStage stage)
+{
+	const double now = Now();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::map<uint64_t, FrameRecord>::iterator it = m_inFlight.find(sequence);
+	if (it == m_inFlight.end())
+		return;
+
+	// later stages start here until they are stamped themselves
+	for (size_t next = stage + 1; next <= NUM_FRAME_STAGES; next++)
+		it->second.stamps[next] = now;
+}
+
+void FrameStats::SampleQueueDepth(size_t depth)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_interval.maxQueueDepth = std::max(m_interval.maxQueueDepth, depth);
+	m_interval.queueDepthSum += depth;
+	m_interval.queueDepthSamples++;
+
+	m_total.maxQueueDepth = std::max(m_total.maxQueueDepth, depth);
+	m_total.queueDepthSum += depth;
+	m_total.queueDepthSamples++;
+}
+
+void FrameStats::SampleWrite(double seconds, uint64_t bytes, size_t inFlight)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_interval.writeBytes += bytes;
+	m_interval.maxWritesInFlight = std::max(m_interval.maxWritesInFlight, inFlight);
+	m_interval.writesInFlightSum += inFlight;
+	m_interval.writeLatencies.Add(seconds);
+
+	m_total.writeBytes += bytes;
+	m_total.maxWritesInFlight = std::max(m_total.maxWritesInFlight, inFlight);
+	m_total.writesInFlightSum += inFlight;
+	m_total.writeLatencies.Add(seconds);
+}
+
+void FrameStats::WriteWaited()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_interval.writeWaits++;
+	m_total.writeWaits++;
+}
+
+void FrameStats::Encoded(uint64_t sequence)
+{
+	const double now = Now();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::map<uint64_t, FrameRecord>::iterator it = m_inFlight.find(sequence);
+	if (it == m_inFlight.end())
+		return;
+
+	if (++it->second.encodedStreams < m_numStreams)
+		return;
+
+	it->second.stamps[NUM_FRAME_STAGES] = now;
+
+	Complete(sequence, it->second);
+	m_inFlight.erase(it);
+}
+
+void FrameStats::Skipped(uint64_t sequence)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_inFlight.erase(sequence);
+	m_interval.skipped++;
+	m_total.skipped++;
+}
+
+bool FrameStats::IsReportDue(double intervalSeconds) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	return Now() - m_interval.start >= intervalSeconds;
+}
+
+// adds a finished frame to the summaries and the CSV file
+//    Called with the lock held.
+void FrameStats::Complete(uint64_t sequence, const FrameRecord& record)
+{
+	float latencies[NUM_FRAME_STAGES + 1];
+
+	for (size_t stage = 0; stage < NUM_FRAME_STAGES; stage++)
+		latencies[stage] = static_cast<float>(record.stamps[stage + 1] - record.stamps[stage]);
+
+	// from arrival on the host, so a free running camera's frame period
+	// does not count as latency
+	latencies[NUM_FRAME_STAGES] = static_cast<float>(record.stamps[NUM_FRAME_STAGES] - record.stamps[FRAME_STAGE_GRAB + 1]);
+
+	m_interval.frames++;
+	m_total.frames++;
+
+	for (size_t stage = 0; stage <= NUM_FRAME_STAGES; stage++)
+	{
+		m_interval.latencies[stage].Add(latencies[stage]);
+		m_total.latencies[stage].Add(latencies[stage]);
+	}
+
+	if (m_file.is_open() && !m_json)
+	{
+		m_file << sequence << "," << record.frameId << "," << (record.incomplete ? 1 : 0);
+		for (size_t stage = 0; stage <= NUM_FRAME_STAGES; stage++)
+			m_file << "," << std::fixed << std::setprecision(3) << 1000.0 * latencies[stage];
+		m_file << "\n";
+	}
+}
+
+void FrameStats::Report(const std::vector<StreamCounter>& counters, bool final)
+{
+	const double now = Now();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// a recording shorter than one interval is summarized once
+	if (!final || m_interval.frames < m_total.frames)
+		PrintInterval("interval", m_interval, counters, now);
+
+	m_interval.Clear(now);
+
+	if (final)
+		PrintInterval("recording", m_total, counters, now);
+}
+
+// prints one summary line and writes it as a JSON line
+//    Called with the lock held.
+void FrameStats::PrintInterval(const char* title, const Interval& interval, const std::vector<StreamCounter>& counters, double now)
+{
+	const double seconds = now - interval.start;
+	const double fps = seconds > 0.0 ? interval.frames / seconds : 0.0;
+	const double meanQueueDepth = interval.queueDepthSamples > 0 ? static_cast<double>(interval.queueDepthSum) / interval.queueDepthSamples : 0.0;
+
+	double p50[NUM_FRAME_STAGES + 1];
+	double p99[NUM_FRAME_STAGES + 1];
+
+	for (size_t stage = 0; stage <= NUM_FRAME_STAGES; stage++)
+	{
+		p50[stage] = interval.latencies[stage].Percentile(0.50);
+		p99[stage] = interval.latencies[stage].Percentile(0.99);
+	}
+
+	std::ostringstream line;
+	line << std::fixed << std::setprecision(1);
+	line << m_label << "Frame stats for the " << title << ": " << interval.frames << " frames, " << fps << " fps, "
+			<< interval.gaps << " dropped, " << interval.incomplete << " incomplete, " << interval.skipped << " skipped, queue "
+			<< meanQueueDepth << " mean " << interval.maxQueueDepth << " max\n";
+
+	line << std::setprecision(2) << "  p50/p99 ms:";
+	for (size_t stage = 0; stage <= NUM_FRAME_STAGES; stage++)
+		line << " " << stageNames[stage] << " " << p50[stage] << "/" << p99[stage];
+	line << "\n";
+
+	// disk writes
+	const uint64_t writes = interval.writeLatencies.count;
+	const double writeMBps = seconds > 0.0 ? interval.writeBytes / seconds / 1e6 : 0.0;
+	const double meanWritesInFlight = writes > 0 ? static_cast<double>(interval.writesInFlightSum) / writes : 0.0;
+	const double writeP50 = interval.writeLatencies.Percentile(0.50);
+	const double writeP99 = interval.writeLatencies.Percentile(0.99);
+
+	if (writes > 0 || interval.writeWaits > 0)
+	{
+		line << std::setprecision(1) << "  disk: " << writes << " writes, " << writeMBps << " MB/s, p50/p99 ms " << std::setprecision(2) << writeP50 << "/" << writeP99
+				<< ", in flight " << std::setprecision(1) << meanWritesInFlight << " mean " << interval.maxWritesInFlight << " max, " << interval.writeWaits << " waits\n";
+	}
+
+	if (!counters.empty())
+	{
+		line << "  stream:";
+		for (size_t c = 0; c < counters.size(); c++)
+			line << " " << counters[c].first << " " << counters[c].second;
+		line << "\n";
+	}
+
+	std::cout << "\n" << line.str() << std::flush;
+
+	if (m_file.is_open() && m_json)
+	{
+		m_file << std::fixed << std::setprecision(3)
+				<< "{\"summary\":\"" << title << "\",\"seconds\":" << seconds << ",\"frames\":" << interval.frames
+				<< ",\"fps\":" << fps << ",\"dropped\":" << interval.gaps << ",\"incomplete\":" << interval.incomplete << ",\"skipped\":" << interval.skipped
+				<< ",\"queueDepthMean\":" << meanQueueDepth << ",\"queueDepthMax\":" << interval.maxQueueDepth;
+
+		for (size_t stage = 0; stage <= NUM_FRAME_STAGES; stage++)
+			m_file << ",\"" << stageNames[stage] << "Ms\":{\"p50\":" << p50[stage] << ",\"p99\":" << p99[stage] << "}";
+
+		m_file << ",\"writes\":" << writes << ",\"writeMBps\":" << writeMBps << ",\"writeMs\":{\"p50\":" << writeP50 << ",\"p99\":" << writeP99 << "}"
+				<< ",\"writesInFlightMean\":" << meanWritesInFlight << ",\"writesInFlightMax\":" << interval.maxWritesInFlight << ",\"writeWaits\":" << interval.writeWaits;
+
+		for (size_t c = 0; c < counters.size(); c++)
+			m_file << ",\"" << counters[c].first << "\":" << counters[c].second;
+
+		m_file << "}\n" << std::flush;
+	}
+}
@@ -0,0 +1,178 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// stages of a frame's trip from the camera to the videos
+//    Each stage runs from the end of the previous one: grab is the wait in
+//    GetImage() and the copy or hand-off, queue the time spent between
+//    acquisition and recorder, demux the split into angle planes, convert the
+//    Stokes stage and encode the wait until every stream has appended the
+//    frame.
+enum FrameStage
+{
+	FRAME_STAGE_GRAB,
+	FRAME_STAGE_QUEUE,
+	FRAME_STAGE_DEMUX,
+	FRAME_STAGE_CONVERT,
+	FRAME_STAGE_ENCODE,
+	NUM_FRAME_STAGES
+};
+
+const char* GetFrameStageName(FrameStage stage);
+
+// transport layer counter read at each summary, such as missed packets
+typedef std::pair<std::string, int64_t> StreamCounter;
+
+// FrameStats
+//    Follows every frame through acquisition, demux, conversion and encoding
+//    and keeps what the progress dots do not show: frame ID gaps, which are
+//    frames the camera sent but the host never got, incomplete images, and
+//    how long each stage took, and frames the host dropped on purpose to
+//    keep up. A summary of the last interval, with fps and
+//    p50/p99 latency per stage, is printed or written as JSON lines; every
+//    frame can also be written as a CSV row. Stages are stamped from the
+//    acquisition thread, the recorder and the encoder threads alike, and the
+//    file writers add how long their disk writes took.
+class FrameStats
+{
+public:
+	// numStreams is the number of videos each frame ends up in
+	//    A fileName ending in .json gets the summaries, any other the frames
+	//    as CSV; empty for neither.
+	FrameStats(const std::string& label, size_t numStreams, const std::string& fileName);
+
+	// steady clock in seconds, the time base of all stamps
+	static double Now();
+
+	// stamps a grabbed image and checks its frame ID
+	//    Returns the sequence number the later stamps refer to.
+	uint64_t Grabbed(uint64_t frameId, bool incomplete, double grabStart);
+
+	// stamps the end of a recorder stage of a frame
+	void Stamp(uint64_t sequence, FrameStage stage);
+
+	// records the queue depth the recorder found
+	void SampleQueueDepth(size_t depth);
+
+	// records a finished disk write of a file writer
+	//    inFlight is the number of its writes queued or running when this
+	//    one was handed over, itself included.
+	void SampleWrite(double seconds, uint64_t bytes, size_t inFlight);
+
+	// a file writer had to wait for one of its buffers to be written
+	void WriteWaited();
+
+	// one stream has appended the frame; the last one completes it
+	void Encoded(uint64_t sequence);
+
+	// the frame was dropped on the host to relieve the recorder
+	void Skipped(uint64_t sequence);
+
+	// true once the interval since the last summary has passed
+	bool IsReportDue(double intervalSeconds) const;
+
+	// prints and writes a summary of the frames completed since the last one
+	//    final also summarizes the whole recording.
+	void Report(const std::vector<StreamCounter>& counters, bool final);
+
+private:
+	FrameStats(const FrameStats&);
+	FrameStats& operator=(const FrameStats&);
+
+	struct FrameRecord
+	{
+		uint64_t frameId;
+		bool incomplete;
+
+		// start of the grab, then the end of each stage
+		double stamps[NUM_FRAME_STAGES + 1];
+
+		size_t encodedStreams;
+	};
+
+	// latency samples in fixed logarithmic buckets
+	//    Eight buckets per doubling from 1 us keep a percentile within 5% of
+	//    the true value in a fixed 2 KB, however long the recording runs.
+	struct LatencyHistogram
+	{
+		LatencyHistogram();
+
+		void Clear();
+
+		void Add(double seconds);
+
+		// nearest rank percentile in milliseconds, at the bucket's middle
+		double Percentile(double fraction) const;
+
+		static const size_t BUCKETS_PER_OCTAVE = 8;
+
+		// below 1 us, then 34 doublings, up to hours
+		static const size_t NUM_BUCKETS = 1 + 34 * BUCKETS_PER_OCTAVE;
+
+		uint64_t count;
+		uint64_t buckets[NUM_BUCKETS];
+	};
+
+	// what a summary covers
+	struct Interval
+	{
+		Interval();
+
+		void Clear(double now);
+
+		double start;
+		uint64_t frames;
+		uint64_t gaps;
+		uint64_t incomplete;
+		uint64_t skipped;
+		size_t maxQueueDepth;
+		uint64_t queueDepthSum;
+		uint64_t queueDepthSamples;
+		// per stage, then grab end to encode end
+		LatencyHistogram latencies[NUM_FRAME_STAGES + 1];
+
+		// disk writes, a few per second of recording
+		uint64_t writeBytes;
+		uint64_t writeWaits;
+		size_t maxWritesInFlight;
+		uint64_t writesInFlightSum;
+		LatencyHistogram writeLatencies;
+	};
+
+	void Complete(uint64_t sequence, const FrameRecord& record);
+	void PrintInterval(const char* title, const Interval& interval, const std::vector<StreamCounter>& counters, double now);
+
+	std::string m_label;
+	size_t m_numStreams;
+	bool m_json;
+	std::ofstream m_file;
+	mutable std::mutex m_mutex;
+	std::map<uint64_t, FrameRecord> m_inFlight;
+	uint64_t m_nextSequence;
+	bool m_haveFrameId;
+	uint64_t m_lastFrameId;
+	Interval m_interval;
+	Interval m_total;
+};
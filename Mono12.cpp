@@ -0,0 +1,693 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+#include "Mono12.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
+#if defined(CPU_NEON)
+#include <arm_neon.h>
+#endif
+
+#define TAB1 "  "
+
+void Unpack12pScalar(const uint8_t* pSrc, size_t numPixels, uint16_t* pDst)
+{
+	size_t i = 0;
+
+	for (; i + 2 <= numPixels; i += 2, pSrc += 3)
+	{
+		pDst[i] = static_cast<uint16_t>(pSrc[0] | ((pSrc[1] & 0x0F) << 8));
+		pDst[i + 1] = static_cast<uint16_t>((pSrc[1] >> 4) | (pSrc[2] << 4));
+	}
+
+	// an odd last pixel has two bytes to itself
+	if (i < numPixels)
+		pDst[i] = static_cast<uint16_t>(pSrc[0] | ((pSrc[1] & 0x0F) << 8));
+}
+
+void Unpack12PackedScalar(const uint8_t* pSrc, size_t numPixels, uint16_t* pDst)
+{
+	size_t i = 0;
+
+	for (; i + 2 <= numPixels; i += 2, pSrc += 3)
+	{
+		pDst[i] = static_cast<uint16_t>((pSrc[0] << 4) | (pSrc[1] & 0x0F));
+		pDst[i + 1] = static_cast<uint16_t>((pSrc[2] << 4) | (pSrc[1] >> 4));
+	}
+
+	if (i < numPixels)
+		pDst[i] = static_cast<uint16_t>((pSrc[0] << 4) | (pSrc[1] & 0x0F));
+}
+
+#if defined(CPU_X86)
+// Vector unpack
+//    A byte shuffle copies the two bytes holding each pixel's bits into the
+//    pixel's 16-bit word. Depending on the bit order and on whether the pixel
+//    is the first or second of its pair, its bits are then the word's low 12
+//    bits, the word shifted down by 4, or a mix of both, which two masks
+//    select. Both bit orders only differ in these constants.
+
+// shuffle and masks for 12p: low bits for even pixels, shifted for odd ones
+#define UNPACK_12P_SHUFFLE 0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11
+#define UNPACK_12P_LOW 0x0FFF, 0, 0x0FFF, 0, 0x0FFF, 0, 0x0FFF, 0
+#define UNPACK_12P_HIGH 0, -1, 0, -1, 0, -1, 0, -1
+
+// shuffle and masks for 12Packed: even pixels take bits 4-11 from the
+// shifted word and bits 0-3 from the low nibble, odd pixels are shifted
+#define UNPACK_12PACKED_SHUFFLE 1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11
+#define UNPACK_12PACKED_LOW 0x000F, 0, 0x000F, 0, 0x000F, 0, 0x000F, 0
+#define UNPACK_12PACKED_HIGH 0x0FF0, -1, 0x0FF0, -1, 0x0FF0, -1, 0x0FF0, -1
+
+// 8 pixels per iteration
+//    A 16-byte load covers eight pixels and reads four bytes past them,
+//    which the three pixels after them always hold.
+TARGET_SSSE3 static inline void Unpack12Ssse3(const uint8_t* pSrc, size_t numPixels, uint16_t* pDst, __m128i shuffle, __m128i lowMask, __m128i highMask, Unpack12Fn tail)
+{
+	size_t i = 0;
+
+	for (; i + 11 <= numPixels; i += 8)
+	{
+		__m128i words = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + 3 * i / 2)), shuffle);
+
+		words = _mm_or_si128(_mm_and_si128(words, lowMask), _mm_and_si128(_mm_srli_epi16(words, 4), highMask));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + i), words);
+	}
+
+	tail(pSrc + 3 * i / 2, numPixels - i, pDst + i);
+}
+
+TARGET_SSSE3 static void Unpack12pSsse3(const uint8_t* pSrc, size_t numPixels, uint16_t* pDst)
+{
+	Unpack12Ssse3(pSrc, numPixels, pDst, _mm_setr_epi8(UNPACK_12P_SHUFFLE), _mm_setr_epi16(UNPACK_12P_LOW), _mm_setr_epi16(UNPACK_12P_HIGH), Unpack12pScalar);
+}
+
+TARGET_SSSE3 static void Unpack12PackedSsse3(const uint8_t* pSrc, size_t numPixels, uint16_t* pDst)
+{
+	Unpack12Ssse3(pSrc, numPixels, pDst, _mm_setr_epi8(UNPACK_12PACKED_SHUFFLE), _mm_setr_epi16(UNPACK_12PACKED_LOW), _mm_setr_epi16(UNPACK_12PACKED_HIGH), Unpack12PackedScalar);
+}
+
+// 16 pixels per iteration
+//    The byte shuffle cannot cross 128-bit lanes, so the 12 bytes of each
+//    lane's eight pixels are loaded into that lane separately.
+TARGET_AVX2 static inline void Unpack12Avx2(const uint8_t* pSrc, size_t numPixels, uint16_t* pDst, __m128i shuffle, __m128i lowMask, __m128i highMask, Unpack12Fn tail)
+{
+	const __m256i shuffle2 = _mm256_broadcastsi128_si256(shuffle);
+	const __m256i lowMask2 = _mm256_broadcastsi128_si256(lowMask);
+	const __m256i highMask2 = _mm256_broadcastsi128_si256(highMask);
+
+	size_t i = 0;
+
+	for (; i + 19 <= numPixels; i += 16)
+	{
+		const uint8_t* pIn = pSrc + 3 * i / 2;
+
+		__m256i words = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn))),
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(pIn + 12)), 1);
+
+		words = _mm256_shuffle_epi8(words, shuffle2);
+		words = _mm256_or_si256(_mm256_and_si256(words, lowMask2), _mm256_and_si256(_mm256_srli_epi16(words, 4), highMask2));
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(pDst + i), words);
+	}
+
+	tail(pSrc + 3 * i / 2, numPixels - i, pDst + i);
+}
+
+TARGET_AVX2 static void Unpack12pAvx2(const uint8_t* pSrc, size_t numPixels, uint16_t* pDst)
+{
+	Unpack12Avx2(pSrc, numPixels, pDst, _mm_setr_epi8(UNPACK_12P_SHUFFLE), _mm_setr_epi16(UNPACK_12P_LOW), _mm_setr_epi16(UNPACK_12P_HIGH), Unpack12pScalar);
+}
+
+TARGET_AVX2 static void Unpack12PackedAvx2(const uint8_t* pSrc, size_t numPixels, uint16_t* pDst)
+{
+	Unpack12Avx2(pSrc, numPixels, pDst, _mm_setr_epi8(UNPACK_12PACKED_SHUFFLE), _mm_setr_epi16(UNPACK_12PACKED_LOW), _mm_setr_epi16(UNPACK_12PACKED_HIGH), Unpack12PackedScalar);
+}
+#endif
+
+#if defined(CPU_NEON)
+// 16 pixels per iteration
+//    vld3_u8 splits the packed bytes by their position in the pair, and
+//    vst2q_u16 interleaves the even and odd pixels again on store.
+static void Unpack12pNeon(const uint8_t* pSrc, size_t numPixels, uint16_t* pDst)
+{
+	const uint8x8_t lowNibble = vdup_n_u8(0x0F);
+	size_t i = 0;
+
+	for (; i + 16 <= numPixels; i += 16)
+	{
+		uint8x8x3_t v = vld3_u8(pSrc + 3 * i / 2);
+		uint16x8x2_t pixels;
+
+		pixels.val[0] = vorrq_u16(vmovl_u8(v.val[0]), vshlq_n_u16(vmovl_u8(vand_u8(v.val[1], lowNibble)), 8));
+		pixels.val[1] = vorrq_u16(vshrq_n_u16(vmovl_u8(v.val[1]), 4), vshlq_n_u16(vmovl_u8(v.val[2]), 4));
+
+		vst2q_u16(pDst + i, pixels);
+	}
+
+	Unpack12pScalar(pSrc + 3 * i / 2, numPixels - i, pDst + i);
+}
+
+static void Unpack12PackedNeon(const uint8_t* pSrc, size_t numPixels, uint16_t* pDst)
+{
+	const uint8x8_t lowNibble = vdup_n_u8(0x0F);
+	size_t i = 0;
+
+	for (; i + 16 <= numPixels; i += 16)
+	{
+		uint8x8x3_t v = vld3_u8(pSrc + 3 * i / 2);
+		uint16x8x2_t pixels;
+
+		pixels.val[0] = vorrq_u16(vshlq_n_u16(vmovl_u8(v.val[0]), 4), vmovl_u8(vand_u8(v.val[1], lowNibble)));
+		pixels.val[1] = vorrq_u16(vshlq_n_u16(vmovl_u8(v.val[2]), 4), vshrq_n_u16(vmovl_u8(v.val[1]), 4));
+
+		vst2q_u16(pDst + i, pixels);
+	}
+
+	Unpack12PackedScalar(pSrc + 3 * i / 2, numPixels - i, pDst + i);
+}
+#endif
+
+std::vector<Unpack12Kernel> GetUnpack12pKernels()
+{
+	std::vector<Unpack12Kernel> kernels;
+
+	Unpack12Kernel scalar = { "scalar", Unpack12pScalar };
+	kernels.push_back(scalar);
+
+#if defined(CPU_X86)
+	if (CpuHasSsse3())
+	{
+		Unpack12Kernel ssse3 = { "ssse3", Unpack12pSsse3 };
+		kernels.push_back(ssse3);
+	}
+
+	if (CpuHasAvx2())
+	{
+		Unpack12Kernel avx2 = { "avx2", Unpack12pAvx2 };
+		kernels.push_back(avx2);
+	}
+#endif
+
+#if defined(CPU_NEON)
+	Unpack12Kernel neon = { "neon", Unpack12pNeon };
+	kernels.push_back(neon);
+#endif
+
+	return kernels;
+}
+
+std::vector<Unpack12Kernel> GetUnpack12PackedKernels()
+{
+	std::vector<Unpack12Kernel> kernels;
+
+	Unpack12Kernel scalar = { "scalar", Unpack12PackedScalar };
+	kernels.push_back(scalar);
+
+#if defined(CPU_X86)
+	if (CpuHasSsse3())
+	{
+		Unpack12Kernel ssse3 = { "ssse3", Unpack12PackedSsse3 };
+		kernels.push_back(ssse3);
+	}
+
+	if (CpuHasAvx2())
+	{
+		Unpack12Kernel avx2 = { "avx2", Unpack12PackedAvx2 };
+		kernels.push_back(avx2);
+	}
+#endif
+
+#if defined(CPU_NEON)
+	Unpack12Kernel neon = { "neon", Unpack12PackedNeon };
+	kernels.push_back(neon);
+#endif
+
+	return kernels;
+}
+
+const Unpack12Kernel& GetUnpack12pKernel()
+{
+	static const Unpack12Kernel kernel = GetUnpack12pKernels().back();
+	return kernel;
+}
+
+const Unpack12Kernel& GetUnpack12PackedKernel()
+{
+	static const Unpack12Kernel kernel = GetUnpack12PackedKernels().back();
+	return kernel;
+}
+
+// row and column of each angle in the polarizer pattern, 0/45/90/135 degrees
+static const size_t patternRow[4] = { 1, 0, 0, 1 };
+static const size_t patternColumn[4] = { 1, 1, 0, 0 };
+
+static inline uint16_t Average2(uint16_t a, uint16_t b)
+{
+	return static_cast<uint16_t>((a + b + 1) >> 1);
+}
+
+static inline uint16_t Average4(uint16_t a, uint16_t b, uint16_t c, uint16_t d)
+{
+	return static_cast<uint16_t>((a + b + c + d + 2) >> 2);
+}
+
+// interpolates one row of one angle
+//    sampleRow tells whether the angle was sampled in this row, at the
+//    columns of parity sampleColumn; otherwise it was sampled in the rows
+//    above and below.
+static void DemosaicRow(const uint16_t* pAbove, const uint16_t* pRow, const uint16_t* pBelow, size_t width, size_t sampleColumn, bool sampleRow, uint16_t* pDst)
+{
+	for (size_t x = 0; x < width; x++)
+	{
+		// mirrored at the left and right edges
+		const size_t left = x > 0 ? x - 1 : x + 1;
+		const size_t right = x + 1 < width ? x + 1 : x - 1;
+		const bool sampled = (x & 1) == sampleColumn;
+
+		if (sampleRow)
+			pDst[x] = sampled ? pRow[x] : Average2(pRow[left], pRow[right]);
+		else
+			pDst[x] = sampled ? Average2(pAbove[x], pBelow[x]) : Average4(pAbove[left], pAbove[right], pBelow[left], pBelow[right]);
+	}
+}
+
+void DemosaicPolarizer(const uint16_t* pSrc, size_t width, size_t height, uint16_t* const pDst[4], size_t dstStride)
+{
+	for (size_t y = 0; y < height; y++)
+	{
+		// mirrored at the top and bottom edges
+		const uint16_t* pAbove = pSrc + (y > 0 ? y - 1 : y + 1) * width;
+		const uint16_t* pRow = pSrc + y * width;
+		const uint16_t* pBelow = pSrc + (y + 1 < height ? y + 1 : y - 1) * width;
+
+		for (size_t angle = 0; angle < 4; angle++)
+			DemosaicRow(pAbove, pRow, pBelow, width, patternColumn[angle], (y & 1) == patternRow[angle], pDst[angle] + y * dstStride);
+	}
+}
+
+// interpolates one pixel of one angle
+//    DemosaicRow() with the angle's sampling fixed; left and right are the
+//    neighbouring columns, mirrored at the edges.
+template <bool SampleRow, bool Sampled>
+static inline uint16_t DemosaicPixel(const uint16_t* pAbove, const uint16_t* pRow, const uint16_t* pBelow, size_t x, size_t left, size_t right)
+{
+	if (SampleRow)
+		return Sampled ? pRow[x] : Average2(pRow[left], pRow[right]);
+
+	return Sampled ? Average2(pAbove[x], pBelow[x]) : Average4(pAbove[left], pAbove[right], pBelow[left], pBelow[right]);
+}
+
+// interpolates one row of one angle of a frame Width pixels wide
+//    The first and last pixels mirror; the pixels between them come in
+//    pairs of an odd and an even column, so neither the edges nor the
+//    column parity is tested inside the loop.
+template <size_t Width, size_t SampleColumn, bool SampleRow>
+static void DemosaicRowFixed(const uint16_t* pAbove, const uint16_t* pRow, const uint16_t* pBelow, uint16_t* pDst)
+{
+	static_assert(Width >= 4 && Width % 2 == 0, "frame kernels need an even width");
+
+	pDst[0] = DemosaicPixel<SampleRow, SampleColumn == 0>(pAbove, pRow, pBelow, 0, 1, 1);
+
+	for (size_t x = 1; x + 2 < Width; x += 2)
+	{
+		pDst[x] = DemosaicPixel<SampleRow, SampleColumn == 1>(pAbove, pRow, pBelow, x, x - 1, x + 1);
+		pDst[x + 1] = DemosaicPixel<SampleRow, SampleColumn == 0>(pAbove, pRow, pBelow, x + 1, x, x + 2);
+	}
+
+	pDst[Width - 1] = DemosaicPixel<SampleRow, SampleColumn == 1>(pAbove, pRow, pBelow, Width - 1, Width - 2, Width - 2);
+}
+
+// unpacks and demosaics a mosaic frame Width pixels wide
+//    Three row buffers hold rows y - 1, y and y + 1 in turn, each row being
+//    unpacked once, just before the first row that needs it below. The
+//    angles' sampling follows patternRow and patternColumn.
+template <size_t Width>
+static void DemosaicFrameFixed(const Unpack12Kernel& unpack, const uint8_t* pFrame, size_t height, uint16_t* const pPlanes[], size_t planeStride)
+{
+	const size_t rowBytes = 3 * Width / 2;
+	uint16_t rows[3][Width];
+
+	unpack.function(pFrame, Width, rows[0]);
+	unpack.function(pFrame + rowBytes, Width, rows[1]);
+
+	for (size_t y = 0; y < height; y++)
+	{
+		if (y > 0 && y + 1 < height)
+			unpack.function(pFrame + (y + 1) * rowBytes, Width, rows[(y + 1) % 3]);
+
+		// mirrored at the top and bottom edges
+		const uint16_t* pAbove = rows[(y > 0 ? y - 1 : y + 1) % 3];
+		const uint16_t* pRow = rows[y % 3];
+		const uint16_t* pBelow = rows[(y + 1 < height ? y + 1 : y - 1) % 3];
+		const size_t offset = y * planeStride;
+
+		// 0 and 135 degrees are sampled in odd rows, 45 and 90 in even ones
+		if (y & 1)
+		{
+			DemosaicRowFixed<Width, 1, true>(pAbove, pRow, pBelow, pPlanes[0] + offset);
+			DemosaicRowFixed<Width, 1, false>(pAbove, pRow, pBelow, pPlanes[1] + offset);
+			DemosaicRowFixed<Width, 0, false>(pAbove, pRow, pBelow, pPlanes[2] + offset);
+			DemosaicRowFixed<Width, 0, true>(pAbove, pRow, pBelow, pPlanes[3] + offset);
+		}
+		else
+		{
+			DemosaicRowFixed<Width, 1, false>(pAbove, pRow, pBelow, pPlanes[0] + offset);
+			DemosaicRowFixed<Width, 1, true>(pAbove, pRow, pBelow, pPlanes[1] + offset);
+			DemosaicRowFixed<Width, 0, true>(pAbove, pRow, pBelow, pPlanes[2] + offset);
+			DemosaicRowFixed<Width, 0, false>(pAbove, pRow, pBelow, pPlanes[3] + offset);
+		}
+	}
+}
+
+// unpacks and splits a DoLP and AoLP frame Width pixels wide, a row of
+// pairs at a time
+template <size_t Width>
+static void SplitDolpAolpFrameFixed(const Unpack12Kernel& unpack, const uint8_t* pFrame, size_t height, uint16_t* const pPlanes[], size_t planeStride)
+{
+	uint16_t pairs[2 * Width];
+
+	for (size_t y = 0; y < height; y++)
+	{
+		unpack.function(pFrame + y * 3 * Width, 2 * Width, pairs);
+
+		uint16_t* pDolp = pPlanes[0] + y * planeStride;
+		uint16_t* pAolp = pPlanes[1] + y * planeStride;
+
+		for (size_t x = 0; x < Width; x++)
+		{
+			pDolp[x] = pairs[2 * x];
+			pAolp[x] = pairs[2 * x + 1];
+		}
+	}
+}
+
+const std::vector<Mono12FrameKernel>& GetMono12FrameKernels()
+{
+	static const Mono12FrameKernel table[] =
+	{
+		{ "2448 mosaic", MONO12_LAYOUT_MOSAIC_12P, 2448, DemosaicFrameFixed<2448> },
+		{ "2448 mosaic", MONO12_LAYOUT_MOSAIC_12PACKED, 2448, DemosaicFrameFixed<2448> },
+		{ "2448 dolp/aolp", MONO12_LAYOUT_DOLP_AOLP_12P, 2448, SplitDolpAolpFrameFixed<2448> },
+		{ "1224 mosaic", MONO12_LAYOUT_MOSAIC_12P, 1224, DemosaicFrameFixed<1224> },
+		{ "1224 mosaic", MONO12_LAYOUT_MOSAIC_12PACKED, 1224, DemosaicFrameFixed<1224> },
+		{ "1224 dolp/aolp", MONO12_LAYOUT_DOLP_AOLP_12P, 1224, SplitDolpAolpFrameFixed<1224> }
+	};
+
+	static const std::vector<Mono12FrameKernel> kernels(table, table + sizeof(table) / sizeof(table[0]));
+	return kernels;
+}
+
+const Mono12FrameKernel* FindMono12FrameKernel(Mono12Layout layout, size_t width)
+{
+	const std::vector<Mono12FrameKernel>& kernels = GetMono12FrameKernels();
+
+	for (size_t k = 0; k < kernels.size(); k++)
+		if (kernels[k].layout == layout && kernels[k].width == width)
+			return &kernels[k];
+
+	return NULL;
+}
+
+Mono12Demux::Mono12Demux(Mono12Layout layout, size_t width, size_t height, bool frameKernel)
+	: m_layout(layout)
+	, m_width(width)
+	, m_height(height)
+	, m_kernel(layout == MONO12_LAYOUT_MOSAIC_12PACKED ? GetUnpack12PackedKernel() : GetUnpack12pKernel())
+	, m_pFrameKernel(frameKernel ? FindMono12FrameKernel(layout, width) : NULL)
+	, m_samples(width * height * (layout == MONO12_LAYOUT_DOLP_AOLP_12P ? 2 : 1))
+{
+	if (width < 2 || height < 2)
+		throw std::runtime_error("12-bit frames must be at least 2x2 pixels");
+}
+
+size_t Mono12Demux::GetNumPlanes() const
+{
+	return m_layout == MONO12_LAYOUT_DOLP_AOLP_12P ? 2 : 4;
+}
+
+size_t Mono12Demux::GetFrameSize() const
+{
+	return (3 * m_samples.size() + 1) / 2;
+}
+
+const char* Mono12Demux::GetKernelName() const
+{
+	return m_kernel.name;
+}
+
+const char* Mono12Demux::GetFrameKernelName() const
+{
+	return m_pFrameKernel ? m_pFrameKernel->name : NULL;
+}
+
+void Mono12Demux::Process(const uint8_t* pFrame, size_t sizeFilled, uint16_t* const pPlanes[], size_t planeStride)
+{
+	if (m_pFrameKernel && sizeFilled >= GetFrameSize())
+	{
+		m_pFrameKernel->function(m_kernel, pFrame, m_height, pPlanes, planeStride);
+		return;
+	}
+
+	// only whole pixels are unpacked
+	const size_t numSamples = std::min(sizeFilled, GetFrameSize()) * 2 / 3;
+
+	m_kernel.function(pFrame, numSamples, m_samples.data());
+
+	if (m_layout != MONO12_LAYOUT_DOLP_AOLP_12P)
+	{
+		DemosaicPolarizer(m_samples.data(), m_width, m_height, pPlanes, planeStride);
+		return;
+	}
+
+	// DoLP and AoLP alternate
+	for (size_t y = 0; y < m_height; y++)
+	{
+		const uint16_t* pPairs = &m_samples[2 * y * m_width];
+		uint16_t* pDolp = pPlanes[0] + y * planeStride;
+		uint16_t* pAolp = pPlanes[1] + y * planeStride;
+
+		for (size_t x = 0; x < m_width; x++)
+		{
+			pDolp[x] = pPairs[2 * x];
+			pAolp[x] = pPairs[2 * x + 1];
+		}
+	}
+}
+
+// packs 12-bit samples the way the camera does, the ground truth the
+// unpack kernels are checked against
+static std::vector<uint8_t> PackReference(const std::vector<uint16_t>& samples, bool msbFirst)
+{
+	std::vector<uint8_t> packed((3 * samples.size() + 1) / 2);
+
+	for (size_t i = 0; i < samples.size(); i++)
+	{
+		const uint16_t s = samples[i];
+		uint8_t* pPair = &packed[3 * (i / 2)];
+
+		if (i % 2 == 0 && msbFirst)
+		{
+			pPair[0] = static_cast<uint8_t>(s >> 4);
+			pPair[1] = static_cast<uint8_t>((pPair[1] & 0xF0) | (s & 0x0F));
+		}
+		else if (i % 2 == 0)
+		{
+			pPair[0] = static_cast<uint8_t>(s);
+			pPair[1] = static_cast<uint8_t>((pPair[1] & 0xF0) | (s >> 8));
+		}
+		else
+		{
+			pPair[1] = static_cast<uint8_t>((pPair[1] & 0x0F) | ((s & 0x0F) << 4));
+			pPair[2] = static_cast<uint8_t>(s >> 4);
+		}
+	}
+
+	return packed;
+}
+
+// checks one unpack kernel family against packed random samples
+static bool VerifyUnpackFamily(const char* family, const std::vector<Unpack12Kernel>& kernels, bool msbFirst)
+{
+	// odd counts, and counts that leave a tail for every vector width
+	const size_t pixelCounts[] = { 1, 2, 7, 8, 11, 16, 19, 33, 1001, 2448 * 3 + 1 };
+
+	for (size_t k = 0; k < kernels.size(); k++)
+	{
+		for (size_t c = 0; c < sizeof(pixelCounts) / sizeof(pixelCounts[0]); c++)
+		{
+			const size_t numPixels = pixelCounts[c];
+
+			std::vector<uint16_t> expected(numPixels + 1, 0xA5A5);
+			uint32_t state = 0x12345678u + static_cast<uint32_t>(numPixels);
+			for (size_t i = 0; i < numPixels; i++)
+			{
+				state = state * 1664525u + 1013904223u;
+				expected[i] = static_cast<uint16_t>(state >> 20);
+			}
+
+			std::vector<uint8_t> packed = PackReference(std::vector<uint16_t>(expected.begin(), expected.begin() + numPixels), msbFirst);
+
+			// one guard sample after the plane, which must be left alone
+			std::vector<uint16_t> actual(numPixels + 1, 0xA5A5);
+			kernels[k].function(packed.data(), numPixels, actual.data());
+
+			if (expected != actual)
+			{
+				std::cout << TAB1 << family << " kernel " << kernels[k].name << " differs from the packing at " << numPixels << " pixels\n";
+				return false;
+			}
+		}
+
+		std::cout << TAB1 << family << " kernel " << kernels[k].name << " is bit-exact\n";
+	}
+
+	return true;
+}
+
+// checks the demosaic against averaging each angle's samples in the 3x3
+// neighbourhood of every pixel, mirrored at the edges
+static bool VerifyDemosaic()
+{
+	const size_t width = 37;
+	const size_t height = 6;
+
+	std::vector<uint16_t> mosaic(width * height);
+	uint32_t state = 0x9E3779B9u;
+	for (size_t i = 0; i < mosaic.size(); i++)
+	{
+		state = state * 1664525u + 1013904223u;
+		mosaic[i] = static_cast<uint16_t>(state >> 20);
+	}
+
+	std::vector<uint16_t> actual(4 * width * height);
+	uint16_t* pPlanes[4] = { &actual[0], &actual[width * height], &actual[2 * width * height], &actual[3 * width * height] };
+	DemosaicPolarizer(mosaic.data(), width, height, pPlanes, width);
+
+	for (size_t angle = 0; angle < 4; angle++)
+	{
+		for (size_t y = 0; y < height; y++)
+		{
+			for (size_t x = 0; x < width; x++)
+			{
+				uint32_t sum = 0;
+				uint32_t count = 0;
+
+				for (int dy = -1; dy <= 1; dy++)
+				{
+					for (int dx = -1; dx <= 1; dx++)
+					{
+						const int my = static_cast<int>(y) + dy;
+						const int mx = static_cast<int>(x) + dx;
+						const size_t sy = static_cast<size_t>(my < 0 ? 1 : my >= static_cast<int>(height) ? static_cast<int>(height) - 2 : my);
+						const size_t sx = static_cast<size_t>(mx < 0 ? 1 : mx >= static_cast<int>(width) ? static_cast<int>(width) - 2 : mx);
+
+						if (sy % 2 == patternRow[angle] && sx % 2 == patternColumn[angle])
+						{
+							sum += mosaic[sy * width + sx];
+							count++;
+						}
+					}
+				}
+
+				if (actual[angle * width * height + y * width + x] != (sum + count / 2) / count)
+				{
+					std::cout << TAB1 << "Polarizer demosaic differs from the neighbourhood average at angle " << angle * 45 << ", pixel " << x << "," << y << "\n";
+					return false;
+				}
+			}
+		}
+	}
+
+	std::cout << TAB1 << "Polarizer demosaic is bit-exact\n";
+	return true;
+}
+
+// checks every frame kernel against the generic path
+//    Frames are a few rows of the kernel's width, in an odd number so that
+//    the bottom edge mirrors a row of either parity, written to planes with
+//    a row stride wider than their rows, whose padding must be left alone.
+static bool VerifyFrameKernels()
+{
+	const std::vector<Mono12FrameKernel>& kernels = GetMono12FrameKernels();
+	const size_t heights[] = { 2, 5 };
+
+	for (size_t k = 0; k < kernels.size(); k++)
+	{
+		const Mono12FrameKernel& kernel = kernels[k];
+
+		for (size_t h = 0; h < sizeof(heights) / sizeof(heights[0]); h++)
+		{
+			const size_t width = kernel.width;
+			const size_t height = heights[h];
+			const size_t stride = width + 3;
+
+			Mono12Demux generic(kernel.layout, width, height, false);
+			Mono12Demux fixed(kernel.layout, width, height);
+
+			std::vector<uint16_t> samples(width * height * (kernel.layout == MONO12_LAYOUT_DOLP_AOLP_12P ? 2 : 1));
+			uint32_t state = 0x2545F491u + static_cast<uint32_t>(k);
+			for (size_t i = 0; i < samples.size(); i++)
+			{
+				state = state * 1664525u + 1013904223u;
+				samples[i] = static_cast<uint16_t>(state >> 20);
+			}
+
+			std::vector<uint8_t> packed = PackReference(samples, kernel.layout == MONO12_LAYOUT_MOSAIC_12PACKED);
+
+			const size_t numPlanes = generic.GetNumPlanes();
+			std::vector<uint16_t> expected(numPlanes * height * stride, 0xA5A5);
+			std::vector<uint16_t> actual(numPlanes * height * stride, 0xA5A5);
+			uint16_t* pExpected[4];
+			uint16_t* pActual[4];
+
+			for (size_t p = 0; p < numPlanes; p++)
+			{
+				pExpected[p] = &expected[p * height * stride];
+				pActual[p] = &actual[p * height * stride];
+			}
+
+			generic.Process(packed.data(), packed.size(), pExpected, stride);
+			fixed.Process(packed.data(), packed.size(), pActual, stride);
+
+			if (fixed.GetFrameKernelName() == NULL || expected != actual)
+			{
+				std::cout << TAB1 << "Frame kernel " << kernel.name << " differs from the generic path at " << width << "x" << height << "\n";
+				return false;
+			}
+		}
+
+		std::cout << TAB1 << "Frame kernel " << kernel.name << (kernel.layout == MONO12_LAYOUT_MOSAIC_12PACKED ? " 12Packed" : " 12p") << " is bit-exact\n";
+	}
+
+	return true;
+}
+
+bool VerifyUnpack12Kernels()
+{
+	bool passed = VerifyUnpackFamily("Unpack 12p", GetUnpack12pKernels(), false);
+	passed = VerifyUnpackFamily("Unpack 12Packed", GetUnpack12PackedKernels(), true) && passed;
+	passed = VerifyDemosaic() && passed;
+	passed = VerifyFrameKernels() && passed;
+	return passed;
+}
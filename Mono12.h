@@ -0,0 +1,170 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Mono12
+//    The camera sends 12-bit pixels packed two to three bytes, in one of two
+//    bit orders:
+//
+//      12p (PFNC)              byte 0  pixel 0 bits 0-7
+//                              byte 1  pixel 0 bits 8-11 | pixel 1 bits 0-3 << 4
+//                              byte 2  pixel 1 bits 4-11
+//
+//      12Packed (GigE Vision)  byte 0  pixel 0 bits 4-11
+//                              byte 1  pixel 0 bits 0-3 | pixel 1 bits 0-3 << 4
+//                              byte 2  pixel 1 bits 4-11
+//
+//    The kernels below unpack either into 16-bit samples holding the 12 bits
+//    in their low bits. All kernels produce identical output; the vectorized
+//    ones only differ in speed and in the CPU features they need.
+
+// unpacks numPixels packed pixels from pSrc, (3 * numPixels + 1) / 2 bytes
+typedef void (*Unpack12Fn)(const uint8_t* pSrc, size_t numPixels, uint16_t* pDst);
+
+struct Unpack12Kernel
+{
+	const char* name;
+	Unpack12Fn function;
+};
+
+// scalar fallbacks, two pixels at a time; also finish the vector kernels' tails
+void Unpack12pScalar(const uint8_t* pSrc, size_t numPixels, uint16_t* pDst);
+void Unpack12PackedScalar(const uint8_t* pSrc, size_t numPixels, uint16_t* pDst);
+
+// kernels usable on this CPU, fastest last
+std::vector<Unpack12Kernel> GetUnpack12pKernels();
+std::vector<Unpack12Kernel> GetUnpack12PackedKernels();
+
+// fastest kernels usable on this CPU
+//    Chosen once on first use from the CPU features detected at runtime.
+const Unpack12Kernel& GetUnpack12pKernel();
+const Unpack12Kernel& GetUnpack12PackedKernel();
+
+// Polarizer demosaic
+//    PolarizeMono formats are the sensor's pixels as they are, each behind
+//    one of four polarizer angles in a repeating 2x2 pattern:
+//
+//      90   45
+//      135   0
+//
+//    which is the layout of Sony's IMX250MZR and IMX253MZR polarized
+//    sensors. Each angle is interpolated to full resolution bilinearly from
+//    its nearest samples: taken as is where the angle was sampled, averaged
+//    from the two horizontal or vertical neighbours next to that, and from
+//    the four diagonal ones in between. Edges mirror, which keeps the
+//    pattern's phase. The camera's own PolarizedAngles formats do the same
+//    on the device.
+
+// demosaics a width x height mosaic of 16-bit samples into four angle planes
+//    pDst holds the 0, 45, 90 and 135 degree planes; row y of each starts at
+//    pDst[angle] + y * dstStride samples. width and height must be at least 2.
+void DemosaicPolarizer(const uint16_t* pSrc, size_t width, size_t height, uint16_t* const pDst[4], size_t dstStride);
+
+// layout of a packed 12-bit frame
+enum Mono12Layout
+{
+	// PolarizeMono12p, the raw polarizer mosaic in 12p
+	MONO12_LAYOUT_MOSAIC_12P,
+
+	// PolarizeMono12Packed, the raw polarizer mosaic in 12Packed
+	MONO12_LAYOUT_MOSAIC_12PACKED,
+
+	// PolarizedDolpAolp_Mono12p, the camera's DoLP and AoLP of each pixel
+	// one after the other in 12p
+	MONO12_LAYOUT_DOLP_AOLP_12P
+};
+
+// Frame kernels
+//    A frame kernel unpacks and demuxes whole frames of one width, fixed at
+//    compile time, a row at a time: the rows a demosaic row needs are
+//    unpacked into buffers on the stack that stay in the L1 cache, instead
+//    of into a frame of scratch samples that is written out and read back,
+//    and the row loops have a constant trip count with the edges handled
+//    outside them. The table holds the sensor's full 2448 and half 1224
+//    pixel rows for each layout; any other width takes the generic unpack
+//    and demosaic, whose output the frame kernels match exactly.
+
+// demuxes a complete packed frame of the kernel's width
+//    unpack is the unpack kernel of the layout's bit order; row y of plane p
+//    starts at pPlanes[p] + y * planeStride samples. height must be at least 2.
+typedef void (*Mono12FrameFn)(const Unpack12Kernel& unpack, const uint8_t* pFrame, size_t height, uint16_t* const pPlanes[], size_t planeStride);
+
+struct Mono12FrameKernel
+{
+	const char* name;
+	Mono12Layout layout;
+	size_t width;
+	Mono12FrameFn function;
+};
+
+// frame kernels compiled in, one per layout and width
+const std::vector<Mono12FrameKernel>& GetMono12FrameKernels();
+
+// frame kernel of a layout and width, or NULL for the generic path
+const Mono12FrameKernel* FindMono12FrameKernel(Mono12Layout layout, size_t width);
+
+// Mono12Demux
+//    Turns a packed 12-bit frame into 16-bit planes: the raw mosaic into the
+//    four angle planes, or the camera's DoLP and AoLP into two planes. The
+//    frame is unpacked into scratch samples first, with the fastest kernel
+//    the CPU supports, then demosaiced or split from there.
+class Mono12Demux
+{
+public:
+	// throws if the frame is smaller than 2x2
+	//    A frame kernel of the layout and width is chosen from the table,
+	//    unless frameKernel is false, which the benchmark compares against.
+	Mono12Demux(Mono12Layout layout, size_t width, size_t height, bool frameKernel = true);
+
+	// 4 angle planes, or 2 for DoLP and AoLP
+	size_t GetNumPlanes() const;
+
+	// bytes of a complete packed frame
+	size_t GetFrameSize() const;
+
+	const char* GetKernelName() const;
+
+	// name of the frame kernel, or NULL if frames take the generic path
+	const char* GetFrameKernelName() const;
+
+	// demuxes one frame into GetNumPlanes() planes
+	//    Row y of plane p starts at pPlanes[p] + y * planeStride samples.
+	//    Complete frames go through the frame kernel if there is one. An
+	//    incomplete frame takes the generic path and is unpacked as far as it
+	//    was filled; the rest of its samples are those of an earlier frame.
+	void Process(const uint8_t* pFrame, size_t sizeFilled, uint16_t* const pPlanes[], size_t planeStride);
+
+private:
+	Mono12Demux(const Mono12Demux&);
+	Mono12Demux& operator=(const Mono12Demux&);
+
+	Mono12Layout m_layout;
+	size_t m_width;
+	size_t m_height;
+	const Unpack12Kernel& m_kernel;
+	const Mono12FrameKernel* m_pFrameKernel;
+	std::vector<uint16_t> m_samples;
+};
+
+// checks every usable unpack kernel against the scalar code, the demosaic
+// against a direct reading of the pattern and every frame kernel against
+// the generic path
+//    Returns true if all kernels are bit-exact.
+bool VerifyUnpack12Kernels();
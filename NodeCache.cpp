@@ -0,0 +1,104 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#include "stdafx.h"
+#include "NodeCache.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+NodeCache::NodeCache(const std::string& fileName)
+	: m_fileName(fileName)
+	, m_changed(false)
+{
+}
+
+void NodeCache::Load()
+{
+	m_entries.clear();
+	m_changed = false;
+
+	std::ifstream file(m_fileName.c_str());
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		std::istringstream fields(line);
+		std::string serial;
+		CachedNodeSettings entry;
+
+		if (fields >> serial >> entry.requested >> entry.width >> entry.height >> entry.offsetX >> entry.offsetY >> entry.binning >> entry.subsampling >> entry.fps)
+			m_entries[serial] = entry;
+	}
+}
+
+bool NodeCache::Find(const std::string& serial, const std::string& requested, CachedNodeSettings& entry) const
+{
+	std::map<std::string, CachedNodeSettings>::const_iterator it = m_entries.find(serial);
+
+	if (it == m_entries.end() || it->second.requested != requested)
+		return false;
+
+	entry = it->second;
+	return true;
+}
+
+void NodeCache::Store(const std::string& serial, const CachedNodeSettings& entry)
+{
+	m_entries[serial] = entry;
+	m_changed = true;
+}
+
+bool NodeCache::Save()
+{
+	if (!m_changed)
+		return true;
+
+	const std::string tempName = m_fileName + ".tmp";
+
+	{
+		std::ofstream file(tempName.c_str());
+		file.precision(17);
+
+		for (std::map<std::string, CachedNodeSettings>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+		{
+			const CachedNodeSettings& entry = it->second;
+
+			file << it->first << " " << entry.requested << " " << entry.width << " " << entry.height << " " << entry.offsetX << " " << entry.offsetY << " "
+					<< entry.binning << " " << entry.subsampling << " " << entry.fps << "\n";
+		}
+
+		file.close();
+
+		if (!file)
+		{
+			std::remove(tempName.c_str());
+			return false;
+		}
+	}
+
+	// rename does not replace a file on Windows
+#ifdef _WIN32
+	std::remove(m_fileName.c_str());
+#endif
+
+	if (std::rename(tempName.c_str(), m_fileName.c_str()) != 0)
+	{
+		std::remove(tempName.c_str());
+		return false;
+	}
+
+	m_changed = false;
+	return true;
+}
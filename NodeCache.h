@@ -0,0 +1,78 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+// settings a camera accepted for a set of requested ones
+//    requested is the requested pixel format, window, binning, decimation,
+//    frame rate and transport limits written as one word; the rest are what
+//    the camera took.
+struct CachedNodeSettings
+{
+	std::string requested;
+	int64_t width;
+	int64_t height;
+	int64_t offsetX;
+	int64_t offsetY;
+	int64_t binning;
+	int64_t subsampling;
+	double fps;
+};
+
+// NodeCache
+//    Configuring a camera reads the range of every node before writing it,
+//    each read and write a request to the camera and back. A service that
+//    restarts asks for the same settings again, so the values each camera
+//    accepted last time are kept by serial number in a text file of one
+//    line per camera:
+//        serial requested width height offsetX offsetY binning subsampling fps
+//    A camera that still holds them only has to be read back. Lines that
+//    cannot be parsed are dropped, so a damaged file only costs a full
+//    configuration.
+class NodeCache
+{
+public:
+	explicit NodeCache(const std::string& fileName);
+
+	// reads the file; a missing file is an empty cache
+	void Load();
+
+	// returns false unless the camera has an entry for these requested
+	// settings
+	bool Find(const std::string& serial, const std::string& requested, CachedNodeSettings& entry) const;
+
+	void Store(const std::string& serial, const CachedNodeSettings& entry);
+
+	// writes the file if an entry changed
+	//    The file is replaced in one rename, so a service killed while saving
+	//    keeps the old cache. Returns false if it could not be written.
+	bool Save();
+
+	const std::string& GetFileName() const
+	{
+		return m_fileName;
+	}
+
+private:
+	NodeCache(const NodeCache&);
+	NodeCache& operator=(const NodeCache&);
+
+	std::string m_fileName;
+	std::map<std::string, CachedNodeSettings> m_entries;
+	bool m_changed;
+};
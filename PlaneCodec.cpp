@@ -0,0 +1,651 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#include "stdafx.h"
+#include "PlaneCodec.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define TAB1 "  "
+
+// Coder parameters
+//    Activity contexts per plane, the count at which a context's statistics
+//    are halved so they follow the image, and the unary length past which a
+//    residual is sent as it is, all as in JPEG-LS.
+#define CODEC_CONTEXTS 12
+#define CODEC_RESET 64
+#define CODEC_ESCAPE 24
+
+#define CODEC_MAX_PLANES 4
+
+namespace
+{
+	// running statistics of one context
+	struct RiceContext
+	{
+		// absolute residuals and their count
+		uint32_t sum;
+		uint32_t count;
+	};
+
+	// number of significant bits, 0 for 0; value is below 2^31
+	//    2 * value + 1 is never 0, which spares the bit scan a branch.
+	inline unsigned int BitLength(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse(&index, 2 * value + 1);
+		return static_cast<unsigned int>(index);
+#else
+		return 31 - static_cast<unsigned int>(__builtin_clz(2 * value + 1));
+#endif
+	}
+
+	// value must not be 0
+	inline unsigned int TrailingZeros(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, value);
+		return static_cast<unsigned int>(index);
+#else
+		return static_cast<unsigned int>(__builtin_ctz(value));
+#endif
+	}
+
+	// writes codes least significant bit first
+	//    Every code is flushed with one unaligned 8-byte store, so the buffer
+	//    needs 8 bytes of slack past where the code may go; IsFull() tells
+	//    the caller once the code has run past that limit.
+	class BitWriter
+	{
+	public:
+		BitWriter(uint8_t* pOut, size_t limit)
+			: m_pBegin(pOut)
+			, m_pOut(pOut)
+			, m_pLimit(pOut + limit)
+			, m_bits(0)
+			, m_count(0)
+		{
+		}
+
+		// Golomb-Rice code of a mapped residual: the quotient in unary as
+		// zeros ended by a one, then k low bits
+		void PutResidual(uint32_t mapped, unsigned int k, unsigned int bitsPerSample)
+		{
+			const uint32_t quotient = mapped >> k;
+
+			if (quotient < CODEC_ESCAPE)
+				Put((1u << quotient) | (static_cast<uint64_t>(mapped & ((1u << k) - 1)) << (quotient + 1)), quotient + 1 + k);
+			else
+				Put(static_cast<uint64_t>(mapped) << CODEC_ESCAPE, CODEC_ESCAPE + bitsPerSample);
+
+			memcpy(m_pOut, &m_bits, sizeof(m_bits));
+			m_pOut += m_count >> 3;
+			m_bits >>= m_count & ~7u;
+			m_count &= 7;
+		}
+
+		// writes the bits left over and returns the bytes written
+		size_t Finish()
+		{
+			if (m_count > 0)
+			{
+				memcpy(m_pOut, &m_bits, sizeof(m_bits));
+				m_pOut += (m_count + 7) >> 3;
+				m_bits = 0;
+				m_count = 0;
+			}
+
+			return static_cast<size_t>(m_pOut - m_pBegin);
+		}
+
+		bool IsFull() const
+		{
+			return m_pOut > m_pLimit;
+		}
+
+	private:
+		// count is at most 56 less the bits pending
+		void Put(uint64_t value, unsigned int count)
+		{
+			m_bits |= value << m_count;
+			m_count += count;
+		}
+
+		uint8_t* m_pBegin;
+		uint8_t* m_pOut;
+		uint8_t* m_pLimit;
+		uint64_t m_bits;
+		unsigned int m_count;
+	};
+
+	// reads what BitWriter wrote
+	//    Keeps at least 56 bits buffered, loading 8 bytes at a time while
+	//    there are that many left; past the end the code reads as zeros.
+	class BitReader
+	{
+	public:
+		BitReader(const uint8_t* pIn, size_t size)
+			: m_pBegin(pIn)
+			, m_pNext(pIn)
+			, m_pEnd(pIn + size)
+			, m_bits(0)
+			, m_count(0)
+			, m_padding(0)
+		{
+		}
+
+		uint32_t GetResidual(unsigned int k, unsigned int bitsPerSample)
+		{
+			Refill();
+
+			const unsigned int zeros = TrailingZeros(static_cast<uint32_t>(m_bits) | (1u << CODEC_ESCAPE));
+
+			if (zeros < CODEC_ESCAPE)
+			{
+				const uint32_t low = static_cast<uint32_t>(m_bits >> (zeros + 1)) & ((1u << k) - 1);
+				Consume(zeros + 1 + k);
+
+				return (zeros << k) | low;
+			}
+
+			const uint32_t value = static_cast<uint32_t>(m_bits >> CODEC_ESCAPE) & ((1u << bitsPerSample) - 1);
+			Consume(CODEC_ESCAPE + bitsPerSample);
+
+			return value;
+		}
+
+		// bits taken, more than the code holds if it was cut short
+		uint64_t GetBitsRead() const
+		{
+			return static_cast<uint64_t>(m_pNext - m_pBegin) * 8 + m_padding - m_count;
+		}
+
+	private:
+		void Refill()
+		{
+			if (m_pEnd - m_pNext >= 8)
+			{
+				uint64_t word;
+				memcpy(&word, m_pNext, sizeof(word));
+
+				m_bits |= word << m_count;
+				m_pNext += (63 - m_count) >> 3;
+				m_count |= 56;
+			}
+			else
+			{
+				while (m_count <= 56 && m_pNext < m_pEnd)
+				{
+					m_bits |= static_cast<uint64_t>(*m_pNext++) << m_count;
+					m_count += 8;
+				}
+
+				if (m_count < 56)
+				{
+					m_padding += 56 - m_count;
+					m_count = 56;
+				}
+			}
+		}
+
+		void Consume(unsigned int count)
+		{
+			m_bits >>= count;
+			m_count -= count;
+		}
+
+		const uint8_t* m_pBegin;
+		const uint8_t* m_pNext;
+		const uint8_t* m_pEnd;
+		uint64_t m_bits;
+		unsigned int m_count;
+		uint64_t m_padding;
+	};
+
+	// smaller and larger of two values without branches
+	inline int32_t Min(int32_t a, int32_t b)
+	{
+		const int32_t difference = a - b;
+		return b + (difference & (difference >> 31));
+	}
+
+	inline int32_t Max(int32_t a, int32_t b)
+	{
+		const int32_t difference = a - b;
+		return a - (difference & (difference >> 31));
+	}
+
+	// median edge detector of JPEG-LS: the smaller or larger neighbour
+	// across an edge, the plane through the three otherwise
+	//    That is the median of a, b and a + b - c, taken without branches
+	//    since edges come and go at random.
+	inline int32_t PredictMedian(int32_t a, int32_t b, int32_t c)
+	{
+		return Max(Min(a, b), Min(Max(a, b), a + b - c));
+	}
+
+	// context of the local activity, from the gradients around a sample
+	inline size_t GetContext(int32_t a, int32_t b, int32_t c, int32_t d)
+	{
+		const uint32_t activity = static_cast<uint32_t>(std::abs(d - b) + std::abs(b - c) + std::abs(c - a));
+		return std::min<size_t>(BitLength(activity), CODEC_CONTEXTS - 1);
+	}
+
+	// smallest k for which the context's mean residual fits in k bits
+	//    The bit lengths put k within one of the answer, which saves a loop
+	//    of unpredictable length per sample.
+	inline unsigned int GetRiceParameter(const RiceContext& context, unsigned int bitsPerSample)
+	{
+		const int difference = static_cast<int>(BitLength(context.sum)) - static_cast<int>(BitLength(context.count));
+		unsigned int k = difference > 0 ? static_cast<unsigned int>(difference) : 0;
+
+		k += (context.count << k) < context.sum ? 1 : 0;
+
+		return std::min(k, bitsPerSample);
+	}
+
+	inline void UpdateContext(RiceContext& context, uint32_t magnitude)
+	{
+		context.sum += magnitude;
+
+		if (++context.count == CODEC_RESET)
+		{
+			context.sum >>= 1;
+			context.count >>= 1;
+		}
+	}
+
+	// codes rows [rowBegin, rowEnd) of every plane, encoding or decoding
+	// (1) predicts each sample from the row so far and the row above
+	// (2) codes the residual modulo the sample range, or decodes the sample
+	// (3) keeps the sample less its reference for the next row
+	//    pRows holds two rows of width + 2 values per plane, the edges
+	//    repeated into the extra two. Prediction works on each sample less
+	//    its reference from the other angles, so both sides derive the same
+	//    values from the planes coded before.
+	template <typename Sample, bool Decoding>
+	void CodeRows(Sample* const pPlanes[], size_t numPlanes, size_t width, size_t rowBegin, size_t rowEnd, unsigned int bitsPerSample, int32_t* pRows, BitWriter* pWriter, BitReader* pReader)
+	{
+		const int32_t range = 1 << bitsPerSample;
+		const int32_t mask = range - 1;
+		const bool angles = numPlanes == 4;
+		const size_t rowSize = width + 2;
+
+		RiceContext contexts[CODEC_MAX_PLANES][CODEC_CONTEXTS];
+		const uint32_t initialSum = static_cast<uint32_t>(std::max(2, (range + 32) >> 6));
+
+		for (size_t p = 0; p < numPlanes; p++)
+		{
+			for (size_t c = 0; c < CODEC_CONTEXTS; c++)
+			{
+				contexts[p][c].sum = initialSum;
+				contexts[p][c].count = 1;
+			}
+		}
+
+		// the row above a slice reads as zeros, which predicts from the left
+		std::fill(pRows, pRows + 2 * numPlanes * rowSize, 0);
+
+		// local copies stay in registers; the row stores could otherwise
+		// alias the coder state and force it through memory
+		BitWriter writer = Decoding ? BitWriter(NULL, 0) : *pWriter;
+		BitReader reader = Decoding ? *pReader : BitReader(NULL, 0);
+
+		for (size_t y = rowBegin; y < rowEnd; y++)
+		{
+			// a slice that outgrew its raw size is stored instead
+			if (!Decoding && writer.IsFull())
+				break;
+
+			const size_t parity = (y - rowBegin) & 1;
+			const Sample* pFirst = pPlanes[0] + y * width;
+			const Sample* pSecond = angles ? pPlanes[1] + y * width : NULL;
+			const Sample* pThird = angles ? pPlanes[2] + y * width : NULL;
+
+			for (size_t p = 0; p < numPlanes; p++)
+			{
+				int32_t* pAbove = pRows + (2 * p + (parity ^ 1)) * rowSize;
+				int32_t* pRow = pRows + (2 * p + parity) * rowSize;
+				Sample* pSample = pPlanes[p] + y * width;
+				RiceContext* pContexts = contexts[p];
+
+				pAbove[0] = pAbove[1];
+				pAbove[width + 1] = pAbove[width];
+				pRow[0] = pAbove[1];
+
+				for (size_t x = 0; x < width; x++)
+				{
+					const int32_t a = pRow[x];
+					const int32_t b = pAbove[x + 1];
+					const int32_t c = pAbove[x];
+					const int32_t d = pAbove[x + 2];
+
+					// (1) the 45 and 90 degree angles follow the 0 degree one,
+					//     the 135 degree angle the intensity of the other three
+					int32_t reference = 0;
+
+					if (angles && p > 0)
+						reference = p == 3 ? pFirst[x] + pThird[x] - pSecond[x] : pFirst[x];
+
+					const int32_t predicted = reference + PredictMedian(a, b, c);
+					RiceContext& context = pContexts[GetContext(a, b, c, d)];
+					const unsigned int k = GetRiceParameter(context, bitsPerSample);
+
+					// (2) residuals wrap around the sample range, so they take
+					//     no more bits than the samples
+					int32_t residual;
+					int32_t sample;
+
+					if (Decoding)
+					{
+						const uint32_t mapped = reader.GetResidual(k, bitsPerSample);
+
+						residual = static_cast<int32_t>(mapped >> 1) ^ -static_cast<int32_t>(mapped & 1);
+						sample = (predicted + residual) & mask;
+						pSample[x] = static_cast<Sample>(sample);
+					}
+					else
+					{
+						sample = pSample[x];
+						residual = (sample - predicted) & mask;
+
+						if (residual >= range / 2)
+							residual -= range;
+
+						writer.PutResidual((static_cast<uint32_t>(residual) << 1) ^ static_cast<uint32_t>(residual >> 31), k, bitsPerSample);
+					}
+
+					UpdateContext(context, static_cast<uint32_t>(std::abs(residual)));
+
+					// (3)
+					pRow[x + 1] = sample - reference;
+				}
+			}
+		}
+
+		if (Decoding)
+			*pReader = reader;
+		else
+			*pWriter = writer;
+	}
+
+	// slices share the pool's threads, and no more threads than slices
+	unsigned int GetSliceThreads(size_t numSlices, unsigned int numThreads)
+	{
+		return static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(numThreads, numSlices)));
+	}
+}
+
+PlaneCodec::PlaneCodec(size_t width, size_t height, size_t numPlanes, size_t bytesPerSample, size_t bitsPerSample, size_t numSlices, unsigned int numThreads)
+	: m_width(width)
+	, m_height(height)
+	, m_numPlanes(numPlanes)
+	, m_bytesPerSample(bytesPerSample)
+	, m_bitsPerSample(bitsPerSample)
+	, m_pool(GetSliceThreads(std::min(std::max<size_t>(numSlices, 1), height), numThreads))
+{
+	if (width == 0 || height == 0 || numPlanes == 0 || numPlanes > CODEC_MAX_PLANES)
+		throw std::invalid_argument("Lossless codec needs 1 to 4 planes of at least 1x1 samples");
+
+	if ((bytesPerSample != 1 && bytesPerSample != 2) || bitsPerSample == 0 || bitsPerSample > 8 * bytesPerSample)
+		throw std::invalid_argument("Lossless codec needs 1 or 2-byte samples of at most as many bits");
+
+	numSlices = std::min(std::max<size_t>(numSlices, 1), height);
+	m_slices.resize(numSlices);
+
+	for (size_t slice = 0; slice < numSlices; slice++)
+	{
+		Slice& s = m_slices[slice];
+		s.rowBegin = height * slice / numSlices;
+		s.rowEnd = height * (slice + 1) / numSlices;
+		s.sizeWord = 0;
+
+		const size_t rawSize = (s.rowEnd - s.rowBegin) * width * numPlanes * bytesPerSample;
+
+		if (rawSize >= PLANE_CODEC_STORED)
+			throw std::invalid_argument("Lossless codec slices must be smaller than 2 GB");
+
+		// a row may run past the limit before the writer's check
+		s.rawSize = rawSize;
+		s.code.resize(rawSize + (width * numPlanes * (CODEC_ESCAPE + 8 * bytesPerSample) + 7) / 8 + 8);
+		s.rows.resize(2 * numPlanes * (width + 2));
+	}
+}
+
+size_t PlaneCodec::GetNumSlices() const
+{
+	return m_slices.size();
+}
+
+unsigned int PlaneCodec::GetNumThreads() const
+{
+	return m_pool.GetNumThreads();
+}
+
+size_t PlaneCodec::GetMaxEncodedSize() const
+{
+	return m_slices.size() * sizeof(uint32_t) + m_width * m_height * m_numPlanes * m_bytesPerSample;
+}
+
+size_t PlaneCodec::Encode(const uint8_t* pPlanes, size_t planeStride, uint8_t* pDst)
+{
+	m_pool.Run(m_slices.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t slice = begin; slice < end; slice++)
+			EncodeSlice(slice, pPlanes, planeStride);
+	});
+
+	uint8_t* pOut = pDst + m_slices.size() * sizeof(uint32_t);
+
+	for (size_t slice = 0; slice < m_slices.size(); slice++)
+	{
+		const Slice& s = m_slices[slice];
+		const size_t size = s.sizeWord & ~PLANE_CODEC_STORED;
+
+		memcpy(pDst + slice * sizeof(uint32_t), &s.sizeWord, sizeof(uint32_t));
+		memcpy(pOut, s.code.data(), size);
+		pOut += size;
+	}
+
+	return static_cast<size_t>(pOut - pDst);
+}
+
+void PlaneCodec::Decode(const uint8_t* pSrc, size_t size, uint8_t* pPlanes, size_t planeStride)
+{
+	const size_t tableSize = m_slices.size() * sizeof(uint32_t);
+
+	if (size < tableSize)
+		throw std::runtime_error("Lossless frame is too short for its slice table");
+
+	std::vector<size_t> offsets(m_slices.size());
+	size_t offset = tableSize;
+
+	for (size_t slice = 0; slice < m_slices.size(); slice++)
+	{
+		memcpy(&m_slices[slice].sizeWord, pSrc + slice * sizeof(uint32_t), sizeof(uint32_t));
+
+		offsets[slice] = offset;
+		offset += m_slices[slice].sizeWord & ~PLANE_CODEC_STORED;
+	}
+
+	if (offset > size)
+		throw std::runtime_error("Lossless frame is shorter than its slices");
+
+	m_pool.Run(m_slices.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t slice = begin; slice < end; slice++)
+			DecodeSlice(slice, pSrc + offsets[slice], m_slices[slice].sizeWord, pPlanes, planeStride);
+	});
+}
+
+// codes one slice, or stores its samples if coding does not make it smaller
+void PlaneCodec::EncodeSlice(size_t slice, const uint8_t* pPlanes, size_t planeStride)
+{
+	Slice& s = m_slices[slice];
+	const size_t rowBytes = m_width * m_bytesPerSample;
+	const size_t planeBytes = (s.rowEnd - s.rowBegin) * rowBytes;
+
+	BitWriter writer(s.code.data(), s.rawSize);
+
+	// the coder only reads the samples when encoding
+	uint8_t* pWritable = const_cast<uint8_t*>(pPlanes);
+
+	if (m_bytesPerSample == 1)
+	{
+		uint8_t* planes[CODEC_MAX_PLANES];
+
+		for (size_t p = 0; p < m_numPlanes; p++)
+			planes[p] = pWritable + p * planeStride;
+
+		CodeRows<uint8_t, false>(planes, m_numPlanes, m_width, s.rowBegin, s.rowEnd, static_cast<unsigned int>(m_bitsPerSample), s.rows.data(), &writer, NULL);
+	}
+	else
+	{
+		uint16_t* planes[CODEC_MAX_PLANES];
+
+		for (size_t p = 0; p < m_numPlanes; p++)
+			planes[p] = reinterpret_cast<uint16_t*>(pWritable + p * planeStride);
+
+		CodeRows<uint16_t, false>(planes, m_numPlanes, m_width, s.rowBegin, s.rowEnd, static_cast<unsigned int>(m_bitsPerSample), s.rows.data(), &writer, NULL);
+	}
+
+	const size_t size = writer.Finish();
+
+	if (!writer.IsFull() && size < s.rawSize)
+	{
+		s.sizeWord = static_cast<uint32_t>(size);
+		return;
+	}
+
+	for (size_t p = 0; p < m_numPlanes; p++)
+		memcpy(&s.code[p * planeBytes], pPlanes + p * planeStride + s.rowBegin * rowBytes, planeBytes);
+
+	s.sizeWord = static_cast<uint32_t>(s.rawSize) | PLANE_CODEC_STORED;
+}
+
+void PlaneCodec::DecodeSlice(size_t slice, const uint8_t* pCode, uint32_t codeSize, uint8_t* pPlanes, size_t planeStride)
+{
+	Slice& s = m_slices[slice];
+	const size_t rowBytes = m_width * m_bytesPerSample;
+	const size_t planeBytes = (s.rowEnd - s.rowBegin) * rowBytes;
+
+	if (codeSize & PLANE_CODEC_STORED)
+	{
+		if ((codeSize & ~PLANE_CODEC_STORED) != s.rawSize)
+			throw std::runtime_error("Lossless frame has a stored slice of the wrong size");
+
+		for (size_t p = 0; p < m_numPlanes; p++)
+			memcpy(pPlanes + p * planeStride + s.rowBegin * rowBytes, pCode + p * planeBytes, planeBytes);
+
+		return;
+	}
+
+	BitReader reader(pCode, codeSize);
+
+	if (m_bytesPerSample == 1)
+	{
+		uint8_t* planes[CODEC_MAX_PLANES];
+
+		for (size_t p = 0; p < m_numPlanes; p++)
+			planes[p] = pPlanes + p * planeStride;
+
+		CodeRows<uint8_t, true>(planes, m_numPlanes, m_width, s.rowBegin, s.rowEnd, static_cast<unsigned int>(m_bitsPerSample), s.rows.data(), NULL, &reader);
+	}
+	else
+	{
+		uint16_t* planes[CODEC_MAX_PLANES];
+
+		for (size_t p = 0; p < m_numPlanes; p++)
+			planes[p] = reinterpret_cast<uint16_t*>(pPlanes + p * planeStride);
+
+		CodeRows<uint16_t, true>(planes, m_numPlanes, m_width, s.rowBegin, s.rowEnd, static_cast<unsigned int>(m_bitsPerSample), s.rows.data(), NULL, &reader);
+	}
+
+	if (reader.GetBitsRead() > static_cast<uint64_t>(codeSize) * 8)
+		throw std::runtime_error("Lossless frame has a slice cut short");
+}
+
+// round trips one frame, smooth like a scene or noise, through the codec
+//    Smooth frames must also shrink by a third, or the prediction
+//    has stopped working; noise exercises the escapes and stored slices.
+static bool VerifyRoundTrip(const char* name, size_t numPlanes, size_t bytesPerSample, size_t bitsPerSample, bool smooth)
+{
+	const size_t width = 37;
+	const size_t height = 11;
+	const size_t planeStride = (width * height * bytesPerSample + 63) / 64 * 64;
+	const uint32_t mask = (1u << bitsPerSample) - 1;
+
+	std::vector<uint8_t> planes(numPlanes * planeStride);
+	uint32_t state = 0x6A09E667u;
+
+	for (size_t p = 0; p < numPlanes; p++)
+	{
+		for (size_t i = 0; i < width * height; i++)
+		{
+			state = state * 1664525u + 1013904223u;
+
+			const size_t x = i % width;
+			const size_t y = i / width;
+			const uint32_t value = smooth ? ((static_cast<uint32_t>(x * 3 + y * 5 + p * 7) << (bitsPerSample - 8)) + (state >> 31)) & mask : (state >> 8) & mask;
+
+			if (bytesPerSample == 1)
+				planes[p * planeStride + i] = static_cast<uint8_t>(value);
+			else
+				reinterpret_cast<uint16_t*>(&planes[p * planeStride])[i] = static_cast<uint16_t>(value);
+		}
+	}
+
+	PlaneCodec codec(width, height, numPlanes, bytesPerSample, bitsPerSample, 3, 2);
+	std::vector<uint8_t> code(codec.GetMaxEncodedSize());
+	const size_t size = codec.Encode(planes.data(), planeStride, code.data());
+
+	std::vector<uint8_t> decoded(planes.size(), 0);
+	codec.Decode(code.data(), size, decoded.data(), planeStride);
+
+	for (size_t p = 0; p < numPlanes; p++)
+	{
+		if (memcmp(&decoded[p * planeStride], &planes[p * planeStride], width * height * bytesPerSample) != 0)
+		{
+			std::cout << TAB1 << "Lossless plane codec does not round trip " << name << "\n";
+			return false;
+		}
+	}
+
+	if (smooth && 3 * size > 2 * width * height * numPlanes * bytesPerSample)
+	{
+		std::cout << TAB1 << "Lossless plane codec does not compress " << name << "\n";
+		return false;
+	}
+
+	std::cout << TAB1 << "Lossless plane codec is bit-exact on " << name << "\n";
+	return true;
+}
+
+bool VerifyPlaneCodec()
+{
+	bool passed = VerifyRoundTrip("smooth 8-bit angles", 4, 1, 8, true);
+	passed = VerifyRoundTrip("noisy 8-bit angles", 4, 1, 8, false) && passed;
+	passed = VerifyRoundTrip("smooth 12-bit angles", 4, 2, 12, true) && passed;
+	passed = VerifyRoundTrip("noisy 12-bit DoLP and AoLP", 2, 2, 12, false) && passed;
+	passed = VerifyRoundTrip("smooth 8-bit plane", 1, 1, 8, true) && passed;
+	return passed;
+}
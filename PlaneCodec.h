@@ -0,0 +1,104 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#pragma once
+
+#include "Threading.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lossless plane codec
+//    Compresses the planes of a frame without losing a bit, for recordings
+//    that must keep every sample but cannot afford the disk bandwidth of raw
+//    planes. Each sample is predicted from its neighbours as in JPEG-LS, by
+//    the median of the left and upper samples and their gradient, and the
+//    residual is Golomb-Rice coded with a parameter adapted to the local
+//    activity. Four angle planes are also predicted from each other: the 45
+//    and 90 degree planes as their difference to the 0 degree plane, and the
+//    135 degree plane from I0 + I90 - I45, the intensity the other three
+//    imply. The scene's texture, which the angles share, cancels and mostly
+//    the polarization is left to code.
+//
+//    A frame is cut into row slices that are coded independently, each on a
+//    thread of its own, so prediction restarts at the first row of a slice:
+//
+//      uint32_t sliceSize[numSlices]   bytes of each slice
+//      slice 0, slice 1, ...           rows in order, each plane by plane
+//
+//    A slice the coder cannot shrink is stored as its samples instead, with
+//    PLANE_CODEC_STORED set in its size, so a frame never takes more than
+//    its raw size plus the slice table. Everything is little endian.
+
+#define PLANE_CODEC_STORED 0x80000000u
+
+// PlaneCodec
+//    Encodes and decodes the planes of one frame size and sample format.
+//    Slices are spread over a BandPool created with the codec. Errors are
+//    reported as exceptions.
+class PlaneCodec
+{
+public:
+	// numPlanes planes of width x height samples, each 1 or 2 bytes holding
+	// bitsPerSample significant low bits; 4 planes are taken as the 0, 45,
+	// 90 and 135 degree angles
+	PlaneCodec(size_t width, size_t height, size_t numPlanes, size_t bytesPerSample, size_t bitsPerSample, size_t numSlices, unsigned int numThreads);
+
+	size_t GetNumSlices() const;
+
+	unsigned int GetNumThreads() const;
+
+	// bytes an encoded frame takes at most
+	size_t GetMaxEncodedSize() const;
+
+	// encodes one frame into pDst, which holds GetMaxEncodedSize() bytes,
+	// and returns the bytes written
+	//    Plane p starts at pPlanes + p * planeStride bytes, its rows one
+	//    after the other.
+	size_t Encode(const uint8_t* pPlanes, size_t planeStride, uint8_t* pDst);
+
+	// decodes a frame of size bytes written by Encode()
+	//    Throws if the code does not fit the frame size.
+	void Decode(const uint8_t* pSrc, size_t size, uint8_t* pPlanes, size_t planeStride);
+
+private:
+	PlaneCodec(const PlaneCodec&);
+	PlaneCodec& operator=(const PlaneCodec&);
+
+	// rows of a slice, the code last encoded and the prediction rows
+	struct Slice
+	{
+		size_t rowBegin;
+		size_t rowEnd;
+		size_t rawSize;
+		std::vector<uint8_t> code;
+		uint32_t sizeWord;
+		std::vector<int32_t> rows;
+	};
+
+	void EncodeSlice(size_t slice, const uint8_t* pPlanes, size_t planeStride);
+	void DecodeSlice(size_t slice, const uint8_t* pCode, uint32_t codeSize, uint8_t* pPlanes, size_t planeStride);
+
+	size_t m_width;
+	size_t m_height;
+	size_t m_numPlanes;
+	size_t m_bytesPerSample;
+	size_t m_bitsPerSample;
+	std::vector<Slice> m_slices;
+	BandPool m_pool;
+};
+
+// round trips 8 and 12-bit frames of every kind through the codec
+//    Returns true if all of them decode bit-exact.
+bool VerifyPlaneCodec();
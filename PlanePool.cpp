@@ -0,0 +1,119 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+#include "PlanePool.h"
+#include <chrono>
+
+PlanePool::PlanePool(size_t planeSize, size_t numPlanes, size_t alignment)
+	: m_planeSize(planeSize)
+	, m_numPlanes(numPlanes)
+{
+	m_storage.resize(GetStorageSize(planeSize, numPlanes, alignment));
+
+	Init(m_storage.data(), alignment);
+}
+
+PlanePool::PlanePool(size_t planeSize, size_t numPlanes, uint8_t* pStorage, size_t alignment)
+	: m_planeSize(planeSize)
+	, m_numPlanes(numPlanes)
+{
+	Init(pStorage, alignment);
+}
+
+size_t PlanePool::GetStorageSize(size_t planeSize, size_t numPlanes, size_t alignment)
+{
+	// round the stride up so every plane, not just the first, is aligned
+	const size_t stride = (planeSize + alignment - 1) / alignment * alignment;
+
+	return stride * numPlanes + alignment;
+}
+
+void PlanePool::Init(uint8_t* pStorage, size_t alignment)
+{
+	const size_t stride = (m_planeSize + alignment - 1) / alignment * alignment;
+
+	m_pStorage = pStorage;
+	m_storageSize = GetStorageSize(m_planeSize, m_numPlanes, alignment);
+
+	uintptr_t base = reinterpret_cast<uintptr_t>(pStorage);
+	uint8_t* pFirst = pStorage + (alignment - base % alignment) % alignment;
+
+	// handed out last-in first-out, so the most recently used plane, still
+	// warm in cache, goes out first
+	for (size_t i = m_numPlanes; i > 0; i--)
+		m_free.push_back(pFirst + (i - 1) * stride);
+
+	m_stats.acquired = 0;
+	m_stats.exhausted = 0;
+	m_stats.waitSeconds = 0.0;
+	m_stats.lowWater = m_numPlanes;
+}
+
+uint8_t* PlanePool::Acquire()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (m_free.empty())
+	{
+		m_stats.exhausted++;
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		m_released.wait(lock, [this] { return !m_free.empty(); });
+		m_stats.waitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	uint8_t* pPlane = m_free.back();
+	m_free.pop_back();
+
+	m_stats.acquired++;
+	if (m_free.size() < m_stats.lowWater)
+		m_stats.lowWater = m_free.size();
+
+	return pPlane;
+}
+
+void PlanePool::Release(uint8_t* pPlane)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_free.push_back(pPlane);
+	m_released.notify_one();
+}
+
+size_t PlanePool::GetPlaneSize() const
+{
+	return m_planeSize;
+}
+
+size_t PlanePool::GetNumPlanes() const
+{
+	return m_numPlanes;
+}
+
+uint8_t* PlanePool::GetStorage() const
+{
+	return m_pStorage;
+}
+
+size_t PlanePool::GetStorageSize() const
+{
+	return m_storageSize;
+}
+
+PlanePoolStats PlanePool::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
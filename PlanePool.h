@@ -0,0 +1,93 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// plane pool usage counters
+struct PlanePoolStats
+{
+	// planes handed out
+	uint64_t acquired;
+
+	// acquisitions that found the pool empty and had to wait
+	uint64_t exhausted;
+
+	// total time spent waiting on an empty pool
+	double waitSeconds;
+
+	// fewest planes ever left free
+	size_t lowWater;
+};
+
+// PlanePool
+//    Fixed set of equally sized plane buffers, allocated once and recycled
+//    for the whole recording. The demux takes a plane per angle and the
+//    recorders give each back once it has been encoded, so memory use is set
+//    by the pool size alone. Every plane starts on an alignment boundary,
+//    which keeps vector loads and stores on whole cache lines. Acquire()
+//    waits while the pool is empty; how often that happens shows how far the
+//    recorders are behind.
+class PlanePool
+{
+public:
+	PlanePool(size_t planeSize, size_t numPlanes, size_t alignment = 64);
+
+	// hands out planes of storage the caller owns, such as GPU memory
+	//    The pool only does arithmetic on the planes' addresses, so they need
+	//    not be host memory. pStorage must hold GetStorageSize() bytes and
+	//    outlive the pool.
+	PlanePool(size_t planeSize, size_t numPlanes, uint8_t* pStorage, size_t alignment = 64);
+
+	// bytes of storage a pool of these planes takes
+	static size_t GetStorageSize(size_t planeSize, size_t numPlanes, size_t alignment = 64);
+
+	// waits for a free plane
+	uint8_t* Acquire();
+
+	// returns a plane taken with Acquire()
+	void Release(uint8_t* pPlane);
+
+	size_t GetPlaneSize() const;
+
+	size_t GetNumPlanes() const;
+
+	// start and size of the memory all planes lie in
+	uint8_t* GetStorage() const;
+	size_t GetStorageSize() const;
+
+	PlanePoolStats GetStats() const;
+
+private:
+	PlanePool(const PlanePool&);
+	PlanePool& operator=(const PlanePool&);
+
+	void Init(uint8_t* pStorage, size_t alignment);
+
+	size_t m_planeSize;
+	size_t m_numPlanes;
+	std::vector<uint8_t> m_storage;
+	uint8_t* m_pStorage;
+	size_t m_storageSize;
+	std::vector<uint8_t*> m_free;
+	PlanePoolStats m_stats;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_released;
+};
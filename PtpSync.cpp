@@ -0,0 +1,200 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#include "stdafx.h"
+#include "PtpSync.h"
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#define TAB1 "  "
+
+// the host clock is mapped to PTP time again every this many commands, so
+// the two clocks cannot drift apart over a long recording
+#define ACTION_RESYNC_COMMANDS 100
+
+void EnablePtp(const std::vector<Arena::IDevice*>& devices)
+{
+	for (size_t d = 0; d < devices.size(); d++)
+		Arena::SetNodeValue<bool>(devices[d]->GetNodeMap(), "PtpEnable", true);
+
+	// Wait for PTP to settle
+	//    After being enabled the cameras negotiate a master, which takes a
+	//    few seconds. Until then PtpStatus reads Initializing or Listening.
+	std::cout << TAB1 << "Wait for PTP to settle on " << devices.size() << " cameras\n";
+
+	for (int second = 0; second < PTP_SYNC_TIMEOUT_S; second++)
+	{
+		size_t masters = 0;
+		size_t slaves = 0;
+
+		for (size_t d = 0; d < devices.size(); d++)
+		{
+			GenICam::gcstring status = Arena::GetNodeValue<GenICam::gcstring>(devices[d]->GetNodeMap(), "PtpStatus");
+
+			if (status == "Master")
+				masters++;
+			else if (status == "Slave")
+				slaves++;
+		}
+
+		if (masters == 1 && slaves + 1 == devices.size())
+			return;
+
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+	}
+
+	throw std::runtime_error("PTP did not settle on one master within " + std::to_string(PTP_SYNC_TIMEOUT_S) + " seconds");
+}
+
+void EnableActionTrigger(Arena::IDevice* pDevice)
+{
+	GenApi::INodeMap* pNodeMap = pDevice->GetNodeMap();
+
+	// Trigger each frame
+	Arena::SetNodeValue<GenICam::gcstring>(pNodeMap, "TriggerSelector", "FrameStart");
+	Arena::SetNodeValue<GenICam::gcstring>(pNodeMap, "TriggerMode", "On");
+	Arena::SetNodeValue<GenICam::gcstring>(pNodeMap, "TriggerSource", "Action0");
+
+	// Accept action 0 with our keys
+	//    Unconditional mode lets actions through while the stream is not
+	//    yet open on the control channel's side.
+	Arena::SetNodeValue<GenICam::gcstring>(pNodeMap, "ActionUnconditionalMode", "On");
+	Arena::SetNodeValue<int64_t>(pNodeMap, "ActionSelector", 0);
+	Arena::SetNodeValue<int64_t>(pNodeMap, "ActionDeviceKey", ACTION_DEVICE_KEY);
+	Arena::SetNodeValue<int64_t>(pNodeMap, "ActionGroupKey", ACTION_GROUP_KEY);
+	Arena::SetNodeValue<int64_t>(pNodeMap, "ActionGroupMask", ACTION_GROUP_MASK);
+}
+
+void DisableActionTrigger(Arena::IDevice* pDevice)
+{
+	Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "TriggerMode", "Off");
+}
+
+uint64_t LatchPtpTime(Arena::IDevice* pDevice)
+{
+	Arena::ExecuteNode(pDevice->GetNodeMap(), "PtpDataSetLatch");
+	return static_cast<uint64_t>(Arena::GetNodeValue<int64_t>(pDevice->GetNodeMap(), "PtpDataSetLatchValue"));
+}
+
+ActionScheduler::ActionScheduler(Arena::ISystem* pSystem, Arena::IDevice* pTimeSource, double fps)
+	: m_pSystem(pSystem)
+	, m_pTimeSource(pTimeSource)
+	, m_periodNs(static_cast<uint64_t>(1e9 / fps + 0.5))
+	, m_stop(false)
+	, m_fired(0)
+	, m_late(0)
+{
+	GenApi::INodeMap* pNodeMap = m_pSystem->GetTLSystemNodeMap();
+
+	// broadcast to every camera on every interface
+	Arena::SetNodeValue<int64_t>(pNodeMap, "ActionCommandDeviceKey", ACTION_DEVICE_KEY);
+	Arena::SetNodeValue<int64_t>(pNodeMap, "ActionCommandGroupKey", ACTION_GROUP_KEY);
+	Arena::SetNodeValue<int64_t>(pNodeMap, "ActionCommandGroupMask", ACTION_GROUP_MASK);
+	Arena::SetNodeValue<int64_t>(pNodeMap, "ActionCommandTargetIP", 0xFFFFFFFF);
+}
+
+ActionScheduler::~ActionScheduler()
+{
+	Join();
+}
+
+void ActionScheduler::Start(CountdownLatch* pStarted)
+{
+	m_thread = std::thread(&ActionScheduler::Run, this, pStarted);
+}
+
+void ActionScheduler::Stop()
+{
+	Join();
+
+	if (m_error)
+		std::rethrow_exception(m_error);
+}
+
+uint64_t ActionScheduler::GetFiredCount() const
+{
+	return m_fired;
+}
+
+uint64_t ActionScheduler::GetLateCount() const
+{
+	return m_late;
+}
+
+// fires commands one period apart until stopped
+void ActionScheduler::Run(CountdownLatch* pStarted)
+{
+	try
+	{
+		while (!pStarted->WaitFor(0.1))
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_stop)
+				return;
+		}
+
+		GenApi::INodeMap* pNodeMap = m_pSystem->GetTLSystemNodeMap();
+
+		const uint64_t firstExecuteTime = LatchPtpTime(m_pTimeSource) + 2 * ACTION_LEAD_NS;
+		uint64_t ptpBase = 0;
+		std::chrono::steady_clock::time_point hostBase;
+
+		for (uint64_t k = 0; ; k++)
+		{
+			// Map host time to PTP time
+			if (k % ACTION_RESYNC_COMMANDS == 0)
+			{
+				hostBase = std::chrono::steady_clock::now();
+				ptpBase = LatchPtpTime(m_pTimeSource);
+			}
+
+			const uint64_t executeTime = firstExecuteTime + k * m_periodNs;
+			const int64_t sendOffsetNs = static_cast<int64_t>(executeTime - ACTION_LEAD_NS - ptpBase);
+			const std::chrono::steady_clock::time_point sendTime = hostBase + std::chrono::nanoseconds(sendOffsetNs);
+
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				if (m_wake.wait_until(lock, sendTime, [this] { return m_stop; }))
+					return;
+			}
+
+			// a command sent later than half the lead time may miss its slot
+			if (std::chrono::steady_clock::now() > sendTime + std::chrono::nanoseconds(ACTION_LEAD_NS / 2))
+				m_late++;
+
+			Arena::SetNodeValue<int64_t>(pNodeMap, "ActionCommandExecuteTime", static_cast<int64_t>(executeTime));
+			Arena::ExecuteNode(pNodeMap, "ActionCommandFireCommand");
+			m_fired++;
+		}
+	}
+	catch (...)
+	{
+		m_error = std::current_exception();
+	}
+}
+
+void ActionScheduler::Join()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_wake.notify_all();
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
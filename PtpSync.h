@@ -0,0 +1,104 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#pragma once
+
+#include "ArenaApi.h"
+#include "Threading.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// PTP synchronization
+//    Free-running cameras each expose on their own clock, so frames of
+//    several cameras drift apart. With PTP (IEEE 1588) the cameras agree on
+//    one time base; one becomes master and the others follow it. Scheduled
+//    action commands are then broadcast ahead of time with the PTP time at
+//    which every camera is to trigger, so all cameras expose together and
+//    stamp their images with the shared PTP time.
+
+// Action keys
+//    A camera only obeys an action command whose device key, group key and
+//    group mask match its own. Any values work as long as cameras and host
+//    agree.
+#define ACTION_DEVICE_KEY 1
+#define ACTION_GROUP_KEY 1
+#define ACTION_GROUP_MASK 1
+
+// Action lead time
+//    Each command is broadcast this long before its execute time, so it has
+//    reached every camera in time even across a switch.
+#define ACTION_LEAD_NS 20000000ull
+
+// how long to wait for the cameras to agree on a PTP master
+#define PTP_SYNC_TIMEOUT_S 30
+
+// enables PTP on every camera and waits for one master and all others slaves
+//    Throws if the cameras have not settled within PTP_SYNC_TIMEOUT_S.
+void EnablePtp(const std::vector<Arena::IDevice*>& devices);
+
+// triggers every frame of a camera from action command 0
+void EnableActionTrigger(Arena::IDevice* pDevice);
+
+void DisableActionTrigger(Arena::IDevice* pDevice);
+
+// current PTP time of a camera in nanoseconds
+uint64_t LatchPtpTime(Arena::IDevice* pDevice);
+
+// ActionScheduler
+//    Broadcasts one scheduled action command per frame period from a thread
+//    of its own. The execute times are spaced exactly one period apart in PTP
+//    time; the host only has to send each command within the lead time, so
+//    host scheduling jitter does not reach the cameras.
+class ActionScheduler
+{
+public:
+	// pTimeSource is a PTP synchronized camera to read the time from
+	ActionScheduler(Arena::ISystem* pSystem, Arena::IDevice* pTimeSource, double fps);
+	~ActionScheduler();
+
+	// starts firing once pStarted counts down to zero, i.e. once every
+	// camera streams
+	void Start(CountdownLatch* pStarted);
+
+	// stops firing; rethrows the error that stopped the scheduler, if any
+	void Stop();
+
+	uint64_t GetFiredCount() const;
+
+	// commands sent after their lead time had already begun
+	uint64_t GetLateCount() const;
+
+private:
+	ActionScheduler(const ActionScheduler&);
+	ActionScheduler& operator=(const ActionScheduler&);
+
+	void Run(CountdownLatch* pStarted);
+	void Join();
+
+	Arena::ISystem* m_pSystem;
+	Arena::IDevice* m_pTimeSource;
+	const uint64_t m_periodNs;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stop;
+	std::atomic<uint64_t> m_fired;
+	std::atomic<uint64_t> m_late;
+	std::exception_ptr m_error;
+};
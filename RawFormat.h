@@ -0,0 +1,168 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#pragma once
+
+#include <cstdint>
+
+// Raw polarization recording
+//    A lossless alternative to the H.264 videos, meant for offline analysis
+//    and for keeping up with the sensor at full frame rate on sequential disk
+//    bandwidth alone. All fields are in host byte order (little endian on
+//    every platform the example supports).
+//
+//    offset 0                      RawFileHeader, padded to headerSize
+//    headerSize + n * frameStride  RawFrameHeader of frame n
+//                 + RAW_FRAME_HEADER_SIZE
+//                                  payload of frame n, payloadSize bytes
+//
+//    Every frame record has the same stride, a multiple of the page size, so
+//    frame n can be found without reading the frames before it. The payload
+//    is either the image exactly as captured (interleaved) or the four angle
+//    planes one after the other in 0, 45, 90, 135 degree order (planar), the
+//    same planes RecordVideo() hands to the video recorders. Planes start on
+//    64-byte boundaries. 12-bit formats are only recorded planar, as 16-bit
+//    samples: four angle planes demosaiced from the raw polarizer mosaic, or
+//    DoLP and AoLP as the camera computed them.
+//
+//    The header is written when the file is opened and again with the final
+//    frame count when it is closed. A recording that was never closed has a
+//    frame count of 0; its frames can still be recovered by checking the
+//    frame magic of each record in turn.
+//
+//    Lossless recordings (version 2) compress the planar payload of every
+//    frame with the codec of PlaneCodec.h, so frame records differ in size:
+//
+//    offset 0                      RawFileHeader, padded to headerSize
+//    headerSize                    frame 0: RawFrameHeader, then its code,
+//                                  padded to recordSize, a multiple of 8
+//    ... recordSize bytes on       frame 1, and so on
+//    indexOffset                   frameCount uint64_t offsets of the
+//                                  frame records
+//
+//    The index is written when the file is closed; without it, the frames of
+//    an unclosed recording are found by following each record's size.
+//    frameStride is 0, payloadSize the size of the decoded planes.
+
+#define RAW_FILE_MAGIC "LUCIDPOL"
+#define RAW_FILE_VERSION 1
+#define RAW_FILE_VERSION_LOSSLESS 2
+#define RAW_FRAME_MAGIC 0x4D415246u // "FRAM"
+
+#define RAW_HEADER_SIZE 4096
+#define RAW_FRAME_HEADER_SIZE 64
+#define RAW_FRAME_ALIGNMENT 4096
+
+enum RawLayout
+{
+	// the image as captured, four angle bytes per pixel
+	RAW_LAYOUT_INTERLEAVED = 0,
+
+	// four angle planes, one after the other
+	RAW_LAYOUT_PLANAR = 1
+};
+
+enum RawCodec
+{
+	// frames stored as they are
+	RAW_CODEC_NONE = 0,
+
+	// planes compressed by PlaneCodec
+	RAW_CODEC_LOSSLESS = 1
+};
+
+// frame flags
+#define RAW_FRAME_INCOMPLETE 0x1u
+
+#pragma pack(push, 1)
+
+struct RawFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+
+	uint32_t width;
+	uint32_t height;
+
+	// PFNC pixel format of the captured image
+	uint64_t pixelFormat;
+
+	// RawLayout
+	uint32_t layout;
+
+	// 4 for planar, or 2 for DoLP and AoLP; 1 for interleaved
+	uint32_t numPlanes;
+
+	// bytes per pixel within a plane; 4 for an interleaved image
+	uint32_t bytesPerPixel;
+
+	// significant low bits of each sample, 8 or 12; 0 in recordings made
+	// before 12-bit formats, which are all 8-bit
+	uint32_t bitsPerSample;
+
+	// bytes from the start of one plane to the next
+	uint64_t planeStride;
+
+	// bytes of pixel data per frame
+	uint64_t payloadSize;
+
+	// bytes from one frame record to the next
+	uint64_t frameStride;
+
+	uint64_t frameCount;
+
+	double fps;
+
+	// RawCodec, and the slices of each frame's code; 0 in recordings made
+	// before lossless ones
+	uint32_t codec;
+	uint32_t numSlices;
+
+	// offset of the frame index of a closed lossless recording, else 0
+	uint64_t indexOffset;
+
+	uint8_t reserved[24];
+};
+
+struct RawFrameHeader
+{
+	uint32_t magic;
+
+	// RAW_FRAME_ flags
+	uint32_t flags;
+
+	// position in the recording, counted from 0
+	uint64_t index;
+
+	// frame ID and timestamp reported by the camera
+	uint64_t frameId;
+	uint64_t timestampNs;
+
+	// bytes of the captured image that were filled, as reported by the
+	// camera; short of a full image if the frame is incomplete
+	uint64_t sizeFilled;
+
+	// bytes from this frame record to the next in a lossless recording;
+	// 0 where every record is frameStride bytes
+	uint64_t recordSize;
+
+	uint8_t reserved[16];
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(RawFileHeader) == 128, "RawFileHeader layout changed");
+static_assert(sizeof(RawFrameHeader) == RAW_FRAME_HEADER_SIZE, "RawFrameHeader layout changed");
@@ -0,0 +1,331 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#include "stdafx.h"
+#include "RawReader.h"
+#include "PlaneCodec.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+RawReader::RawReader(const std::string& fileName)
+	: m_fileName(fileName)
+	, m_pData(NULL)
+	, m_size(0)
+	, m_frameCount(0)
+	, m_payloadIndex(UINT64_MAX)
+#ifdef _WIN32
+	, m_file(INVALID_HANDLE_VALUE)
+	, m_mapping(NULL)
+#endif
+{
+	Map();
+
+	try
+	{
+		if (m_size < RAW_HEADER_SIZE)
+			throw std::runtime_error("Raw recording " + m_fileName + " is too short for a header");
+
+		memcpy(&m_header, m_pData, sizeof(m_header));
+
+		if (memcmp(m_header.magic, RAW_FILE_MAGIC, sizeof(m_header.magic)) != 0)
+			throw std::runtime_error("Raw recording " + m_fileName + " is not a raw polarization recording");
+
+		if (m_header.version != RAW_FILE_VERSION && m_header.version != RAW_FILE_VERSION_LOSSLESS)
+			throw std::runtime_error("Raw recording " + m_fileName + " has an unsupported version");
+
+		// lossless records have no fixed stride, but planes of fixed size
+		const bool lossless = m_header.version == RAW_FILE_VERSION_LOSSLESS;
+		const bool consistent = lossless ?
+			m_header.codec == RAW_CODEC_LOSSLESS && m_header.layout == RAW_LAYOUT_PLANAR &&
+				m_header.planeStride >= static_cast<uint64_t>(m_header.width) * m_header.height * m_header.bytesPerPixel &&
+				m_header.payloadSize == m_header.planeStride * m_header.numPlanes :
+			m_header.frameStride >= RAW_FRAME_HEADER_SIZE + m_header.payloadSize;
+
+		if (!consistent || m_header.headerSize < sizeof(RawFileHeader) || m_header.headerSize > m_size)
+			throw std::runtime_error("Raw recording " + m_fileName + " has an inconsistent header");
+
+		if (lossless)
+		{
+			m_pCodec.reset(new PlaneCodec(m_header.width, m_header.height, m_header.numPlanes, m_header.bytesPerPixel,
+				m_header.bitsPerSample > 0 ? m_header.bitsPerSample : 8, m_header.numSlices, GetCpuCount()));
+
+			BuildLosslessIndex();
+		}
+
+		BuildIndex();
+	}
+	catch (...)
+	{
+		Unmap();
+		throw;
+	}
+}
+
+RawReader::~RawReader()
+{
+	Unmap();
+}
+
+const RawFileHeader& RawReader::GetHeader() const
+{
+	return m_header;
+}
+
+uint64_t RawReader::GetFrameCount() const
+{
+	return m_frameCount;
+}
+
+const RawFrameHeader& RawReader::GetFrameHeader(uint64_t index) const
+{
+	if (index >= m_frameCount)
+		throw std::out_of_range("Raw recording frame index out of range");
+
+	return *reinterpret_cast<const RawFrameHeader*>(m_pData + GetFrameOffset(index));
+}
+
+const uint8_t* RawReader::GetPayload(uint64_t index) const
+{
+	const RawFrameHeader& frame = GetFrameHeader(index);
+	const uint8_t* pRecord = reinterpret_cast<const uint8_t*>(&frame);
+
+	if (!m_pCodec)
+		return pRecord + RAW_FRAME_HEADER_SIZE;
+
+	// the last frame decoded stays until another one is asked for
+	if (m_payloadIndex != index)
+	{
+		m_payload.resize(static_cast<size_t>(m_header.payloadSize));
+		m_payloadIndex = UINT64_MAX;
+
+		m_pCodec->Decode(pRecord + RAW_FRAME_HEADER_SIZE, static_cast<size_t>(frame.recordSize - RAW_FRAME_HEADER_SIZE), m_payload.data(), static_cast<size_t>(m_header.planeStride));
+		m_payloadIndex = index;
+	}
+
+	return m_payload.data();
+}
+
+RawPlaneView RawReader::GetPlane(uint64_t index, size_t angle) const
+{
+	if (angle >= (m_header.layout == RAW_LAYOUT_PLANAR ? m_header.numPlanes : 4))
+		throw std::out_of_range("Raw recording angle out of range");
+
+	const uint8_t* pPayload = GetPayload(index);
+
+	RawPlaneView view;
+	view.width = m_header.width;
+	view.height = m_header.height;
+
+	if (m_header.layout == RAW_LAYOUT_PLANAR)
+	{
+		view.pData = pPayload + angle * m_header.planeStride;
+		view.pixelStride = m_header.bytesPerPixel;
+	}
+	else
+	{
+		// each interleaved pixel holds the four angles one after the other
+		view.pData = pPayload + angle * (m_header.bytesPerPixel / 4);
+		view.pixelStride = m_header.bytesPerPixel;
+	}
+
+	view.rowStride = view.pixelStride * view.width;
+	return view;
+}
+
+bool RawReader::FindFrameId(uint64_t frameId, uint64_t& index) const
+{
+	std::vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+		std::lower_bound(m_byFrameId.begin(), m_byFrameId.end(), std::make_pair(frameId, static_cast<uint64_t>(0)));
+
+	if (it == m_byFrameId.end() || it->first != frameId)
+		return false;
+
+	index = it->second;
+	return true;
+}
+
+bool RawReader::FindTimestamp(uint64_t timestampNs, uint64_t& index) const
+{
+	std::vector<std::pair<uint64_t, uint64_t> >::const_iterator it =
+		std::lower_bound(m_byTimestamp.begin(), m_byTimestamp.end(), std::make_pair(timestampNs, static_cast<uint64_t>(0)));
+
+	if (it == m_byTimestamp.end())
+		return false;
+
+	index = it->second;
+	return true;
+}
+
+// maps the whole file read-only
+void RawReader::Map()
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(m_fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Raw recording " + m_fileName + ": could not open file");
+
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || (mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL)
+	{
+		CloseHandle(file);
+		throw std::runtime_error("Raw recording " + m_fileName + ": could not map file");
+	}
+
+	m_pData = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (m_pData == NULL)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		throw std::runtime_error("Raw recording " + m_fileName + ": could not map file");
+	}
+
+	m_file = file;
+	m_mapping = mapping;
+	m_size = static_cast<uint64_t>(size.QuadPart);
+#else
+	int fd = open(m_fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("Raw recording " + m_fileName + ": could not open file: " + strerror(errno));
+
+	struct stat status;
+	if (fstat(fd, &status) != 0 || status.st_size == 0)
+	{
+		close(fd);
+		throw std::runtime_error("Raw recording " + m_fileName + " is empty or unreadable");
+	}
+
+	void* pData = mmap(NULL, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (pData == MAP_FAILED)
+		throw std::runtime_error("Raw recording " + m_fileName + ": could not map file: " + strerror(errno));
+
+	// frames are visited out of order, read-ahead would mostly be wasted
+	madvise(pData, static_cast<size_t>(status.st_size), MADV_RANDOM);
+
+	m_pData = static_cast<const uint8_t*>(pData);
+	m_size = static_cast<uint64_t>(status.st_size);
+#endif
+}
+
+void RawReader::Unmap()
+{
+	if (m_pData == NULL)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_pData);
+	CloseHandle(static_cast<HANDLE>(m_mapping));
+	CloseHandle(static_cast<HANDLE>(m_file));
+#else
+	munmap(const_cast<uint8_t*>(m_pData), static_cast<size_t>(m_size));
+#endif
+
+	m_pData = NULL;
+}
+
+// counts the frames and sorts them by frame ID and timestamp
+//    Only the frame headers are touched, one page per frame. An unclosed
+//    recording has no frame count, so its records are taken for as long as
+//    they fit in the file and carry the frame magic.
+void RawReader::BuildIndex()
+{
+	uint64_t count = m_offsets.size();
+
+	if (!m_pCodec)
+	{
+		const uint64_t available = (m_size - m_header.headerSize) / m_header.frameStride;
+		count = m_header.frameCount > 0 ? std::min(m_header.frameCount, available) : available;
+	}
+
+	m_frameCount = 0;
+	m_byFrameId.reserve(static_cast<size_t>(count));
+	m_byTimestamp.reserve(static_cast<size_t>(count));
+
+	for (uint64_t i = 0; i < count; i++)
+	{
+		const uint64_t offset = GetFrameOffset(i);
+
+		// a lossless record must lie within the file
+		if (m_pCodec && (offset < m_header.headerSize || offset > m_size - RAW_FRAME_HEADER_SIZE))
+			break;
+
+		const RawFrameHeader* pFrame = reinterpret_cast<const RawFrameHeader*>(m_pData + offset);
+
+		if (pFrame->magic != RAW_FRAME_MAGIC || pFrame->index != i)
+			break;
+
+		if (m_pCodec && (pFrame->recordSize < RAW_FRAME_HEADER_SIZE || pFrame->recordSize > m_size - offset))
+			break;
+
+		m_byFrameId.push_back(std::make_pair(pFrame->frameId, i));
+		m_byTimestamp.push_back(std::make_pair(pFrame->timestampNs, i));
+		m_frameCount++;
+	}
+
+	std::sort(m_byFrameId.begin(), m_byFrameId.end());
+	std::sort(m_byTimestamp.begin(), m_byTimestamp.end());
+
+	if (m_pCodec)
+		m_offsets.resize(static_cast<size_t>(m_frameCount));
+}
+
+// finds the records of a lossless recording for BuildIndex() to check
+//    A closed recording has an index after its last frame. An unclosed one
+//    has none, so its records are followed by their sizes for as long as
+//    they fit in the file.
+void RawReader::BuildLosslessIndex()
+{
+	const uint64_t count = m_header.frameCount;
+	const uint64_t indexOffset = m_header.indexOffset;
+
+	m_offsets.clear();
+
+	if (count > 0 && indexOffset >= m_header.headerSize && indexOffset <= m_size && (m_size - indexOffset) / sizeof(uint64_t) >= count)
+	{
+		m_offsets.resize(static_cast<size_t>(count));
+		memcpy(m_offsets.data(), m_pData + indexOffset, static_cast<size_t>(count) * sizeof(uint64_t));
+		return;
+	}
+
+	uint64_t offset = m_header.headerSize;
+
+	while (m_size - offset >= RAW_FRAME_HEADER_SIZE)
+	{
+		const RawFrameHeader* pFrame = reinterpret_cast<const RawFrameHeader*>(m_pData + offset);
+
+		if (pFrame->magic != RAW_FRAME_MAGIC || pFrame->recordSize < RAW_FRAME_HEADER_SIZE || pFrame->recordSize > m_size - offset)
+			break;
+
+		m_offsets.push_back(offset);
+		offset += pFrame->recordSize;
+	}
+}
+
+uint64_t RawReader::GetFrameOffset(uint64_t index) const
+{
+	return m_pCodec ? m_offsets[static_cast<size_t>(index)] : m_header.headerSize + index * m_header.frameStride;
+}
@@ -0,0 +1,108 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#pragma once
+
+#include "RawFormat.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// view of one angle plane inside a mapped recording
+//    Pixel (x, y) starts at pData + y * rowStride + x * pixelStride. For a
+//    planar recording the plane is contiguous; for an interleaved one the
+//    view steps over the other angles' bytes.
+class PlaneCodec;
+
+struct RawPlaneView
+{
+	const uint8_t* pData;
+	uint32_t width;
+	uint32_t height;
+	size_t pixelStride;
+	size_t rowStride;
+};
+
+// RawReader
+//    Random access to a raw polarization recording (see RawFormat.h). The
+//    file is memory mapped read-only, so seeking to frame N costs nothing and
+//    only the pages actually looked at are read from disk. Frames can be
+//    looked up by position, camera frame ID or timestamp, and every view
+//    points straight into the mapping, valid as long as the reader lives.
+//    Recordings that were never closed are recovered up to the last complete
+//    frame record. Lossless recordings are decoded a frame at a time into a
+//    buffer of the reader, which the views of that frame point into until
+//    another frame is decoded. Errors are reported as exceptions.
+class RawReader
+{
+public:
+	explicit RawReader(const std::string& fileName);
+	~RawReader();
+
+	const RawFileHeader& GetHeader() const;
+
+	uint64_t GetFrameCount() const;
+
+	const RawFrameHeader& GetFrameHeader(uint64_t index) const;
+
+	// the frame's payload, GetHeader().payloadSize bytes
+	//    A lossless frame is decoded first, on one thread per slice.
+	const uint8_t* GetPayload(uint64_t index) const;
+
+	// angle is 0, 1, 2 or 3 for 0, 45, 90 and 135 degrees, or 0 and 1 for
+	// the DoLP and AoLP planes of a PolarizedDolpAolp recording
+	//    Samples of 12-bit recordings are 16-bit little endian words.
+	RawPlaneView GetPlane(uint64_t index, size_t angle) const;
+
+	// finds the frame with a camera frame ID; returns false if there is none
+	bool FindFrameId(uint64_t frameId, uint64_t& index) const;
+
+	// finds the first frame taken at or after a timestamp; returns false if
+	// all frames are older
+	bool FindTimestamp(uint64_t timestampNs, uint64_t& index) const;
+
+private:
+	RawReader(const RawReader&);
+	RawReader& operator=(const RawReader&);
+
+	void Map();
+	void Unmap();
+	void BuildIndex();
+	void BuildLosslessIndex();
+	uint64_t GetFrameOffset(uint64_t index) const;
+
+	std::string m_fileName;
+	const uint8_t* m_pData;
+	uint64_t m_size;
+	RawFileHeader m_header;
+	uint64_t m_frameCount;
+
+	// lossless recordings only: record offsets, and the frame decoded last
+	std::vector<uint64_t> m_offsets;
+	std::unique_ptr<PlaneCodec> m_pCodec;
+	mutable std::vector<uint8_t> m_payload;
+	mutable uint64_t m_payloadIndex;
+
+	// (frame ID, index) and (timestamp, index), sorted by key
+	std::vector<std::pair<uint64_t, uint64_t> > m_byFrameId;
+	std::vector<std::pair<uint64_t, uint64_t> > m_byTimestamp;
+
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#endif
+};
@@ -0,0 +1,316 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+#include "RawWriter.h"
+#include "RawReader.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#define TAB1 "  "
+
+// Write buffers
+//    Frame records are gathered into buffers of this size, or of one record
+//    if that is larger, and written one buffer per call. Up to the queue
+//    size is held while the disk lags behind, a few seconds of most
+//    recordings, before the recorder has to wait for it.
+#define RAW_BUFFER_BYTES (8ull << 20)
+#define RAW_QUEUE_BYTES (512ull << 20)
+
+namespace
+{
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+RawWriter::RawWriter(const std::string& fileName, size_t width, size_t height, uint64_t pixelFormat, RawLayout layout, size_t numPlanes, size_t bytesPerPixel, size_t bitsPerSample, double fps, RawCodec codec, size_t numSlices, FrameStats* pStats)
+	: m_fileName(fileName)
+	, m_pStats(pStats)
+	, m_maxRecordSize(0)
+	, m_pRecord(NULL)
+	, m_open(false)
+{
+	memset(&m_header, 0, sizeof(m_header));
+	memcpy(m_header.magic, RAW_FILE_MAGIC, sizeof(m_header.magic));
+	m_header.version = RAW_FILE_VERSION;
+	m_header.headerSize = RAW_HEADER_SIZE;
+	m_header.width = static_cast<uint32_t>(width);
+	m_header.height = static_cast<uint32_t>(height);
+	m_header.pixelFormat = pixelFormat;
+	m_header.layout = layout;
+	m_header.numPlanes = static_cast<uint32_t>(numPlanes);
+	m_header.bytesPerPixel = static_cast<uint32_t>(bytesPerPixel);
+	m_header.bitsPerSample = static_cast<uint32_t>(bitsPerSample);
+	m_header.fps = fps;
+
+	const uint64_t planeSize = static_cast<uint64_t>(width) * height * bytesPerPixel;
+
+	m_header.planeStride = layout == RAW_LAYOUT_PLANAR ? AlignUp(planeSize, 64) : planeSize;
+	m_header.payloadSize = m_header.planeStride * m_header.numPlanes;
+	m_header.frameStride = AlignUp(RAW_FRAME_HEADER_SIZE + m_header.payloadSize, RAW_FRAME_ALIGNMENT);
+	m_maxRecordSize = static_cast<size_t>(m_header.frameStride);
+
+	// lossless frames are appended, one record per frame of whatever size
+	//    its code takes
+	if (codec == RAW_CODEC_LOSSLESS)
+	{
+		if (layout != RAW_LAYOUT_PLANAR)
+			throw std::invalid_argument("Lossless raw recordings must be planar");
+
+		m_pCodec.reset(new PlaneCodec(width, height, numPlanes, bytesPerPixel, bitsPerSample, numSlices, GetCpuCount()));
+
+		m_header.version = RAW_FILE_VERSION_LOSSLESS;
+		m_header.codec = codec;
+		m_header.numSlices = static_cast<uint32_t>(m_pCodec->GetNumSlices());
+		m_header.frameStride = 0;
+
+		// a frame's code runs at most 8 bytes past its padded size
+		m_maxRecordSize = static_cast<size_t>(AlignUp(RAW_FRAME_HEADER_SIZE + m_pCodec->GetMaxEncodedSize() + 8, 8));
+	}
+}
+
+RawWriter::~RawWriter()
+{
+	if (m_open)
+	{
+		try
+		{
+			Close();
+		}
+		catch (...)
+		{
+			// nothing sensible left to do with an error while unwinding
+		}
+	}
+}
+
+void RawWriter::Open()
+{
+	if (m_pCodec)
+		m_payload.resize(static_cast<size_t>(m_header.payloadSize));
+
+	const size_t bufferSize = static_cast<size_t>(std::max<uint64_t>(RAW_BUFFER_BYTES, m_maxRecordSize));
+
+	m_pFile.reset(new FileWriter(m_fileName, bufferSize, static_cast<size_t>(RAW_QUEUE_BYTES / bufferSize), m_pStats));
+	m_pFile->Open();
+	m_open = true;
+
+	// the header is rewritten with the final counts on close
+	std::vector<uint8_t> block(m_header.headerSize, 0);
+	memcpy(block.data(), &m_header, sizeof(m_header));
+	m_pFile->Append(block.data(), block.size());
+}
+
+uint8_t* RawWriter::BeginFrame(uint64_t frameId, uint64_t timestampNs, uint32_t flags)
+{
+	m_pRecord = m_pFile->Reserve(m_maxRecordSize);
+
+	RawFrameHeader frameHeader;
+	memset(&frameHeader, 0, sizeof(frameHeader));
+	frameHeader.magic = RAW_FRAME_MAGIC;
+	frameHeader.flags = flags;
+	frameHeader.index = m_header.frameCount;
+	frameHeader.frameId = frameId;
+	frameHeader.timestampNs = timestampNs;
+	memcpy(m_pRecord, &frameHeader, sizeof(frameHeader));
+
+	uint8_t* pPayload = m_pCodec ? m_payload.data() : m_pRecord + RAW_FRAME_HEADER_SIZE;
+
+	// the record and the staging buffer are reused, so what an incomplete
+	// frame leaves unfilled would otherwise be an older frame's pixels
+	if (flags & RAW_FRAME_INCOMPLETE)
+		memset(pPayload, 0, static_cast<size_t>(m_header.payloadSize));
+
+	return pPayload;
+}
+
+void RawWriter::EndFrame(size_t sizeFilled)
+{
+	RawFrameHeader* pFrameHeader = reinterpret_cast<RawFrameHeader*>(m_pRecord);
+	pFrameHeader->sizeFilled = sizeFilled;
+
+	size_t recordSize = m_maxRecordSize;
+
+	if (m_pCodec)
+	{
+		const size_t codeSize = m_pCodec->Encode(m_payload.data(), static_cast<size_t>(m_header.planeStride), m_pRecord + RAW_FRAME_HEADER_SIZE);
+		recordSize = static_cast<size_t>(AlignUp(RAW_FRAME_HEADER_SIZE + codeSize, 8));
+
+		memset(m_pRecord + RAW_FRAME_HEADER_SIZE + codeSize, 0, recordSize - RAW_FRAME_HEADER_SIZE - codeSize);
+		pFrameHeader->recordSize = recordSize;
+
+		m_index.push_back(m_pFile->GetSize());
+	}
+	else
+	{
+		// the alignment padding goes to disk as zeros
+		memset(m_pRecord + RAW_FRAME_HEADER_SIZE + m_header.payloadSize, 0, static_cast<size_t>(m_header.frameStride - RAW_FRAME_HEADER_SIZE - m_header.payloadSize));
+	}
+
+	m_pFile->Commit(recordSize);
+	m_header.frameCount++;
+}
+
+void RawWriter::Close()
+{
+	m_open = false;
+
+	// the index of a lossless recording follows its last frame
+	if (m_pCodec && !m_index.empty())
+	{
+		m_header.indexOffset = m_pFile->GetSize();
+		m_pFile->Append(m_index.data(), m_index.size() * sizeof(uint64_t));
+	}
+
+	WriteHeader();
+	m_pFile->Close();
+}
+
+const RawFileHeader& RawWriter::GetHeader() const
+{
+	return m_header;
+}
+
+uint64_t RawWriter::GetPayloadSize() const
+{
+	return m_header.payloadSize;
+}
+
+uint64_t RawWriter::GetPlaneStride() const
+{
+	return m_header.planeStride;
+}
+
+uint64_t RawWriter::GetFrameCount() const
+{
+	return m_header.frameCount;
+}
+
+uint64_t RawWriter::GetFrameBytes() const
+{
+	return m_pFile ? m_pFile->GetSize() - m_header.headerSize : 0;
+}
+
+// rewrites the file header, padded to its full size, at the start of the file
+void RawWriter::WriteHeader()
+{
+	std::vector<uint8_t> block(m_header.headerSize, 0);
+	memcpy(block.data(), &m_header, sizeof(m_header));
+
+	m_pFile->WriteAt(0, block.data(), block.size());
+}
+
+namespace
+{
+	uint8_t TestPixel(uint64_t frame, size_t plane, size_t i)
+	{
+		return static_cast<uint8_t>(1 + (frame * 37 + plane * 11 + i) % 255);
+	}
+
+	bool VerifyRawRoundTrip(const char* name, RawCodec codec)
+	{
+		const size_t width = 37;
+		const size_t height = 11;
+		const size_t numFrames = 3;
+		const size_t incompleteFrame = 1;
+		const size_t filled = width * height / 2;
+
+#ifdef _WIN32
+		const std::string fileName = "lucid_selftest_" + std::to_string(_getpid()) + ".raw";
+#else
+		const std::string fileName = "lucid_selftest_" + std::to_string(getpid()) + ".raw";
+#endif
+
+		bool passed = true;
+
+		try
+		{
+			// (1) write full frames around an incomplete one, filled halfway
+			// (2) read them back, expecting zeros where nothing was filled
+			{
+				RawWriter writer(fileName, width, height, 0, RAW_LAYOUT_PLANAR, 4, 1, 8, 10.0, codec, 2, NULL);
+				writer.Open();
+
+				for (uint64_t frame = 0; frame < numFrames; frame++)
+				{
+					const bool incomplete = frame == incompleteFrame;
+					uint8_t* pPayload = writer.BeginFrame(1000 + frame, frame * 100, incomplete ? RAW_FRAME_INCOMPLETE : 0);
+
+					for (size_t plane = 0; plane < 4; plane++)
+					{
+						for (size_t i = 0; i < (incomplete ? filled : width * height); i++)
+							pPayload[plane * writer.GetPlaneStride() + i] = TestPixel(frame, plane, i);
+					}
+
+					writer.EndFrame(incomplete ? filled * 4 : width * height * 4);
+				}
+
+				writer.Close();
+			}
+
+			// (2)
+			{
+				RawReader reader(fileName);
+				passed = reader.GetFrameCount() == numFrames;
+
+				for (uint64_t frame = 0; passed && frame < numFrames; frame++)
+				{
+					const bool incomplete = frame == incompleteFrame;
+					passed = reader.GetFrameHeader(frame).frameId == 1000 + frame && (reader.GetFrameHeader(frame).flags & RAW_FRAME_INCOMPLETE) == (incomplete ? RAW_FRAME_INCOMPLETE : 0u);
+
+					for (size_t plane = 0; passed && plane < 4; plane++)
+					{
+						const RawPlaneView view = reader.GetPlane(frame, plane);
+
+						for (size_t i = 0; i < width * height; i++)
+						{
+							const uint8_t expected = incomplete && i >= filled ? 0 : TestPixel(frame, plane, i);
+							passed = passed && view.pData[(i / width) * view.rowStride + (i % width) * view.pixelStride] == expected;
+						}
+					}
+				}
+			}
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << TAB1 << "Raw recording " << name << " failed: " << ex.what() << "\n";
+			passed = false;
+		}
+
+		std::remove(fileName.c_str());
+
+		std::cout << TAB1 << "Raw recording " << name << (passed ? " round trips" : " does not round trip") << " an incomplete frame\n";
+
+		return passed;
+	}
+}
+
+bool VerifyRawWriter()
+{
+	bool passed = VerifyRawRoundTrip("planar", RAW_CODEC_NONE);
+	passed = VerifyRawRoundTrip("lossless", RAW_CODEC_LOSSLESS) && passed;
+	return passed;
+}
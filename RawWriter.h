@@ -0,0 +1,97 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#pragma once
+
+#include "FileWriter.h"
+#include "PlaneCodec.h"
+#include "RawFormat.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// RawWriter
+//    Writes a raw polarization recording (see RawFormat.h) through a
+//    FileWriter, so the disk never holds up the recorder. Each frame record
+//    is reserved in the writer's current buffer and filled in place:
+//    BeginFrame() returns where its payload goes and the demux writes the
+//    angle planes straight into the buffer that goes to disk. Lossless
+//    recordings are filled in a staging buffer instead and compressed slice
+//    by slice, on one thread per slice, into the record. Errors are reported
+//    as exceptions.
+class RawWriter
+{
+public:
+	// bytesPerPixel is per plane pixel: 1 for Mono8 planes, 2 for 12-bit
+	// planes, 4 for an interleaved PolarizedAngles_0d_45d_90d_135d_Mono8
+	// image; numPlanes is 1 for an interleaved image
+	//    RAW_CODEC_LOSSLESS compresses planar layouts in numSlices slices.
+	//    pStats, if not NULL, gets the latency of the disk writes.
+	RawWriter(const std::string& fileName, size_t width, size_t height, uint64_t pixelFormat, RawLayout layout, size_t numPlanes, size_t bytesPerPixel, size_t bitsPerSample, double fps, RawCodec codec, size_t numSlices, FrameStats* pStats);
+	~RawWriter();
+
+	void Open();
+
+	// reserves the next frame record and returns where its payload goes
+	//    The payload is GetPayloadSize() bytes; planes start GetPlaneStride()
+	//    bytes apart. The payload of a frame flagged RAW_FRAME_INCOMPLETE
+	//    starts zeroed, so whatever is left unfilled reads back as zeros.
+	uint8_t* BeginFrame(uint64_t frameId, uint64_t timestampNs, uint32_t flags);
+
+	// completes the frame started last
+	//    sizeFilled is the filled size of the captured image.
+	void EndFrame(size_t sizeFilled);
+
+	// writes the index of a lossless recording and the final header
+	void Close();
+
+	const RawFileHeader& GetHeader() const;
+
+	uint64_t GetPayloadSize() const;
+
+	uint64_t GetPlaneStride() const;
+
+	uint64_t GetFrameCount() const;
+
+	// bytes of frame records written so far
+	uint64_t GetFrameBytes() const;
+
+private:
+	RawWriter(const RawWriter&);
+	RawWriter& operator=(const RawWriter&);
+
+	void WriteHeader();
+
+	std::string m_fileName;
+	RawFileHeader m_header;
+	FrameStats* m_pStats;
+	std::unique_ptr<FileWriter> m_pFile;
+	size_t m_maxRecordSize;
+	uint8_t* m_pRecord;
+	bool m_open;
+
+	// lossless recordings only
+	std::unique_ptr<PlaneCodec> m_pCodec;
+	std::vector<uint8_t> m_payload;
+	std::vector<uint64_t> m_index;
+};
+
+// writes planar and lossless recordings with an incomplete frame among
+// full ones and reads them back
+//    Returns true if every frame reads back as written, with zeros where
+//    the incomplete frame was not filled.
+bool VerifyRawWriter();
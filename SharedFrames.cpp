@@ -0,0 +1,448 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+#include "SharedFrames.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+#define TAB1 "  "
+
+namespace
+{
+	const char* const planeNames[] = { "0", "45", "90", "135", "DoLP", "AoLP" };
+
+	uint64_t AlignUp(uint64_t value, uint64_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	void ThrowSharedError(const std::string& name, const char* what)
+	{
+		throw std::runtime_error("Shared frames " + name + ": could not " + what + ": " + strerror(errno));
+	}
+
+	// sleeps until the word no longer holds value, or for at most timeoutMs
+	//    Polls where there is no futex.
+	void WaitForChange(const std::atomic<uint32_t>& word, uint32_t value, int timeoutMs)
+	{
+#ifdef __linux__
+		struct timespec timeout;
+		timeout.tv_sec = timeoutMs / 1000;
+		timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+
+		syscall(SYS_futex, reinterpret_cast<const uint32_t*>(&word), FUTEX_WAIT, value, &timeout, NULL, 0);
+#else
+		if (word.load(std::memory_order_acquire) == value)
+			std::this_thread::sleep_for(std::chrono::milliseconds(std::min(timeoutMs, 1)));
+#endif
+	}
+
+	void WakeAll(std::atomic<uint32_t>& word)
+	{
+#ifdef __linux__
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#else
+		(void)word;
+#endif
+	}
+}
+
+const char* GetSharedPlaneName(SharedPlaneKind kind)
+{
+	return planeNames[kind];
+}
+
+SharedFramePublisher::SharedFramePublisher(const std::string& name, size_t width, size_t height, const std::vector<SharedPlaneKind>& planeKinds, size_t bytesPerSample, size_t bitsPerSample, uint64_t pixelFormat, double fps, size_t numSlots)
+	: m_name(name)
+	, m_layout()
+	, m_pMapping(NULL)
+	, m_mappingSize(0)
+	, m_pSlot(NULL)
+	, m_sequence(0)
+{
+	if (name.size() < 2 || name[0] != '/' || name.find('/', 1) != std::string::npos)
+		throw std::invalid_argument("Shared memory names are a slash and a name without slashes, not " + name);
+
+	if (planeKinds.empty() || planeKinds.size() > SHARED_FRAMES_MAX_PLANES)
+		throw std::invalid_argument("Shared frames take 1 to " + std::to_string(SHARED_FRAMES_MAX_PLANES) + " planes");
+
+	m_layout.version = SHARED_FRAMES_VERSION;
+	m_layout.headerSize = SHARED_FRAMES_HEADER_SIZE;
+	m_layout.width = static_cast<uint32_t>(width);
+	m_layout.height = static_cast<uint32_t>(height);
+	m_layout.pixelFormat = pixelFormat;
+	m_layout.numPlanes = static_cast<uint32_t>(planeKinds.size());
+	m_layout.bytesPerSample = static_cast<uint32_t>(bytesPerSample);
+	m_layout.bitsPerSample = static_cast<uint32_t>(bitsPerSample);
+	m_layout.numSlots = static_cast<uint32_t>(std::max<size_t>(numSlots, 2));
+	m_layout.planeStride = AlignUp(static_cast<uint64_t>(width) * height * bytesPerSample, 64);
+	m_layout.slotStride = AlignUp(SHARED_FRAME_HEADER_SIZE + m_layout.planeStride * m_layout.numPlanes, 4096);
+	m_layout.fps = fps;
+
+	for (size_t plane = 0; plane < planeKinds.size(); plane++)
+		m_layout.planeKinds[plane] = planeKinds[plane];
+
+	m_mappingSize = static_cast<size_t>(m_layout.headerSize + m_layout.numSlots * m_layout.slotStride);
+}
+
+SharedFramePublisher::~SharedFramePublisher()
+{
+	try
+	{
+		Close();
+	}
+	catch (...)
+	{
+		// nothing sensible left to do with an error while unwinding
+	}
+}
+
+// (1) creates the object, after removing a stale one of the same name
+// (2) sizes and maps it; the new pages are zero, so every slot is empty
+// (3) fills in the header, the magic last, so a reader never sees half
+void SharedFramePublisher::Open()
+{
+#ifdef _WIN32
+	throw std::runtime_error("Shared frames need POSIX shared memory");
+#else
+	// (1)
+	shm_unlink(m_name.c_str());
+
+	const int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0)
+		ThrowSharedError(m_name, "create shared memory");
+
+	// (2)
+	if (ftruncate(fd, static_cast<off_t>(m_mappingSize)) != 0)
+	{
+		::close(fd);
+		shm_unlink(m_name.c_str());
+		ThrowSharedError(m_name, "size shared memory");
+	}
+
+	void* pMapping = mmap(NULL, m_mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (pMapping == MAP_FAILED)
+	{
+		shm_unlink(m_name.c_str());
+		ThrowSharedError(m_name, "map shared memory");
+	}
+
+	m_pMapping = static_cast<uint8_t*>(pMapping);
+
+	// (3)
+	SharedFramesHeader* pHeader = reinterpret_cast<SharedFramesHeader*>(m_pMapping);
+	const size_t fieldsSize = offsetof(SharedFramesHeader, planeKinds) + sizeof(pHeader->planeKinds);
+
+	memcpy(static_cast<void*>(pHeader), &m_layout, fieldsSize);
+	pHeader->writerPid = static_cast<uint32_t>(getpid());
+
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(pHeader->magic, SHARED_FRAMES_MAGIC, sizeof(pHeader->magic));
+#endif
+}
+
+void SharedFramePublisher::BeginFrame(uint64_t frameId, uint64_t timestampNs, uint32_t flags)
+{
+	const uint64_t slot = m_sequence % m_layout.numSlots;
+	m_pSlot = reinterpret_cast<SharedFrameHeader*>(m_pMapping + m_layout.headerSize + slot * m_layout.slotStride);
+
+	// readers still on the frame this overwrites see an odd version from
+	// here on
+	m_pSlot->version.store(2 * m_sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	m_pSlot->frameId = frameId;
+	m_pSlot->timestampNs = timestampNs;
+	m_pSlot->flags = flags;
+}
+
+uint8_t* SharedFramePublisher::GetPlane(size_t plane)
+{
+	return reinterpret_cast<uint8_t*>(m_pSlot) + SHARED_FRAME_HEADER_SIZE + plane * m_layout.planeStride;
+}
+
+void SharedFramePublisher::EndFrame()
+{
+	SharedFramesHeader* pHeader = reinterpret_cast<SharedFramesHeader*>(m_pMapping);
+
+	m_pSlot->version.store(2 * m_sequence + 2, std::memory_order_release);
+	m_sequence++;
+
+	pHeader->published.store(m_sequence, std::memory_order_release);
+	pHeader->futex.fetch_add(1, std::memory_order_release);
+	WakeAll(pHeader->futex);
+}
+
+void SharedFramePublisher::Close()
+{
+#ifndef _WIN32
+	if (m_pMapping == NULL)
+		return;
+
+	SharedFramesHeader* pHeader = reinterpret_cast<SharedFramesHeader*>(m_pMapping);
+
+	pHeader->closed.store(1, std::memory_order_release);
+	pHeader->futex.fetch_add(1, std::memory_order_release);
+	WakeAll(pHeader->futex);
+
+	munmap(m_pMapping, m_mappingSize);
+	m_pMapping = NULL;
+	m_pSlot = NULL;
+
+	shm_unlink(m_name.c_str());
+#endif
+}
+
+const std::string& SharedFramePublisher::GetName() const
+{
+	return m_name;
+}
+
+const SharedFramesHeader& SharedFramePublisher::GetHeader() const
+{
+	return m_layout;
+}
+
+// maps the ring read only and checks its header
+SharedFrameReader::SharedFrameReader(const std::string& name)
+	: m_name(name)
+	, m_pMapping(NULL)
+	, m_mappingSize(0)
+	, m_pHeader(NULL)
+{
+#ifdef _WIN32
+	throw std::runtime_error("Shared frames need POSIX shared memory");
+#else
+	const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		ThrowSharedError(name, "open shared memory");
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < SHARED_FRAMES_HEADER_SIZE)
+	{
+		::close(fd);
+		throw std::runtime_error("Shared frames " + name + ": not a frame ring");
+	}
+
+	m_mappingSize = static_cast<size_t>(info.st_size);
+
+	void* pMapping = mmap(NULL, m_mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if (pMapping == MAP_FAILED)
+		ThrowSharedError(name, "map shared memory");
+
+	m_pMapping = static_cast<const uint8_t*>(pMapping);
+	m_pHeader = reinterpret_cast<const SharedFramesHeader*>(m_pMapping);
+
+	const bool valid = memcmp(m_pHeader->magic, SHARED_FRAMES_MAGIC, sizeof(m_pHeader->magic)) == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	std::string problem;
+	if (!valid)
+		problem = "not a frame ring, or its writer is still starting";
+	else if (m_pHeader->version != SHARED_FRAMES_VERSION)
+		problem = "version " + std::to_string(m_pHeader->version) + " is not supported";
+	else if (m_pHeader->numPlanes == 0 || m_pHeader->numPlanes > SHARED_FRAMES_MAX_PLANES || m_pHeader->numSlots == 0
+			|| m_pHeader->headerSize + static_cast<uint64_t>(m_pHeader->numSlots) * m_pHeader->slotStride > m_mappingSize)
+		problem = "inconsistent header";
+
+	if (!problem.empty())
+	{
+		munmap(const_cast<uint8_t*>(m_pMapping), m_mappingSize);
+		throw std::runtime_error("Shared frames " + name + ": " + problem);
+	}
+#endif
+}
+
+SharedFrameReader::~SharedFrameReader()
+{
+#ifndef _WIN32
+	if (m_pMapping != NULL)
+		munmap(const_cast<uint8_t*>(m_pMapping), m_mappingSize);
+#endif
+}
+
+const SharedFramesHeader& SharedFrameReader::GetHeader() const
+{
+	return *m_pHeader;
+}
+
+uint64_t SharedFrameReader::GetPublished() const
+{
+	return m_pHeader->published.load(std::memory_order_acquire);
+}
+
+bool SharedFrameReader::IsClosed() const
+{
+	return m_pHeader->closed.load(std::memory_order_acquire) != 0;
+}
+
+bool SharedFrameReader::Wait(uint64_t sequence, int timeoutMs) const
+{
+	// the word is read before the count, so a frame published in between
+	// changes it and the wait returns at once
+	const uint32_t word = m_pHeader->futex.load(std::memory_order_acquire);
+
+	if (GetPublished() > sequence)
+		return true;
+
+	if (IsClosed())
+		return false;
+
+	WaitForChange(m_pHeader->futex, word, timeoutMs);
+
+	return GetPublished() > sequence;
+}
+
+bool SharedFrameReader::Get(uint64_t sequence, SharedFrameView& view) const
+{
+	const SharedFrameHeader* pSlot = GetSlot(sequence);
+	const uint64_t version = pSlot->version.load(std::memory_order_acquire);
+
+	if (version != 2 * sequence + 2)
+		return false;
+
+	view.sequence = sequence;
+	view.version = version;
+	view.frameId = pSlot->frameId;
+	view.timestampNs = pSlot->timestampNs;
+	view.flags = pSlot->flags;
+
+	for (size_t plane = 0; plane < SHARED_FRAMES_MAX_PLANES; plane++)
+		view.pPlanes[plane] = plane < m_pHeader->numPlanes ? reinterpret_cast<const uint8_t*>(pSlot) + SHARED_FRAME_HEADER_SIZE + plane * m_pHeader->planeStride : NULL;
+
+	// the header fields may already be the next frame's
+	return IsIntact(view);
+}
+
+bool SharedFrameReader::IsIntact(const SharedFrameView& view) const
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	return GetSlot(view.sequence)->version.load(std::memory_order_relaxed) == view.version;
+}
+
+const SharedFrameHeader* SharedFrameReader::GetSlot(uint64_t sequence) const
+{
+	return reinterpret_cast<const SharedFrameHeader*>(m_pMapping + m_pHeader->headerSize + (sequence % m_pHeader->numSlots) * m_pHeader->slotStride);
+}
+
+bool VerifySharedFrames()
+{
+#ifdef _WIN32
+	std::cout << TAB1 << "Shared frames need POSIX shared memory, not checked\n";
+	return true;
+#else
+	const size_t width = 37;
+	const size_t height = 11;
+	const size_t numSlots = 4;
+	const std::string name = "/lucid_selftest_" + std::to_string(getpid());
+
+	std::vector<SharedPlaneKind> planeKinds;
+	planeKinds.push_back(SHARED_PLANE_ANGLE_0);
+	planeKinds.push_back(SHARED_PLANE_DOLP);
+
+	std::vector<uint8_t> expected(width * height * 2);
+
+	try
+	{
+		SharedFramePublisher publisher(name, width, height, planeKinds, 2, 12, 0, 10.0, numSlots);
+		publisher.Open();
+
+		SharedFrameReader reader(name);
+		bool passed = reader.GetHeader().numPlanes == 2 && reader.GetHeader().bytesPerSample == 2 && reader.GetPublished() == 0;
+
+		SharedFrameView view;
+		passed = passed && !reader.Get(0, view) && !reader.Wait(0, 1);
+
+		// (1) every frame reads back while it is the newest
+		// (2) a frame held across numSlots more is reported overwritten
+		SharedFrameView held = SharedFrameView();
+
+		for (uint64_t sequence = 0; sequence < 3 * numSlots; sequence++)
+		{
+			publisher.BeginFrame(1000 + sequence, sequence * 100, 0);
+
+			for (size_t plane = 0; plane < planeKinds.size(); plane++)
+			{
+				uint16_t* pPlane = reinterpret_cast<uint16_t*>(publisher.GetPlane(plane));
+
+				for (size_t i = 0; i < width * height; i++)
+					pPlane[i] = static_cast<uint16_t>((sequence * 131 + plane * 17 + i) & 0xFFF);
+			}
+
+			// a frame being written is not readable
+			passed = passed && !reader.Get(sequence, view);
+
+			publisher.EndFrame();
+
+			// (1)
+			passed = passed && reader.Wait(sequence, 0) && reader.Get(sequence, view) && view.frameId == 1000 + sequence;
+
+			for (size_t plane = 0; passed && plane < planeKinds.size(); plane++)
+			{
+				const uint16_t* pPlane = reinterpret_cast<const uint16_t*>(view.pPlanes[plane]);
+
+				for (size_t i = 0; i < width * height; i++)
+					passed = passed && pPlane[i] == ((sequence * 131 + plane * 17 + i) & 0xFFF);
+			}
+
+			passed = passed && reader.IsIntact(view);
+
+			// (2)
+			if (sequence == 1)
+				held = view;
+			else if (sequence == 1 + numSlots)
+				passed = passed && !reader.IsIntact(held) && !reader.Get(1, view);
+		}
+
+		passed = passed && reader.GetPublished() == 3 * numSlots && !reader.IsClosed();
+
+		publisher.Close();
+		passed = passed && reader.IsClosed() && !reader.Wait(3 * numSlots, 1000);
+
+		std::cout << TAB1 << (passed ? "Shared frames read back intact and report overwritten frames\n" : "Shared frames do not read back correctly\n");
+		return passed;
+	}
+	catch (std::exception& ex)
+	{
+		shm_unlink(name.c_str());
+		std::cout << TAB1 << "Shared frames could not be checked: " << ex.what() << "\n";
+		return false;
+	}
+#endif
+}
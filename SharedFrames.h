@@ -0,0 +1,235 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Shared memory frames
+//    A ring of the latest frames in POSIX shared memory, which the recorder
+//    publishes and other processes on the host read in place, without
+//    decoding a video or copying a frame. There is one writer and any number
+//    of readers, none of which take a lock: the writer never waits for a
+//    reader, and a reader that falls more than the ring behind skips ahead.
+//
+//    offset 0                       SharedFramesHeader, padded to headerSize
+//    headerSize + s * slotStride    SharedFrameHeader of slot s
+//                 + SHARED_FRAME_HEADER_SIZE
+//                                   planes of slot s, planeStride apart
+//
+//    Frame n goes to slot n % numSlots. Each slot's version is a sequence
+//    lock: it is 2n + 1 while frame n is written and 2n + 2 once it is
+//    complete. A reader of frame n checks for 2n + 2 before reading a plane
+//    and again afterwards; if the version changed, the writer has started
+//    to overwrite the slot and what was read is torn. published counts the
+//    frames completed so far, and futex is bumped with every frame, so Linux
+//    readers can sleep on it instead of polling.
+//
+//    Planes are angle planes at 0, 45, 90 and 135 degrees and, when they are
+//    computed, DoLP and AoLP, in the order of planeKinds. Samples are 8 or
+//    16-bit; 12-bit data is in the low bits of each 16-bit sample. All
+//    fields are in host byte order, and the 64-bit counters are read and
+//    written atomically.
+
+#define SHARED_FRAMES_MAGIC "LUCIDSHM"
+#define SHARED_FRAMES_VERSION 1
+
+#define SHARED_FRAMES_HEADER_SIZE 4096
+#define SHARED_FRAME_HEADER_SIZE 64
+#define SHARED_FRAMES_MAX_PLANES 8
+
+enum SharedPlaneKind
+{
+	SHARED_PLANE_ANGLE_0 = 0,
+	SHARED_PLANE_ANGLE_45 = 1,
+	SHARED_PLANE_ANGLE_90 = 2,
+	SHARED_PLANE_ANGLE_135 = 3,
+	SHARED_PLANE_DOLP = 4,
+	SHARED_PLANE_AOLP = 5
+};
+
+const char* GetSharedPlaneName(SharedPlaneKind kind);
+
+// frame flags
+#define SHARED_FRAME_INCOMPLETE 0x1u
+
+struct SharedFramesHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+
+	uint32_t width;
+	uint32_t height;
+
+	// PFNC pixel format of the captured image
+	uint64_t pixelFormat;
+
+	uint32_t numPlanes;
+
+	// 1 or 2, and the significant low bits of each sample, 8 or 12
+	uint32_t bytesPerSample;
+	uint32_t bitsPerSample;
+
+	uint32_t numSlots;
+
+	// bytes from one plane to the next, and from one slot to the next
+	uint64_t planeStride;
+	uint64_t slotStride;
+
+	double fps;
+
+	// SharedPlaneKind of each plane
+	uint32_t planeKinds[SHARED_FRAMES_MAX_PLANES];
+
+	// process ID of the writer
+	uint32_t writerPid;
+
+	// non-zero once the writer has stopped publishing
+	std::atomic<uint32_t> closed;
+
+	// frames completed so far
+	std::atomic<uint64_t> published;
+
+	// bumped with every frame
+	std::atomic<uint32_t> futex;
+
+	uint8_t reserved[36];
+};
+
+struct SharedFrameHeader
+{
+	// 2n + 1 while frame n is written, 2n + 2 once it is complete
+	std::atomic<uint64_t> version;
+
+	// frame ID and timestamp reported by the camera
+	uint64_t frameId;
+	uint64_t timestampNs;
+
+	// SHARED_FRAME_ flags
+	uint32_t flags;
+
+	uint8_t reserved[36];
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == 8 && sizeof(std::atomic<uint32_t>) == 4, "Shared counters must be plain words");
+static_assert(sizeof(SharedFramesHeader) == 160, "SharedFramesHeader layout changed");
+static_assert(sizeof(SharedFrameHeader) == SHARED_FRAME_HEADER_SIZE, "SharedFrameHeader layout changed");
+
+// SharedFramePublisher
+//    Creates the ring and publishes frames into it. A frame is filled in
+//    place: BeginFrame() claims the next slot, its planes are written through
+//    GetPlane() and EndFrame() makes it visible. The ring is removed when the
+//    publisher closes; readers that still have it open keep their mapping
+//    and see it closed. Needs POSIX shared memory. Errors are reported as
+//    exceptions.
+class SharedFramePublisher
+{
+public:
+	// name is a shared memory object name such as "/polar"
+	//    bytesPerSample is 1 or 2; planeKinds lists what each plane holds.
+	SharedFramePublisher(const std::string& name, size_t width, size_t height, const std::vector<SharedPlaneKind>& planeKinds, size_t bytesPerSample, size_t bitsPerSample, uint64_t pixelFormat, double fps, size_t numSlots);
+	~SharedFramePublisher();
+
+	// creates the ring, replacing one left behind by a writer that died
+	void Open();
+
+	void BeginFrame(uint64_t frameId, uint64_t timestampNs, uint32_t flags);
+
+	// where plane of the frame begun last goes, width * height samples
+	uint8_t* GetPlane(size_t plane);
+
+	// completes the frame begun last and wakes the readers waiting for it
+	void EndFrame();
+
+	// marks the ring closed and removes it
+	void Close();
+
+	const std::string& GetName() const;
+
+	const SharedFramesHeader& GetHeader() const;
+
+private:
+	SharedFramePublisher(const SharedFramePublisher&);
+	SharedFramePublisher& operator=(const SharedFramePublisher&);
+
+	std::string m_name;
+	SharedFramesHeader m_layout;
+	uint8_t* m_pMapping;
+	size_t m_mappingSize;
+	SharedFrameHeader* m_pSlot;
+	uint64_t m_sequence;
+};
+
+// a frame as it is in the ring
+struct SharedFrameView
+{
+	uint64_t sequence;
+	uint64_t version;
+	uint64_t frameId;
+	uint64_t timestampNs;
+	uint32_t flags;
+	const uint8_t* pPlanes[SHARED_FRAMES_MAX_PLANES];
+};
+
+// SharedFrameReader
+//    Opens a ring another process publishes and reads its frames in place.
+//    The mapping is read only, so a reader cannot disturb the writer or the
+//    other readers. Errors are reported as exceptions.
+class SharedFrameReader
+{
+public:
+	explicit SharedFrameReader(const std::string& name);
+	~SharedFrameReader();
+
+	const SharedFramesHeader& GetHeader() const;
+
+	// frames published so far; the newest is GetPublished() - 1
+	uint64_t GetPublished() const;
+
+	bool IsClosed() const;
+
+	// waits up to timeoutMs for frame sequence to be published
+	//    Returns false on a timeout or once the ring is closed.
+	bool Wait(uint64_t sequence, int timeoutMs) const;
+
+	// points view at frame sequence if it is in the ring
+	//    Returns false if it is not published yet or was overwritten.
+	bool Get(uint64_t sequence, SharedFrameView& view) const;
+
+	// true if the view's frame is still in its slot, so everything read
+	// from its planes up to now is intact
+	bool IsIntact(const SharedFrameView& view) const;
+
+private:
+	SharedFrameReader(const SharedFrameReader&);
+	SharedFrameReader& operator=(const SharedFrameReader&);
+
+	const SharedFrameHeader* GetSlot(uint64_t sequence) const;
+
+	std::string m_name;
+	const uint8_t* m_pMapping;
+	size_t m_mappingSize;
+	const SharedFramesHeader* m_pHeader;
+};
+
+// publishes and reads back frames through a ring in this process,
+// overwriting some, and prints the outcome
+//    Returns true if every frame read back intact and overwritten frames
+//    were reported as such.
+bool VerifySharedFrames();
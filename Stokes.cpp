@@ -0,0 +1,663 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#include "stdafx.h"
+#include "Stokes.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#if defined(CPU_X86_SSE2)
+#include <emmintrin.h>
+#endif
+#if defined(CPU_X86)
+#include <immintrin.h>
+#endif
+#if defined(CPU_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+#define STOKES_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define TAB1 "  "
+
+// AoLP from the S1 and S2 planes already written for pixels [begin, end)
+static void AolpFromStokes(const StokesOutput& out, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++)
+		out.pAolp[i] = 0.5f * std::atan2(out.pS2[i], out.pS1[i]);
+}
+
+// half of atan2(y, x) by the polynomial of STOKES_FAST_AOLP_MAX_ERROR
+//    The ratio of the smaller to the larger magnitude lies in [0, 1], where
+//    the polynomial holds; the octant is restored from the magnitudes' order
+//    and the signs.
+static inline float FastAolp(float y, float x)
+{
+	float ax = std::fabs(x);
+	float ay = std::fabs(y);
+	float larger = std::max(ax, ay);
+	float a = larger > 0.0f ? std::min(ax, ay) / larger : 0.0f;
+	float a2 = a * a;
+
+	float r = a * (0.9998660f + a2 * (-0.3302995f + a2 * (0.1801410f + a2 * (-0.0851330f + a2 * 0.0208351f))));
+
+	if (ay > ax)
+		r = 1.57079633f - r;
+	if (x < 0.0f)
+		r = 3.14159265f - r;
+	if (y < 0.0f)
+		r = -r;
+
+	return 0.5f * r;
+}
+
+// one pixel at a time, with AoLP exact or by polynomial
+template <bool fastAolp>
+static void StokesScalarT(const StokesInput& in, const StokesOutput& out, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++)
+	{
+		float i0 = in.pAngle[0][i];
+		float i45 = in.pAngle[1][i];
+		float i90 = in.pAngle[2][i];
+		float i135 = in.pAngle[3][i];
+
+		float s0 = (i0 + i45 + i90 + i135) * 0.5f;
+		float s1 = i0 - i90;
+		float s2 = i45 - i135;
+
+		out.pS0[i] = s0;
+		out.pS1[i] = s1;
+		out.pS2[i] = s2;
+		out.pDolp[i] = s0 > 0.0f ? std::min(std::sqrt(s1 * s1 + s2 * s2) / s0, 1.0f) : 0.0f;
+
+		if (fastAolp)
+			out.pAolp[i] = FastAolp(s2, s1);
+	}
+
+	if (!fastAolp)
+		AolpFromStokes(out, begin, end);
+}
+
+void StokesScalar(const StokesInput& in, const StokesOutput& out, size_t begin, size_t end)
+{
+	StokesScalarT<false>(in, out, begin, end);
+}
+
+void StokesFastScalar(const StokesInput& in, const StokesOutput& out, size_t begin, size_t end)
+{
+	StokesScalarT<true>(in, out, begin, end);
+}
+
+#if defined(CPU_X86_SSE2)
+// selects a where mask is set, b elsewhere
+static inline __m128 SelectSse2(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// FastAolp() of four pixels
+static inline __m128 FastAolpSse2(__m128 y, __m128 x)
+{
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	__m128 ax = _mm_andnot_ps(signBit, x);
+	__m128 ay = _mm_andnot_ps(signBit, y);
+	__m128 larger = _mm_max_ps(ax, ay);
+	__m128 a = _mm_and_ps(_mm_div_ps(_mm_min_ps(ax, ay), larger), _mm_cmpgt_ps(larger, zero));
+	__m128 a2 = _mm_mul_ps(a, a);
+
+	__m128 r = _mm_add_ps(_mm_set1_ps(-0.0851330f), _mm_mul_ps(a2, _mm_set1_ps(0.0208351f)));
+	r = _mm_add_ps(_mm_set1_ps(0.1801410f), _mm_mul_ps(a2, r));
+	r = _mm_add_ps(_mm_set1_ps(-0.3302995f), _mm_mul_ps(a2, r));
+	r = _mm_add_ps(_mm_set1_ps(0.9998660f), _mm_mul_ps(a2, r));
+	r = _mm_mul_ps(a, r);
+
+	r = SelectSse2(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(1.57079633f), r), r);
+	r = SelectSse2(_mm_cmplt_ps(x, zero), _mm_sub_ps(_mm_set1_ps(3.14159265f), r), r);
+	r = _mm_xor_ps(r, _mm_and_ps(signBit, y));
+
+	return _mm_mul_ps(r, _mm_set1_ps(0.5f));
+}
+
+// S0, S1, S2, DoLP and optionally AoLP of four pixels
+template <bool fastAolp>
+static inline void Stokes4Sse2(__m128 i0, __m128 i45, __m128 i90, __m128 i135, const StokesOutput& out, size_t i)
+{
+	const __m128 zero = _mm_setzero_ps();
+
+	__m128 s0 = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_add_ps(i0, i45), i90), i135), _mm_set1_ps(0.5f));
+	__m128 s1 = _mm_sub_ps(i0, i90);
+	__m128 s2 = _mm_sub_ps(i45, i135);
+
+	// lanes where S0 is 0 divide by zero and are masked to 0 afterwards
+	__m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(s1, s1), _mm_mul_ps(s2, s2)));
+	__m128 dolp = _mm_min_ps(_mm_div_ps(magnitude, s0), _mm_set1_ps(1.0f));
+	dolp = _mm_and_ps(dolp, _mm_cmpgt_ps(s0, zero));
+
+	_mm_storeu_ps(out.pS0 + i, s0);
+	_mm_storeu_ps(out.pS1 + i, s1);
+	_mm_storeu_ps(out.pS2 + i, s2);
+	_mm_storeu_ps(out.pDolp + i, dolp);
+
+	if (fastAolp)
+		_mm_storeu_ps(out.pAolp + i, FastAolpSse2(s2, s1));
+}
+
+// widens 16 bytes to four registers of four floats
+static inline void Widen16Sse2(const uint8_t* pSrc, __m128 out[4])
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc));
+	__m128i lo = _mm_unpacklo_epi8(v, zero);
+	__m128i hi = _mm_unpackhi_epi8(v, zero);
+
+	out[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+	out[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+	out[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+	out[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+}
+
+// 16 pixels per iteration
+template <bool fastAolp>
+static void StokesSse2(const StokesInput& in, const StokesOutput& out, size_t begin, size_t end)
+{
+	size_t i = begin;
+
+	for (; i + 16 <= end; i += 16)
+	{
+		__m128 angles[4][4];
+		for (int angle = 0; angle < 4; angle++)
+			Widen16Sse2(in.pAngle[angle] + i, angles[angle]);
+
+		for (int group = 0; group < 4; group++)
+			Stokes4Sse2<fastAolp>(angles[0][group], angles[1][group], angles[2][group], angles[3][group], out, i + 4 * group);
+	}
+
+	StokesScalarT<fastAolp>(in, out, i, end);
+
+	if (!fastAolp)
+		AolpFromStokes(out, begin, i);
+}
+#endif
+
+#if defined(CPU_X86)
+// widens 8 bytes to eight floats
+TARGET_AVX2 static inline __m256 Widen8Avx2(const uint8_t* pSrc)
+{
+	return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pSrc))));
+}
+
+// FastAolp() of eight pixels
+TARGET_AVX2 static inline __m256 FastAolpAvx2(__m256 y, __m256 x)
+{
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	__m256 ax = _mm256_andnot_ps(signBit, x);
+	__m256 ay = _mm256_andnot_ps(signBit, y);
+	__m256 larger = _mm256_max_ps(ax, ay);
+	__m256 a = _mm256_and_ps(_mm256_div_ps(_mm256_min_ps(ax, ay), larger), _mm256_cmp_ps(larger, zero, _CMP_GT_OQ));
+	__m256 a2 = _mm256_mul_ps(a, a);
+
+	__m256 r = _mm256_add_ps(_mm256_set1_ps(-0.0851330f), _mm256_mul_ps(a2, _mm256_set1_ps(0.0208351f)));
+	r = _mm256_add_ps(_mm256_set1_ps(0.1801410f), _mm256_mul_ps(a2, r));
+	r = _mm256_add_ps(_mm256_set1_ps(-0.3302995f), _mm256_mul_ps(a2, r));
+	r = _mm256_add_ps(_mm256_set1_ps(0.9998660f), _mm256_mul_ps(a2, r));
+	r = _mm256_mul_ps(a, r);
+
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(1.57079633f), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(3.14159265f), r), _mm256_cmp_ps(x, zero, _CMP_LT_OQ));
+	r = _mm256_xor_ps(r, _mm256_and_ps(signBit, y));
+
+	return _mm256_mul_ps(r, _mm256_set1_ps(0.5f));
+}
+
+// 8 pixels per iteration
+template <bool fastAolp>
+TARGET_AVX2 static void StokesAvx2(const StokesInput& in, const StokesOutput& out, size_t begin, size_t end)
+{
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 zero = _mm256_setzero_ps();
+
+	size_t i = begin;
+
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 i0 = Widen8Avx2(in.pAngle[0] + i);
+		__m256 i45 = Widen8Avx2(in.pAngle[1] + i);
+		__m256 i90 = Widen8Avx2(in.pAngle[2] + i);
+		__m256 i135 = Widen8Avx2(in.pAngle[3] + i);
+
+		__m256 s0 = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(i0, i45), i90), i135), half);
+		__m256 s1 = _mm256_sub_ps(i0, i90);
+		__m256 s2 = _mm256_sub_ps(i45, i135);
+
+		// separate multiply and add, as in the scalar kernel
+		__m256 magnitude = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(s1, s1), _mm256_mul_ps(s2, s2)));
+		__m256 dolp = _mm256_min_ps(_mm256_div_ps(magnitude, s0), one);
+		dolp = _mm256_and_ps(dolp, _mm256_cmp_ps(s0, zero, _CMP_GT_OQ));
+
+		_mm256_storeu_ps(out.pS0 + i, s0);
+		_mm256_storeu_ps(out.pS1 + i, s1);
+		_mm256_storeu_ps(out.pS2 + i, s2);
+		_mm256_storeu_ps(out.pDolp + i, dolp);
+
+		if (fastAolp)
+			_mm256_storeu_ps(out.pAolp + i, FastAolpAvx2(s2, s1));
+	}
+
+	StokesScalarT<fastAolp>(in, out, i, end);
+
+	if (!fastAolp)
+		AolpFromStokes(out, begin, i);
+}
+#endif
+
+#if defined(STOKES_NEON)
+// FastAolp() of four pixels
+static inline float32x4_t FastAolpNeon(float32x4_t y, float32x4_t x)
+{
+	const float32x4_t zero = vdupq_n_f32(0.0f);
+
+	float32x4_t ax = vabsq_f32(x);
+	float32x4_t ay = vabsq_f32(y);
+	float32x4_t larger = vmaxq_f32(ax, ay);
+	float32x4_t a = vbslq_f32(vcgtq_f32(larger, zero), vdivq_f32(vminq_f32(ax, ay), larger), zero);
+	float32x4_t a2 = vmulq_f32(a, a);
+
+	float32x4_t r = vaddq_f32(vdupq_n_f32(-0.0851330f), vmulq_f32(a2, vdupq_n_f32(0.0208351f)));
+	r = vaddq_f32(vdupq_n_f32(0.1801410f), vmulq_f32(a2, r));
+	r = vaddq_f32(vdupq_n_f32(-0.3302995f), vmulq_f32(a2, r));
+	r = vaddq_f32(vdupq_n_f32(0.9998660f), vmulq_f32(a2, r));
+	r = vmulq_f32(a, r);
+
+	r = vbslq_f32(vcgtq_f32(ay, ax), vsubq_f32(vdupq_n_f32(1.57079633f), r), r);
+	r = vbslq_f32(vcltq_f32(x, zero), vsubq_f32(vdupq_n_f32(3.14159265f), r), r);
+	r = vbslq_f32(vcltq_f32(y, zero), vnegq_f32(r), r);
+
+	return vmulq_f32(r, vdupq_n_f32(0.5f));
+}
+
+// 16 pixels per iteration, AArch64 only for the vector divide and square root
+template <bool fastAolp>
+static void StokesNeon(const StokesInput& in, const StokesOutput& out, size_t begin, size_t end)
+{
+	const float32x4_t half = vdupq_n_f32(0.5f);
+	const float32x4_t one = vdupq_n_f32(1.0f);
+	const float32x4_t zero = vdupq_n_f32(0.0f);
+
+	size_t i = begin;
+
+	for (; i + 16 <= end; i += 16)
+	{
+		float32x4_t angles[4][4];
+		for (int angle = 0; angle < 4; angle++)
+		{
+			uint8x16_t v = vld1q_u8(in.pAngle[angle] + i);
+			uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+			uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+
+			angles[angle][0] = vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo)));
+			angles[angle][1] = vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo)));
+			angles[angle][2] = vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi)));
+			angles[angle][3] = vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi)));
+		}
+
+		for (int group = 0; group < 4; group++)
+		{
+			size_t j = i + 4 * group;
+
+			float32x4_t s0 = vmulq_f32(vaddq_f32(vaddq_f32(vaddq_f32(angles[0][group], angles[1][group]), angles[2][group]), angles[3][group]), half);
+			float32x4_t s1 = vsubq_f32(angles[0][group], angles[2][group]);
+			float32x4_t s2 = vsubq_f32(angles[1][group], angles[3][group]);
+
+			float32x4_t magnitude = vsqrtq_f32(vaddq_f32(vmulq_f32(s1, s1), vmulq_f32(s2, s2)));
+			float32x4_t dolp = vbslq_f32(vcgtq_f32(s0, zero), vminq_f32(vdivq_f32(magnitude, s0), one), zero);
+
+			vst1q_f32(out.pS0 + j, s0);
+			vst1q_f32(out.pS1 + j, s1);
+			vst1q_f32(out.pS2 + j, s2);
+			vst1q_f32(out.pDolp + j, dolp);
+
+			if (fastAolp)
+				vst1q_f32(out.pAolp + j, FastAolpNeon(s2, s1));
+		}
+	}
+
+	StokesScalarT<fastAolp>(in, out, i, end);
+
+	if (!fastAolp)
+		AolpFromStokes(out, begin, i);
+}
+#endif
+
+// kernels of one AoLP mode usable on this CPU, fastest last
+template <bool fastAolp>
+static std::vector<StokesKernel> GetStokesKernelsT()
+{
+	std::vector<StokesKernel> kernels;
+
+	StokesKernel scalar = { "scalar", StokesScalarT<fastAolp> };
+	kernels.push_back(scalar);
+
+#if defined(CPU_X86_SSE2)
+	StokesKernel sse2 = { "sse2", StokesSse2<fastAolp> };
+	kernels.push_back(sse2);
+#endif
+
+#if defined(CPU_X86)
+	if (CpuHasAvx2())
+	{
+		StokesKernel avx2 = { "avx2", StokesAvx2<fastAolp> };
+		kernels.push_back(avx2);
+	}
+#endif
+
+#if defined(STOKES_NEON)
+	StokesKernel neon = { "neon", StokesNeon<fastAolp> };
+	kernels.push_back(neon);
+#endif
+
+	return kernels;
+}
+
+std::vector<StokesKernel> GetStokesKernels()
+{
+	return GetStokesKernelsT<false>();
+}
+
+const StokesKernel& GetStokesKernel()
+{
+	static const StokesKernel kernel = GetStokesKernels().back();
+	return kernel;
+}
+
+std::vector<StokesKernel> GetStokesFastKernels()
+{
+	return GetStokesKernelsT<true>();
+}
+
+const StokesKernel& GetStokesFastKernel()
+{
+	static const StokesKernel kernel = GetStokesFastKernels().back();
+	return kernel;
+}
+
+#define AOLP_OFFSET 1.57079633f
+#define AOLP_SCALE (255.0f / 3.14159265f)
+
+#if defined(CPU_X86_SSE2)
+// converts four floats, already scaled and offset by 0.5, to integers
+static inline __m128i Round4Sse2(const float* pSrc, __m128 offset, __m128 scale)
+{
+	__m128 v = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_loadu_ps(pSrc), offset), scale), _mm_set1_ps(0.5f));
+	return _mm_cvttps_epi32(_mm_min_ps(v, _mm_set1_ps(255.0f)));
+}
+
+// 8-bit values of 16 pixels of one plane
+static inline void Quantize16Sse2(const float* pSrc, __m128 offset, __m128 scale, uint8_t* pDst)
+{
+	__m128i lo = _mm_packs_epi32(Round4Sse2(pSrc, offset, scale), Round4Sse2(pSrc + 4, offset, scale));
+	__m128i hi = _mm_packs_epi32(Round4Sse2(pSrc + 8, offset, scale), Round4Sse2(pSrc + 12, offset, scale));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(pDst), _mm_packus_epi16(lo, hi));
+}
+#endif
+
+#if defined(STOKES_NEON)
+static inline void Quantize16Neon(const float* pSrc, float32x4_t offset, float32x4_t scale, uint8_t* pDst)
+{
+	uint16x4_t words[4];
+	for (int group = 0; group < 4; group++)
+	{
+		float32x4_t v = vaddq_f32(vmulq_f32(vaddq_f32(vld1q_f32(pSrc + 4 * group), offset), scale), vdupq_n_f32(0.5f));
+		words[group] = vmovn_u32(vcvtq_u32_f32(vminq_f32(v, vdupq_n_f32(255.0f))));
+	}
+
+	vst1q_u8(pDst, vcombine_u8(vmovn_u16(vcombine_u16(words[0], words[1])), vmovn_u16(vcombine_u16(words[2], words[3]))));
+}
+#endif
+
+// writes 16 gray values with each repeated bytesPerPixel times
+static inline void RepeatGray16(const uint8_t* pSrc, size_t bytesPerPixel, uint8_t* pDst)
+{
+	if (bytesPerPixel == 3)
+	{
+		for (size_t j = 0; j < 16; j++)
+			pDst[3 * j] = pDst[3 * j + 1] = pDst[3 * j + 2] = pSrc[j];
+		return;
+	}
+
+	for (size_t j = 0; j < 16; j++)
+		for (size_t b = 0; b < bytesPerPixel; b++)
+			pDst[j * bytesPerPixel + b] = pSrc[j];
+}
+
+void QuantizeDolpAolp(const StokesOutput& out, size_t begin, size_t end, uint8_t* pDolp8, uint8_t* pAolp8, size_t bytesPerPixel)
+{
+	size_t i = begin;
+
+	// Vectorize 16 pixels at a time
+	//    Both planes are converted into a small block first, which is then
+	//    stored as is or with each value repeated for BGR8.
+#if defined(CPU_X86_SSE2) || defined(STOKES_NEON)
+	uint8_t dolp[16];
+	uint8_t aolp[16];
+
+	for (; i + 16 <= end; i += 16)
+	{
+		uint8_t* pDolp = bytesPerPixel == 1 ? pDolp8 + i : dolp;
+		uint8_t* pAolp = bytesPerPixel == 1 ? pAolp8 + i : aolp;
+
+#if defined(CPU_X86_SSE2)
+		Quantize16Sse2(out.pDolp + i, _mm_setzero_ps(), _mm_set1_ps(255.0f), pDolp);
+		Quantize16Sse2(out.pAolp + i, _mm_set1_ps(AOLP_OFFSET), _mm_set1_ps(AOLP_SCALE), pAolp);
+#else
+		Quantize16Neon(out.pDolp + i, vdupq_n_f32(0.0f), vdupq_n_f32(255.0f), pDolp);
+		Quantize16Neon(out.pAolp + i, vdupq_n_f32(AOLP_OFFSET), vdupq_n_f32(AOLP_SCALE), pAolp);
+#endif
+
+		if (bytesPerPixel == 1)
+			continue;
+
+		RepeatGray16(dolp, bytesPerPixel, pDolp8 + i * bytesPerPixel);
+		RepeatGray16(aolp, bytesPerPixel, pAolp8 + i * bytesPerPixel);
+	}
+#endif
+
+	for (; i < end; i++)
+	{
+		uint8_t dolp = static_cast<uint8_t>(std::min(out.pDolp[i] * 255.0f + 0.5f, 255.0f));
+		uint8_t aolp = static_cast<uint8_t>(std::min((out.pAolp[i] + AOLP_OFFSET) * AOLP_SCALE + 0.5f, 255.0f));
+
+		for (size_t b = 0; b < bytesPerPixel; b++)
+		{
+			pDolp8[i * bytesPerPixel + b] = dolp;
+			pAolp8[i * bytesPerPixel + b] = aolp;
+		}
+	}
+}
+
+float SampleMeanDolp(const uint8_t* pFrame, size_t numPixels, size_t width, size_t height, size_t step)
+{
+	step = std::max<size_t>(step, 1);
+
+	float sum = 0.0f;
+	size_t count = 0;
+
+	for (size_t y = 0; y < height && y * width < numPixels; y += step)
+	{
+		for (size_t x = 0; x < width && y * width + x < numPixels; x += step)
+		{
+			const uint8_t* pPixel = pFrame + 4 * (y * width + x);
+
+			const float s0 = 0.5f * (static_cast<float>(pPixel[0]) + pPixel[1] + pPixel[2] + pPixel[3]);
+			const float s1 = static_cast<float>(pPixel[0]) - pPixel[2];
+			const float s2 = static_cast<float>(pPixel[1]) - pPixel[3];
+
+			if (s0 > 0.0f)
+				sum += std::min(std::sqrt(s1 * s1 + s2 * s2) / s0, 1.0f);
+
+			count++;
+		}
+	}
+
+	return count > 0 ? sum / count : 0.0f;
+}
+
+// runs a kernel and the exact scalar kernel over the same angles
+//    S0, S1, S2 and DoLP must be identical and AoLP within aolpTolerance.
+//    Pixels before begin must be left alone.
+static bool CompareStokesKernel(const StokesKernel& kernel, const std::vector<uint8_t>& angles, size_t begin, float aolpTolerance)
+{
+	const size_t numPixels = angles.size() / 4;
+
+	StokesInput in = { { &angles[0], &angles[numPixels], &angles[2 * numPixels], &angles[3 * numPixels] } };
+
+	std::vector<float> expected(5 * numPixels, -1.0f);
+	StokesOutput expectedOut = { &expected[0], &expected[numPixels], &expected[2 * numPixels], &expected[3 * numPixels], &expected[4 * numPixels] };
+	StokesScalar(in, expectedOut, begin, numPixels);
+
+	std::vector<float> actual(5 * numPixels, -1.0f);
+	StokesOutput actualOut = { &actual[0], &actual[numPixels], &actual[2 * numPixels], &actual[3 * numPixels], &actual[4 * numPixels] };
+	kernel.function(in, actualOut, begin, numPixels);
+
+	if (memcmp(expected.data(), actual.data(), 4 * numPixels * sizeof(float)) != 0)
+		return false;
+
+	for (size_t i = 0; i < numPixels; i++)
+		if (!(std::fabs(expectedOut.pAolp[i] - actualOut.pAolp[i]) <= aolpTolerance))
+			return false;
+
+	return true;
+}
+
+// checks one kernel family against the exact scalar kernel
+static bool VerifyStokesFamily(const char* family, const std::vector<StokesKernel>& kernels, float aolpTolerance)
+{
+	// sizes that leave a tail for every vector width
+	const size_t pixelCounts[] = { 1, 7, 8, 9, 15, 16, 17, 33, 1000, 2448 * 4 + 7 };
+
+	// every S1, S2 pair 8-bit angles can produce, one per pixel
+	std::vector<uint8_t> pairs(4 * 511 * 511);
+	const size_t numPairs = pairs.size() / 4;
+	for (size_t i = 0; i < numPairs; i++)
+	{
+		int s1 = static_cast<int>(i % 511) - 255;
+		int s2 = static_cast<int>(i / 511) - 255;
+
+		pairs[i] = static_cast<uint8_t>(std::max(s1, 0));
+		pairs[numPairs + i] = static_cast<uint8_t>(std::max(s2, 0));
+		pairs[2 * numPairs + i] = static_cast<uint8_t>(std::max(-s1, 0));
+		pairs[3 * numPairs + i] = static_cast<uint8_t>(std::max(-s2, 0));
+	}
+
+	for (size_t k = 0; k < kernels.size(); k++)
+	{
+		for (size_t c = 0; c < sizeof(pixelCounts) / sizeof(pixelCounts[0]); c++)
+		{
+			const size_t numPixels = pixelCounts[c];
+
+			// random angles, with every eighth pixel black to cover S0 of 0
+			std::vector<uint8_t> angles(4 * numPixels);
+			uint32_t state = 0x9E3779B9u + static_cast<uint32_t>(numPixels);
+			for (size_t i = 0; i < angles.size(); i++)
+			{
+				state = state * 1664525u + 1013904223u;
+				angles[i] = (i % numPixels) % 8 == 5 ? 0 : static_cast<uint8_t>(state >> 24);
+			}
+
+			// a start offset of 1 checks unaligned bands
+			if (!CompareStokesKernel(kernels[k], angles, numPixels > 1 ? 1 : 0, aolpTolerance))
+			{
+				std::cout << TAB1 << family << " kernel " << kernels[k].name << " differs from the exact scalar kernel at " << numPixels << " pixels\n";
+				return false;
+			}
+		}
+
+		if (!CompareStokesKernel(kernels[k], pairs, 0, aolpTolerance))
+		{
+			std::cout << TAB1 << family << " kernel " << kernels[k].name << " differs from the exact scalar kernel for some S1, S2 pair\n";
+			return false;
+		}
+
+		if (aolpTolerance > 0.0f)
+			std::cout << TAB1 << family << " kernel " << kernels[k].name << " is within " << aolpTolerance << " rad\n";
+		else
+			std::cout << TAB1 << family << " kernel " << kernels[k].name << " is exact\n";
+	}
+
+	return true;
+}
+
+bool VerifyStokesKernels()
+{
+	bool passed = VerifyStokesFamily("Stokes", GetStokesKernels(), 0.0f);
+	passed = VerifyStokesFamily("Fast Stokes", GetStokesFastKernels(), STOKES_FAST_AOLP_MAX_ERROR) && passed;
+	return passed;
+}
+
+StokesStage::StokesStage(size_t width, size_t height, unsigned int numThreads, bool fastAolp)
+	: m_width(width)
+	, m_height(height)
+	, m_kernel(fastAolp ? GetStokesFastKernel() : GetStokesKernel())
+	, m_planes(5 * width * height)
+	, m_bands(numThreads)
+{
+	const size_t planeSize = width * height;
+
+	m_output.pS0 = &m_planes[0];
+	m_output.pS1 = &m_planes[planeSize];
+	m_output.pS2 = &m_planes[2 * planeSize];
+	m_output.pDolp = &m_planes[3 * planeSize];
+	m_output.pAolp = &m_planes[4 * planeSize];
+}
+
+void StokesStage::Process(const StokesInput& in, size_t numPixels, uint8_t* pDolp8, uint8_t* pAolp8, size_t bytesPerPixel)
+{
+	numPixels = std::min(numPixels, m_width * m_height);
+
+	// Split into row bands
+	//    Each band is computed and quantized while its results are still in
+	//    cache.
+	m_bands.Run((numPixels + m_width - 1) / m_width, [&](size_t rowBegin, size_t rowEnd)
+	{
+		size_t begin = rowBegin * m_width;
+		size_t end = std::min(rowEnd * m_width, numPixels);
+
+		m_kernel.function(in, m_output, begin, end);
+
+		if (pDolp8 != NULL && pAolp8 != NULL)
+			QuantizeDolpAolp(m_output, begin, end, pDolp8, pAolp8, bytesPerPixel);
+	});
+}
+
+const StokesOutput& StokesStage::GetOutput() const
+{
+	return m_output;
+}
+
+const char* StokesStage::GetKernelName() const
+{
+	return m_kernel.name;
+}
+
+unsigned int StokesStage::GetNumThreads() const
+{
+	return m_bands.GetNumThreads();
+}
@@ -0,0 +1,133 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+#pragma once
+
+#include "Threading.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Stokes
+//    The camera computes Stokes parameters and DoLP/AoLP itself only as 8-bit
+//    results. The stage below computes them on the host in float from the
+//    four Mono8 angle planes the demux produces:
+//
+//      S0   = (I0 + I45 + I90 + I135) / 2     total intensity
+//      S1   = I0 - I90
+//      S2   = I45 - I135
+//      DoLP = sqrt(S1^2 + S2^2) / S0         clamped to [0, 1], 0 where S0 is 0
+//      AoLP = atan2(S2, S1) / 2              radians in [-pi/2, pi/2]
+//
+//    S0 averages both orthogonal pairs, which halves its noise compared with
+//    I0 + I90 alone.
+
+// four Mono8 angle planes, 0/45/90/135 degrees
+struct StokesInput
+{
+	const uint8_t* pAngle[4];
+};
+
+// float result planes, one value per pixel each
+struct StokesOutput
+{
+	float* pS0;
+	float* pS1;
+	float* pS2;
+	float* pDolp;
+	float* pAolp;
+};
+
+// computes pixels [begin, end) of the result planes
+typedef void (*StokesFn)(const StokesInput& in, const StokesOutput& out, size_t begin, size_t end);
+
+struct StokesKernel
+{
+	const char* name;
+	StokesFn function;
+};
+
+// scalar fallback, one pixel at a time
+void StokesScalar(const StokesInput& in, const StokesOutput& out, size_t begin, size_t end);
+
+// kernels usable on this CPU, fastest last
+//    The vector kernels compute S0, S1, S2 and DoLP in registers; AoLP goes
+//    through the C library's atan2 in every kernel.
+std::vector<StokesKernel> GetStokesKernels();
+
+// fastest kernel usable on this CPU
+const StokesKernel& GetStokesKernel();
+
+// converts pixels [begin, end) of DoLP and AoLP to 8-bit planes for a video
+// recorder, each value repeated bytesPerPixel times
+//    DoLP 0..1 maps to 0..255 and AoLP -pi/2..pi/2 to 0..255, the scaling of
+//    the camera's own PolarizedDolpAolp_Mono8 format.
+void QuantizeDolpAolp(const StokesOutput& out, size_t begin, size_t end, uint8_t* pDolp8, uint8_t* pAolp8, size_t bytesPerPixel);
+
+// mean DoLP of an interleaved PolarizedAngles_0d_45d_90d_135d_Mono8 frame
+//    Samples every step-th pixel of every step-th row straight from the
+//    camera's buffer, cheap enough to run on every frame, e.g. to trigger a
+//    recording. Pixels past numPixels are not sampled and pixels with an S0
+//    of 0 count as unpolarized.
+float SampleMeanDolp(const uint8_t* pFrame, size_t numPixels, size_t width, size_t height, size_t step);
+
+// Fast AoLP
+//    atan2 costs more than the rest of the Stokes stage together. The fast
+//    kernels replace it with a vectorized polynomial (Abramowitz and Stegun
+//    4.4.47) of the octant-reduced ratio min(|S1|, |S2|) / max(|S1|, |S2|).
+//    Over every S1, S2 pair 8-bit angles can produce, AoLP stays within
+//    STOKES_FAST_AOLP_MAX_ERROR radians of atan2, under a thousandth of an
+//    8-bit AoLP step, so the 8-bit planes differ from the exact ones by at
+//    most one count where a value sits right on a rounding boundary. S0, S1,
+//    S2 and DoLP are the same as in the exact kernels.
+#define STOKES_FAST_AOLP_MAX_ERROR 1e-5f
+
+void StokesFastScalar(const StokesInput& in, const StokesOutput& out, size_t begin, size_t end);
+
+std::vector<StokesKernel> GetStokesFastKernels();
+
+const StokesKernel& GetStokesFastKernel();
+
+// checks every usable kernel against the exact scalar one
+//    The exact kernels share the AoLP code, so all their results must match
+//    exactly; the fast kernels' AoLP must stay within its error bound, which
+//    is checked over every S1, S2 pair.
+bool VerifyStokesKernels();
+
+// StokesStage
+//    Owns the float result planes of one frame size and fills them across
+//    row bands on a pool of threads, with the exact or the fast kernels.
+class StokesStage
+{
+public:
+	StokesStage(size_t width, size_t height, unsigned int numThreads, bool fastAolp);
+
+	// computes the first numPixels pixels of every result plane, and the
+	// 8-bit DoLP and AoLP planes if given
+	void Process(const StokesInput& in, size_t numPixels, uint8_t* pDolp8, uint8_t* pAolp8, size_t bytesPerPixel);
+
+	const StokesOutput& GetOutput() const;
+
+	const char* GetKernelName() const;
+
+	unsigned int GetNumThreads() const;
+
+private:
+	const size_t m_width;
+	const size_t m_height;
+	const StokesKernel& m_kernel;
+	std::vector<float> m_planes;
+	StokesOutput m_output;
+	BandPool m_bands;
+};
@@ -0,0 +1,629 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+#include "TemporalFilter.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#if defined(CPU_X86_SSE2)
+#include <emmintrin.h>
+#endif
+#if defined(CPU_NEON)
+#include <arm_neon.h>
+#endif
+
+#define TAB1 "  "
+
+// fixed point fraction bits of the running averages
+//    The largest sample shifted by them still fits a signed 16-bit lane,
+//    rounding included.
+#define FRACTION_8 7
+#define FRACTION_16 3
+
+// one running average step
+//    A difference beyond the gate restarts the average from the sample;
+//    otherwise the average moves 1/2^shift of the way towards it. Returns
+//    the new average; the sample put out is it rounded back.
+static inline int RecursiveStep(int sample, int state, unsigned int shift, int gate)
+{
+	const int difference = sample - state;
+
+	return (difference > gate || -difference > gate) ? sample : state + (difference >> shift);
+}
+
+template <typename Sample, int Fraction>
+static void TemporalRecursiveScalarT(Sample* pPlane, int16_t* pState, size_t numSamples, unsigned int shift, int16_t gate)
+{
+	for (size_t i = 0; i < numSamples; i++)
+	{
+		const int state = RecursiveStep(pPlane[i] << Fraction, pState[i], shift, gate);
+
+		pState[i] = static_cast<int16_t>(state);
+		pPlane[i] = static_cast<Sample>((state + (1 << (Fraction - 1))) >> Fraction);
+	}
+}
+
+template <typename Sample>
+static void TemporalWindowScalarT(Sample* pPlane, Sample* pOldest, uint16_t* pSum, size_t numSamples, unsigned int shift)
+{
+	const unsigned int half = (1u << shift) >> 1;
+
+	for (size_t i = 0; i < numSamples; i++)
+	{
+		const uint16_t sum = static_cast<uint16_t>(pSum[i] + pPlane[i] - pOldest[i]);
+
+		pSum[i] = sum;
+		pOldest[i] = pPlane[i];
+		pPlane[i] = static_cast<Sample>((sum + half) >> shift);
+	}
+}
+
+static void TemporalRecursive8Scalar(uint8_t* pPlane, int16_t* pState, size_t numSamples, unsigned int shift, int16_t gate)
+{
+	TemporalRecursiveScalarT<uint8_t, FRACTION_8>(pPlane, pState, numSamples, shift, gate);
+}
+
+static void TemporalRecursive16Scalar(uint16_t* pPlane, int16_t* pState, size_t numSamples, unsigned int shift, int16_t gate)
+{
+	TemporalRecursiveScalarT<uint16_t, FRACTION_16>(pPlane, pState, numSamples, shift, gate);
+}
+
+static void TemporalWindow8Scalar(uint8_t* pPlane, uint8_t* pOldest, uint16_t* pSum, size_t numSamples, unsigned int shift)
+{
+	TemporalWindowScalarT<uint8_t>(pPlane, pOldest, pSum, numSamples, shift);
+}
+
+static void TemporalWindow16Scalar(uint16_t* pPlane, uint16_t* pOldest, uint16_t* pSum, size_t numSamples, unsigned int shift)
+{
+	TemporalWindowScalarT<uint16_t>(pPlane, pOldest, pSum, numSamples, shift);
+}
+
+#if defined(CPU_X86_SSE2)
+// eight running average steps in 16-bit lanes
+//    The absolute difference is the larger of it and its negation, and the
+//    arithmetic shift rounds down like the scalar one. Returns the new
+//    averages; pState gets them too.
+template <int Fraction>
+static inline __m128i RecursiveStepSse2(__m128i samples, int16_t* pState, __m128i shift, __m128i gate)
+{
+	__m128i* pStates = reinterpret_cast<__m128i*>(pState);
+	const __m128i scaled = _mm_slli_epi16(samples, Fraction);
+	const __m128i state = _mm_loadu_si128(pStates);
+	const __m128i difference = _mm_sub_epi16(scaled, state);
+	const __m128i magnitude = _mm_max_epi16(difference, _mm_sub_epi16(_mm_setzero_si128(), difference));
+	const __m128i restart = _mm_cmpgt_epi16(magnitude, gate);
+	const __m128i moved = _mm_add_epi16(state, _mm_sra_epi16(difference, shift));
+	const __m128i next = _mm_or_si128(_mm_and_si128(restart, scaled), _mm_andnot_si128(restart, moved));
+
+	_mm_storeu_si128(pStates, next);
+
+	return _mm_srli_epi16(_mm_add_epi16(next, _mm_set1_epi16(1 << (Fraction - 1))), Fraction);
+}
+
+// 16 samples per iteration
+static void TemporalRecursive8Sse2(uint8_t* pPlane, int16_t* pState, size_t numSamples, unsigned int shift, int16_t gate)
+{
+	const __m128i shiftCount = _mm_cvtsi32_si128(static_cast<int>(shift));
+	const __m128i gates = _mm_set1_epi16(gate);
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+
+	for (; i + 16 <= numSamples; i += 16)
+	{
+		__m128i* pSamples = reinterpret_cast<__m128i*>(pPlane + i);
+		const __m128i samples = _mm_loadu_si128(pSamples);
+
+		const __m128i low = RecursiveStepSse2<FRACTION_8>(_mm_unpacklo_epi8(samples, zero), pState + i, shiftCount, gates);
+		const __m128i high = RecursiveStepSse2<FRACTION_8>(_mm_unpackhi_epi8(samples, zero), pState + i + 8, shiftCount, gates);
+
+		_mm_storeu_si128(pSamples, _mm_packus_epi16(low, high));
+	}
+
+	TemporalRecursive8Scalar(pPlane + i, pState + i, numSamples - i, shift, gate);
+}
+
+// 8 samples per iteration
+static void TemporalRecursive16Sse2(uint16_t* pPlane, int16_t* pState, size_t numSamples, unsigned int shift, int16_t gate)
+{
+	const __m128i shiftCount = _mm_cvtsi32_si128(static_cast<int>(shift));
+	const __m128i gates = _mm_set1_epi16(gate);
+	size_t i = 0;
+
+	for (; i + 8 <= numSamples; i += 8)
+	{
+		__m128i* pSamples = reinterpret_cast<__m128i*>(pPlane + i);
+
+		_mm_storeu_si128(pSamples, RecursiveStepSse2<FRACTION_16>(_mm_loadu_si128(pSamples), pState + i, shiftCount, gates));
+	}
+
+	TemporalRecursive16Scalar(pPlane + i, pState + i, numSamples - i, shift, gate);
+}
+
+// eight window steps in 16-bit lanes
+//    The sums wrap like the scalar ones and never exceed 16 bits once the
+//    oldest samples are taken out. Returns the means.
+static inline __m128i WindowStepSse2(__m128i samples, __m128i oldest, uint16_t* pSum, __m128i shift, __m128i half)
+{
+	__m128i* pSums = reinterpret_cast<__m128i*>(pSum);
+	const __m128i sum = _mm_sub_epi16(_mm_add_epi16(_mm_loadu_si128(pSums), samples), oldest);
+
+	_mm_storeu_si128(pSums, sum);
+
+	return _mm_srl_epi16(_mm_add_epi16(sum, half), shift);
+}
+
+// 16 samples per iteration
+static void TemporalWindow8Sse2(uint8_t* pPlane, uint8_t* pOldest, uint16_t* pSum, size_t numSamples, unsigned int shift)
+{
+	const __m128i shiftCount = _mm_cvtsi32_si128(static_cast<int>(shift));
+	const __m128i half = _mm_set1_epi16(static_cast<int16_t>((1u << shift) >> 1));
+	const __m128i zero = _mm_setzero_si128();
+	size_t i = 0;
+
+	for (; i + 16 <= numSamples; i += 16)
+	{
+		__m128i* pSamples = reinterpret_cast<__m128i*>(pPlane + i);
+		__m128i* pOld = reinterpret_cast<__m128i*>(pOldest + i);
+		const __m128i samples = _mm_loadu_si128(pSamples);
+		const __m128i oldest = _mm_loadu_si128(pOld);
+
+		const __m128i low = WindowStepSse2(_mm_unpacklo_epi8(samples, zero), _mm_unpacklo_epi8(oldest, zero), pSum + i, shiftCount, half);
+		const __m128i high = WindowStepSse2(_mm_unpackhi_epi8(samples, zero), _mm_unpackhi_epi8(oldest, zero), pSum + i + 8, shiftCount, half);
+
+		_mm_storeu_si128(pOld, samples);
+		_mm_storeu_si128(pSamples, _mm_packus_epi16(low, high));
+	}
+
+	TemporalWindow8Scalar(pPlane + i, pOldest + i, pSum + i, numSamples - i, shift);
+}
+
+// 8 samples per iteration
+static void TemporalWindow16Sse2(uint16_t* pPlane, uint16_t* pOldest, uint16_t* pSum, size_t numSamples, unsigned int shift)
+{
+	const __m128i shiftCount = _mm_cvtsi32_si128(static_cast<int>(shift));
+	const __m128i half = _mm_set1_epi16(static_cast<int16_t>((1u << shift) >> 1));
+	size_t i = 0;
+
+	for (; i + 8 <= numSamples; i += 8)
+	{
+		__m128i* pSamples = reinterpret_cast<__m128i*>(pPlane + i);
+		__m128i* pOld = reinterpret_cast<__m128i*>(pOldest + i);
+		const __m128i samples = _mm_loadu_si128(pSamples);
+
+		const __m128i means = WindowStepSse2(samples, _mm_loadu_si128(pOld), pSum + i, shiftCount, half);
+
+		_mm_storeu_si128(pOld, samples);
+		_mm_storeu_si128(pSamples, means);
+	}
+
+	TemporalWindow16Scalar(pPlane + i, pOldest + i, pSum + i, numSamples - i, shift);
+}
+#endif
+
+#if defined(CPU_NEON)
+// eight running average steps in 16-bit lanes
+//    A left shift by a negative count is an arithmetic right shift.
+template <int Fraction>
+static inline uint16x8_t RecursiveStepNeon(uint16x8_t samples, int16_t* pState, int16x8_t shift, int16x8_t gate)
+{
+	const int16x8_t scaled = vreinterpretq_s16_u16(vshlq_n_u16(samples, Fraction));
+	const int16x8_t state = vld1q_s16(pState);
+	const int16x8_t difference = vsubq_s16(scaled, state);
+	const uint16x8_t restart = vcgtq_s16(vabsq_s16(difference), gate);
+	const int16x8_t next = vbslq_s16(restart, scaled, vaddq_s16(state, vshlq_s16(difference, shift)));
+
+	vst1q_s16(pState, next);
+
+	return vshrq_n_u16(vaddq_u16(vreinterpretq_u16_s16(next), vdupq_n_u16(1 << (Fraction - 1))), Fraction);
+}
+
+// 16 samples per iteration
+static void TemporalRecursive8Neon(uint8_t* pPlane, int16_t* pState, size_t numSamples, unsigned int shift, int16_t gate)
+{
+	const int16x8_t shiftCount = vdupq_n_s16(-static_cast<int16_t>(shift));
+	const int16x8_t gates = vdupq_n_s16(gate);
+	size_t i = 0;
+
+	for (; i + 16 <= numSamples; i += 16)
+	{
+		const uint8x16_t samples = vld1q_u8(pPlane + i);
+
+		const uint16x8_t low = RecursiveStepNeon<FRACTION_8>(vmovl_u8(vget_low_u8(samples)), pState + i, shiftCount, gates);
+		const uint16x8_t high = RecursiveStepNeon<FRACTION_8>(vmovl_u8(vget_high_u8(samples)), pState + i + 8, shiftCount, gates);
+
+		vst1q_u8(pPlane + i, vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
+	}
+
+	TemporalRecursive8Scalar(pPlane + i, pState + i, numSamples - i, shift, gate);
+}
+
+// 8 samples per iteration
+static void TemporalRecursive16Neon(uint16_t* pPlane, int16_t* pState, size_t numSamples, unsigned int shift, int16_t gate)
+{
+	const int16x8_t shiftCount = vdupq_n_s16(-static_cast<int16_t>(shift));
+	const int16x8_t gates = vdupq_n_s16(gate);
+	size_t i = 0;
+
+	for (; i + 8 <= numSamples; i += 8)
+		vst1q_u16(pPlane + i, RecursiveStepNeon<FRACTION_16>(vld1q_u16(pPlane + i), pState + i, shiftCount, gates));
+
+	TemporalRecursive16Scalar(pPlane + i, pState + i, numSamples - i, shift, gate);
+}
+
+// eight window steps in 16-bit lanes, with a rounding right shift
+static inline uint16x8_t WindowStepNeon(uint16x8_t samples, uint16x8_t oldest, uint16_t* pSum, int16x8_t shift, uint16x8_t half)
+{
+	const uint16x8_t sum = vsubq_u16(vaddq_u16(vld1q_u16(pSum), samples), oldest);
+
+	vst1q_u16(pSum, sum);
+
+	return vshlq_u16(vaddq_u16(sum, half), shift);
+}
+
+// 16 samples per iteration
+static void TemporalWindow8Neon(uint8_t* pPlane, uint8_t* pOldest, uint16_t* pSum, size_t numSamples, unsigned int shift)
+{
+	const int16x8_t shiftCount = vdupq_n_s16(-static_cast<int16_t>(shift));
+	const uint16x8_t half = vdupq_n_u16(static_cast<uint16_t>((1u << shift) >> 1));
+	size_t i = 0;
+
+	for (; i + 16 <= numSamples; i += 16)
+	{
+		const uint8x16_t samples = vld1q_u8(pPlane + i);
+		const uint8x16_t oldest = vld1q_u8(pOldest + i);
+
+		const uint16x8_t low = WindowStepNeon(vmovl_u8(vget_low_u8(samples)), vmovl_u8(vget_low_u8(oldest)), pSum + i, shiftCount, half);
+		const uint16x8_t high = WindowStepNeon(vmovl_u8(vget_high_u8(samples)), vmovl_u8(vget_high_u8(oldest)), pSum + i + 8, shiftCount, half);
+
+		vst1q_u8(pOldest + i, samples);
+		vst1q_u8(pPlane + i, vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
+	}
+
+	TemporalWindow8Scalar(pPlane + i, pOldest + i, pSum + i, numSamples - i, shift);
+}
+
+// 8 samples per iteration
+static void TemporalWindow16Neon(uint16_t* pPlane, uint16_t* pOldest, uint16_t* pSum, size_t numSamples, unsigned int shift)
+{
+	const int16x8_t shiftCount = vdupq_n_s16(-static_cast<int16_t>(shift));
+	const uint16x8_t half = vdupq_n_u16(static_cast<uint16_t>((1u << shift) >> 1));
+	size_t i = 0;
+
+	for (; i + 8 <= numSamples; i += 8)
+	{
+		const uint16x8_t samples = vld1q_u16(pPlane + i);
+		const uint16x8_t means = WindowStepNeon(samples, vld1q_u16(pOldest + i), pSum + i, shiftCount, half);
+
+		vst1q_u16(pOldest + i, samples);
+		vst1q_u16(pPlane + i, means);
+	}
+
+	TemporalWindow16Scalar(pPlane + i, pOldest + i, pSum + i, numSamples - i, shift);
+}
+#endif
+
+std::vector<TemporalFilterKernel> GetTemporalFilterKernels()
+{
+	std::vector<TemporalFilterKernel> kernels;
+
+	TemporalFilterKernel scalar = { "scalar", TemporalRecursive8Scalar, TemporalRecursive16Scalar, TemporalWindow8Scalar, TemporalWindow16Scalar };
+	kernels.push_back(scalar);
+
+#if defined(CPU_X86_SSE2)
+	TemporalFilterKernel sse2 = { "sse2", TemporalRecursive8Sse2, TemporalRecursive16Sse2, TemporalWindow8Sse2, TemporalWindow16Sse2 };
+	kernels.push_back(sse2);
+#endif
+
+#if defined(CPU_NEON)
+	TemporalFilterKernel neon = { "neon", TemporalRecursive8Neon, TemporalRecursive16Neon, TemporalWindow8Neon, TemporalWindow16Neon };
+	kernels.push_back(neon);
+#endif
+
+	return kernels;
+}
+
+const TemporalFilterKernel& GetTemporalFilterKernel()
+{
+	static const TemporalFilterKernel kernel = GetTemporalFilterKernels().back();
+	return kernel;
+}
+
+TemporalFilter::TemporalFilter(TemporalFilterMode mode, unsigned int numFrames, unsigned int threshold, size_t numPlanes, size_t planeSamples, size_t sampleBytes)
+	: m_mode(mode)
+	, m_numFrames(numFrames)
+	, m_numPlanes(numPlanes)
+	, m_planeSamples(planeSamples)
+	, m_sampleBytes(sampleBytes)
+	, m_kernel(GetTemporalFilterKernel())
+	, m_shift(0)
+	, m_gate(INT16_MAX)
+	, m_primed(false)
+	, m_oldest(0)
+{
+	if (numFrames < 2 || numFrames > TEMPORAL_FILTER_MAX_FRAMES || (numFrames & (numFrames - 1)) != 0)
+		throw std::runtime_error("Temporal filters take a power of two from 2 to " + std::to_string(TEMPORAL_FILTER_MAX_FRAMES) + " frames, not " + std::to_string(numFrames));
+
+	if (sampleBytes != 1 && sampleBytes != 2)
+		throw std::runtime_error("Temporal filters take 8 or 16-bit samples");
+
+	while ((1u << m_shift) < numFrames)
+		m_shift++;
+
+	// a gate past every possible difference never restarts
+	const int fraction = sampleBytes == 1 ? FRACTION_8 : FRACTION_16;
+
+	if (threshold > 0 && threshold < static_cast<unsigned int>(INT16_MAX >> fraction))
+		m_gate = static_cast<int16_t>(threshold << fraction);
+
+	if (mode == TEMPORAL_FILTER_RECURSIVE)
+	{
+		m_state.resize(numPlanes * planeSamples);
+	}
+	else
+	{
+		m_history.resize(numFrames * numPlanes * planeSamples * sampleBytes);
+		m_sums.resize(numPlanes * planeSamples);
+	}
+}
+
+// starts every sample's average, or window, from the first frame
+void TemporalFilter::Prime(uint8_t* const pPlanes[])
+{
+	const int fraction = m_sampleBytes == 1 ? FRACTION_8 : FRACTION_16;
+
+	for (size_t p = 0; p < m_numPlanes; p++)
+	{
+		const uint8_t* pPlane8 = pPlanes[p];
+		const uint16_t* pPlane16 = reinterpret_cast<const uint16_t*>(pPlanes[p]);
+
+		for (size_t i = 0; i < m_planeSamples; i++)
+		{
+			const unsigned int sample = m_sampleBytes == 1 ? pPlane8[i] : pPlane16[i];
+
+			if (m_mode == TEMPORAL_FILTER_RECURSIVE)
+				m_state[p * m_planeSamples + i] = static_cast<int16_t>(sample << fraction);
+			else
+				m_sums[p * m_planeSamples + i] = static_cast<uint16_t>(sample * m_numFrames);
+		}
+
+		if (m_mode == TEMPORAL_FILTER_WINDOW)
+		{
+			const size_t planeBytes = m_planeSamples * m_sampleBytes;
+
+			for (size_t f = 0; f < m_numFrames; f++)
+				std::copy(pPlanes[p], pPlanes[p] + planeBytes, &m_history[(f * m_numPlanes + p) * planeBytes]);
+		}
+	}
+
+	m_primed = true;
+}
+
+void TemporalFilter::Process(uint8_t* const pPlanes[], size_t numSamples)
+{
+	if (!m_primed)
+	{
+		Prime(pPlanes);
+		return;
+	}
+
+	numSamples = std::min(numSamples, m_planeSamples);
+
+	for (size_t p = 0; p < m_numPlanes; p++)
+	{
+		uint8_t* pPlane = pPlanes[p];
+
+		if (m_mode == TEMPORAL_FILTER_RECURSIVE)
+		{
+			int16_t* pState = &m_state[p * m_planeSamples];
+
+			if (m_sampleBytes == 1)
+				m_kernel.recursive8(pPlane, pState, numSamples, m_shift, m_gate);
+			else
+				m_kernel.recursive16(reinterpret_cast<uint16_t*>(pPlane), pState, numSamples, m_shift, m_gate);
+		}
+		else
+		{
+			uint8_t* pOldest = &m_history[(m_oldest * m_numPlanes + p) * m_planeSamples * m_sampleBytes];
+			uint16_t* pSum = &m_sums[p * m_planeSamples];
+
+			if (m_sampleBytes == 1)
+				m_kernel.window8(pPlane, pOldest, pSum, numSamples, m_shift);
+			else
+				m_kernel.window16(reinterpret_cast<uint16_t*>(pPlane), reinterpret_cast<uint16_t*>(pOldest), pSum, numSamples, m_shift);
+		}
+	}
+
+	// the frame just taken in is the newest, the one after it the oldest
+	if (m_mode == TEMPORAL_FILTER_WINDOW)
+		m_oldest = (m_oldest + 1) % m_numFrames;
+}
+
+const char* TemporalFilter::GetKernelName() const
+{
+	return m_kernel.name;
+}
+
+size_t TemporalFilter::GetStateSize() const
+{
+	if (m_mode == TEMPORAL_FILTER_RECURSIVE)
+		return m_planeSamples * sizeof(int16_t);
+
+	return m_planeSamples * (sizeof(uint16_t) + m_numFrames * m_sampleBytes);
+}
+
+// frame f of a noisy test sequence
+//    A bright bar moves across a dim background, so the gate sees motion,
+//    under noise of about a tenth of the range that it must average out.
+template <typename Sample>
+static void MakeTestFrame(size_t f, unsigned int maxSample, std::vector<Sample>& frame)
+{
+	uint32_t state = 0x9E3779B9u + static_cast<uint32_t>(f);
+	const size_t barStart = (7 * f) % frame.size();
+
+	for (size_t i = 0; i < frame.size(); i++)
+	{
+		state = state * 1664525u + 1013904223u;
+
+		const int level = (i >= barStart && i < barStart + 9) ? static_cast<int>(maxSample * 3 / 4) : static_cast<int>(maxSample / 4);
+		const int noise = static_cast<int>((state >> 16) % (maxSample / 5 + 1)) - static_cast<int>(maxSample / 10);
+
+		frame[i] = static_cast<Sample>(std::min(std::max(level + noise, 0), static_cast<int>(maxSample)));
+	}
+}
+
+// runs one kernel of each sample size and mode over the test sequence and
+// compares every frame's output and state with the scalar kernel's
+template <typename Sample, typename RecursiveFn, typename WindowFn>
+static bool CompareTemporalKernel(RecursiveFn recursive, RecursiveFn scalarRecursive, WindowFn window, WindowFn scalarWindow, unsigned int maxSample, int fraction, size_t numSamples)
+{
+	const unsigned int shifts[] = { 1, 4 };
+	const int thresholds[] = { INT16_MAX, static_cast<int>(maxSample / 8) << fraction };
+
+	for (size_t s = 0; s < sizeof(shifts) / sizeof(shifts[0]); s++)
+	{
+		for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++)
+		{
+			// a guard sample after the plane must be left alone
+			std::vector<Sample> first(numSamples + 1, static_cast<Sample>(0xA5));
+			MakeTestFrame<Sample>(0, maxSample, first);
+			first[numSamples] = static_cast<Sample>(0xA5);
+
+			std::vector<int16_t> state(numSamples + 1);
+			for (size_t i = 0; i < numSamples; i++)
+				state[i] = static_cast<int16_t>(first[i] << fraction);
+
+			std::vector<int16_t> expectedState(state);
+			const size_t numFrames = 1u << shifts[s];
+			std::vector<std::vector<Sample>> expectedHistory(numFrames, first);
+			std::vector<std::vector<Sample>> actualHistory(numFrames, first);
+			std::vector<uint16_t> expectedSums(numSamples + 1);
+			for (size_t i = 0; i < numSamples; i++)
+				expectedSums[i] = static_cast<uint16_t>(first[i] * numFrames);
+			std::vector<uint16_t> actualSums(expectedSums);
+
+			for (size_t f = 1; f < 12; f++)
+			{
+				std::vector<Sample> frame(numSamples + 1);
+				MakeTestFrame<Sample>(f, maxSample, frame);
+				frame[numSamples] = static_cast<Sample>(0xA5);
+
+				std::vector<Sample> expected(frame);
+				std::vector<Sample> actual(frame);
+
+				scalarRecursive(expected.data(), expectedState.data(), numSamples, shifts[s], static_cast<int16_t>(thresholds[t]));
+				recursive(actual.data(), state.data(), numSamples, shifts[s], static_cast<int16_t>(thresholds[t]));
+
+				if (expected != actual || expectedState != state)
+					return false;
+
+				expected = frame;
+				actual = frame;
+
+				scalarWindow(expected.data(), expectedHistory[f % numFrames].data(), expectedSums.data(), numSamples, shifts[s]);
+				window(actual.data(), actualHistory[f % numFrames].data(), actualSums.data(), numSamples, shifts[s]);
+
+				if (expected != actual || expectedSums != actualSums || expectedHistory != actualHistory)
+					return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+// checks the scalar kernels against what the filters are meant to do
+//    The window must give the rounded mean of the last N frames, counting
+//    the first frame for those before it, and the gated average must jump
+//    to a sample that steps past the threshold at once.
+static bool VerifyTemporalFilterMeaning()
+{
+	const size_t numSamples = 33;
+	const size_t numFrames = 4;
+	std::vector<std::vector<uint8_t>> frames(12, std::vector<uint8_t>(numSamples));
+
+	for (size_t f = 0; f < frames.size(); f++)
+		MakeTestFrame<uint8_t>(f, 255, frames[f]);
+
+	std::vector<std::vector<uint8_t>> history(numFrames, frames[0]);
+	std::vector<uint16_t> sums(numSamples);
+	for (size_t i = 0; i < numSamples; i++)
+		sums[i] = static_cast<uint16_t>(frames[0][i] * numFrames);
+
+	for (size_t f = 1; f < frames.size(); f++)
+	{
+		std::vector<uint8_t> plane(frames[f]);
+		TemporalWindow8Scalar(plane.data(), history[f % numFrames].data(), sums.data(), numSamples, 2);
+
+		for (size_t i = 0; i < numSamples; i++)
+		{
+			unsigned int sum = 0;
+			for (size_t k = 0; k < numFrames; k++)
+				sum += frames[f >= k ? f - k : 0][i];
+
+			if (plane[i] != (sum + numFrames / 2) / numFrames)
+			{
+				std::cout << TAB1 << "Temporal window differs from the mean of the last " << numFrames << " frames at frame " << f << "\n";
+				return false;
+			}
+		}
+	}
+
+	int16_t state = 40 << FRACTION_8;
+	uint8_t step = 200;
+	TemporalRecursive8Scalar(&step, &state, 1, 3, 16 << FRACTION_8);
+
+	if (step != 200)
+	{
+		std::cout << TAB1 << "Gated running average smears a step past its threshold\n";
+		return false;
+	}
+
+	std::cout << TAB1 << "Temporal window and gated running average behave as documented\n";
+	return true;
+}
+
+bool VerifyTemporalFilterKernels()
+{
+	if (!VerifyTemporalFilterMeaning())
+		return false;
+
+	// sizes that leave a tail for every vector width
+	const size_t sampleCounts[] = { 1, 7, 8, 15, 16, 17, 33, 1000 };
+	const std::vector<TemporalFilterKernel> kernels = GetTemporalFilterKernels();
+	const TemporalFilterKernel& scalar = kernels[0];
+
+	for (size_t k = 0; k < kernels.size(); k++)
+	{
+		for (size_t c = 0; c < sizeof(sampleCounts) / sizeof(sampleCounts[0]); c++)
+		{
+			const size_t numSamples = sampleCounts[c];
+
+			if (!CompareTemporalKernel<uint8_t>(kernels[k].recursive8, scalar.recursive8, kernels[k].window8, scalar.window8, 255, FRACTION_8, numSamples) ||
+				!CompareTemporalKernel<uint16_t>(kernels[k].recursive16, scalar.recursive16, kernels[k].window16, scalar.window16, 4095, FRACTION_16, numSamples))
+			{
+				std::cout << TAB1 << "Temporal filter kernel " << kernels[k].name << " differs from the scalar one at " << numSamples << " samples\n";
+				return false;
+			}
+		}
+
+		std::cout << TAB1 << "Temporal filter kernel " << kernels[k].name << " is bit-exact\n";
+	}
+
+	return true;
+}
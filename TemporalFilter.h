@@ -0,0 +1,132 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Temporal filter
+//    Angle planes are noisy, and the encoders spend most of their bitrate
+//    on noise, which changes every frame. The filter below smooths each
+//    sample over time, in place, between the demux and the recorders, in
+//    one of two ways:
+//
+//      recursive  each sample keeps a running average that takes 1/N of
+//                 every new frame; where a sample differs from its average
+//                 by more than a threshold, something moved, and the average
+//                 restarts from the new sample rather than smearing it
+//
+//      window     each sample is the mean of the same sample in the last N
+//                 frames, the integration of a longer exposure for low light
+//                 at the full frame rate
+//
+//    N is a power of two up to TEMPORAL_FILTER_MAX_FRAMES, so both filters
+//    divide by shifting. Samples are 8 bits, or 16 bits holding 12. The
+//    running average is kept in 16-bit fixed point, with 7 fraction bits for
+//    8-bit samples and 3 for 12-bit ones; the window keeps the last N frames
+//    and a 16-bit sum of them. All kernels produce identical output; the
+//    vectorized ones only differ in speed and in the CPU features they need.
+
+#define TEMPORAL_FILTER_MAX_FRAMES 16
+
+enum TemporalFilterMode
+{
+	TEMPORAL_FILTER_RECURSIVE,
+	TEMPORAL_FILTER_WINDOW
+};
+
+// filters numSamples samples of a plane in place
+//    Recursive: pState holds the running averages in fixed point and shift
+//    is log2 N; a sample whose fixed point difference from its average
+//    exceeds gate restarts it.
+typedef void (*TemporalRecursive8Fn)(uint8_t* pPlane, int16_t* pState, size_t numSamples, unsigned int shift, int16_t gate);
+typedef void (*TemporalRecursive16Fn)(uint16_t* pPlane, int16_t* pState, size_t numSamples, unsigned int shift, int16_t gate);
+
+//    Window: pOldest holds the samples of the frame N frames ago, which the
+//    new ones replace, and pSum the sums of the last N frames.
+typedef void (*TemporalWindow8Fn)(uint8_t* pPlane, uint8_t* pOldest, uint16_t* pSum, size_t numSamples, unsigned int shift);
+typedef void (*TemporalWindow16Fn)(uint16_t* pPlane, uint16_t* pOldest, uint16_t* pSum, size_t numSamples, unsigned int shift);
+
+struct TemporalFilterKernel
+{
+	const char* name;
+	TemporalRecursive8Fn recursive8;
+	TemporalRecursive16Fn recursive16;
+	TemporalWindow8Fn window8;
+	TemporalWindow16Fn window16;
+};
+
+// kernels usable on this CPU, fastest last
+std::vector<TemporalFilterKernel> GetTemporalFilterKernels();
+
+// fastest kernel usable on this CPU
+const TemporalFilterKernel& GetTemporalFilterKernel();
+
+// checks every usable kernel against the scalar one
+//    Runs each over a sequence of noisy frames with moving edges, at sizes
+//    that leave a scalar tail, and reports the first mismatch. Returns true
+//    if all kernels are bit-exact.
+bool VerifyTemporalFilterKernels();
+
+// TemporalFilter
+//    Holds the filter state of a fixed set of equally sized planes, such as
+//    the four angle planes of a stream, and filters them in place frame by
+//    frame. The first frame starts the averages, or fills the window, as if
+//    the scene had been still before it.
+class TemporalFilter
+{
+public:
+	// numFrames is N; threshold, in sample counts, gates the recursive
+	//    filter, 0 for none. Throws if N is not a power of two from 2 to
+	//    TEMPORAL_FILTER_MAX_FRAMES or samples are not 1 or 2 bytes.
+	TemporalFilter(TemporalFilterMode mode, unsigned int numFrames, unsigned int threshold, size_t numPlanes, size_t planeSamples, size_t sampleBytes);
+
+	// filters the first numSamples samples of each plane
+	//    The rest, such as the part of an incomplete frame that never
+	//    arrived, is left as it was and keeps its state.
+	void Process(uint8_t* const pPlanes[], size_t numSamples);
+
+	const char* GetKernelName() const;
+
+	// bytes of state kept per plane
+	size_t GetStateSize() const;
+
+private:
+	TemporalFilter(const TemporalFilter&);
+	TemporalFilter& operator=(const TemporalFilter&);
+
+	void Prime(uint8_t* const pPlanes[]);
+
+	const TemporalFilterMode m_mode;
+	const unsigned int m_numFrames;
+	const size_t m_numPlanes;
+	const size_t m_planeSamples;
+	const size_t m_sampleBytes;
+	const TemporalFilterKernel& m_kernel;
+	unsigned int m_shift;
+	int16_t m_gate;
+	bool m_primed;
+
+	// recursive: the running averages of every plane
+	std::vector<int16_t> m_state;
+
+	// window: the last N frames of every plane, oldest at m_oldest, and
+	// their sums
+	std::vector<uint8_t> m_history;
+	std::vector<uint16_t> m_sums;
+	size_t m_oldest;
+};
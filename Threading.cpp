@@ -0,0 +1,210 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+#include "Threading.h"
+#include <chrono>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+unsigned int GetCpuCount()
+{
+	unsigned int count = std::thread::hardware_concurrency();
+	return count > 0 ? count : 1;
+}
+
+bool PinThread(std::thread& thread, int cpu)
+{
+	if (cpu < 0)
+		return false;
+
+#ifdef _WIN32
+	if (cpu >= static_cast<int>(sizeof(DWORD_PTR) * 8))
+		return false;
+
+	return SetThreadAffinityMask(static_cast<HANDLE>(thread.native_handle()), static_cast<DWORD_PTR>(1) << cpu) != 0;
+#else
+	if (cpu >= CPU_SETSIZE)
+		return false;
+
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(cpu, &cpuSet);
+
+	return pthread_setaffinity_np(thread.native_handle(), sizeof(cpuSet), &cpuSet) == 0;
+#endif
+}
+
+bool RaiseThreadPriority(std::thread& thread)
+{
+#ifdef _WIN32
+	return SetThreadPriority(static_cast<HANDLE>(thread.native_handle()), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+	// the middle of the range leaves room above for the kernel's own
+	sched_param param;
+	param.sched_priority = (sched_get_priority_min(SCHED_FIFO) + sched_get_priority_max(SCHED_FIFO)) / 2;
+
+	return pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param) == 0;
+#endif
+}
+
+bool ParseCpuList(const char* text, std::vector<int>& cpus)
+{
+	cpus.clear();
+
+	while (*text != '\0')
+	{
+		char* end = NULL;
+		long cpu = strtol(text, &end, 10);
+
+		if (end == text || cpu < 0)
+			return false;
+
+		cpus.push_back(static_cast<int>(cpu));
+
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return false;
+
+		text = end;
+	}
+
+	return !cpus.empty();
+}
+
+BandPool::BandPool(unsigned int numThreads)
+	: m_numThreads(numThreads > 0 ? numThreads : 1)
+	, m_pJob(NULL)
+	, m_numRows(0)
+	, m_generation(0)
+	, m_pending(0)
+	, m_stop(false)
+{
+	for (unsigned int band = 1; band < m_numThreads; band++)
+		m_threads.push_back(std::thread(&BandPool::Work, this, band));
+}
+
+BandPool::~BandPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_start.notify_all();
+
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+}
+
+void BandPool::Run(size_t numRows, const std::function<void(size_t, size_t)>& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pJob = &job;
+		m_numRows = numRows;
+		m_pending = m_numThreads - 1;
+		m_error = std::exception_ptr();
+		m_generation++;
+	}
+
+	m_start.notify_all();
+
+	RunBand(0);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [this] { return m_pending == 0; });
+	m_pJob = NULL;
+
+	if (m_error)
+		std::rethrow_exception(m_error);
+}
+
+unsigned int BandPool::GetNumThreads() const
+{
+	return m_numThreads;
+}
+
+// waits for each new job and runs this thread's band of it
+void BandPool::Work(unsigned int band)
+{
+	uint64_t generation = 0;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_start.wait(lock, [&] { return m_stop || m_generation != generation; });
+
+			if (m_stop)
+				return;
+
+			generation = m_generation;
+		}
+
+		RunBand(band);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_pending == 0)
+			m_done.notify_one();
+	}
+}
+
+// band b covers rows [b * n / t, (b + 1) * n / t)
+void BandPool::RunBand(unsigned int band)
+{
+	size_t rowBegin = m_numRows * band / m_numThreads;
+	size_t rowEnd = m_numRows * (band + 1) / m_numThreads;
+
+	if (rowBegin == rowEnd)
+		return;
+
+	try
+	{
+		(*m_pJob)(rowBegin, rowEnd);
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_error)
+			m_error = std::current_exception();
+	}
+}
+
+CountdownLatch::CountdownLatch(size_t count)
+	: m_count(count)
+{
+}
+
+void CountdownLatch::CountDown()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_count > 0 && --m_count == 0)
+		m_zero.notify_all();
+}
+
+bool CountdownLatch::WaitFor(double seconds)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	return m_zero.wait_for(lock, std::chrono::duration<double>(seconds), [this] { return m_count == 0; });
+}
@@ -0,0 +1,103 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threading
+//    Small platform wrappers for the worker threads of the recording
+//    pipeline.
+
+// number of logical CPUs, at least 1
+unsigned int GetCpuCount();
+
+// pins a thread to one logical CPU; returns false if the OS refused
+bool PinThread(std::thread& thread, int cpu);
+
+// raises a thread to realtime priority, above every normal thread
+//    SCHED_FIFO on Linux, which needs CAP_SYS_NICE or a suitable rtprio
+//    limit, time critical on Windows. Returns false if the OS refused.
+bool RaiseThreadPriority(std::thread& thread);
+
+// parses a comma separated CPU list such as "2,3,4,5"
+//    Returns false if the list is empty or holds anything but CPU numbers.
+bool ParseCpuList(const char* text, std::vector<int>& cpus);
+
+// BandPool
+//    Splits per-frame work into row bands and runs them on a fixed set of
+//    threads, created once rather than per frame. The calling thread takes
+//    the first band itself, so a pool of one thread runs the job inline.
+class BandPool
+{
+public:
+	explicit BandPool(unsigned int numThreads);
+	~BandPool();
+
+	// calls job(rowBegin, rowEnd) for contiguous bands covering numRows rows
+	// and returns once all bands are done; an exception thrown by any band
+	// is rethrown here
+	void Run(size_t numRows, const std::function<void(size_t, size_t)>& job);
+
+	unsigned int GetNumThreads() const;
+
+private:
+	BandPool(const BandPool&);
+	BandPool& operator=(const BandPool&);
+
+	void Work(unsigned int band);
+	void RunBand(unsigned int band);
+
+	const unsigned int m_numThreads;
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_start;
+	std::condition_variable m_done;
+	const std::function<void(size_t, size_t)>* m_pJob;
+	size_t m_numRows;
+	uint64_t m_generation;
+	unsigned int m_pending;
+	bool m_stop;
+	std::exception_ptr m_error;
+};
+
+// CountdownLatch
+//    Lets threads wait until a number of events have happened, such as every
+//    camera having started streaming.
+class CountdownLatch
+{
+public:
+	explicit CountdownLatch(size_t count);
+
+	void CountDown();
+
+	// waits up to the given time; returns true once the count reached zero
+	bool WaitFor(double seconds);
+
+private:
+	CountdownLatch(const CountdownLatch&);
+	CountdownLatch& operator=(const CountdownLatch&);
+
+	size_t m_count;
+	std::mutex m_mutex;
+	std::condition_variable m_zero;
+};
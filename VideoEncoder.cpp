@@ -0,0 +1,289 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+#include "VideoEncoder.h"
+#include "SaveApi.h"
+#ifdef USE_FFMPEG
+#include "FfmpegEncoder.h"
+#endif
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#define TAB1 "  "
+
+size_t GetBytesPerPixel(EncoderInput input)
+{
+	if (input == ENCODER_INPUT_BGR8)
+		return 3;
+
+	return input == ENCODER_INPUT_MONO16 ? 2 : 1;
+}
+
+namespace
+{
+	// SaveEncoder
+	//    The Save library's H.264 recorder in an MPEG-4 container. It only
+	//    takes colour input, so gray angle planes are handed to it as BGR8.
+	class SaveEncoder : public VideoEncoder
+	{
+	public:
+		SaveEncoder(const std::string& fileName, size_t width, size_t height, double fps)
+			: m_recorder(Save::VideoParams(width, height, fps), fileName.c_str())
+		{
+			m_recorder.SetH264Mp4BGR8();
+		}
+
+		std::string GetDescription() const
+		{
+			return "Save H264/MPEG-4 from BGR8";
+		}
+
+		EncoderInput GetInput() const
+		{
+			return ENCODER_INPUT_BGR8;
+		}
+
+		void Open()
+		{
+			m_recorder.Open();
+		}
+
+		void AppendImage(const uint8_t* pFrame)
+		{
+			m_recorder.AppendImage(pFrame);
+		}
+
+		void Close()
+		{
+			m_recorder.Close();
+		}
+
+	private:
+		Save::VideoRecorder m_recorder;
+	};
+}
+
+namespace
+{
+	struct BackendInfo
+	{
+		EncoderBackend backend;
+		const char* name;
+
+		// FFmpeg encoders to try, in order, NULL terminated
+		const char* codecNames[3];
+
+		// the same for 12-bit planes
+		const char* deepCodecNames[3];
+	};
+
+	// Jetson has two FFmpeg ports of its encoder: NVIDIA's own in L4T and
+	// the community jetson-ffmpeg
+	const BackendInfo backends[] =
+	{
+		{ ENCODER_BACKEND_AUTO, "auto", { NULL }, { NULL } },
+		{ ENCODER_BACKEND_SAVE, "save", { NULL }, { NULL } },
+		{ ENCODER_BACKEND_X264, "x264", { "libx264", NULL }, { NULL } },
+		{ ENCODER_BACKEND_X265, "x265", { "libx265", NULL }, { "libx265", NULL } },
+		{ ENCODER_BACKEND_NVENC, "nvenc", { "h264_nvenc", NULL }, { "hevc_nvenc", NULL } },
+		{ ENCODER_BACKEND_VAAPI, "vaapi", { "h264_vaapi", NULL }, { "hevc_vaapi", NULL } },
+		{ ENCODER_BACKEND_JETSON, "jetson", { "h264_nvv4l2enc", "h264_nvmpi", NULL }, { "hevc_nvv4l2enc", "hevc_nvmpi", NULL } },
+	};
+
+	const BackendInfo& GetBackendInfo(EncoderBackend backend)
+	{
+		for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+		{
+			if (backends[i].backend == backend)
+				return backends[i];
+		}
+
+		return backends[0];
+	}
+}
+
+bool IsHardwareBackend(EncoderBackend backend)
+{
+	return backend == ENCODER_BACKEND_NVENC || backend == ENCODER_BACKEND_VAAPI || backend == ENCODER_BACKEND_JETSON;
+}
+
+bool ParseEncoderBackend(const char* name, EncoderBackend& backend)
+{
+	for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+	{
+		if (std::string(name) == backends[i].name)
+		{
+			backend = backends[i].backend;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char* GetEncoderBackendName(EncoderBackend backend)
+{
+	return GetBackendInfo(backend).name;
+}
+
+std::unique_ptr<VideoEncoder> CreateVideoEncoder(const std::string& fileName, size_t width, size_t height, double fps, EncoderBackend backend, unsigned int bitDepth, FrameStats* pStats)
+{
+	// cameras set up their recorders at the same time
+	static std::mutex mutex;
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// warn about a fallback once rather than once per stream
+	static bool warned = false;
+
+	const bool deep = bitDepth > 8;
+
+	if (backend == ENCODER_BACKEND_SAVE)
+	{
+		if (deep)
+			throw std::runtime_error("The Save library cannot encode 12-bit planes");
+
+		std::unique_ptr<VideoEncoder> pEncoder(new SaveEncoder(fileName, width, height, fps));
+		pEncoder->Open();
+		return pEncoder;
+	}
+
+	// auto tries the hardware back ends, fastest first, and for 12-bit planes
+	// libx265 in place of the Save library
+	std::vector<EncoderBackend> candidates;
+
+	if (backend == ENCODER_BACKEND_AUTO)
+	{
+		candidates.push_back(ENCODER_BACKEND_NVENC);
+		candidates.push_back(ENCODER_BACKEND_VAAPI);
+		candidates.push_back(ENCODER_BACKEND_JETSON);
+
+		if (deep)
+			candidates.push_back(ENCODER_BACKEND_X265);
+	}
+	else
+	{
+		candidates.push_back(backend);
+	}
+
+#ifdef USE_FFMPEG
+	// Probe encoders
+	//    Opening a session shows whether an encoder really works on this
+	//    host, which its presence in libavcodec does not. An encoder that
+	//    fails its probe is skipped by every further stream of the size; one
+	//    that passes is still opened for each stream, since NVENC refuses
+	//    sessions past the driver's limit once earlier streams hold theirs.
+	static std::map<std::string, std::string> probeErrors;
+	std::string reasons;
+
+	for (size_t c = 0; c < candidates.size(); c++)
+	{
+		const BackendInfo& info = GetBackendInfo(candidates[c]);
+		const char* const* codecNames = deep ? info.deepCodecNames : info.codecNames;
+
+		for (size_t n = 0; codecNames[n] != NULL; n++)
+		{
+			const std::string key = std::string(codecNames[n]) + " " + std::to_string(width) + "x" + std::to_string(height) + " " + std::to_string(bitDepth) + "-bit";
+
+			if (probeErrors.find(key) == probeErrors.end())
+				probeErrors[key] = FfmpegEncoder::Probe(codecNames[n], width, height, fps, false, bitDepth);
+
+			if (!probeErrors[key].empty())
+			{
+				reasons += (reasons.empty() ? "" : "; ") + probeErrors[key];
+				continue;
+			}
+
+			try
+			{
+				std::unique_ptr<VideoEncoder> pEncoder(new FfmpegEncoder(fileName, width, height, fps, codecNames[n], false, bitDepth, pStats));
+				pEncoder->Open();
+				return pEncoder;
+			}
+			catch (std::exception& ex)
+			{
+				reasons += (reasons.empty() ? "" : "; ") + std::string(codecNames[n]) + ": " + ex.what();
+			}
+		}
+	}
+
+	if (deep)
+		throw std::runtime_error(std::string("No ") + GetEncoderBackendName(backend) + " encoder for 12-bit planes (" + (reasons.empty() ? "none is HEVC" : reasons) + ")");
+
+	if (!warned)
+		std::cout << TAB1 << "No " << GetEncoderBackendName(backend) << " encoder available (" << reasons << "), using the Save library\n";
+	warned = true;
+#else
+	(void)pStats;
+
+	if (deep)
+		throw std::runtime_error("12-bit planes need a USE_FFMPEG build with an HEVC encoder");
+
+	if (!warned && backend != ENCODER_BACKEND_AUTO)
+		std::cout << TAB1 << "The " << GetEncoderBackendName(backend) << " encoder needs a USE_FFMPEG build, using the Save library\n";
+	warned = true;
+#endif
+
+	std::unique_ptr<VideoEncoder> pEncoder(new SaveEncoder(fileName, width, height, fps));
+	pEncoder->Open();
+	return pEncoder;
+}
+
+#ifdef USE_CUDA
+std::unique_ptr<VideoEncoder> CreateCudaVideoEncoder(const std::string& fileName, size_t width, size_t height, double fps, FrameStats* pStats)
+{
+#ifdef USE_FFMPEG
+	static std::mutex mutex;
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// probed once, like the host encoders, and opened for each stream
+	static std::map<std::string, std::string> probeErrors;
+	const std::string key = std::to_string(width) + "x" + std::to_string(height);
+
+	if (probeErrors.find(key) == probeErrors.end())
+	{
+		probeErrors[key] = FfmpegEncoder::Probe("h264_nvenc", width, height, fps, true);
+
+		if (!probeErrors[key].empty())
+			std::cout << TAB1 << "NVENC does not take CUDA frames (" << probeErrors[key] << "), bringing planes back to the host\n";
+	}
+
+	if (probeErrors[key].empty())
+	{
+		try
+		{
+			std::unique_ptr<VideoEncoder> pEncoder(new FfmpegEncoder(fileName, width, height, fps, "h264_nvenc", true, 8, pStats));
+			pEncoder->Open();
+			return pEncoder;
+		}
+		catch (std::exception& ex)
+		{
+			std::cout << TAB1 << "NVENC does not open another CUDA session (" << ex.what() << "), bringing planes back to the host\n";
+		}
+	}
+#else
+	(void)fileName;
+	(void)width;
+	(void)height;
+	(void)fps;
+	(void)pStats;
+#endif
+
+	return std::unique_ptr<VideoEncoder>();
+}
+#endif
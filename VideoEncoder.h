@@ -0,0 +1,133 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class FrameStats;
+
+// pixel layout an encoder takes its frames in
+enum EncoderInput
+{
+	// three bytes per pixel, gray repeated, as for SetH264Mp4BGR8()
+	ENCODER_INPUT_BGR8,
+
+	// one byte per pixel, the angle plane exactly as demuxed
+	ENCODER_INPUT_MONO8,
+
+	// Mono8 planes in CUDA device memory, demuxed on the GPU
+	ENCODER_INPUT_MONO8_CUDA,
+
+	// two bytes per pixel, 12-bit samples in the low bits of each word
+	ENCODER_INPUT_MONO16
+};
+
+// bytes per pixel of an encoder input
+size_t GetBytesPerPixel(EncoderInput input);
+
+// VideoEncoder
+//    Writes one angle stream to a video file. Every frame handed to
+//    AppendImage() is width x height pixels in the encoder's input layout.
+//    Errors are reported as exceptions.
+class VideoEncoder
+{
+public:
+	virtual ~VideoEncoder() {}
+
+	// human readable codec, container and input description
+	virtual std::string GetDescription() const = 0;
+
+	virtual EncoderInput GetInput() const = 0;
+
+	// CreateVideoEncoder() returns its encoders open
+	virtual void Open() = 0;
+
+	virtual void AppendImage(const uint8_t* pFrame) = 0;
+
+	virtual void Close() = 0;
+};
+
+// encoder back end a video stream is recorded with
+//    Every back end but the Save library goes through FFmpeg, needs a build
+//    with USE_FFMPEG and takes the Mono8 planes as the luma of its pictures,
+//    so no colour expansion is needed. 12-bit planes are encoded as 10 or
+//    12-bit HEVC by the back ends that have an HEVC encoder; the Save library
+//    and libx264 take 8 bits only.
+enum EncoderBackend
+{
+	// the first hardware encoder that works, else the Save library
+	ENCODER_BACKEND_AUTO,
+
+	// the Save library's H.264 recorder, from BGR8
+	ENCODER_BACKEND_SAVE,
+
+	// software H.264 through libx264
+	ENCODER_BACKEND_X264,
+
+	// software HEVC through libx265
+	ENCODER_BACKEND_X265,
+
+	// NVIDIA GPUs through NVENC
+	ENCODER_BACKEND_NVENC,
+
+	// Intel and AMD GPUs through VAAPI
+	ENCODER_BACKEND_VAAPI,
+
+	// Jetson hardware encoder through NVIDIA's L4T FFmpeg or jetson-ffmpeg
+	ENCODER_BACKEND_JETSON
+};
+
+// largest width or height the hardware back ends encode as H.264
+//    NVENC, VAAPI and the Jetson encoder all stop at 4096 pixels, which a
+//    mosaic of full sensor planes is past.
+#define HARDWARE_H264_MAX_SIZE 4096
+
+// true for the back ends that encode on a GPU or a hardware encoder block
+bool IsHardwareBackend(EncoderBackend backend);
+
+// parses a back end name: auto, save, x264, x265, nvenc, vaapi or jetson
+bool ParseEncoderBackend(const char* name, EncoderBackend& backend);
+
+const char* GetEncoderBackendName(EncoderBackend backend);
+
+// creates and opens the encoder for one video stream
+//    The chosen back end is probed once per process by opening an encoder
+//    session at the stream's size, then opened for the stream itself. If
+//    either fails, for instance because the GPU or its driver is missing or
+//    NVENC is past its session limit, the stream falls back to the Save
+//    library's H.264 BGR8 recorder with a warning. Safe to call from several
+//    threads.
+//
+//    With a bitDepth of 12 the stream takes ENCODER_INPUT_MONO16 planes and
+//    is encoded as HEVC; auto then falls back to libx265. There is no 12-bit
+//    fallback beyond that, so this throws if no HEVC encoder opens.
+//
+//    pStats, if not NULL, gets the latency of the FFmpeg encoders' disk
+//    writes; the Save library writes its files itself.
+std::unique_ptr<VideoEncoder> CreateVideoEncoder(const std::string& fileName, size_t width, size_t height, double fps, EncoderBackend backend, unsigned int bitDepth = 8, FrameStats* pStats = NULL);
+
+#ifdef USE_CUDA
+// creates and opens an NVENC encoder that takes Mono8 planes in CUDA device
+// memory
+//    The planes are copied into NVENC's surfaces on the GPU, so they never
+//    cross PCIe. Returns NULL if NVENC does not open, or without FFmpeg, in
+//    which case the planes have to come back to the host for
+//    CreateVideoEncoder()'s encoders.
+std::unique_ptr<VideoEncoder> CreateCudaVideoEncoder(const std::string& fileName, size_t width, size_t height, double fps, FrameStats* pStats = NULL);
+#endif
@@ -0,0 +1,135 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+#include "VideoWorker.h"
+
+VideoWorker::VideoWorker(std::unique_ptr<VideoEncoder> pEncoder, const std::string& fileName, PlanePool* pPool, EncoderPool* pEncoders, FrameStats* pStats)
+	: m_fileName(fileName)
+	, m_pEncoder(std::move(pEncoder))
+	, m_pPool(pPool)
+	, m_pEncoders(pEncoders)
+	, m_pStats(pStats)
+	, m_scheduled(false)
+	, m_failed(false)
+{
+}
+
+VideoWorker::~VideoWorker()
+{
+	WaitIdle();
+}
+
+EncoderInput VideoWorker::GetInput() const
+{
+	return m_pEncoder->GetInput();
+}
+
+void VideoWorker::Submit(uint8_t* pPlane, uint64_t sequence)
+{
+	bool schedule = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		PendingPlane pending = { pPlane, sequence };
+		m_pending.push_back(pending);
+
+		if (!m_scheduled)
+			m_scheduled = schedule = true;
+	}
+
+	if (schedule)
+		m_pEncoders->Schedule(this);
+}
+
+bool VideoWorker::HasFailed() const
+{
+	return m_failed;
+}
+
+// finishes the file
+//    A failed worker still closes its encoder, so the frames appended
+//    before the failure stay playable. The append error is rethrown
+//    first, otherwise the close error.
+void VideoWorker::Close()
+{
+	WaitIdle();
+
+	std::exception_ptr closeError;
+
+	try
+	{
+		m_pEncoder->Close();
+	}
+	catch (...)
+	{
+		closeError = std::current_exception();
+	}
+
+	if (m_error)
+		std::rethrow_exception(m_error);
+
+	if (closeError)
+		std::rethrow_exception(closeError);
+}
+
+// appends one plane
+//    After a failure the worker keeps handing planes back unrecorded, so
+//    the demux never waits on a worker that has stopped.
+bool VideoWorker::RecordNext()
+{
+	PendingPlane pending;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		pending = m_pending.front();
+		m_pending.pop_front();
+	}
+
+	if (!m_failed)
+	{
+		try
+		{
+			m_pEncoder->AppendImage(pending.pPlane);
+		}
+		catch (...)
+		{
+			m_error = std::current_exception();
+			m_failed = true;
+		}
+	}
+
+	m_pPool->Release(pending.pPlane);
+
+	if (m_pStats != NULL)
+		m_pStats->Encoded(pending.sequence);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_pending.empty())
+		return true;
+
+	m_scheduled = false;
+	m_idle.notify_all();
+	return false;
+}
+
+// waits until the encoder pool is done with this worker
+void VideoWorker::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this] { return !m_scheduled; });
+}
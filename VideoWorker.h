@@ -0,0 +1,92 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#pragma once
+
+#include "EncoderPool.h"
+#include "FrameStats.h"
+#include "PlanePool.h"
+#include "VideoEncoder.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// VideoWorker
+//    Records one video stream on the threads of a shared EncoderPool, so all
+//    streams encode side by side without a thread each. The demux fills a
+//    plane from the shared PlanePool in the encoder's input layout and hands
+//    it over with Submit(); the worker appends it to the video and returns it
+//    to the pool. A worker that falls behind holds on to more planes, until
+//    the pool runs dry and the demux has to wait for it. Given FrameStats,
+//    the worker reports each frame once it has been appended.
+class VideoWorker
+{
+public:
+	// pEncoder is open, as CreateVideoEncoder() returns it; pStats may be
+	// NULL
+	VideoWorker(std::unique_ptr<VideoEncoder> pEncoder, const std::string& fileName, PlanePool* pPool, EncoderPool* pEncoders, FrameStats* pStats);
+	~VideoWorker();
+
+	// input layout of the frames the worker takes
+	EncoderInput GetInput() const;
+
+	// queues a filled pool plane for recording
+	//    sequence is the frame's FrameStats sequence number.
+	void Submit(uint8_t* pPlane, uint64_t sequence);
+
+	// true once recording failed; Close() then reports why
+	bool HasFailed() const;
+
+	// waits for the remaining images to be recorded and closes the video
+	//    The video is closed even after a failure; then rethrows the
+	//    exception that stopped the worker, or else the close error.
+	void Close();
+
+	// records the oldest pending plane; called by the encoder pool
+	//    Returns true if more planes are waiting, in which case the pool
+	//    queues the worker again.
+	bool RecordNext();
+
+private:
+	VideoWorker(const VideoWorker&);
+	VideoWorker& operator=(const VideoWorker&);
+
+	void WaitIdle();
+
+	struct PendingPlane
+	{
+		uint8_t* pPlane;
+		uint64_t sequence;
+	};
+
+	std::string m_fileName;
+	std::unique_ptr<VideoEncoder> m_pEncoder;
+	PlanePool* m_pPool;
+	EncoderPool* m_pEncoders;
+	FrameStats* m_pStats;
+	std::mutex m_mutex;
+	std::condition_variable m_idle;
+	std::deque<PendingPlane> m_pending;
+
+	// true while the worker is queued in or run by the encoder pool
+	bool m_scheduled;
+
+	std::atomic<bool> m_failed;
+	std::exception_ptr m_error;
+};
@@ -0,0 +1,747 @@
+/***************************************************************************************
+ ***                                                                                 ***
+ ***  Copyright (c) 2023, Lucid Vision Labs, Inc.                                    ***
+ ***                                                                                 ***
+ ***  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR     ***
+ ***  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,       ***
+ ***  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE    ***
+ ***  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER         ***
+ ***  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,  ***
+ ***  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE  ***
+ ***  SOFTWARE.                                                                      ***
+ ***                                                                                 ***
+ ***************************************************************************************/
+
+
+#include "stdafx.h"
+#include "ArenaApi.h"
+#include "Deinterleave.h"
+#include "EncoderPool.h"
+#include "Mono12.h"
+#include "PlaneCodec.h"
+#include "PlanePool.h"
+#include "RawReader.h"
+#include "Stokes.h"
+#include "TemporalFilter.h"
+#include "Threading.h"
+#include "VideoEncoder.h"
+#include "VideoWorker.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define TAB1 "  "
+
+// Cpp_Record_Bench: Benchmark
+//    Times the stages of the recorder on PolarizedAngles_0d_45d_90d_135d_Mono8
+//    frames without a camera, so changes can be checked for regressions and
+//    hosts sized before cameras are attached. Frames are synthetic, or loaded
+//    from a raw recording made with record -raw. Every demux kernel, the
+//    fused BGR8 conversion, the cropped and scaled demux, the 12-bit demux
+//    with and without its frame kernels, every Stokes kernel, the Stokes
+//    stage, every temporal filter kernel, the lossless codec and each
+//    encoder back end is timed at several resolutions and thread counts.
+
+// =-=-=-=-=-=-=-=-=-
+// =-=- SETTINGS =-=-
+// =-=-=-=-=-=-=-=-=-
+
+// Resolutions
+//    The camera's full 2448x2048 frame and its half and quarter size
+//    regions. A loaded recording replaces them with its own size.
+#define RESOLUTIONS "612x512,1224x1024,2448x2048"
+
+// Thread counts
+//    Stokes stage bands, lossless codec slices and encoder pool threads to
+//    time.
+#define THREAD_COUNTS "1,2,4"
+
+// Frames
+//    Frames timed per measurement, after one untimed warm-up frame. FRAME_SET
+//    distinct frames are cycled through so that no measurement runs on a
+//    single frame that stays in cache.
+#define NUM_FRAMES 30
+#define FRAME_SET 4
+
+// Encoder output
+//    Encoded videos are written with this prefix and removed afterwards.
+#define FILE_PREFIX "bench_"
+
+// planes kept in flight per stream, as in the recorder
+#define PLANE_POOL_FRAMES 5
+
+// =-=-=-=-=-=-=-=-=-
+// =-=- BENCHMARK -=-
+// =-=-=-=-=-=-=-=-=-
+
+struct Resolution
+{
+	size_t width;
+	size_t height;
+};
+
+struct BenchSettings
+{
+	std::vector<Resolution> resolutions;
+	std::vector<int> threadCounts;
+	std::vector<EncoderBackend> backends;
+	size_t numFrames = NUM_FRAMES;
+	std::string rawFile;
+	std::string csvFile;
+	bool encode = true;
+};
+
+// interleaved source frames of one resolution
+struct FrameSet
+{
+	size_t width;
+	size_t height;
+	std::vector<std::vector<uint8_t>> frames;
+};
+
+// prints and records one measurement
+class Results
+{
+public:
+	explicit Results(const std::string& csvFile)
+	{
+		if (csvFile.empty())
+			return;
+
+		m_csv.open(csvFile.c_str());
+		if (!m_csv)
+			throw std::runtime_error("Could not create " + csvFile);
+
+		m_csv << "stage,variant,width,height,threads,msPerFrame,megapixelsPerSecond\n";
+	}
+
+	void Add(const char* stage, const std::string& variant, const FrameSet& set, unsigned int threads, double secondsPerFrame)
+	{
+		const double megapixels = set.width * set.height / 1e6;
+
+		std::cout << TAB1 << std::left << std::setw(12) << stage << std::setw(34) << variant
+				<< std::right << std::setw(5) << set.width << "x" << std::left << std::setw(6) << set.height
+				<< std::right << std::setw(3) << threads << " threads"
+				<< std::fixed << std::setprecision(3) << std::setw(10) << 1000.0 * secondsPerFrame << " ms"
+				<< std::setprecision(1) << std::setw(10) << megapixels / secondsPerFrame << " MP/s\n";
+
+		if (m_csv.is_open())
+			m_csv << stage << "," << variant << "," << set.width << "," << set.height << "," << threads << ","
+					<< std::fixed << std::setprecision(4) << 1000.0 * secondsPerFrame << "," << megapixels / secondsPerFrame << "\n";
+	}
+
+private:
+	Results(const Results&);
+	Results& operator=(const Results&);
+
+	std::ofstream m_csv;
+};
+
+double Now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// parses a comma separated list of WIDTHxHEIGHT
+bool ParseResolutions(const char* text, std::vector<Resolution>& resolutions)
+{
+	resolutions.clear();
+
+	while (*text != '\0')
+	{
+		char* end = NULL;
+		Resolution resolution;
+		resolution.width = strtoul(text, &end, 10);
+
+		if (end == text || *end != 'x')
+			return false;
+
+		text = end + 1;
+		resolution.height = strtoul(text, &end, 10);
+
+		if (end == text || resolution.width == 0 || resolution.height == 0)
+			return false;
+
+		resolutions.push_back(resolution);
+
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+			return false;
+
+		text = end;
+	}
+
+	return !resolutions.empty();
+}
+
+// builds frames of pseudo-random pixels
+//    Random data is the worst case for the encoders, which is what a sizing
+//    run should plan for; the kernels do not care.
+FrameSet MakeSyntheticFrames(const Resolution& resolution)
+{
+	FrameSet set;
+	set.width = resolution.width;
+	set.height = resolution.height;
+
+	uint32_t state = 0x2545F491u;
+
+	for (size_t f = 0; f < FRAME_SET; f++)
+	{
+		set.frames.push_back(std::vector<uint8_t>(4 * set.width * set.height));
+
+		std::vector<uint8_t>& frame = set.frames.back();
+		for (size_t i = 0; i < frame.size(); i++)
+		{
+			state = state * 1664525u + 1013904223u;
+			frame[i] = static_cast<uint8_t>(state >> 24);
+		}
+	}
+
+	return set;
+}
+
+// loads the first frames of a raw recording as interleaved frames
+//    Planar recordings are interleaved again, so every stage sees the
+//    buffer layout the camera sends.
+FrameSet LoadRawFrames(const std::string& fileName)
+{
+	RawReader reader(fileName);
+	const RawFileHeader& header = reader.GetHeader();
+
+	if (header.layout == RAW_LAYOUT_INTERLEAVED ? header.bytesPerPixel != 4 : header.bytesPerPixel != 1)
+		throw std::runtime_error(fileName + " does not hold 8-bit angle planes");
+
+	if (reader.GetFrameCount() == 0)
+		throw std::runtime_error(fileName + " holds no frames");
+
+	FrameSet set;
+	set.width = header.width;
+	set.height = header.height;
+
+	for (uint64_t index = 0; index < std::min<uint64_t>(reader.GetFrameCount(), FRAME_SET); index++)
+	{
+		set.frames.push_back(std::vector<uint8_t>(4 * set.width * set.height));
+
+		uint8_t* pFrame = set.frames.back().data();
+
+		for (size_t angle = 0; angle < 4; angle++)
+		{
+			RawPlaneView plane = reader.GetPlane(index, angle);
+
+			for (size_t y = 0; y < plane.height; y++)
+				for (size_t x = 0; x < plane.width; x++)
+					pFrame[4 * (y * set.width + x) + angle] = plane.pData[y * plane.rowStride + x * plane.pixelStride];
+		}
+	}
+
+	return set;
+}
+
+// times one demux kernel family
+void BenchDeinterleave(const char* stage, const std::vector<DeinterleaveKernel>& kernels, size_t bytesPerPixel, const FrameSet& set, size_t numFrames, Results& results)
+{
+	const size_t numPixels = set.width * set.height;
+	std::vector<uint8_t> planes(4 * numPixels * bytesPerPixel);
+	uint8_t* pPlanes[4] = { &planes[0], &planes[numPixels * bytesPerPixel], &planes[2 * numPixels * bytesPerPixel], &planes[3 * numPixels * bytesPerPixel] };
+
+	for (size_t k = 0; k < kernels.size(); k++)
+	{
+		kernels[k].function(set.frames[0].data(), numPixels, pPlanes[0], pPlanes[1], pPlanes[2], pPlanes[3]);
+
+		const double start = Now();
+
+		for (size_t f = 0; f < numFrames; f++)
+			kernels[k].function(set.frames[f % set.frames.size()].data(), numPixels, pPlanes[0], pPlanes[1], pPlanes[2], pPlanes[3]);
+
+		results.Add(stage, kernels[k].name, set, 1, (Now() - start) / numFrames);
+	}
+}
+
+// times the region demux of the fastest kernel
+//    A centred half-size crop, then the whole frame shrunk by 2 and 4, the
+//    host side trade of resolution for encode and disk cost.
+void BenchRegion(const FrameSet& set, size_t numFrames, Results& results)
+{
+	const FrameRegion crop = { set.width / 4, set.height / 4, set.width / 2, set.height / 2 };
+	const FrameRegion frame = { 0, 0, set.width, set.height };
+	const FrameRegion regions[] = { crop, frame, frame };
+	const size_t scales[] = { 1, 2, 4 };
+	const char* names[] = { "crop 1/2", "scale 1/2", "scale 1/4" };
+
+	const size_t numPixels = set.width * set.height;
+	std::vector<uint8_t> planes(4 * numPixels);
+	uint8_t* pPlanes[4] = { &planes[0], &planes[numPixels], &planes[2 * numPixels], &planes[3 * numPixels] };
+
+	for (size_t r = 0; r < sizeof(regions) / sizeof(regions[0]); r++)
+	{
+		RegionDemux demux(GetDeinterleaveKernel(), 1, set.width, set.height, regions[r], scales[r]);
+
+		demux.Process(set.frames[0].data(), numPixels, pPlanes, demux.GetWidth());
+
+		const double start = Now();
+
+		for (size_t f = 0; f < numFrames; f++)
+			demux.Process(set.frames[f % set.frames.size()].data(), numPixels, pPlanes, demux.GetWidth());
+
+		results.Add("region", names[r], set, 1, (Now() - start) / numFrames);
+	}
+}
+
+// times one 12-bit unpack kernel family, then the polarizer demosaic
+//    The frames' bytes stand in for packed pixels, which any bytes are.
+void BenchUnpack12(const char* stage, const std::vector<Unpack12Kernel>& kernels, const FrameSet& set, size_t numFrames, Results& results)
+{
+	const size_t numPixels = set.width * set.height;
+	std::vector<uint16_t> samples(numPixels);
+
+	for (size_t k = 0; k < kernels.size(); k++)
+	{
+		kernels[k].function(set.frames[0].data(), numPixels, samples.data());
+
+		const double start = Now();
+
+		for (size_t f = 0; f < numFrames; f++)
+			kernels[k].function(set.frames[f % set.frames.size()].data(), numPixels, samples.data());
+
+		results.Add(stage, kernels[k].name, set, 1, (Now() - start) / numFrames);
+	}
+}
+
+void BenchDemosaic(const FrameSet& set, size_t numFrames, Results& results)
+{
+	const size_t numPixels = set.width * set.height;
+	std::vector<uint16_t> samples(numPixels);
+	std::vector<uint16_t> planes(4 * numPixels);
+	uint16_t* pPlanes[4] = { &planes[0], &planes[numPixels], &planes[2 * numPixels], &planes[3 * numPixels] };
+
+	GetUnpack12pKernel().function(set.frames[0].data(), numPixels, samples.data());
+	DemosaicPolarizer(samples.data(), set.width, set.height, pPlanes, set.width);
+
+	const double start = Now();
+
+	for (size_t f = 0; f < numFrames; f++)
+		DemosaicPolarizer(samples.data(), set.width, set.height, pPlanes, set.width);
+
+	results.Add("demosaic", "bilinear", set, 1, (Now() - start) / numFrames);
+}
+
+// times the 12-bit demux of each layout as the recorder runs it, the
+// generic unpack and demosaic, then the frame kernel of the width if the
+// table has one
+//    The frames' bytes stand in for packed pixels, as with the unpack.
+void BenchMono12Demux(const FrameSet& set, size_t numFrames, Results& results)
+{
+	const Mono12Layout layouts[] = { MONO12_LAYOUT_MOSAIC_12P, MONO12_LAYOUT_DOLP_AOLP_12P };
+	const char* stages[] = { "demux 12p", "demux dolp" };
+	const size_t numPixels = set.width * set.height;
+	std::vector<uint16_t> planes(4 * numPixels);
+	uint16_t* pPlanes[4] = { &planes[0], &planes[numPixels], &planes[2 * numPixels], &planes[3 * numPixels] };
+
+	for (size_t l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++)
+	{
+		for (int frameKernel = 0; frameKernel < 2; frameKernel++)
+		{
+			Mono12Demux demux(layouts[l], set.width, set.height, frameKernel != 0);
+
+			if (frameKernel && demux.GetFrameKernelName() == NULL)
+				continue;
+
+			demux.Process(set.frames[0].data(), demux.GetFrameSize(), pPlanes, set.width);
+
+			const double start = Now();
+
+			for (size_t f = 0; f < numFrames; f++)
+				demux.Process(set.frames[f % set.frames.size()].data(), demux.GetFrameSize(), pPlanes, set.width);
+
+			results.Add(stages[l], std::string(demux.GetKernelName()) + (frameKernel ? std::string(" ") + demux.GetFrameKernelName() : " generic"), set, 1, (Now() - start) / numFrames);
+		}
+	}
+}
+
+// times every temporal filter kernel on the four demuxed angle planes,
+// running average and window, 8-bit and 12-bit
+//    The frames cycle, so the filters see changing samples as they would
+//    in a recording.
+void BenchTemporalFilter(const FrameSet& set, size_t numFrames, Results& results)
+{
+	const size_t numPixels = set.width * set.height;
+	const std::vector<TemporalFilterKernel> kernels = GetTemporalFilterKernels();
+	const unsigned int shift = 2;
+	const char* names[] = { " denoise 8 bit", " integrate 8 bit", " denoise 12 bit", " integrate 12 bit" };
+	std::vector<uint8_t> planes8(4 * numPixels);
+	std::vector<uint16_t> planes16(4 * numPixels);
+	std::vector<int16_t> state(4 * numPixels);
+	std::vector<uint8_t> oldest8(4 * numPixels);
+	std::vector<uint16_t> oldest16(4 * numPixels);
+	std::vector<uint16_t> sums(4 * numPixels);
+
+	for (size_t k = 0; k < kernels.size(); k++)
+	{
+		const TemporalFilterKernel& kernel = kernels[k];
+
+		for (int variant = 0; variant < 4; variant++)
+		{
+			double seconds = 0.0;
+
+			for (size_t f = 0; f <= numFrames; f++)
+			{
+				// the interleaved frame stands in for four planes, and its
+				// bytes widened for 12-bit samples
+				const std::vector<uint8_t>& frame = set.frames[f % set.frames.size()];
+				if (variant < 2)
+					planes8.assign(frame.begin(), frame.end());
+				else
+					for (size_t i = 0; i < planes16.size(); i++)
+						planes16[i] = static_cast<uint16_t>(frame[i] << 4);
+
+				const double start = Now();
+
+				if (variant == 0)
+					kernel.recursive8(planes8.data(), state.data(), planes8.size(), shift, 24 << 7);
+				else if (variant == 1)
+					kernel.window8(planes8.data(), oldest8.data(), sums.data(), planes8.size(), shift);
+				else if (variant == 2)
+					kernel.recursive16(planes16.data(), state.data(), planes16.size(), shift, 384 << 3);
+				else
+					kernel.window16(planes16.data(), oldest16.data(), sums.data(), planes16.size(), shift);
+
+				// the first frame warms up
+				if (f > 0)
+					seconds += Now() - start;
+			}
+
+			results.Add("temporal", std::string(kernel.name) + names[variant], set, 1, seconds / numFrames);
+		}
+	}
+}
+
+// times the lossless codec on the demuxed angle planes at each thread
+// count, one slice per thread
+//    The variant reports the compression ratio; synthetic frames are noise,
+//    which only the stored slices can hold.
+void BenchLossless(const FrameSet& set, const BenchSettings& settings, Results& results)
+{
+	const size_t numPixels = set.width * set.height;
+	std::vector<std::vector<uint8_t>> planes(set.frames.size(), std::vector<uint8_t>(4 * numPixels));
+
+	for (size_t f = 0; f < set.frames.size(); f++)
+	{
+		uint8_t* pPlanes = planes[f].data();
+		GetDeinterleaveKernel().function(set.frames[f].data(), numPixels, pPlanes, pPlanes + numPixels, pPlanes + 2 * numPixels, pPlanes + 3 * numPixels);
+	}
+
+	for (size_t t = 0; t < settings.threadCounts.size(); t++)
+	{
+		const unsigned int numThreads = static_cast<unsigned int>(settings.threadCounts[t]);
+		PlaneCodec codec(set.width, set.height, 4, 1, 8, numThreads, numThreads);
+		std::vector<uint8_t> code(codec.GetMaxEncodedSize());
+		std::vector<uint8_t> decoded(4 * numPixels);
+
+		size_t codeSize = codec.Encode(planes[0].data(), numPixels, code.data());
+		uint64_t totalSize = 0;
+
+		double start = Now();
+
+		for (size_t f = 0; f < settings.numFrames; f++)
+		{
+			codeSize = codec.Encode(planes[f % planes.size()].data(), numPixels, code.data());
+			totalSize += codeSize;
+		}
+
+		char variant[32];
+		snprintf(variant, sizeof(variant), "encode %.2f:1", static_cast<double>(settings.numFrames * 4 * numPixels) / totalSize);
+		results.Add("lossless", variant, set, codec.GetNumThreads(), (Now() - start) / settings.numFrames);
+
+		// the last frame encoded is decoded over and over
+		start = Now();
+
+		for (size_t f = 0; f < settings.numFrames; f++)
+			codec.Decode(code.data(), codeSize, decoded.data(), numPixels);
+
+		results.Add("lossless", "decode", set, codec.GetNumThreads(), (Now() - start) / settings.numFrames);
+	}
+}
+
+// times every Stokes kernel on one thread, then the stage on each thread
+// count
+//    The stage includes the 8-bit DoLP and AoLP planes the recorder encodes.
+void BenchStokes(const FrameSet& set, const BenchSettings& settings, Results& results)
+{
+	const size_t numPixels = set.width * set.height;
+
+	std::vector<uint8_t> planes(4 * numPixels);
+	DeinterleaveScalar(set.frames[0].data(), numPixels, &planes[0], &planes[numPixels], &planes[2 * numPixels], &planes[3 * numPixels]);
+
+	StokesInput in = { { &planes[0], &planes[numPixels], &planes[2 * numPixels], &planes[3 * numPixels] } };
+
+	std::vector<float> outputPlanes(5 * numPixels);
+	StokesOutput out = { &outputPlanes[0], &outputPlanes[numPixels], &outputPlanes[2 * numPixels], &outputPlanes[3 * numPixels], &outputPlanes[4 * numPixels] };
+
+	for (int fast = 0; fast < 2; fast++)
+	{
+		const std::vector<StokesKernel> kernels = fast ? GetStokesFastKernels() : GetStokesKernels();
+
+		for (size_t k = 0; k < kernels.size(); k++)
+		{
+			kernels[k].function(in, out, 0, numPixels);
+
+			const double start = Now();
+
+			for (size_t f = 0; f < settings.numFrames; f++)
+				kernels[k].function(in, out, 0, numPixels);
+
+			results.Add("stokes", std::string(kernels[k].name) + (fast ? " fast" : ""), set, 1, (Now() - start) / settings.numFrames);
+		}
+	}
+
+	std::vector<uint8_t> dolp(numPixels);
+	std::vector<uint8_t> aolp(numPixels);
+
+	for (int fast = 0; fast < 2; fast++)
+	{
+		for (size_t t = 0; t < settings.threadCounts.size(); t++)
+		{
+			StokesStage stage(set.width, set.height, settings.threadCounts[t], fast != 0);
+			stage.Process(in, numPixels, &dolp[0], &aolp[0], 1);
+
+			const double start = Now();
+
+			for (size_t f = 0; f < settings.numFrames; f++)
+				stage.Process(in, numPixels, &dolp[0], &aolp[0], 1);
+
+			results.Add("stokesstage", std::string(stage.GetKernelName()) + (fast ? " fast" : "") + " to 8 bit", set, stage.GetNumThreads(), (Now() - start) / settings.numFrames);
+		}
+	}
+}
+
+// times the four angle streams of one back end as the recorder runs them
+// (1) prepares an encoder and worker per angle on a shared encoder pool
+// (2) demuxes and submits every frame
+// (3) closes video, which waits for the last frame
+//    The time is per frame of all four streams, from the first submission to
+//    the closed files, so it includes what the demux adds to the pipeline.
+void BenchEncoder(EncoderBackend backend, const FrameSet& set, unsigned int numThreads, size_t numFrames, Results& results)
+{
+	std::vector<std::unique_ptr<VideoEncoder>> encoders;
+	std::vector<std::string> fileNames;
+
+	for (size_t angle = 0; angle < 4; angle++)
+	{
+		fileNames.push_back(FILE_PREFIX + std::to_string(angle) + ".mp4");
+		encoders.push_back(CreateVideoEncoder(fileNames[angle], set.width, set.height, 10.0, backend));
+	}
+
+	const EncoderInput input = encoders[0]->GetInput();
+	const size_t bytesPerPixel = GetBytesPerPixel(input);
+	const std::string description = encoders[0]->GetDescription();
+	const DeinterleaveKernel& deinterleave = input == ENCODER_INPUT_MONO8 ? GetDeinterleaveKernel() : GetDeinterleaveBgr8Kernel();
+
+	PlanePool pool(set.width * set.height * bytesPerPixel, 4 * PLANE_POOL_FRAMES);
+	EncoderPool encoderPool(numThreads, std::vector<int>());
+	std::vector<std::unique_ptr<VideoWorker>> workers;
+
+	for (size_t angle = 0; angle < 4; angle++)
+		workers.push_back(std::unique_ptr<VideoWorker>(new VideoWorker(std::move(encoders[angle]), fileNames[angle], &pool, &encoderPool, NULL)));
+
+	const double start = Now();
+
+	for (size_t f = 0; f < numFrames; f++)
+	{
+		uint8_t* pPlanes[4];
+		for (size_t angle = 0; angle < 4; angle++)
+			pPlanes[angle] = pool.Acquire();
+
+		deinterleave.function(set.frames[f % set.frames.size()].data(), set.width * set.height, pPlanes[0], pPlanes[1], pPlanes[2], pPlanes[3]);
+
+		for (size_t angle = 0; angle < 4; angle++)
+			workers[angle]->Submit(pPlanes[angle], f);
+	}
+
+	for (size_t angle = 0; angle < 4; angle++)
+		workers[angle]->Close();
+
+	const double seconds = Now() - start;
+
+	workers.clear();
+
+	for (size_t angle = 0; angle < 4; angle++)
+		std::remove(fileNames[angle].c_str());
+
+	results.Add("encode", description, set, encoderPool.GetNumThreads(), seconds / numFrames);
+}
+
+void usage(char* app)
+{
+	std::cout << "Usage:\n";
+	std::cout << app << " [-r resolutions] [-t threadCounts] [-n numFrames] [-backend names] [-noencode] [-raw rawFile] [-csv fileName]\n";
+	std::cout << "Where:\n";
+	std::cout << "resolutions:  comma separated WIDTHxHEIGHT sizes to time. Default is " << RESOLUTIONS << ".\n";
+	std::cout << "threadCounts: comma separated Stokes and encoder thread counts. Default is " << THREAD_COUNTS << ".\n";
+	std::cout << "numFrames:    frames timed per measurement. Default is " << NUM_FRAMES << ".\n";
+	std::cout << "names:        comma separated encoder back ends to time, as for record -backend. Default is save,\n";
+	std::cout << "              and x264 in USE_FFMPEG builds. Unavailable back ends time the Save library instead.\n";
+	std::cout << "-noencode:    skip the encoders, which take longest.\n";
+	std::cout << "rawFile:      time the first frames of a raw recording instead of synthetic frames.\n";
+	std::cout << "fileName:     also write every measurement as CSV, to compare runs.\n";
+	std::cout << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+	std::cout << "\nCpp_Record_Bench\n\n";
+
+	// Parse command line args
+	BenchSettings settings;
+	ParseResolutions(RESOLUTIONS, settings.resolutions);
+	ParseCpuList(THREAD_COUNTS, settings.threadCounts);
+
+	settings.backends.push_back(ENCODER_BACKEND_SAVE);
+#ifdef USE_FFMPEG
+	settings.backends.push_back(ENCODER_BACKEND_X264);
+#endif
+
+	for (int32_t i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-r") == 0) && (i + 1 < argc))
+		{
+			if (!ParseResolutions(argv[++i], settings.resolutions))
+			{
+				std::cout << "Invalid resolution list [" << argv[i] << "]\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-t") == 0) && (i + 1 < argc))
+		{
+			if (!ParseCpuList(argv[++i], settings.threadCounts) || std::find(settings.threadCounts.begin(), settings.threadCounts.end(), 0) != settings.threadCounts.end())
+			{
+				std::cout << "Invalid thread count list [" << argv[i] << "]\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc))
+		{
+			settings.numFrames = strtoul(argv[++i], NULL, 10);
+
+			if (settings.numFrames == 0)
+			{
+				std::cout << "Number of frames must be greater than 0.\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-backend") == 0) && (i + 1 < argc))
+		{
+			settings.backends.clear();
+
+			std::string list(argv[++i]);
+			size_t begin = 0;
+
+			while (begin <= list.size())
+			{
+				size_t end = std::min(list.find(',', begin), list.size());
+				EncoderBackend backend;
+
+				if (!ParseEncoderBackend(list.substr(begin, end - begin).c_str(), backend))
+				{
+					std::cout << "Invalid encoder back end list [" << argv[i] << "]\n";
+					return -1;
+				}
+
+				settings.backends.push_back(backend);
+				begin = end + 1;
+			}
+		}
+		else if (strcmp(argv[i], "-noencode") == 0)
+		{
+			settings.encode = false;
+		}
+		else if ((strcmp(argv[i], "-raw") == 0) && (i + 1 < argc))
+		{
+			settings.rawFile = argv[++i];
+		}
+		else if ((strcmp(argv[i], "-csv") == 0) && (i + 1 < argc))
+		{
+			settings.csvFile = argv[++i];
+		}
+		else if (strcmp(argv[i], "--help") == 0)
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else
+		{
+			std::cout << "Invalid argument [" << argv[i] << "]\n";
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	try
+	{
+		Results results(settings.csvFile);
+
+		// timings mean little from kernels that are wrong
+		if (!VerifyDeinterleaveKernels() || !VerifyUnpack12Kernels() || !VerifyStokesKernels() || !VerifyTemporalFilterKernels() || !VerifyPlaneCodec())
+			throw std::runtime_error("Kernel self test failed");
+
+		std::cout << "\n" << GetCpuCount() << " CPUs\n";
+
+		std::vector<FrameSet> sets;
+
+		if (!settings.rawFile.empty())
+		{
+			sets.push_back(LoadRawFrames(settings.rawFile));
+			std::cout << "Loaded " << sets[0].frames.size() << " frames of " << settings.rawFile << "\n";
+		}
+		else
+		{
+			for (size_t r = 0; r < settings.resolutions.size(); r++)
+				sets.push_back(MakeSyntheticFrames(settings.resolutions[r]));
+		}
+
+		for (size_t s = 0; s < sets.size(); s++)
+		{
+			std::cout << "\n" << sets[s].width << "x" << sets[s].height << "\n";
+
+			BenchDeinterleave("demux", GetDeinterleaveKernels(), 1, sets[s], settings.numFrames, results);
+			BenchDeinterleave("demux bgr8", GetDeinterleaveBgr8Kernels(), 3, sets[s], settings.numFrames, results);
+			BenchRegion(sets[s], settings.numFrames, results);
+			BenchUnpack12("unpack 12p", GetUnpack12pKernels(), sets[s], settings.numFrames, results);
+			BenchUnpack12("unpack 12pk", GetUnpack12PackedKernels(), sets[s], settings.numFrames, results);
+			BenchDemosaic(sets[s], settings.numFrames, results);
+			BenchMono12Demux(sets[s], settings.numFrames, results);
+			BenchStokes(sets[s], settings, results);
+			BenchTemporalFilter(sets[s], settings.numFrames, results);
+			BenchLossless(sets[s], settings, results);
+
+			if (!settings.encode)
+				continue;
+
+			for (size_t b = 0; b < settings.backends.size(); b++)
+				for (size_t t = 0; t < settings.threadCounts.size(); t++)
+					BenchEncoder(settings.backends[b], sets[s], settings.threadCounts[t], settings.numFrames, results);
+		}
+	}
+	catch (GenICam::GenericException& ge)
+	{
+		std::cout << "\nGenICam exception thrown: " << ge.what() << "\n";
+		return -1;
+	}
+	catch (std::exception& ex)
+	{
+		std::cout << "\nStandard exception thrown: " << ex.what() << "\n";
+		return -1;
+	}
+
+	std::cout << "\nBenchmark complete\n";
+	return 0;
+}
@@ -15,7 +15,40 @@
 #include "stdafx.h"
 #include "ArenaApi.h"
 #include "SaveApi.h"
+#include "FrameQueue.h"
+#include "FrameMetadata.h"
+#include "FrameStats.h"
+#include "Deinterleave.h"
+#include "CudaStage.h"
+#include "EncoderPool.h"
+#include "Mono12.h"
+#include "NodeCache.h"
+#include "PlaneCodec.h"
+#include "PlanePool.h"
+#include "PtpSync.h"
+#include "RawReader.h"
+#include "RawWriter.h"
+#include "SharedFrames.h"
+#include "Stokes.h"
+#include "TemporalFilter.h"
+#include "Threading.h"
+#include "VideoEncoder.h"
+#include "VideoWorker.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 #define TAB1 "  "
 #define TAB2 "    "
@@ -49,8 +82,48 @@
 #define FRAMES_PER_SECOND 10.0
 
 // number of images to grab
+//    A value of 0 keeps recording until the example is stopped with Ctrl+C.
 #define NUM_IMAGES 50
 
+// Queue depth
+//    Images are recorded while they are being captured. Captured images wait
+//    in a bounded queue until the recorder picks them up; when the queue is
+//    full, acquisition waits for the recorder. Memory use is therefore bounded
+//    by the queue depth rather than by the number of images, at roughly 20 MB
+//    per queued image at full resolution.
+#define QUEUE_DEPTH 8
+
+// Stream buffers
+//    By default each image is copied out of its stream buffer so the buffer
+//    can go straight back to the driver. In zero-copy mode the recorder demuxes
+//    directly from the stream buffer and requeues it afterwards, which means
+//    queued images hold on to stream buffers. The pool is then sized to fit a
+//    full queue plus a reserve that is always left to the driver; an image is
+//    only copied when the recorder falls so far behind that the reserve would
+//    be touched. Either way the pool holds at least STREAM_BUFFER_S seconds
+//    of frames at the frame rate, so the driver rides out the host stalling
+//    for that long, as far as STREAM_BUFFER_BUDGET_MB of buffers allow.
+#define STREAM_BUFFER_RESERVE 2
+#define STREAM_BUFFER_S 0.5
+#define STREAM_BUFFER_BUDGET_MB 1024
+
+// Transport
+//    A busy link or NIC loses packets at high resolution, which shows as
+//    resends and then as incomplete images. -bufferhandling chooses which of
+//    the driver's buffers the host gets when it falls behind, -throughput
+//    caps the bytes per second the camera sends, or with auto shares its
+//    link evenly between the cameras recording, and -packetdelay spaces the
+//    packets of a frame by so many ticks of the camera's clock. The
+//    acquisition thread, which takes the images from the driver, can be
+//    pinned with -rxcpu and given realtime priority with -rxrealtime.
+//    -calibrate looks for the highest frame rate at which the window arrives
+//    without a resend: it streams CALIBRATE_TRIAL_S seconds at the camera's
+//    maximum, then halves the range between the highest clean and the
+//    lowest failing rate CALIBRATE_STEPS times, and records at the best
+//    clean rate found.
+#define CALIBRATE_TRIAL_S 1.0
+#define CALIBRATE_STEPS 6
+
 // File name
 //    The relative path and file name to save to. After running the example, a
 //    video should exist at the location specified. The image writer chooses the
@@ -61,23 +134,587 @@
 #define FILE_NAME_90 "video_90.mp4"
 #define FILE_NAME_135 "video_135.mp4"
 
+// Raw file name
+//    With -raw, frames are written losslessly to a single file instead of the
+//    videos above, either as captured or as four angle planes. The layout is
+//    described in RawFormat.h. -raw lossless compresses the planes instead
+//    (see PlaneCodec.h), in as many row slices as there are encoder threads,
+//    each slice on a thread of its own.
+#define FILE_NAME_RAW "video_angles.raw"
+
+// number of angle streams, one per file name above
+#define NUM_ANGLES 4
+
+// Mosaic file name
+//    With -mosaic the four angle planes are tiled into one picture of twice
+//    the width and height, 0 degrees top left, 45 top right, 90 bottom left
+//    and 135 bottom right, and recorded as this single video instead of the
+//    four above. One encoder session and muxer replace four, which is much
+//    cheaper on hardware encoders, and the angles of a frame can never drift
+//    apart.
+#define FILE_NAME_MOSAIC "video_mosaic.mp4"
+
+// Stokes file names
+//    With -stokes, DoLP and AoLP are computed on the host from the angle
+//    planes of each frame and recorded as two more videos, scaled to 8 bits
+//    like the camera's PolarizedDolpAolp_Mono8 format. The float results are
+//    computed across row bands on up to STOKES_MAX_THREADS threads. With
+//    -stokes fast, AoLP comes from a polynomial instead of atan2, which lets
+//    slower hosts keep up at full frame rate; see Stokes.h for its accuracy.
+#define FILE_NAME_DOLP "video_dolp.mp4"
+#define FILE_NAME_AOLP "video_aolp.mp4"
+#define STOKES_MAX_THREADS 4
+
+// Temporal filter
+//    Angle planes are noisy, and the encoders spend most of their bitrate
+//    on the noise. With -denoise each angle sample keeps a running average
+//    over about DENOISE_FRAMES frames that is put out in its place, except
+//    where it differs from the new sample by more than DENOISE_THRESHOLD
+//    8-bit counts, 16 times as many for 12-bit samples, where the scene
+//    moved and the average starts again from the new frame. With -integrate
+//    each sample is instead the mean of the last INTEGRATE_FRAMES frames,
+//    the equivalent of a longer exposure for low light that keeps the frame
+//    rate. Either filters the angle planes in place between the demux and
+//    the recorders, so DoLP and AoLP, the pre-trigger history and the shared
+//    memory ring all see the filtered angles. Frame counts are powers of two
+//    up to 16.
+#define DENOISE_FRAMES 4
+#define DENOISE_THRESHOLD 24
+#define INTEGRATE_FRAMES 4
+
+// Timestamps file name
+//    With -sync every camera is triggered by PTP scheduled action commands
+//    instead of running free at AcquisitionFrameRate, and the device
+//    timestamp of each recorded frame is written here, one line per video
+//    frame, to line up the videos of several cameras afterwards.
+#define FILE_NAME_TIMESTAMPS "video_timestamps.csv"
+
+// Metadata file name
+//    With -metadata the camera sends its exposure time, gain and input lines
+//    as chunk data with every image, and each recording gets this sidecar of
+//    one 64-byte record per video or raw frame, in the same order, holding
+//    them with the frame ID, the device timestamp and the host time of the
+//    grab (see FrameMetadata.h). The chunks are read off the stream buffer
+//    by the acquisition thread along with the image; the records go to disk
+//    from a writer thread.
+#define FILE_NAME_METADATA "video_metadata.bin"
+
+// Backpressure
+//    What acquisition does when the recorder falls behind and the queue is
+//    full. By default it waits, which holds on to the camera's stream
+//    buffers until the driver has none left and drops frames on its own.
+//    With -backpressure the host chooses instead: drop the oldest queued
+//    image, drop the new one, keep only every DECIMATION-th image until the
+//    queue has drained to half, or lower AcquisitionFrameRate by THROTTLE_STEP
+//    at most once every THROTTLE_HOLDOFF_S seconds while waiting. Every
+//    dropped image is counted and reported. Videos keep their nominal frame
+//    rate, so a throttled or thinned recording plays faster than real time.
+#define DECIMATION 2
+#define THROTTLE_STEP 0.9
+#define THROTTLE_HOLDOFF_S 1.0
+
+// Frame statistics
+//    With -stats every frame's ID, completeness and stage times are tracked
+//    and a summary with fps, dropped and incomplete frames, p50/p99 latency
+//    per stage, queue depth and the transport layer counters below is
+//    printed every STATS_INTERVAL_S seconds, or as often as given. With
+//    -statsfile the frames are written as CSV, or the summaries as JSON
+//    lines if the name ends in .json.
+#define STATS_INTERVAL_S 5.0
+
+// Plane pool
+//    Demuxed angle planes live in a fixed pool shared by the demux and the
+//    recorders, sized in frames of four planes. It is allocated once from the
+//    configured plane size, so a recorder that falls behind makes the
+//    demux wait instead of growing memory.
+#define PLANE_POOL_FRAMES 5
+
+// Region of interest
+//    The camera can send just a Width x Height window of its sensor, placed
+//    with -offset, and bin or decimate the sensor by -binning or -subsample
+//    in both directions first. Fewer pixels per frame raise the highest
+//    frame rate the sensor and the link allow, and the frame rate is set
+//    after the window, so it is only limited by what remains. Binning
+//    combines neighbouring pixels, decimation skips them. On the host,
+//    -crop keeps a window of every angle plane and -scale shrinks the
+//    planes by averaging blocks of pixels, so the encoders and the disk only
+//    see the part of the scene being watched. Plane pools, recorders and
+//    raw files are all sized from the cropped and scaled planes.
+
+// Pre-trigger
+//    With -pretrigger the recorder holds the demuxed planes of the last
+//    PRETRIGGER_S seconds in the plane pools, without encoding them, until a
+//    trigger fires: SIGUSR1, a rising edge on a camera input line, read from
+//    the ChunkLineStatusAll chunk of every image, or a frame whose mean DoLP,
+//    sampled every DOLP_SAMPLE_STEP pixels, reaches a threshold. The history
+//    and the next POSTTRIGGER_S seconds are then recorded, in place of a
+//    fixed number of images, and the recording ends. Stopping before a
+//    trigger records the history held so far. The pools grow by the history,
+//    about 20 MB per second of history and frame per second at full
+//    resolution; frames that age out of it are counted as skipped.
+#define PRETRIGGER_S 5.0
+#define POSTTRIGGER_S 5.0
+#define DOLP_SAMPLE_STEP 16
+
+// Shared memory frames
+//    With -shm name the recorder also publishes every frame's angle planes,
+//    and DoLP and AoLP when they are computed on the host, to a ring of the
+//    last SHM_SLOTS frames in POSIX shared memory named /name, or
+//    /<serial>_name per camera when several record at once. Processes on the
+//    same host, such as inference services, read the planes in place as
+//    they arrive, with no video to decode (see SharedFrames.h); -subscribe
+//    name shows what such a reader sees. 8-bit planes are published as
+//    Mono8 whatever the encoders take, 12-bit ones as 16-bit samples. The
+//    ring never holds up the recording: a reader that falls further behind
+//    than the ring skips the frames it missed.
+#define SHM_SLOTS 16
+
+// Service mode
+//    With -daemon the recorder runs unattended, for instance under systemd:
+//    it never prompts, finishes its files on SIGTERM as on Ctrl+C, and exits
+//    with an error when there is no camera so the service manager can try
+//    again. Options can be read from a file with -config, one per line as
+//    on the command line. The cameras are left configured on exit, and the
+//    values each camera accepted are kept in NODE_CACHE_FILE by serial
+//    number, so a restart with the same settings only reads the nodes back
+//    instead of setting every one of them within its range again.
+#define NODE_CACHE_FILE "record_nodes.cache"
+
 
 // =-=-=-=-=-=-=-=-=-
 // =-=- EXAMPLE -=-=-
 // =-=-=-=-=-=-=-=-=-
 
+// set by Ctrl+C to end an open-ended recording
+std::atomic<bool> g_stopRequested(false);
+
+// set by SIGUSR1 to fire the trigger of a pre-trigger recording
+std::atomic<bool> g_triggerRequested(false);
+
+// acquisition's response to a full queue, see Backpressure above
+enum BackpressurePolicy
+{
+	BACKPRESSURE_BLOCK,
+	BACKPRESSURE_DROP_OLDEST,
+	BACKPRESSURE_DROP_NEWEST,
+	BACKPRESSURE_DECIMATE,
+	BACKPRESSURE_THROTTLE
+};
+
+// what fires a pre-trigger recording besides SIGUSR1, see Pre-trigger above
+enum TriggerSource
+{
+	TRIGGER_SOURCE_SIGNAL,
+	TRIGGER_SOURCE_LINE,
+	TRIGGER_SOURCE_DOLP
+};
+
+// pixel format the camera sends
+//    By default the camera demosaics its polarizer into four 8-bit angles per
+//    pixel. The 12-bit formats pack two pixels into three bytes: the sensor's
+//    raw polarizer mosaic, demosaiced into the angle planes on the host, or
+//    DoLP and AoLP as the camera computed them. Their planes are 16-bit
+//    samples, recorded with -raw planar or as 10 or 12-bit HEVC.
+enum CameraFormat
+{
+	// PolarizedAngles_0d_45d_90d_135d_Mono8
+	CAMERA_FORMAT_ANGLES8,
+
+	// PolarizeMono12p
+	CAMERA_FORMAT_MONO12P,
+
+	// PolarizeMono12Packed
+	CAMERA_FORMAT_MONO12PACKED,
+
+	// PolarizedDolpAolp_Mono12p
+	CAMERA_FORMAT_DOLPAOLP12P
+};
+
+// recording settings gathered from the command line
+struct RecordSettings
+{
+	int64_t width = WIDTH;
+	int64_t height = HEIGHT;
+
+	// camera window and sensor binning and decimation, see Region of
+	// interest above
+	int64_t offsetX = 0;
+	int64_t offsetY = 0;
+	int64_t binning = 1;
+	int64_t subsampling = 1;
+
+	// host crop of the angle planes, none if its width is 0, and the factor
+	// the planes are shrunk by
+	FrameRegion crop = { 0, 0, 0, 0 };
+	size_t scale = 1;
+
+	uint32_t numImages = NUM_IMAGES;
+	double fps = FRAMES_PER_SECOND;
+	size_t queueDepth = QUEUE_DEPTH;
+	size_t numBuffers = 0;
+	CameraFormat format = CAMERA_FORMAT_ANGLES8;
+	bool zeroCopy = false;
+	BackpressurePolicy backpressure = BACKPRESSURE_BLOCK;
+	unsigned int decimation = DECIMATION;
+	std::vector<int> cpus;
+	unsigned int encoderThreads = 0;
+	EncoderBackend encoderBackend = ENCODER_BACKEND_AUTO;
+	int rawLayout = -1;
+	RawCodec rawCodec = RAW_CODEC_NONE;
+	bool stokes = false;
+	bool stokesFast = false;
+	bool mosaic = false;
+	bool cuda = false;
+	bool sync = false;
+	bool metadata = false;
+
+	// temporal filter of the angle planes, see Temporal filter above: none
+	// if temporalFrames is 0, and the running average's gate in 8-bit counts
+	TemporalFilterMode temporalFilter = TEMPORAL_FILTER_RECURSIVE;
+	unsigned int temporalFrames = 0;
+	unsigned int denoiseThreshold = DENOISE_THRESHOLD;
+
+	// seconds held before a trigger, 0 to record right away, and recorded
+	// after it; the input line or DoLP threshold that fires it
+	double preTrigger = 0.0;
+	double postTrigger = POSTTRIGGER_S;
+	TriggerSource triggerSource = TRIGGER_SOURCE_SIGNAL;
+	int64_t triggerLine = 0;
+	double triggerDolp = 0.0;
+
+	// shared memory ring the planes are published to, none if empty, and
+	// the frames it holds
+	std::string shmName;
+	size_t shmSlots = SHM_SLOTS;
+
+	// seconds between frame statistics summaries, 0 for none
+	double statsInterval = 0.0;
+	std::string statsFile;
+
+	// transport tuning, see Transport above: the TL stream's
+	// StreamBufferHandlingMode, empty to leave it; the camera's throughput
+	// limit in bytes per second, 0 to leave it or -1 for an even share of
+	// its link between linkShares cameras; its inter-packet delay in ticks,
+	// -1 to leave it
+	std::string bufferHandling;
+	int64_t throughputLimit = 0;
+	size_t linkShares = 1;
+	int64_t packetDelay = -1;
+
+	// CPUs for the cameras' acquisition threads, one per camera in turn,
+	// and the CPU of this camera's, -1 for any
+	std::vector<int> rxCpus;
+	int rxCpu = -1;
+	bool rxRealtime = false;
+	bool calibrate = false;
+
+	// run unattended, see Service mode above, with the cameras' accepted
+	// settings kept in this file
+	bool daemon = false;
+	std::string nodeCacheFile = NODE_CACHE_FILE;
+
+	// cameras to record: the first one found, every one, or these serials
+	bool allDevices = false;
+	std::vector<std::string> serials;
+
+	// put in front of every output file name, set per camera when several
+	// cameras record at once
+	std::string filePrefix;
+};
+
+// stream buffer bookkeeping shared by acquisition and recording
+struct StreamContext
+{
+	StreamContext(Arena::IDevice* pDevice_, size_t numBuffers_, bool zeroCopy_, BackpressurePolicy backpressure_, unsigned int decimation_, FrameStats* pStats_)
+		: pDevice(pDevice_)
+		, numBuffers(numBuffers_)
+		, zeroCopy(zeroCopy_)
+		, pStats(pStats_)
+		, heldBuffers(0)
+		, copiedImages(0)
+		, backpressure(backpressure_)
+		, decimation(decimation_)
+		, droppedImages(0)
+		, decimating(false)
+		, decimationPhase(0)
+		, throttleCount(0)
+		, throttledFrameRate(0.0)
+		, readLineStatus(false)
+		, readMetadata(false)
+	{
+	}
+
+	Arena::IDevice* pDevice;
+	size_t numBuffers;
+	bool zeroCopy;
+
+	// NULL unless frame statistics are on
+	FrameStats* pStats;
+
+	// stream buffers currently queued or being demuxed
+	std::atomic<size_t> heldBuffers;
+
+	// images copied in zero-copy mode because the recorder fell behind
+	std::atomic<uint64_t> copiedImages;
+
+	// backpressure policy and the acquisition thread's state for it
+	BackpressurePolicy backpressure;
+	unsigned int decimation;
+	std::atomic<uint64_t> droppedImages;
+	bool decimating;
+	uint64_t decimationPhase;
+	uint64_t throttleCount;
+	double throttledFrameRate;
+	std::chrono::steady_clock::time_point lastThrottle;
+
+	// read each image's input lines for a line trigger
+	bool readLineStatus;
+
+	// read each image's chunk data for the metadata file
+	bool readMetadata;
+};
+
+// image handed from acquisition to the recorder
+//    A stream buffer must be requeued once demuxed, a copy destroyed.
+struct AcquiredImage
+{
+	Arena::IImage* pImage;
+	bool isStreamBuffer;
+
+	// FrameStats sequence number
+	uint64_t sequence;
+
+	// ChunkLineStatusAll, one bit per input line; 0 unless read
+	int64_t lineStatus;
+
+	// record for the metadata file, filled with -metadata
+	FrameMetadata metadata;
+};
+
+// demuxed frame held back by a pre-trigger recording
+//    One pool plane per video stream, in the order of the recorders.
+struct HeldFrame
+{
+	uint8_t* pPlanes[NUM_ANGLES + 2];
+	uint64_t sequence;
+	uint64_t frameId;
+	uint64_t timestampNs;
+	FrameMetadata metadata;
+};
+
+void SignalHandler(int)
+{
+	g_stopRequested = true;
+}
+
+void TriggerHandler(int)
+{
+	g_triggerRequested = true;
+}
+
 void usage(char* app)
 {
 	std::cout << "Usage:\n";
-	std::cout << app << " [-w width] [-h height] [-n numImages]\n";
+	std::cout << app << " [-w width] [-h height] [-offset x,y] [-binning factor] [-subsample factor] [-crop x,y,w,h] [-scale factor] [-n numImages] [-fps fps] [-q queueDepth] [-b numBuffers] [-format format] [-zerocopy] [-backpressure policy] [-bufferhandling mode] [-throughput MBps] [-packetdelay ticks] [-rxcpu cpuList] [-rxrealtime] [-calibrate] [-pin cpuList] [-encoders numThreads] [-devices deviceList] [-backend name] [-mono] [-mosaic] [-cuda] [-raw layout] [-stokes [fast]] [-sync] [-metadata] [-denoise [frames [threshold]]] [-integrate [frames]] [-pretrigger seconds [postSeconds]] [-trigger source] [-stats [seconds]] [-statsfile fileName] [-shm ringName [slots]] [-subscribe ringName] [-config configFile] [-daemon] [-nodecache cacheFile] [-inspect file] [-selftest]\n";
 	std::cout << "Where:\n";
-	std::cout << "width:     camera image width to configure. Default is " << WIDTH << ".\n";
-	std::cout << "height:    camera image height to configure. Default is " << HEIGHT << ".\n";
-	std::cout << "numImages: number of images to capture for recording. Default is " << NUM_IMAGES << ".\n";
-	std::cout << "fps:       framerate to use for the recording. Default is " << FRAMES_PER_SECOND << ".\n";
+	std::cout << "width:      camera image width to configure. Default is " << WIDTH << ".\n";
+	std::cout << "height:     camera image height to configure. Default is " << HEIGHT << ".\n";
+	std::cout << "x,y:        camera window offset on the sensor. Default is 0,0.\n";
+	std::cout << "factor:     -binning and -subsample bin or decimate the sensor in both directions, if the camera can;\n";
+	std::cout << "            -scale averages factor x factor blocks of each angle plane on the host. Default is 1.\n";
+	std::cout << "x,y,w,h:    window of each angle plane to keep, demuxed on the host. Default is the whole frame.\n";
+	std::cout << "numImages:  number of images to capture for recording, 0 to record until Ctrl+C. Default is " << NUM_IMAGES << ".\n";
+	std::cout << "fps:        framerate to use for the recording. Default is " << FRAMES_PER_SECOND << ".\n";
+	std::cout << "queueDepth: images buffered between acquisition and recording. Default is " << QUEUE_DEPTH << ".\n";
+	std::cout << "numBuffers: stream buffers to announce. Default is sized from the queue depth.\n";
+	std::cout << "format:     camera pixel format: angles8, or 12-bit mono12p or mono12packed demosaiced on the host, or\n";
+	std::cout << "            dolpaolp12p for the camera's DoLP and AoLP. 12-bit planes are recorded with -raw planar or as\n";
+	std::cout << "            HEVC. Default is angles8.\n";
+	std::cout << "-zerocopy:  demux straight from stream buffers instead of copying each image.\n";
+	std::cout << "policy:     when the recorder falls behind: block, dropoldest, dropnewest, decimate [N] to keep every\n";
+	std::cout << "            Nth image (default " << DECIMATION << "), or throttle to lower the frame rate. Default is block.\n";
+	std::cout << "mode:       which stream buffer the driver hands out next: oldest, overwrite for the oldest while\n";
+	std::cout << "            overwriting it when none is free, or newest. Default is the driver's, oldest.\n";
+	std::cout << "MBps:       cap the camera's link throughput at this many MB/s, or 'auto' to share it evenly between\n";
+	std::cout << "            the cameras recording.\n";
+	std::cout << "ticks:      delay between the packets of a frame, in ticks of the camera's clock (GevSCPD).\n";
+	std::cout << "cpuList:    -rxcpu pins each camera's acquisition thread to the next of these CPUs, -pin the encoder\n";
+	std::cout << "            threads to them, e.g. 2,3,4,5.\n";
+	std::cout << "-rxrealtime: run the acquisition threads at realtime priority, if the OS allows.\n";
+	std::cout << "-calibrate: record at the highest frame rate the window arrives at without resends or missed packets,\n";
+	std::cout << "            found by streaming for a few seconds before recording.\n";
+	std::cout << "numThreads: encoder threads shared by all streams, or with -raw lossless the slices each frame is\n";
+	std::cout << "            compressed in. Default is one per CPU, at most one per stream.\n";
+	std::cout << "deviceList: 'all' or comma separated serial numbers of the cameras to record. Default is the first camera.\n";
+	std::cout << "name:       video encoder: auto, save, x264, x265, nvenc, vaapi or jetson. Every one but save needs a\n";
+	std::cout << "            USE_FFMPEG build and falls back to save if unavailable. Default is auto, the first working\n";
+	std::cout << "            hardware encoder.\n";
+	std::cout << "-mono:      same as -backend x264, encoding Mono8 angle planes natively instead of as BGR8.\n";
+	std::cout << "-mosaic:    record the four angles tiled 2x2 into one " << FILE_NAME_MOSAIC << ".\n";
+	std::cout << "-cuda:      demux and compute DoLP/AoLP on the GPU, feeding NVENC from GPU memory (USE_CUDA builds).\n";
+	std::cout << "layout:     write a lossless " << FILE_NAME_RAW << " instead of videos, 'planar' or 'interleaved', or\n";
+	std::cout << "            'lossless' for compressed planes.\n";
+	std::cout << "-stokes:    also record host computed DoLP and AoLP as " << FILE_NAME_DOLP << " and " << FILE_NAME_AOLP << ",\n";
+	std::cout << "            'fast' for a polynomial AoLP instead of atan2.\n";
+	std::cout << "-sync:      trigger all cameras together by PTP scheduled action commands at fps.\n";
+	std::cout << "-metadata:  write each frame's ID, timestamps, exposure time, gain and input lines, sent as chunk\n";
+	std::cout << "            data, to " << FILE_NAME_METADATA << " next to the recording.\n";
+	std::cout << "frames:     -denoise keeps a running average of each angle sample over about so many frames (default\n";
+	std::cout << "            " << DENOISE_FRAMES << "), restarting it where the sample changed by more than threshold 8-bit counts (default\n";
+	std::cout << "            " << DENOISE_THRESHOLD << ", 0 for never); -integrate records the mean of the last so many frames (default " << INTEGRATE_FRAMES << ").\n";
+	std::cout << "seconds:    -pretrigger holds the last seconds of frames unencoded until a trigger, then records them\n";
+	std::cout << "            and postSeconds more (default " << POSTTRIGGER_S << ") instead of numImages.\n";
+	std::cout << "source:     what fires the trigger besides SIGUSR1: signal for nothing else, line N for a rising edge on\n";
+	std::cout << "            input line N, or dolp threshold for a mean DoLP of at least threshold. Default is signal.\n";
+	std::cout << "seconds:    print frame statistics every so many seconds. Default is " << STATS_INTERVAL_S << ".\n";
+	std::cout << "fileName:   write every frame's statistics as CSV, or the summaries as JSON if it ends in .json.\n";
+	std::cout << "ringName:   -shm also publishes each frame's planes to the POSIX shared memory ring /ringName, holding\n";
+	std::cout << "            slots frames (default " << SHM_SLOTS << "); -subscribe reads a ring another recorder publishes and exits.\n";
+	std::cout << "configFile: read options from a file, one per line as on the command line with or without the dash;\n";
+	std::cout << "            lines starting with # are comments. Options after -config override the file's.\n";
+	std::cout << "-daemon:    run unattended: no prompts, SIGTERM finishes the files like Ctrl+C, and the cameras stay\n";
+	std::cout << "            configured on exit, to be read back on restart if they hold the settings in cacheFile.\n";
+	std::cout << "cacheFile:  where -daemon keeps the settings each camera accepted. Default is " << NODE_CACHE_FILE << ".\n";
+	std::cout << "file:       summarize a raw recording or a -metadata file and exit.\n";
+	std::cout << "-selftest:  check the demux, unpack, Stokes and temporal filter kernels against the scalar code, round trip the\n";
+	std::cout << "            lossless codec, raw recordings and shared frames and exit.\n";
 	std::cout << std::endl;
 }
 
+// reads the options of a -config file, appending them to args
+//    Each line holds one option and its values as on the command line, the
+//    leading dash optional; blank lines and lines starting with # are
+//    skipped. Returns false if the file cannot be read.
+bool ReadConfigFile(const char* fileName, std::vector<std::string>& args)
+{
+	std::ifstream file(fileName);
+
+	if (!file)
+		return false;
+
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		std::istringstream words(line);
+		std::string word;
+
+		if (!(words >> word) || word[0] == '#')
+			continue;
+
+		args.push_back(word[0] == '-' ? word : "-" + word);
+
+		while (words >> word)
+			args.push_back(word);
+	}
+
+	return !file.bad();
+}
+
+// parses a comma separated list of serial numbers
+bool ParseSerialList(const char* text, std::vector<std::string>& serials)
+{
+	serials.clear();
+
+	std::string list(text);
+	size_t begin = 0;
+
+	while (begin <= list.size())
+	{
+		size_t end = list.find(',', begin);
+		if (end == std::string::npos)
+			end = list.size();
+
+		if (end == begin)
+			return false;
+
+		serials.push_back(list.substr(begin, end - begin));
+		begin = end + 1;
+	}
+
+	return true;
+}
+
+// parses a list of exactly count comma separated unsigned numbers
+bool ParseNumberList(const char* text, size_t count, size_t* pValues)
+{
+	for (size_t n = 0; n < count; n++)
+	{
+		char* pEnd = NULL;
+
+		if (*text < '0' || *text > '9')
+			return false;
+
+		pValues[n] = strtoul(text, &pEnd, 10);
+
+		if (*pEnd != (n + 1 < count ? ',' : '\0'))
+			return false;
+
+		text = pEnd + 1;
+	}
+
+	return true;
+}
+
+// PixelFormat node value of a camera format
+const char* GetPixelFormatName(CameraFormat format)
+{
+	switch (format)
+	{
+	case CAMERA_FORMAT_MONO12P:
+		return "PolarizeMono12p";
+	case CAMERA_FORMAT_MONO12PACKED:
+		return "PolarizeMono12Packed";
+	case CAMERA_FORMAT_DOLPAOLP12P:
+		return "PolarizedDolpAolp_Mono12p";
+	default:
+		return "PolarizedAngles_0d_45d_90d_135d_Mono8";
+	}
+}
+
+// packing of a 12-bit camera format
+Mono12Layout GetMono12Layout(CameraFormat format)
+{
+	if (format == CAMERA_FORMAT_MONO12PACKED)
+		return MONO12_LAYOUT_MOSAIC_12PACKED;
+
+	return format == CAMERA_FORMAT_DOLPAOLP12P ? MONO12_LAYOUT_DOLP_AOLP_12P : MONO12_LAYOUT_MOSAIC_12P;
+}
+
+// video streams a camera records: the angles or their mosaic, then DoLP and
+// AoLP, which are all there is of a PolarizedDolpAolp format
+size_t GetNumVideoStreams(const RecordSettings& settings)
+{
+	if (settings.format == CAMERA_FORMAT_DOLPAOLP12P)
+		return 2;
+
+	return (settings.mosaic ? 1 : NUM_ANGLES) + (settings.stokes ? 2 : 0);
+}
+
+// part of each frame the angle planes keep, the whole frame unless cropped
+FrameRegion GetPlaneRegion(const RecordSettings& settings)
+{
+	if (settings.crop.width != 0)
+		return settings.crop;
+
+	const FrameRegion frame = { 0, 0, static_cast<size_t>(settings.width), static_cast<size_t>(settings.height) };
+	return frame;
+}
+
+// prints one dot per image, wrapping every 25 images
+//    A total of 0 means the number of images is open-ended.
+void PrintProgress(uint64_t i, uint64_t total)
+{
+	if (i % 25 == 0)
+		std::cout << TAB2;
+	std::cout << ".";
+	if (total != 0 && i % total == total - 1)
+		std::cout << "\n";
+	else if (i % 25 == 24)
+		std::cout << "\r" << ERASE_LINE << "\r";
+	std::cout << std::flush;
+}
+
 // sets integer value safely
 // (1) ensures increment
 // (2) ensures over minimum
@@ -141,378 +778,3098 @@ double SetFloatValue(GenApi::INodeMap* pNodeMap, const char* nodeName, double va
 	return value;
 }
 
-// demonstrates recording a video
-// (1) prepares video parameters
-// (2) prepares video recorder
-// (3) sets video settings
-// (4) opens video
-// (5) appends images
-// (6) closes video
-void RecordVideo(const std::vector<Arena::IImage*>& images, double fps)
+// sets a horizontal and vertical factor pair the camera may not have
+//    Returns the factor set, or 1 if the camera has no such nodes, in which
+//    case asking for more than 1 is an error.
+int64_t SetFactorPair(GenApi::INodeMap* pNodeMap, const char* horizontalName, const char* verticalName, int64_t factor)
 {
-	// Prepare video parameters
-	std::cout << TAB1 << "Prepares video parameters (" << images[0]->GetWidth() << "x" << images[0]->GetHeight() << ", " << fps << " FPS)\n";
-
-	Save::VideoParams params_0(
-		images[0]->GetWidth(),
-		images[0]->GetHeight(),
-		fps);
-
-	Save::VideoParams params_45(
-		images[0]->GetWidth(),
-		images[0]->GetHeight(),
-		fps);
-
-	Save::VideoParams params_90(
-		images[0]->GetWidth(),
-		images[0]->GetHeight(),
-		fps);
-
-	Save::VideoParams params_135(
-		images[0]->GetWidth(),
-		images[0]->GetHeight(),
-		fps);
-
-	// Prepare video recorder
-	std::cout << TAB1 << "Prepare video recorder for video 0 " << FILE_NAME_0 << "\n";
-	std::cout << TAB1 << "Prepare video recorder for video 45" << FILE_NAME_45 << "\n";
-	std::cout << TAB1 << "Prepare video recorder for video 90" << FILE_NAME_90 << "\n";
-	std::cout << TAB1 << "Prepare video recorder for video 135" << FILE_NAME_135 << "\n";
-
-
-	Save::VideoRecorder videoRecorder_0(
-		params_0,
-		FILE_NAME_0);
-	Save::VideoRecorder videoRecorder_45(
-		params_45,
-		FILE_NAME_45);
-	Save::VideoRecorder videoRecorder_90(
-		params_90,
-		FILE_NAME_90);
-	Save::VideoRecorder videoRecorder_135(
-		params_135,
-		FILE_NAME_135);
-	// Set codec, container, and pixel format
-	std::cout << TAB1 << "Set codec to H264, container to MPEG-4, and pixel format to BGR8\n";
-
-	videoRecorder_0.SetH264Mp4BGR8();
-	videoRecorder_45.SetH264Mp4BGR8();
-	videoRecorder_90.SetH264Mp4BGR8();
-	videoRecorder_135.SetH264Mp4BGR8();
+	GenApi::CIntegerPtr pHorizontal = pNodeMap->GetNode(horizontalName);
+	GenApi::CIntegerPtr pVertical = pNodeMap->GetNode(verticalName);
 
-	// Open video
-	std::cout << TAB1 << "Open video\n";
+	if (!pHorizontal || !pVertical || !GenApi::IsWritable(pHorizontal) || !GenApi::IsWritable(pVertical))
+	{
+		if (factor > 1)
+			throw std::runtime_error(std::string("The camera cannot set ") + horizontalName + " and " + verticalName);
 
-	std::cout << "\nFFMPEG OUTPUT---------------\n\n";
-	videoRecorder_0.Open();
+		return 1;
+	}
 
-	videoRecorder_45.Open();
+	SetIntValue(pNodeMap, horizontalName, factor);
+	return SetIntValue(pNodeMap, verticalName, factor);
+}
 
-	videoRecorder_90.Open();
+// reads an integer node the camera may not have, 0 if it has not
+int64_t GetOptionalIntValue(GenApi::INodeMap* pNodeMap, const char* nodeName)
+{
+	GenApi::CIntegerPtr pInteger = pNodeMap->GetNode(nodeName);
 
-	videoRecorder_135.Open();
+	if (!pInteger || !GenApi::IsReadable(pInteger))
+		return 0;
 
-	// Append images
-	std::cout << TAB2 << "Append images\n";
+	return pInteger->GetValue();
+}
 
-	for (size_t i = 0; i < images.size(); i++)
+// returns an image to where it came from once it has been demuxed
+void ReleaseImage(StreamContext* pStream, const AcquiredImage& image)
+{
+	if (image.isStreamBuffer)
 	{
-		if (i % 25 == 0)
-			std::cout << TAB2;
-		std::cout << ".";
-		if (i % images.size() == images.size() - 1)
-			std::cout << "\n";
-		else if (i % 25 == 24)
-			std::cout << "\r" << ERASE_LINE << "\r";
-
+		pStream->pDevice->RequeueBuffer(image.pImage);
+		pStream->heldBuffers--;
+	}
+	else
+	{
+		Arena::ImageFactory::Destroy(image.pImage);
+	}
+}
 
-        const uint32_t srcWidth = static_cast<uint32_t>(images[i]->GetWidth());
-        const uint32_t srcHeight = static_cast<uint32_t>(images[i]->GetHeight());
-        // Create the buffer for four channels
-        uint8_t *dummyBuffer = new uint8_t[srcWidth * srcHeight];
+// input line levels sent with an image, one bit per line
+//    0 if the image came without its ChunkLineStatusAll chunk, such as an
+//    incomplete one.
+int64_t ReadLineStatus(Arena::IImage* pImage)
+{
+	if (!pImage->HasChunkData())
+		return 0;
 
-		Arena::IImage *outputImage0 = Arena::ImageFactory::Create(dummyBuffer, srcWidth * srcHeight, srcWidth, srcHeight, PfncFormat::Mono8);
-		Arena::IImage *outputImage45 = Arena::ImageFactory::Create(dummyBuffer, srcWidth * srcHeight, srcWidth, srcHeight, PfncFormat::Mono8);
-		Arena::IImage *outputImage90 = Arena::ImageFactory::Create(dummyBuffer, srcWidth * srcHeight, srcWidth, srcHeight, PfncFormat::Mono8);
-		Arena::IImage *outputImage135 = Arena::ImageFactory::Create(dummyBuffer, srcWidth * srcHeight, srcWidth, srcHeight, PfncFormat::Mono8);
+	GenApi::CIntegerPtr pLineStatus = pImage->AsChunkData()->GetChunk("ChunkLineStatusAll");
 
-		uint8_t *outputBuffer0 = const_cast<uint8_t*>(outputImage0->GetData());
-		uint8_t *outputBuffer45 = const_cast<uint8_t*>(outputImage45->GetData());
-		uint8_t *outputBuffer90 = const_cast<uint8_t*>(outputImage90->GetData());
-		uint8_t *outputBuffer135 = const_cast<uint8_t*>(outputImage135->GetData());
+	if (!pLineStatus || !GenApi::IsReadable(pLineStatus))
+		return 0;
 
-		uint8_t *inputBufferPtr = const_cast<uint8_t*>(images[i]->GetData());
+	return pLineStatus->GetValue();
+}
 
-		size_t buffer_size = images[i]->GetSizeFilled() - 1;
+// fills the metadata file record of an image from it and its chunk data
+//    Reads chunk data without a round trip to the camera, so the
+//    acquisition thread can afford it for every image.
+void ReadFrameMetadata(Arena::IImage* pImage, FrameMetadata* pMetadata)
+{
+	memset(pMetadata, 0, sizeof(*pMetadata));
+	pMetadata->frameId = pImage->GetFrameId();
+	pMetadata->timestampNs = pImage->GetTimestampNs();
+	pMetadata->hostTimeNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
 
-		uint32_t bufferIndex = 0;
+	if (pImage->IsIncomplete())
+		pMetadata->flags |= METADATA_FRAME_INCOMPLETE;
 
-		for (uint32_t i = 0; i < buffer_size; i += 4)
-		{
-			// 0 degree pixels are byte 0
-			outputBuffer0[bufferIndex] = inputBufferPtr[i];
+	if (!pImage->HasChunkData())
+		return;
 
-			// 45 degree pixels are byte 1
-			outputBuffer45[bufferIndex] = inputBufferPtr[i+1];
+	Arena::IChunkData* pChunkData = pImage->AsChunkData();
+	GenApi::CFloatPtr pExposureTime = pChunkData->GetChunk("ChunkExposureTime");
+	GenApi::CFloatPtr pGain = pChunkData->GetChunk("ChunkGain");
+	GenApi::CIntegerPtr pLineStatus = pChunkData->GetChunk("ChunkLineStatusAll");
 
-			// 90 degree pixels are byte 2
-			outputBuffer90[bufferIndex] = inputBufferPtr[i+2];
+	if (pExposureTime && GenApi::IsReadable(pExposureTime))
+	{
+		pMetadata->exposureTime = pExposureTime->GetValue();
+		pMetadata->flags |= METADATA_HAS_EXPOSURE;
+	}
 
-			// 135 degree pixels are byte 3
-			outputBuffer135[bufferIndex] = inputBufferPtr[i+3];
+	if (pGain && GenApi::IsReadable(pGain))
+	{
+		pMetadata->gain = pGain->GetValue();
+		pMetadata->flags |= METADATA_HAS_GAIN;
+	}
 
-			bufferIndex++;
-		}
+	if (pLineStatus && GenApi::IsReadable(pLineStatus))
+	{
+		pMetadata->lineStatus = pLineStatus->GetValue();
+		pMetadata->flags |= METADATA_HAS_LINE_STATUS;
+	}
+}
 
-		// videoRecorder_0.AppendImage(images[i]->GetData());
-		videoRecorder_0.AppendImage(Arena::ImageFactory::Convert(outputImage0, RGB8)->GetData());
-		videoRecorder_45.AppendImage(Arena::ImageFactory::Convert(outputImage45, RGB8)->GetData());
-		videoRecorder_90.AppendImage(Arena::ImageFactory::Convert(outputImage90, RGB8)->GetData());
-		videoRecorder_135.AppendImage(Arena::ImageFactory::Convert(outputImage135, RGB8)->GetData());
+// transport layer stream counters reported with the frame statistics
+//    Missed packets and resend requests show a link that drops data before
+//    it turns into lost or incomplete frames. Counters the transport layer
+//    does not have are left out.
+std::vector<StreamCounter> ReadStreamCounters(Arena::IDevice* pDevice)
+{
+	const char* names[] = { "StreamDeliveredFrameCount", "StreamLostFrameCount", "StreamIncompleteFrameCount", "StreamMissedPacketCount", "StreamResendRequestCount" };
 
-	}
+	std::vector<StreamCounter> counters;
 
-	// Close video
-	std::cout << TAB1 << "Close video\n";
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+	{
+		GenApi::CIntegerPtr pCounter = pDevice->GetTLStreamNodeMap()->GetNode(names[i]);
 
-	videoRecorder_0.Close();
-	videoRecorder_45.Close();
-	videoRecorder_90.Close();
-	videoRecorder_135.Close();
+		if (pCounter && GenApi::IsReadable(pCounter))
+			counters.push_back(StreamCounter(names[i], pCounter->GetValue()));
+	}
 
-	std::cout << "\nFFMPEG OUTPUT---------------\n";
+	return counters;
 }
 
-// =-=-=-=-=-=-=-=-=-
-// =- PREPARATION -=-
-// =- & CLEAN UP =-=-
-// =-=-=-=-=-=-=-=-=-
-
-int main(int argc, char** argv)
+// prints a frame statistics summary once its interval has passed
+void ReportFrameStats(StreamContext* pStream, const RecordSettings& settings)
 {
-	// flag to track when an exception has been thrown
-	bool exceptionThrown = false;
+	if (pStream->pStats != NULL && settings.statsInterval > 0.0 && pStream->pStats->IsReportDue(settings.statsInterval))
+		pStream->pStats->Report(ReadStreamCounters(pStream->pDevice), false);
+}
 
-	std::cout << "\nCpp_Record\n\n";
+// drops an image the recorder has no room for
+void DropImage(StreamContext* pStream, const AcquiredImage& image)
+{
+	if (pStream->pStats != NULL)
+		pStream->pStats->Skipped(image.sequence);
 
-	// Parse command line args
-	int64_t width = WIDTH;
-	int64_t height = HEIGHT;
-	uint32_t numImages = NUM_IMAGES;
-	double fps = FRAMES_PER_SECOND;
+	ReleaseImage(pStream, image);
+	pStream->droppedImages++;
+}
 
-	for (int32_t i = 1; i < argc; i++)
-	{
-		if ((strcmp(argv[i], "-w") == 0) && (i + 1 < argc))
-		{
-			width = strtol(argv[++i], NULL, 10);
-		}
-		else if ((strcmp(argv[i], "-h") == 0) && (i + 1 < argc))
-		{
-			height = strtol(argv[++i], NULL, 10);
-		}
-		else if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc))
-		{
-			numImages = strtol(argv[++i], NULL, 10);
-		}
-		else if ((strcmp(argv[i], "-fps") == 0) && (i + 1 < argc))
-		{
-			fps = strtof(argv[++i], NULL);
+// lowers the camera's frame rate by a step while the recorder is behind
+//    Waits out THROTTLE_HOLDOFF_S after each step, so the queue has time to
+//    drain at the new rate before the next one.
+void ThrottleFrameRate(StreamContext* pStream)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
 
-			if (fps <= 0)
-			{
-				std::cout << "Framerate must be greater than 0.\n";
-				return -1;
-			}
-		}
-		else if (strcmp(argv[i], "--help") == 0)
-		{
-			usage(argv[0]);
-			return 0;
-		}
-		else
-		{
-			std::cout << "Invalid argument [" << argv[i] << "]\n";
-			usage(argv[0]);
-			return -1;
-		}
-	}
+	if (pStream->throttleCount > 0 && std::chrono::duration<double>(now - pStream->lastThrottle).count() < THROTTLE_HOLDOFF_S)
+		return;
 
-	if (height == 0 || width == 0)
-	{
-		std::cout << "Invalid with or height specified!\n";
-		return -1;
-	}
+	GenApi::INodeMap* pNodeMap = pStream->pDevice->GetNodeMap();
+	const double frameRate = Arena::GetNodeValue<double>(pNodeMap, "AcquisitionFrameRate");
 
-	std::cout << "While the recorder is running, images may be buffered to memory.\n";
-	std::cout << "To reduce the chance of problems when running on platforms with lower\n"
-			<< "performance and/or lower amounts of memory, this example will use a\n"
-			<< "default resolution of " << WIDTH << "x" << HEIGHT << std::endl;
-	std::cout << "The default resolution can be overridden with command line arguments.\n"
-			<< "Use: " << argv[0] << " --help for more info.\n";
+	pStream->throttledFrameRate = SetFloatValue(pNodeMap, "AcquisitionFrameRate", frameRate * THROTTLE_STEP);
+	pStream->throttleCount++;
+	pStream->lastThrottle = now;
 
-	std::cout << "\nProceed with example? ('y' to continue) ";
+	std::cout << "\n" << TAB1 << "Recorder behind, lowering frame rate to " << pStream->throttledFrameRate << " FPS\n";
+}
 
-	char continueExample = 'a';
-	std::cin >> continueExample;
+// hands an image to the recorder under the backpressure policy
+//    Returns false once the recorder has stopped, in which case the image
+//    has been released.
+bool HandOver(StreamContext* pStream, FrameQueue<AcquiredImage>* pQueue, const AcquiredImage& image)
+{
+	bool queued = false;
 
-	if (continueExample != 'y')
+	switch (pStream->backpressure)
+	{
+	case BACKPRESSURE_DROP_OLDEST:
 	{
-		std::cout << "\nPress enter to complete\n";
+		AcquiredImage dropped;
+		bool hasDropped = false;
 
-		// clear input
-		while (std::cin.get() != '\n')
-			continue;
+		queued = pQueue->PushDropOldest(image, &dropped, &hasDropped);
 
-		std::getchar();
-		return -1;
+		if (hasDropped)
+			DropImage(pStream, dropped);
+		break;
 	}
 
-	try
-	{
-		// prepare example
-		Arena::ISystem* pSystem = Arena::OpenSystem();
-		pSystem->UpdateDevices(100);
-		std::vector<Arena::DeviceInfo> deviceInfos = pSystem->GetDevices();
-		if (deviceInfos.size() == 0)
+	case BACKPRESSURE_DROP_NEWEST:
+		queued = pQueue->TryPush(image);
+
+		if (!queued && !pQueue->IsClosed())
 		{
-			std::cout << "\nNo camera connected\nPress enter to complete\n";
-			std::getchar();
-			return 0;
+			DropImage(pStream, image);
+			return true;
 		}
-		else if (numImages == 0)
+		break;
+
+	case BACKPRESSURE_DECIMATE:
+		// thin out from a full queue until it has drained to half
+		if (pQueue->Size() >= pQueue->Capacity())
+			pStream->decimating = true;
+		else if (pQueue->Size() <= pQueue->Capacity() / 2)
+			pStream->decimating = false;
+
+		if (!pStream->decimating)
+			pStream->decimationPhase = 0;
+		else if (pStream->decimationPhase++ % pStream->decimation != 0)
 		{
-			std::cout << "\nnumImages should be greater than 0\nPress enter to complete\n";
-			std::getchar();
-			return 0;
+			DropImage(pStream, image);
+			return true;
 		}
-		Arena::IDevice* pDevice = pSystem->CreateDevice(deviceInfos[0]);
 
-		// Store initial settings
-		GenICam::gcstring acquisitionModeInitial = "";
-		bool frameRateEnableInitial = true;
-		double frameRateInitial = 0.0;
-		int64_t imageWidthInitial = 0;
-		int64_t imageHeightInitial = 0;
+		queued = pQueue->Push(image);
+		break;
 
-		// Store acquisition mode
-		acquisitionModeInitial = Arena::GetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "AcquisitionMode");
+	case BACKPRESSURE_THROTTLE:
+		if (pQueue->Size() >= pQueue->Capacity())
+			ThrottleFrameRate(pStream);
 
-		// Store frame rate enable
-		frameRateEnableInitial = Arena::GetNodeValue<bool>(pDevice->GetNodeMap(), "AcquisitionFrameRateEnable");
+		queued = pQueue->Push(image);
+		break;
 
-		if (frameRateEnableInitial)
-		{
-			// Store frame rate value
-			frameRateInitial = Arena::GetNodeValue<double>(pDevice->GetNodeMap(), "AcquisitionFrameRate");
-		}
-
-		// Store image width
-		imageWidthInitial = Arena::GetNodeValue<int64_t>(pDevice->GetNodeMap(), "Width");
+	default:
+		queued = pQueue->Push(image);
+		break;
+	}
 
-		// Store image height
-		imageHeightInitial = Arena::GetNodeValue<int64_t>(pDevice->GetNodeMap(), "Height");
+	if (!queued)
+		ReleaseImage(pStream, image);
 
-		// Set acquisition mode
-		Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "AcquisitionMode", "Continuous");
+	return queued;
+}
 
-		
-		// ['Mono8', 'Mono10', 'Mono10p', 'Mono10Packed', 'Mono12', 
-		// 'Mono12p', 'Mono12Packed', 'Mono16', 'PolarizeMono8', 
-		// 'PolarizeMono12', 'PolarizeMono12p', 'PolarizeMono12Packed', 
-		// 'PolarizeMono16', 'PolarizedAngles_0d_45d_90d_135d_Mono8', 
-		// 'PolarizedStokes_S0_S1_S2_S3_Mono8', 'PolarizedDolpAolp_Mono8', 
-		// 'PolarizedDolpAolp_Mono12p', 'PolarizedDolp_Mono8', 
-		// 'PolarizedDolp_Mono12p', 'PolarizedAolp_Mono8', 'PolarizedAolp_Mono12p']
-	
+// acquires images for the recorder
+// (1) grabs image
+// (2) holds on to the stream buffer, or copies the image and requeues it
+// (3) hands image to the recorder, or drops it under a backpressure policy
+//    Runs on its own thread so that images are captured while the recorder
+//    encodes. The queue is closed when acquisition ends, which in turn ends
+//    the recording. Exceptions are handed back to the main thread.
+void AcquireImages(StreamContext* pStream, FrameQueue<AcquiredImage>* pQueue, uint32_t numImages, std::exception_ptr* pError)
+{
+	try
+	{
+		for (uint32_t i = 0; (numImages == 0 || i < numImages) && !g_stopRequested; i++)
+		{
+			const double grabStart = pStream->pStats != NULL ? FrameStats::Now() : 0.0;
 
-		Arena::SetNodeValue<GenICam::gcstring>(
-		pDevice->GetNodeMap(),
-		"PixelFormat",
-		"PolarizedAngles_0d_45d_90d_135d_Mono8");
-		// PolarizedAolp_Mono8
+			AcquiredImage image;
+			image.pImage = pStream->pDevice->GetImage(2000);
+			image.isStreamBuffer = false;
+			image.sequence = 0;
 
-		// Set width and height
-		//    Reducing the size of an image reduces the amount of bandwidth
-		//    required for each image. The less bandwidth required per image, the
-		//    more images can be sent over the same bandwidth.
-		width = SetIntValue(pDevice->GetNodeMap(), "Width", width);
-		height = SetIntValue(pDevice->GetNodeMap(), "Height", height);
+			// chunk data is read off the stream buffer, before any copy
+			image.lineStatus = pStream->readLineStatus ? ReadLineStatus(image.pImage) : 0;
 
-		// Set framerate
-		Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "AcquisitionFrameRateEnable", true);
+			if (pStream->readMetadata)
+				ReadFrameMetadata(image.pImage, &image.metadata);
 
-		fps = SetFloatValue(pDevice->GetNodeMap(), "AcquisitionFrameRate", fps);
+			const uint64_t frameId = image.pImage->GetFrameId();
+			const bool incomplete = image.pImage->IsIncomplete();
 
-		std::cout << "Using: \nwidth: " << width
-				<< "\nheight: " << height
-				<< "\nnumImages: " << numImages
-				<< "\nfps: " << fps
-				<< std::endl
-				<< std::endl;
+			// only this thread takes buffers, so the check cannot race
+			if (pStream->zeroCopy && pStream->heldBuffers + STREAM_BUFFER_RESERVE < pStream->numBuffers)
+			{
+				pStream->heldBuffers++;
+				image.isStreamBuffer = true;
+			}
+			else
+			{
+				Arena::IImage* pCopy = Arena::ImageFactory::Copy(image.pImage);
 
-		std::vector<Arena::IImage*> images;
+				pStream->pDevice->RequeueBuffer(image.pImage);
+				image.pImage = pCopy;
 
-		// enable stream auto negotiate packet size
-		Arena::SetNodeValue<bool>(pDevice->GetTLStreamNodeMap(), "StreamAutoNegotiatePacketSize", true);
+				if (pStream->zeroCopy)
+					pStream->copiedImages++;
+			}
 
-		// enable stream packet resend
-		Arena::SetNodeValue<bool>(pDevice->GetTLStreamNodeMap(), "StreamPacketResendEnable", true);
+			if (pStream->pStats != NULL)
+				image.sequence = pStream->pStats->Grabbed(frameId, incomplete, grabStart);
 
-		pDevice->StartStream();
+			// recorder has stopped
+			if (!HandOver(pStream, pQueue, image))
+				break;
+		}
+	}
+	catch (...)
+	{
+		*pError = std::current_exception();
+	}
 
-		std::cout << "Capturing images\n";
-		for (unsigned int i = 0; i < numImages; i++)
-		{
-			if (i % 25 == 0)
-				std::cout << TAB2;
-			std::cout << ".";
-			if (i % numImages == numImages - 1)
-				std::cout << "\n";
-			else if (i % 25 == 24)
-				std::cout << "\r" << ERASE_LINE << "\r";
+	pQueue->Close();
+}
 
-			Arena::IImage* pImage = pDevice->GetImage(2000);
+// what fires a pre-trigger recording, for the log
+std::string GetTriggerDescription(const RecordSettings& settings)
+{
+	switch (settings.triggerSource)
+	{
+	case TRIGGER_SOURCE_LINE:
+		return "a rising edge on line " + std::to_string(settings.triggerLine) + " or SIGUSR1";
+	case TRIGGER_SOURCE_DOLP:
+		return "a mean DoLP of at least " + std::to_string(settings.triggerDolp) + " or SIGUSR1";
+	default:
+		return "SIGUSR1";
+	}
+}
 
-			// images.push_back(Arena::ImageFactory::Convert(pImage, RGB8));
-			images.push_back(Arena::ImageFactory::Copy(pImage));
+// true if the trigger of a pre-trigger recording fires on this image
+//    pLineWasLow carries the input line from one image to the next, so only
+//    a rising edge fires, not a line that was already high.
+bool CheckTrigger(const RecordSettings& settings, const AcquiredImage& image, size_t numPixels, bool* pLineWasLow)
+{
+	if (g_triggerRequested)
+		return true;
 
-            // images.push_back(pImage);
+	switch (settings.triggerSource)
+	{
+	case TRIGGER_SOURCE_LINE:
+	{
+		const bool high = ((image.lineStatus >> settings.triggerLine) & 1) != 0;
+		const bool rising = high && *pLineWasLow;
 
+		*pLineWasLow = !high;
+		return rising;
+	}
+	case TRIGGER_SOURCE_DOLP:
+		return SampleMeanDolp(image.pImage->GetData(), numPixels, static_cast<size_t>(settings.width), static_cast<size_t>(settings.height), DOLP_SAMPLE_STEP) >= settings.triggerDolp;
+	default:
+		return false;
+	}
+}
+
+// writes the device timestamp of a frame going to the videos
+//    videoFrame counts the frames recorded so far.
+void WriteTimestamp(std::ofstream& timestamps, uint64_t& videoFrame, uint64_t frameId, uint64_t timestampNs)
+{
+	if (timestamps.is_open())
+		timestamps << videoFrame << "," << frameId << "," << timestampNs << "\n";
+
+	videoFrame++;
+}
+
+// records the frames held before a trigger, oldest first, a plane per
+// stream, with their timestamps and their metadata if pMetadata is not NULL
+void FlushHistory(FrameQueue<HeldFrame>& history, std::vector<std::unique_ptr<VideoWorker>>& workers, MetadataWriter* pMetadata, std::ofstream& timestamps, uint64_t& videoFrame)
+{
+	HeldFrame frame;
+
+	while (history.Size() > 0 && history.Pop(frame))
+	{
+		for (size_t stream = 0; stream < workers.size(); stream++)
+			workers[stream]->Submit(frame.pPlanes[stream], frame.sequence);
+
+		if (pMetadata != NULL)
+			pMetadata->Append(frame.metadata);
+
+		WriteTimestamp(timestamps, videoFrame, frame.frameId, frame.timestampNs);
+	}
+}
+
+// copies a plane into a shared frame, row by row
+//    A source with wider pixels than the frame, such as a BGR8 plane of gray,
+//    gives the first bytes of each pixel.
+void CopySharedPlane(uint8_t* pDst, size_t dstPixelBytes, const uint8_t* pSrc, size_t srcPixelBytes, size_t srcStride, size_t width, size_t height)
+{
+	for (size_t y = 0; y < height; y++)
+	{
+		const uint8_t* pSrcRow = pSrc + y * srcStride;
+		uint8_t* pDstRow = pDst + y * width * dstPixelBytes;
+
+		if (srcPixelBytes == dstPixelBytes)
+		{
+			memcpy(pDstRow, pSrcRow, width * dstPixelBytes);
+			continue;
+		}
+
+		for (size_t x = 0; x < width; x++)
+			memcpy(pDstRow + x * dstPixelBytes, pSrcRow + x * srcPixelBytes, dstPixelBytes);
+	}
+}
+
+// demonstrates recording a video
+// (1) prepares video parameters
+// (2) opens one recorder per angle, or one for the mosaic with -mosaic, and
+//     one per Stokes result with -stokes or the camera's DoLP and AoLP
+// (3) demuxes angle planes as images arrive and hands them to the recorders,
+//     or with -pretrigger holds them until the trigger fires, and with -shm
+//     publishes them to shared memory
+// (4) closes video
+void RecordVideo(FrameQueue<AcquiredImage>& queue, StreamContext* pStream, const RecordSettings& settings, EncoderPool* pEncoders)
+{
+	const size_t width = static_cast<size_t>(settings.width);
+	const size_t height = static_cast<size_t>(settings.height);
+
+	// Prepare region
+	//    The angle planes keep the cropped part of each frame, shrunk by the
+	//    scale, and everything downstream is sized from the planes. The
+	//    Mono8 demux also fills the Stokes stage's scratch planes.
+	RegionDemux monoDemux(GetDeinterleaveKernel(), 1, width, height, GetPlaneRegion(settings), settings.scale);
+	const size_t planeWidth = monoDemux.GetWidth();
+	const size_t planeHeight = monoDemux.GetHeight();
+
+	if (!monoDemux.IsWholeFrame())
+		std::cout << TAB1 << "Crop " << width << "x" << height << " frames to " << planeWidth << "x" << planeHeight << " angle planes\n";
+
+	// Prepare video parameters
+	std::cout << TAB1 << "Prepares video parameters (" << planeWidth << "x" << planeHeight << ", " << settings.fps << " FPS)\n";
+
+	// Set codec, container, and pixel format
+	//    Mono8 planes are encoded natively by the FFmpeg back ends; the Save
+	//    library's H.264 recorder, also the fallback, takes them expanded to
+	//    BGR8. 12-bit planes are encoded as HEVC. The angle streams, or the
+	//    mosaic, come first, then DoLP and AoLP.
+	std::vector<std::string> fileNames = { FILE_NAME_0, FILE_NAME_45, FILE_NAME_90, FILE_NAME_135 };
+	if (settings.mosaic)
+		fileNames.assign(1, FILE_NAME_MOSAIC);
+
+	// the camera's own DoLP and AoLP replace the angles
+	const bool cameraDolpAolp = settings.format == CAMERA_FORMAT_DOLPAOLP12P;
+	if (cameraDolpAolp)
+		fileNames.clear();
+
+	const size_t numAngleStreams = fileNames.size();
+	const unsigned int bitDepth = settings.format == CAMERA_FORMAT_ANGLES8 ? 8 : 12;
+
+	if (settings.stokes || cameraDolpAolp)
+	{
+		fileNames.push_back(FILE_NAME_DOLP);
+		fileNames.push_back(FILE_NAME_AOLP);
+	}
+
+	for (size_t stream = 0; stream < fileNames.size(); stream++)
+		fileNames[stream] = settings.filePrefix + fileNames[stream];
+
+	const size_t numStreams = fileNames.size();
+	EncoderBackend backend = settings.encoderBackend;
+
+	// Check mosaic size
+	//    A mosaic is twice the planes' width and height, which for full
+	//    sensor planes is past what the hardware encoders take as H.264.
+	//    Auto then records every stream of the camera with the Save library,
+	//    so they agree on their input; a hardware back end asked for by name
+	//    is refused before any file is opened.
+	const size_t mosaicWidth = 2 * planeWidth;
+	const size_t mosaicHeight = 2 * planeHeight;
+
+	if (settings.mosaic && bitDepth == 8 && std::max(mosaicWidth, mosaicHeight) > HARDWARE_H264_MAX_SIZE)
+	{
+		const std::string mosaicSize = std::to_string(mosaicWidth) + "x" + std::to_string(mosaicHeight);
+
+		if (IsHardwareBackend(backend))
+			throw std::runtime_error("The " + mosaicSize + " mosaic is larger than the " + GetEncoderBackendName(backend) + " encoder takes (" + std::to_string(HARDWARE_H264_MAX_SIZE)
+					+ " pixels); use -crop or -scale to shrink the angle planes, or -backend x264 or save");
+
+		if (backend == ENCODER_BACKEND_AUTO)
+		{
+			std::cout << TAB1 << "The " << mosaicSize << " mosaic is larger than the hardware encoders take, recording with the Save library\n";
+			backend = ENCODER_BACKEND_SAVE;
+		}
+	}
+
+	// Open video
+	//    The encoders open their sessions as they are created. A stream
+	//    whose back end fails to open, for instance past NVENC's session
+	//    limit, falls back to the Save library, and the camera's other
+	//    streams follow it, since they share one plane layout.
+	std::cout << TAB1 << "Open video\n";
+
+	std::cout << "\nFFMPEG OUTPUT---------------\n\n";
+
+	std::vector<std::unique_ptr<VideoEncoder>> encoders;
+
+	while (encoders.size() < numStreams)
+	{
+		const size_t stream = encoders.size();
+		const size_t scale = settings.mosaic && stream < numAngleStreams ? 2 : 1;
+
+#ifdef USE_CUDA
+		// NVENC takes the GPU's planes without a round trip through the host
+		if (settings.cuda && (backend == ENCODER_BACKEND_AUTO || backend == ENCODER_BACKEND_NVENC))
+			encoders.push_back(CreateCudaVideoEncoder(fileNames[stream], width, height, settings.fps, pStream->pStats));
+
+		if (encoders.size() > stream && !encoders[stream])
+			encoders.pop_back();
+#endif
+
+		if (encoders.size() == stream)
+			encoders.push_back(CreateVideoEncoder(fileNames[stream], scale * planeWidth, scale * planeHeight, settings.fps, backend, bitDepth, pStream->pStats));
+
+		if (encoders[stream]->GetInput() != encoders[0]->GetInput())
+		{
+			if (backend == ENCODER_BACKEND_SAVE || (encoders[stream]->GetInput() != ENCODER_INPUT_BGR8 && encoders[0]->GetInput() != ENCODER_INPUT_BGR8))
+				throw std::runtime_error("Video recorders disagree on their input pixel format");
+
+			std::cout << TAB1 << "Recording every stream of the camera with the Save library\n";
+
+			encoders.clear();
+			backend = ENCODER_BACKEND_SAVE;
+		}
+	}
+
+	const EncoderInput input = encoders[0]->GetInput();
+	const size_t bytesPerPixel = GetBytesPerPixel(input);
+
+	std::cout << TAB1 << "Set codec, container, and pixel format: " << encoders[0]->GetDescription() << "\n";
+
+	// Size pre-trigger history
+	//    Held frames keep their planes, so the pools grow by the history.
+	const size_t historyFrames = settings.preTrigger > 0.0 ? static_cast<size_t>(std::ceil(settings.preTrigger * settings.fps)) : 0;
+	const size_t postFrames = static_cast<size_t>(std::ceil(settings.postTrigger * settings.fps));
+	const size_t poolFrames = PLANE_POOL_FRAMES + historyFrames;
+
+	// Prepare plane pool
+	//    Mosaic pictures are four planes in size and get a pool of their own,
+	//    which leaves the plane pool to DoLP and AoLP.
+	std::unique_ptr<PlanePool> pMosaicPool;
+
+	if (settings.mosaic)
+	{
+		pMosaicPool.reset(new PlanePool(NUM_ANGLES * planeWidth * planeHeight * bytesPerPixel, poolFrames));
+
+		std::cout << TAB1 << "Prepare mosaic pool (" << pMosaicPool->GetNumPlanes() << " pictures of " << pMosaicPool->GetPlaneSize() << " bytes)\n";
+	}
+
+	const size_t planeSize = planeWidth * planeHeight * bytesPerPixel;
+	const size_t numPlanes = (numStreams - (settings.mosaic ? numAngleStreams : 0)) * poolFrames;
+
+#ifdef USE_CUDA
+	// planes NVENC takes from the GPU are allocated there
+	std::unique_ptr<CudaDeviceMemory> pDevicePlanes;
+
+	if (input == ENCODER_INPUT_MONO8_CUDA)
+		pDevicePlanes.reset(new CudaDeviceMemory(PlanePool::GetStorageSize(planeSize, numPlanes)));
+
+	PlanePool pool(planeSize, numPlanes, pDevicePlanes ? pDevicePlanes->Get() : NULL);
+#else
+	PlanePool pool(planeSize, numPlanes);
+#endif
+
+	PlanePool* pAnglePool = settings.mosaic ? pMosaicPool.get() : &pool;
+
+	if (pool.GetNumPlanes() > 0)
+		std::cout << TAB1 << "Prepare plane pool (" << pool.GetNumPlanes() << " planes of " << pool.GetPlaneSize() << " bytes"
+				<< (input == ENCODER_INPUT_MONO8_CUDA ? " on the GPU)\n" : ")\n");
+
+#ifdef USE_CUDA
+	// Prepare CUDA stage
+	//    The GPU demuxes each frame and computes DoLP and AoLP in place of
+	//    the CPU kernels and the Stokes stage. Host planes are pinned, so
+	//    they come back by DMA.
+	std::unique_ptr<CudaStage> pCuda;
+	std::unique_ptr<CudaHostRegistration> pPinnedPool;
+
+	if (settings.cuda)
+	{
+		pCuda.reset(new CudaStage(width, height, bytesPerPixel, settings.stokes, settings.stokesFast, input == ENCODER_INPUT_MONO8_CUDA));
+
+		if (input != ENCODER_INPUT_MONO8_CUDA)
+			pPinnedPool.reset(new CudaHostRegistration(pool.GetStorage(), pool.GetStorageSize()));
+
+		std::cout << TAB1 << "Prepare CUDA stage on " << pCuda->GetDeviceName() << (settings.stokesFast ? " with fast AoLP" : "")
+				<< (input == ENCODER_INPUT_MONO8_CUDA ? ", planes stay on the GPU\n" : ", planes come back to the host\n");
+	}
+#endif
+
+	// Prepare Stokes stage
+	//    Stokes parameters are computed from contiguous Mono8 angle planes.
+	//    BGR8 recorders get expanded planes and a mosaic interleaves the
+	//    angles' rows, so in those cases the frame is also demuxed to Mono8
+	//    scratch planes for the Stokes stage.
+	std::unique_ptr<StokesStage> pStokes;
+	std::vector<uint8_t> monoPlanes;
+
+	if (settings.stokes && !settings.cuda)
+	{
+		pStokes.reset(new StokesStage(planeWidth, planeHeight, std::min(GetCpuCount(), static_cast<unsigned int>(STOKES_MAX_THREADS)), settings.stokesFast));
+
+		if (input != ENCODER_INPUT_MONO8 || settings.mosaic)
+			monoPlanes.resize(NUM_ANGLES * planeWidth * planeHeight);
+
+		std::cout << TAB1 << "Prepare Stokes stage (" << pStokes->GetKernelName() << (settings.stokesFast ? " fast" : "") << " kernel, " << pStokes->GetNumThreads() << " threads)\n";
+	}
+
+	// Prepare 12-bit demux
+	//    Packed frames are unpacked with the fastest kernel the CPU supports,
+	//    then demosaiced into the angle planes or split into DoLP and AoLP, in
+	//    place of the 8-bit demux. Frames of the sensor's full or half width
+	//    take a frame kernel compiled for that width.
+	std::unique_ptr<Mono12Demux> pMono12;
+
+	if (settings.format != CAMERA_FORMAT_ANGLES8)
+	{
+		pMono12.reset(new Mono12Demux(GetMono12Layout(settings.format), width, height));
+
+		std::cout << TAB1 << "Unpack " << GetPixelFormatName(settings.format) << " with " << pMono12->GetKernelName() << " kernel"
+				<< (cameraDolpAolp ? "" : ", demosaic angle planes on the host")
+				<< (pMono12->GetFrameKernelName() ? std::string(" (") + pMono12->GetFrameKernelName() + " frame kernel)\n" : "\n");
+	}
+
+	// Prepare temporal filter
+	//    The recorders' angle planes, or their mosaic, are filtered as the
+	//    encoders take them; BGR8 planes a byte at a time, which keeps their
+	//    three channels equal. Stokes scratch planes get a filter of their
+	//    own, so DoLP and AoLP always come from the filtered angles.
+	std::unique_ptr<TemporalFilter> pDenoise;
+	std::unique_ptr<TemporalFilter> pStokesDenoise;
+	const size_t filterSamples = (settings.mosaic ? NUM_ANGLES : 1) * planeSize / (bitDepth > 8 ? 2 : 1);
+
+	if (settings.temporalFrames > 0)
+	{
+		const bool recursive = settings.temporalFilter == TEMPORAL_FILTER_RECURSIVE;
+		const unsigned int threshold = settings.denoiseThreshold * (bitDepth > 8 ? 16 : 1);
+
+		pDenoise.reset(new TemporalFilter(settings.temporalFilter, settings.temporalFrames, threshold, settings.mosaic ? 1 : NUM_ANGLES, filterSamples, bitDepth > 8 ? 2 : 1));
+
+		if (!monoPlanes.empty())
+			pStokesDenoise.reset(new TemporalFilter(settings.temporalFilter, settings.temporalFrames, settings.denoiseThreshold, NUM_ANGLES, planeWidth * planeHeight, 1));
+
+		const size_t stateBytes = (settings.mosaic ? 1 : NUM_ANGLES) * pDenoise->GetStateSize() + (pStokesDenoise ? NUM_ANGLES * pStokesDenoise->GetStateSize() : 0);
+
+		std::cout << TAB1 << "Filter angle planes by " << (recursive ? "a running average" : "the mean") << " of " << (recursive ? "about " : "the last ") << settings.temporalFrames << " frames"
+				<< (recursive && settings.denoiseThreshold > 0 ? ", restarted past " + std::to_string(threshold) + " counts" : "")
+				<< " (" << pDenoise->GetKernelName() << " kernel, " << stateBytes / (1024 * 1024) << " MB of state)\n";
+	}
+
+	// Prepare video recorders
+	//    Each stream is recorded on the shared encoder threads, so all streams
+	//    of all cameras encode at the same time.
+	std::vector<std::unique_ptr<VideoWorker>> workers;
+
+	for (size_t stream = 0; stream < numStreams; stream++)
+	{
+		std::cout << TAB1 << "Prepare video recorder for video " << fileNames[stream] << "\n";
+
+		workers.push_back(std::unique_ptr<VideoWorker>(new VideoWorker(std::move(encoders[stream]), fileNames[stream], stream < numAngleStreams ? pAnglePool : &pool, pEncoders, pStream->pStats)));
+	}
+
+	// Select demux kernel
+	//    The fastest kernel the CPU supports splits each frame into its angle
+	//    planes and writes them straight into the recorders' frames, with no
+	//    intermediate images or conversions, cropped and scaled on the way.
+	//    BGR8 recorders get the fused kernel that also expands gray to
+	//    colour. Use -selftest to check the kernels against the scalar loop.
+	const DeinterleaveKernel& deinterleave = input == ENCODER_INPUT_BGR8 ? GetDeinterleaveBgr8Kernel() : GetDeinterleaveKernel();
+	RegionDemux demux(deinterleave, bytesPerPixel, width, height, GetPlaneRegion(settings), settings.scale);
+
+	if (!settings.cuda && !pMono12)
+		std::cout << TAB1 << "Demux angle planes with " << deinterleave.name << " kernel\n";
+
+	// Prepare timestamps file
+	std::ofstream timestamps;
+
+	if (settings.sync)
+	{
+		const std::string fileName = settings.filePrefix + FILE_NAME_TIMESTAMPS;
+
+		timestamps.open(fileName.c_str());
+		if (!timestamps)
+			throw std::runtime_error("Could not create " + fileName);
+
+		timestamps << "frame,frameId,timestampNs\n";
+
+		std::cout << TAB1 << "Write device timestamps to " << fileName << "\n";
+	}
+
+	// Prepare metadata file
+	//    Records follow the video frames, so held frames keep theirs until
+	//    they are recorded.
+	std::unique_ptr<MetadataWriter> pMetadata;
+
+	if (settings.metadata)
+	{
+		const std::string fileName = settings.filePrefix + FILE_NAME_METADATA;
+
+		pMetadata.reset(new MetadataWriter(fileName, settings.fps, pStream->pStats));
+		pMetadata->Open();
+
+		std::cout << TAB1 << "Write frame metadata to " << fileName << "\n";
+	}
+
+	// Prepare pre-trigger history
+	//    Frames wait here with their planes until the trigger fires, the
+	//    oldest going back to the pools once the history is full.
+	FrameQueue<HeldFrame> history(historyFrames);
+	bool holding = historyFrames > 0;
+	bool lineWasLow = false;
+	size_t postRemaining = postFrames;
+	uint64_t evictedCount = 0;
+	uint64_t videoFrame = 0;
+
+	if (holding)
+	{
+		const size_t frameSize = (numStreams - numAngleStreams) * planeSize + (settings.mosaic ? NUM_ANGLES : numAngleStreams) * planeSize;
+
+		std::cout << TAB1 << "Hold the last " << historyFrames << " frames (" << historyFrames * frameSize / (1024 * 1024) << " MB) until "
+				<< GetTriggerDescription(settings) << ", then record " << postFrames << " more\n";
+	}
+
+	// Prepare shared memory frames
+	//    The ring is created with the first image, which gives its pixel
+	//    format. DoLP and AoLP are only published from host memory.
+	std::unique_ptr<SharedFramePublisher> pPublisher;
+	std::vector<SharedPlaneKind> sharedPlanes;
+	const size_t sharedSampleBytes = bitDepth > 8 ? 2 : 1;
+	const bool publishStokes = (settings.stokes || cameraDolpAolp) && input != ENCODER_INPUT_MONO8_CUDA;
+
+	if (!settings.shmName.empty())
+	{
+		if (!cameraDolpAolp)
+		{
+			sharedPlanes.push_back(SHARED_PLANE_ANGLE_0);
+			sharedPlanes.push_back(SHARED_PLANE_ANGLE_45);
+			sharedPlanes.push_back(SHARED_PLANE_ANGLE_90);
+			sharedPlanes.push_back(SHARED_PLANE_ANGLE_135);
+		}
+
+		if (publishStokes)
+		{
+			sharedPlanes.push_back(SHARED_PLANE_DOLP);
+			sharedPlanes.push_back(SHARED_PLANE_AOLP);
+		}
+	}
+
+	// Append images
+	std::cout << TAB2 << "Append images\n";
+
+	AcquiredImage image;
+	uint64_t imageCount = 0;
+
+	FrameStats* pStats = pStream->pStats;
+
+	while (queue.Pop(image))
+	{
+		PrintProgress(imageCount, settings.numImages);
+
+		if (pStats != NULL)
+		{
+			pStats->Stamp(image.sequence, FRAME_STAGE_QUEUE);
+			pStats->SampleQueueDepth(queue.Size());
+		}
+
+		imageCount++;
+
+		// four bytes per pixel, one per angle
+		size_t numPixels = std::min<size_t>(image.pImage->GetSizeFilled(), width * height * 4) / 4;
+
+		// plane pixels filled, short of whole planes if the frame is incomplete
+		size_t numPlanePixels = numPixels;
+
+		// planes go back to the pool once the recorders have appended them
+		uint8_t* outputPlanes[NUM_ANGLES];
+		StokesInput stokesInput;
+		uint8_t* pDolp = NULL;
+		uint8_t* pAolp = NULL;
+
+#ifdef USE_CUDA
+		if (pCuda)
+		{
+			for (size_t angle = 0; angle < NUM_ANGLES; angle++)
+				outputPlanes[angle] = pool.Acquire();
+
+			if (settings.stokes)
+			{
+				pDolp = pool.Acquire();
+				pAolp = pool.Acquire();
+			}
+
+			pCuda->Process(image.pImage->GetData(), numPixels, outputPlanes, pDolp, pAolp);
+		}
+		else
+#endif
+		if (pMono12)
+		{
+			uint16_t* planes[NUM_ANGLES];
+			size_t planeStride = width;
+
+			if (cameraDolpAolp)
+			{
+				pDolp = pool.Acquire();
+				pAolp = pool.Acquire();
+
+				planes[0] = reinterpret_cast<uint16_t*>(pDolp);
+				planes[1] = reinterpret_cast<uint16_t*>(pAolp);
+			}
+			else if (settings.mosaic)
+			{
+				// quadrants of a picture twice the width and height
+				uint16_t* pMosaic = reinterpret_cast<uint16_t*>(pAnglePool->Acquire());
+
+				planes[0] = pMosaic;
+				planes[1] = pMosaic + width;
+				planes[2] = pMosaic + 2 * width * height;
+				planes[3] = pMosaic + 2 * width * height + width;
+				planeStride = 2 * width;
+
+				outputPlanes[0] = reinterpret_cast<uint8_t*>(pMosaic);
+			}
+			else
+			{
+				for (size_t angle = 0; angle < NUM_ANGLES; angle++)
+				{
+					outputPlanes[angle] = pool.Acquire();
+					planes[angle] = reinterpret_cast<uint16_t*>(outputPlanes[angle]);
+				}
+			}
+
+			pMono12->Process(image.pImage->GetData(), image.pImage->GetSizeFilled(), planes, planeStride);
+		}
+		else if (settings.mosaic)
+		{
+			// quadrants of a picture twice the width and height
+			uint8_t* pMosaic = pAnglePool->Acquire();
+			const size_t rowSize = planeWidth * bytesPerPixel;
+			uint8_t* quadrants[NUM_ANGLES] = { pMosaic, pMosaic + rowSize, pMosaic + 2 * planeHeight * rowSize, pMosaic + 2 * planeHeight * rowSize + rowSize };
+
+			demux.Process(image.pImage->GetData(), numPixels, quadrants, 2 * rowSize);
+
+			outputPlanes[0] = pMosaic;
+		}
+		else
+		{
+			for (size_t angle = 0; angle < NUM_ANGLES; angle++)
+				outputPlanes[angle] = pool.Acquire();
+
+			numPlanePixels = demux.Process(image.pImage->GetData(), numPixels, outputPlanes, planeWidth * bytesPerPixel);
+
+			for (size_t angle = 0; angle < NUM_ANGLES; angle++)
+				stokesInput.pAngle[angle] = outputPlanes[angle];
+		}
+
+		// Filter angle planes
+		//    Only contiguous 8-bit planes know how much of them an incomplete
+		//    frame filled.
+		if (pDenoise)
+			pDenoise->Process(outputPlanes, settings.mosaic || pMono12 ? filterSamples : numPlanePixels * bytesPerPixel);
+
+		if (pStokes && !monoPlanes.empty())
+		{
+			uint8_t* scratch[NUM_ANGLES];
+
+			for (size_t angle = 0; angle < NUM_ANGLES; angle++)
+			{
+				scratch[angle] = &monoPlanes[angle * planeWidth * planeHeight];
+				stokesInput.pAngle[angle] = scratch[angle];
+			}
+
+			numPlanePixels = monoDemux.Process(image.pImage->GetData(), numPixels, scratch, planeWidth);
+
+			if (pStokesDenoise)
+				pStokesDenoise->Process(scratch, numPlanePixels);
+		}
+
+		// Publish angle planes
+		//    8-bit angles are demuxed into the ring straight from the image,
+		//    whatever layout the encoders take; 12-bit and filtered planes are
+		//    copied from the recorders' planes or mosaic quadrants.
+		if (!sharedPlanes.empty())
+		{
+			if (!pPublisher)
+			{
+				pPublisher.reset(new SharedFramePublisher("/" + settings.filePrefix + settings.shmName, planeWidth, planeHeight, sharedPlanes, sharedSampleBytes, bitDepth, image.pImage->GetPixelFormat(), settings.fps, settings.shmSlots));
+				pPublisher->Open();
+
+				std::cout << "\n" << TAB2 << "Publish " << sharedPlanes.size() << " planes of the last " << pPublisher->GetHeader().numSlots << " frames to shared memory " << pPublisher->GetName()
+						<< ((settings.stokes && !publishStokes) ? ", DoLP and AoLP stay on the GPU\n" : "\n");
+			}
+
+			pPublisher->BeginFrame(image.pImage->GetFrameId(), image.pImage->GetTimestampNs(), image.pImage->IsIncomplete() ? SHARED_FRAME_INCOMPLETE : 0);
+
+			if (!pMono12 && !pDenoise)
+			{
+				uint8_t* sharedAngles[NUM_ANGLES];
+
+				for (size_t angle = 0; angle < NUM_ANGLES; angle++)
+					sharedAngles[angle] = pPublisher->GetPlane(angle);
+
+				monoDemux.Process(image.pImage->GetData(), numPixels, sharedAngles, planeWidth);
+			}
+			else if (!cameraDolpAolp)
+			{
+				const size_t rowSize = planeWidth * bytesPerPixel;
+
+				for (size_t angle = 0; angle < NUM_ANGLES; angle++)
+				{
+					if (settings.mosaic)
+						CopySharedPlane(pPublisher->GetPlane(angle), sharedSampleBytes, outputPlanes[0] + (angle / 2) * planeHeight * 2 * rowSize + (angle % 2) * rowSize, bytesPerPixel, 2 * rowSize, planeWidth, planeHeight);
+					else
+						CopySharedPlane(pPublisher->GetPlane(angle), sharedSampleBytes, outputPlanes[angle], bytesPerPixel, rowSize, planeWidth, planeHeight);
+				}
+			}
+		}
+
+		// the trigger looks at the camera's data before it goes back
+		const bool fired = holding && CheckTrigger(settings, image, numPixels, &lineWasLow);
+
+		// PTP time of the exposure, shared by all synchronized cameras
+		const uint64_t frameId = image.pImage->GetFrameId();
+		const uint64_t timestampNs = image.pImage->GetTimestampNs();
+
+		// planes are demuxed, so the stream buffer can go back to the driver
+		ReleaseImage(pStream, image);
+
+		if (pStats != NULL)
+			pStats->Stamp(image.sequence, FRAME_STAGE_DEMUX);
+
+		if (!holding)
+		{
+			for (size_t stream = 0; stream < numAngleStreams; stream++)
+				workers[stream]->Submit(outputPlanes[stream], image.sequence);
+
+			if (pMetadata)
+				pMetadata->Append(image.metadata);
+
+			WriteTimestamp(timestamps, videoFrame, frameId, timestampNs);
+		}
+
+		// angle recorders are already encoding while DoLP and AoLP are computed
+		if (pStokes)
+		{
+			pDolp = pool.Acquire();
+			pAolp = pool.Acquire();
+
+			pStokes->Process(stokesInput, numPlanePixels, pDolp, pAolp, bytesPerPixel);
+		}
+
+		// Publish DoLP and AoLP
+		//    The frame becomes visible to readers once these are in.
+		if (pPublisher)
+		{
+			if (publishStokes)
+			{
+				const size_t first = sharedPlanes.size() - 2;
+
+				CopySharedPlane(pPublisher->GetPlane(first), sharedSampleBytes, pDolp, bytesPerPixel, planeWidth * bytesPerPixel, planeWidth, planeHeight);
+				CopySharedPlane(pPublisher->GetPlane(first + 1), sharedSampleBytes, pAolp, bytesPerPixel, planeWidth * bytesPerPixel, planeWidth, planeHeight);
+			}
+
+			pPublisher->EndFrame();
+		}
+
+		if (pDolp != NULL)
+		{
+			if (pStats != NULL)
+				pStats->Stamp(image.sequence, FRAME_STAGE_CONVERT);
+
+			if (!holding)
+			{
+				workers[numAngleStreams]->Submit(pDolp, image.sequence);
+				workers[numAngleStreams + 1]->Submit(pAolp, image.sequence);
+			}
+		}
+
+		// Hold frame
+		//    A full history hands its oldest frame's planes back to the
+		//    pools. Once the trigger fires, the history, this frame last, is
+		//    recorded and the frames that follow go straight to the
+		//    recorders.
+		if (holding)
+		{
+			HeldFrame frame;
+			frame.sequence = image.sequence;
+			frame.frameId = frameId;
+			frame.timestampNs = timestampNs;
+			frame.metadata = image.metadata;
+
+			for (size_t stream = 0; stream < numAngleStreams; stream++)
+				frame.pPlanes[stream] = outputPlanes[stream];
+
+			if (pDolp != NULL)
+			{
+				frame.pPlanes[numAngleStreams] = pDolp;
+				frame.pPlanes[numAngleStreams + 1] = pAolp;
+			}
+
+			HeldFrame oldest;
+			bool hasOldest = false;
+			history.PushDropOldest(frame, &oldest, &hasOldest);
+
+			if (hasOldest)
+			{
+				for (size_t stream = 0; stream < numStreams; stream++)
+					(stream < numAngleStreams ? pAnglePool : &pool)->Release(oldest.pPlanes[stream]);
+
+				if (pStats != NULL)
+					pStats->Skipped(oldest.sequence);
+
+				evictedCount++;
+			}
+
+			if (fired)
+			{
+				std::cout << "\n" << TAB2 << "Triggered at image " << imageCount << ", recording " << history.Size() << " held frames\n";
+
+				FlushHistory(history, workers, pMetadata.get(), timestamps, videoFrame);
+				holding = false;
+			}
+		}
+		else if (historyFrames > 0)
+		{
+			postRemaining--;
+		}
+
+		ReportFrameStats(pStream, settings);
+
+		// a failed recorder ends the recording; Close() below reports it
+		bool failed = false;
+		for (size_t stream = 0; stream < numStreams; stream++)
+			failed = failed || workers[stream]->HasFailed();
+
+		if (failed)
+			break;
+
+		// the post-trigger window ends a pre-trigger recording
+		if (historyFrames > 0 && !holding && postRemaining == 0)
+			break;
+	}
+
+	// stopped before the trigger, so the history is all there is
+	if (holding && history.Size() > 0)
+	{
+		std::cout << "\n" << TAB2 << "Stopped before the trigger, recording " << history.Size() << " held frames\n";
+
+		FlushHistory(history, workers, pMetadata.get(), timestamps, videoFrame);
+	}
+
+	if (settings.numImages == 0 || imageCount < settings.numImages)
+		std::cout << "\n";
+
+	// readers see the ring closed
+	if (pPublisher)
+		pPublisher->Close();
+
+	// Close video
+	//    Every file is finished before the first recorder error is rethrown,
+	//    so one failed stream leaves the others playable.
+	std::cout << TAB1 << "Close video (" << imageCount - evictedCount << " images)\n";
+
+	std::exception_ptr closeError;
+
+	for (size_t stream = 0; stream < numStreams; stream++)
+	{
+		try
+		{
+			workers[stream]->Close();
+		}
+		catch (...)
+		{
+			if (!closeError)
+				closeError = std::current_exception();
+		}
+	}
+
+	try
+	{
+		if (pMetadata)
+			pMetadata->Close();
+	}
+	catch (...)
+	{
+		if (!closeError)
+			closeError = std::current_exception();
+	}
+
+	if (closeError)
+		std::rethrow_exception(closeError);
+
+	std::cout << "\nFFMPEG OUTPUT---------------\n";
+
+	// Report plane pool use
+	//    Waits on an empty pool mean the recorders could not keep up with
+	//    acquisition for a while.
+	PlanePoolStats poolStats = pAnglePool->GetStats();
+
+	std::cout << TAB1 << (settings.mosaic ? "Mosaic pool: " : "Plane pool: ") << poolStats.acquired << " planes used, "
+			<< poolStats.exhausted << " waits on an empty pool (" << poolStats.waitSeconds << " s), "
+			<< "at least " << poolStats.lowWater << " of " << pAnglePool->GetNumPlanes() << " planes free\n";
+}
+
+// demonstrates lossless raw recording
+// (1) prepares raw file from the first image
+// (2) writes each image, demuxed to angle planes or as captured; 12-bit
+//     images are unpacked to 16-bit planes
+// (3) closes raw file
+//    Frames are filled in place in the writer's buffers on their way to disk,
+//    so a planar recording costs one demux pass and no extra copy. Lossless
+//    frames are demuxed into a staging buffer and compressed from there.
+void RecordRaw(FrameQueue<AcquiredImage>& queue, StreamContext* pStream, const RecordSettings& settings)
+{
+	const size_t width = static_cast<size_t>(settings.width);
+	const size_t height = static_cast<size_t>(settings.height);
+	const bool planar = settings.rawLayout == RAW_LAYOUT_PLANAR;
+	const DeinterleaveKernel& deinterleave = GetDeinterleaveKernel();
+
+	// planar files hold the cropped and scaled planes
+	RegionDemux demux(deinterleave, 1, width, height, GetPlaneRegion(settings), settings.scale);
+	const size_t planeWidth = demux.GetWidth();
+	const size_t planeHeight = demux.GetHeight();
+
+	// 12-bit formats are only recorded planar
+	std::unique_ptr<Mono12Demux> pMono12;
+
+	if (settings.format != CAMERA_FORMAT_ANGLES8)
+		pMono12.reset(new Mono12Demux(GetMono12Layout(settings.format), width, height));
+
+	const std::string fileName = settings.filePrefix + FILE_NAME_RAW;
+	const bool lossless = settings.rawCodec == RAW_CODEC_LOSSLESS;
+	const size_t numSlices = settings.encoderThreads > 0 ? settings.encoderThreads : GetCpuCount();
+
+	std::cout << TAB1 << "Prepare raw recording " << fileName << " (" << planeWidth << "x" << planeHeight << ", "
+			<< (lossless ? "lossless" : planar ? "planar" : "interleaved") << ")\n";
+
+	if (lossless)
+		std::cout << TAB1 << "Compress each frame in " << numSlices << " slices\n";
+
+	if (!demux.IsWholeFrame())
+		std::cout << TAB1 << "Crop " << width << "x" << height << " frames to " << planeWidth << "x" << planeHeight << " angle planes\n";
+
+	if (pMono12)
+		std::cout << TAB1 << "Unpack " << GetPixelFormatName(settings.format) << " to 16-bit planes with " << pMono12->GetKernelName() << " kernel"
+				<< (pMono12->GetFrameKernelName() ? std::string(" (") + pMono12->GetFrameKernelName() + " frame kernel)\n" : "\n");
+	else if (planar)
+		std::cout << TAB1 << "Demux angle planes with " << deinterleave.name << " kernel\n";
+
+	std::unique_ptr<RawWriter> pWriter;
+	std::unique_ptr<MetadataWriter> pMetadata;
+
+	if (settings.metadata)
+	{
+		const std::string metadataName = settings.filePrefix + FILE_NAME_METADATA;
+
+		pMetadata.reset(new MetadataWriter(metadataName, settings.fps, pStream->pStats));
+		pMetadata->Open();
+
+		std::cout << TAB1 << "Write frame metadata to " << metadataName << "\n";
+	}
+
+	// Write images
+	std::cout << TAB2 << "Write images\n";
+
+	AcquiredImage image;
+	uint64_t imageCount = 0;
+
+	FrameStats* pStats = pStream->pStats;
+
+	while (queue.Pop(image))
+	{
+		PrintProgress(imageCount++, settings.numImages);
+
+		if (pStats != NULL)
+		{
+			pStats->Stamp(image.sequence, FRAME_STAGE_QUEUE);
+			pStats->SampleQueueDepth(queue.Size());
+		}
+
+		// the header records the pixel format the camera actually sent
+		if (!pWriter)
+		{
+			if (pMono12)
+				pWriter.reset(new RawWriter(fileName, width, height, image.pImage->GetPixelFormat(), RAW_LAYOUT_PLANAR, pMono12->GetNumPlanes(), 2, 12, settings.fps, settings.rawCodec, numSlices, pStats));
+			else
+				pWriter.reset(new RawWriter(fileName, planeWidth, planeHeight, image.pImage->GetPixelFormat(), static_cast<RawLayout>(settings.rawLayout), planar ? NUM_ANGLES : 1, planar ? 1 : 4, 8, settings.fps, settings.rawCodec, numSlices, pStats));
+
+			pWriter->Open();
+		}
+
+		const size_t frameSize = pMono12 ? pMono12->GetFrameSize() : width * height * 4;
+		const size_t sizeFilled = std::min<size_t>(image.pImage->GetSizeFilled(), frameSize);
+
+		// a short frame is recorded as incomplete, with the rest zeroed
+		uint8_t* pPayload = pWriter->BeginFrame(
+			image.pImage->GetFrameId(),
+			image.pImage->GetTimestampNs(),
+			image.pImage->IsIncomplete() || sizeFilled < frameSize ? RAW_FRAME_INCOMPLETE : 0);
+
+		if (pMono12)
+		{
+			uint16_t* planes[NUM_ANGLES];
+
+			for (size_t plane = 0; plane < pMono12->GetNumPlanes(); plane++)
+				planes[plane] = reinterpret_cast<uint16_t*>(pPayload + plane * pWriter->GetPlaneStride());
+
+			pMono12->Process(image.pImage->GetData(), sizeFilled, planes, width);
+		}
+		else if (planar)
+		{
+			const uint64_t planeStride = pWriter->GetPlaneStride();
+			uint8_t* planes[NUM_ANGLES] = { pPayload, pPayload + planeStride, pPayload + 2 * planeStride, pPayload + 3 * planeStride };
+
+			demux.Process(image.pImage->GetData(), sizeFilled / 4, planes, planeWidth);
+		}
+		else
+		{
+			memcpy(pPayload, image.pImage->GetData(), sizeFilled);
+		}
+
+		pWriter->EndFrame(sizeFilled);
+
+		if (pMetadata)
+			pMetadata->Append(image.metadata);
+
+		ReleaseImage(pStream, image);
+
+		// written in place, so the frame is done
+		if (pStats != NULL)
+		{
+			pStats->Stamp(image.sequence, FRAME_STAGE_DEMUX);
+			pStats->Encoded(image.sequence);
+		}
+
+		ReportFrameStats(pStream, settings);
+	}
+
+	if (settings.numImages == 0 || imageCount < settings.numImages)
+		std::cout << "\n";
+
+	// Close raw file
+	if (pWriter)
+	{
+		std::cout << TAB1 << "Close raw recording (" << pWriter->GetFrameCount() << " frames";
+
+		if (lossless && pWriter->GetFrameBytes() > 0)
+			std::cout << ", compressed " << static_cast<double>(pWriter->GetFrameCount() * pWriter->GetPayloadSize()) / pWriter->GetFrameBytes() << ":1";
+
+		std::cout << ")\n";
+		pWriter->Close();
+	}
+
+	if (pMetadata)
+		pMetadata->Close();
+}
+
+// sizes the stream buffer pool, see Stream buffers above
+//    In zero-copy mode a full queue, the image being demuxed, the image
+//    waiting to be queued and the driver reserve must all fit. The TL
+//    stream node map reports the smallest pool the transport layer accepts.
+size_t GetNumStreamBuffers(Arena::IDevice* pDevice, const RecordSettings& settings, double fps)
+{
+	size_t numBuffers = settings.numBuffers;
+
+	if (numBuffers == 0)
+	{
+		numBuffers = settings.zeroCopy ? settings.queueDepth + 2 + STREAM_BUFFER_RESERVE : 10;
+
+		// frames of a host stall, within the budget
+		const int64_t payloadSize = GetOptionalIntValue(pDevice->GetNodeMap(), "PayloadSize");
+
+		if (payloadSize > 0)
+		{
+			const size_t stallBuffers = static_cast<size_t>(std::ceil(fps * STREAM_BUFFER_S));
+			const size_t budgetBuffers = (static_cast<size_t>(STREAM_BUFFER_BUDGET_MB) << 20) / static_cast<size_t>(payloadSize);
+
+			numBuffers = std::max(numBuffers, std::min(stallBuffers, budgetBuffers));
+		}
+	}
+
+	GenApi::CIntegerPtr pBufferMinimum = pDevice->GetTLStreamNodeMap()->GetNode("StreamAnnounceBufferMinimum");
+
+	if (pBufferMinimum && GenApi::IsReadable(pBufferMinimum) && static_cast<int64_t>(numBuffers) < pBufferMinimum->GetValue())
+		numBuffers = static_cast<size_t>(pBufferMinimum->GetValue());
+
+	return numBuffers;
+}
+
+// streams at a frame rate for CALIBRATE_TRIAL_S seconds
+//    Returns the lost and incomplete frames, missed packets and resend
+//    requests counted meanwhile, 0 if every frame arrived in one go.
+uint64_t CountTransportErrors(Arena::IDevice* pDevice, double fps, size_t numBuffers)
+{
+	SetFloatValue(pDevice->GetNodeMap(), "AcquisitionFrameRate", fps);
+	pDevice->StartStream(numBuffers);
+
+	// the counters may restart with the stream
+	const std::vector<StreamCounter> before = ReadStreamCounters(pDevice);
+	uint64_t errors = 0;
+
+	try
+	{
+		const double start = FrameStats::Now();
+		bool first = true;
+		uint64_t lastFrameId = 0;
+
+		while (FrameStats::Now() - start < CALIBRATE_TRIAL_S && !g_stopRequested)
+		{
+			Arena::IImage* pImage = pDevice->GetImage(2000);
+			const uint64_t frameId = pImage->GetFrameId();
+
+			if (pImage->IsIncomplete())
+				errors++;
+
+			if (!first && frameId > lastFrameId + 1)
+				errors += frameId - lastFrameId - 1;
+
+			first = false;
+			lastFrameId = frameId;
 			pDevice->RequeueBuffer(pImage);
 		}
-		pDevice->StopStream();
+	}
+	catch (...)
+	{
+		pDevice->StopStream();
+		throw;
+	}
+
+	const std::vector<StreamCounter> after = ReadStreamCounters(pDevice);
+	pDevice->StopStream();
+
+	// adds missed packets and resend requests
+	//    Incomplete and lost frames are counted from the images above
+	//    already, their stream counters would count them a second time.
+	for (size_t i = 0; i < after.size() && i < before.size(); i++)
+		if ((after[i].first == "StreamMissedPacketCount" || after[i].first == "StreamResendRequestCount") && after[i].second > before[i].second)
+			errors += static_cast<uint64_t>(after[i].second - before[i].second);
+
+	return errors;
+}
+
+// finds the highest frame rate the window arrives at without transport
+// errors, see Transport above
+// (1) tries camera's maximum
+// (2) halves range between highest clean and lowest failing rate
+// (3) sets highest clean rate, or the camera's minimum if none was clean
+double CalibrateFrameRate(Arena::IDevice* pDevice, const RecordSettings& settings)
+{
+	GenApi::CFloatPtr pFrameRate = pDevice->GetNodeMap()->GetNode("AcquisitionFrameRate");
+	const double minimum = pFrameRate->GetMin();
+	const double maximum = pFrameRate->GetMax();
+	const size_t numBuffers = GetNumStreamBuffers(pDevice, settings, maximum);
+	const std::string serial = Arena::GetNodeValue<GenICam::gcstring>(pDevice->GetTLDeviceNodeMap(), "DeviceSerialNumber").c_str();
+
+	std::cout << "Calibrating the frame rate of camera " << serial << " at " << settings.width << "x" << settings.height << ", up to " << maximum << " FPS\n";
+
+	// (1)
+	double clean = 0.0;
+	double failing = maximum;
+	uint64_t errors = CountTransportErrors(pDevice, maximum, numBuffers);
+
+	std::cout << TAB1 << maximum << " FPS: " << errors << " transport errors\n";
+
+	if (errors == 0)
+		clean = maximum;
+
+	// (2)
+	for (size_t step = 0; step < CALIBRATE_STEPS && clean < maximum && !g_stopRequested; step++)
+	{
+		const double fps = ((clean > 0.0 ? clean : minimum) + failing) / 2.0;
+		errors = CountTransportErrors(pDevice, fps, numBuffers);
+
+		std::cout << TAB1 << fps << " FPS: " << errors << " transport errors\n";
+
+		if (errors == 0)
+			clean = fps;
+		else
+			failing = fps;
+	}
+
+	// (3)
+	if (clean == 0.0)
+	{
+		clean = minimum;
+		std::cout << TAB1 << "No rate was clean; recording at the camera's minimum\n";
+	}
+
+	clean = SetFloatValue(pDevice->GetNodeMap(), "AcquisitionFrameRate", clean);
+	std::cout << "Camera " << serial << " records at " << clean << " FPS\n";
+
+	return clean;
+}
+
+// records while acquiring
+// (1) sizes stream buffer pool
+// (2) starts stream
+// (3) starts acquisition thread
+// (4) records images as they are captured
+// (5) stops stream
+void StreamAndRecord(Arena::IDevice* pDevice, const RecordSettings& settings, EncoderPool* pEncoders, CountdownLatch* pStarted)
+{
+	// Size stream buffer pool
+	const size_t numBuffers = GetNumStreamBuffers(pDevice, settings, settings.fps);
+
+	// Prepare frame statistics
+	//    A video frame is done once every stream has appended it, a raw frame
+	//    once it is written.
+	std::unique_ptr<FrameStats> pStats;
+
+	if (settings.statsInterval > 0.0 || !settings.statsFile.empty())
+	{
+		const size_t numStreams = settings.rawLayout >= 0 ? 1 : GetNumVideoStreams(settings);
+		const std::string fileName = settings.statsFile.empty() ? "" : settings.filePrefix + settings.statsFile;
+
+		pStats.reset(new FrameStats(settings.filePrefix, numStreams, fileName));
+
+		if (!fileName.empty())
+			std::cout << "Writing frame statistics to " << fileName << "\n";
+	}
+
+	StreamContext stream(pDevice, numBuffers, settings.zeroCopy, settings.backpressure, settings.decimation, pStats.get());
+	stream.readLineStatus = settings.preTrigger > 0.0 && settings.triggerSource == TRIGGER_SOURCE_LINE;
+	stream.readMetadata = settings.metadata;
+	FrameQueue<AcquiredImage> queue(settings.queueDepth);
+	std::exception_ptr acquisitionError;
+
+	std::cout << "Starting stream with " << numBuffers << " buffers" << (settings.zeroCopy ? " (zero-copy)\n" : "\n");
+
+	pDevice->StartStream(numBuffers);
+
+	// triggered cameras only see actions fired after they stream
+	if (pStarted != NULL)
+		pStarted->CountDown();
+
+	std::cout << "Capturing and recording images\n";
+	if (settings.preTrigger > 0.0)
+		std::cout << "Waiting for " << GetTriggerDescription(settings) << "; press Ctrl+C to stop\n";
+	else if (settings.numImages == 0)
+		std::cout << "Press Ctrl+C to stop recording\n";
+
+	std::thread acquisitionThread(AcquireImages, &stream, &queue, settings.numImages, &acquisitionError);
+
+	// Tune acquisition thread
+	//    It waits on the driver for every image, and any delay in handing
+	//    the buffer back shrinks what the driver has to receive into.
+	if (settings.rxCpu >= 0 && !PinThread(acquisitionThread, settings.rxCpu))
+		std::cout << "Could not pin the acquisition thread to CPU " << settings.rxCpu << "\n";
+
+	if (settings.rxRealtime && !RaiseThreadPriority(acquisitionThread))
+		std::cout << "Could not raise the acquisition thread to realtime priority\n";
+
+	try
+	{
+		if (settings.rawLayout >= 0)
+			RecordRaw(queue, &stream, settings);
+		else
+			RecordVideo(queue, &stream, settings, pEncoders);
+	}
+	catch (...)
+	{
+		// release acquisition before passing the error on
+		g_stopRequested = true;
+		queue.Close();
+		acquisitionThread.join();
+
+		AcquiredImage image;
+		while (queue.Pop(image))
+			ReleaseImage(&stream, image);
+
+		pDevice->StopStream();
+		throw;
+	}
+
+	// a triggered recording ends while acquisition still runs
+	queue.Close();
+	acquisitionThread.join();
+
+	AcquiredImage image;
+	while (queue.Pop(image))
+		ReleaseImage(&stream, image);
+
+	if (pStats)
+		pStats->Report(ReadStreamCounters(pDevice), true);
+
+	pDevice->StopStream();
+
+	if (settings.zeroCopy)
+		std::cout << "Copied " << stream.copiedImages << " images while the recorder was behind\n";
+
+	if (settings.backpressure != BACKPRESSURE_BLOCK)
+		std::cout << "Dropped " << stream.droppedImages << " images while the recorder was behind\n";
+
+	if (stream.throttleCount > 0)
+		std::cout << "Lowered the frame rate " << stream.throttleCount << " times, to " << stream.throttledFrameRate << " FPS\n";
+
+	if (acquisitionError)
+		std::rethrow_exception(acquisitionError);
+}
+
+// device settings changed by the example, restored when it ends
+struct InitialSettings
+{
+	GenICam::gcstring acquisitionMode;
+	GenICam::gcstring pixelFormat;
+	bool frameRateEnable;
+	double frameRate;
+	int64_t width;
+	int64_t height;
+	int64_t offsetX;
+	int64_t offsetY;
+
+	// 0 on cameras without the node
+	int64_t binningHorizontal;
+	int64_t binningVertical;
+	int64_t decimationHorizontal;
+	int64_t decimationVertical;
+
+	// only stored with -sync
+	bool ptpEnable;
+	GenICam::gcstring triggerMode;
+
+	// ChunkEnable only stored with chunks, one per GetChunkSelectors()
+	//    Chunk mode is turned off without chunks, so it is always stored.
+	bool chunkModeActive;
+	std::vector<bool> chunkEnables;
+
+	// only stored with -throughput and -packetdelay
+	GenICam::gcstring throughputLimitMode;
+	int64_t throughputLimit;
+	int64_t packetDelay;
+};
+
+// chunks the camera sends with every image: the input lines for a line
+// trigger or -metadata, and the exposure time and gain for -metadata
+std::vector<const char*> GetChunkSelectors(const RecordSettings& settings)
+{
+	std::vector<const char*> chunks;
+
+	if (settings.metadata || (settings.preTrigger > 0.0 && settings.triggerSource == TRIGGER_SOURCE_LINE))
+		chunks.push_back("LineStatusAll");
+
+	if (settings.metadata)
+	{
+		chunks.push_back("ExposureTime");
+		chunks.push_back("Gain");
+	}
+
+	return chunks;
+}
+
+// stores the settings ConfigureDevice() changes
+InitialSettings StoreInitialSettings(Arena::IDevice* pDevice, const RecordSettings& settings)
+{
+	InitialSettings initial;
+	initial.frameRate = 0.0;
+	initial.ptpEnable = false;
+	initial.chunkModeActive = false;
+	initial.throughputLimit = 0;
+	initial.packetDelay = 0;
+
+	// Store acquisition mode
+	initial.acquisitionMode = Arena::GetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "AcquisitionMode");
+
+	// Store pixel format
+	initial.pixelFormat = Arena::GetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "PixelFormat");
+
+	// Store frame rate enable
+	initial.frameRateEnable = Arena::GetNodeValue<bool>(pDevice->GetNodeMap(), "AcquisitionFrameRateEnable");
+
+	if (initial.frameRateEnable)
+	{
+		// Store frame rate value
+		initial.frameRate = Arena::GetNodeValue<double>(pDevice->GetNodeMap(), "AcquisitionFrameRate");
+	}
+
+	// Store image width
+	initial.width = Arena::GetNodeValue<int64_t>(pDevice->GetNodeMap(), "Width");
+
+	// Store image height
+	initial.height = Arena::GetNodeValue<int64_t>(pDevice->GetNodeMap(), "Height");
+
+	// Store image offsets
+	initial.offsetX = Arena::GetNodeValue<int64_t>(pDevice->GetNodeMap(), "OffsetX");
+	initial.offsetY = Arena::GetNodeValue<int64_t>(pDevice->GetNodeMap(), "OffsetY");
+
+	// Store binning and decimation, if the camera has them
+	initial.binningHorizontal = GetOptionalIntValue(pDevice->GetNodeMap(), "BinningHorizontal");
+	initial.binningVertical = GetOptionalIntValue(pDevice->GetNodeMap(), "BinningVertical");
+	initial.decimationHorizontal = GetOptionalIntValue(pDevice->GetNodeMap(), "DecimationHorizontal");
+	initial.decimationVertical = GetOptionalIntValue(pDevice->GetNodeMap(), "DecimationVertical");
+
+	// Store PTP and trigger mode
+	if (settings.sync)
+	{
+		initial.ptpEnable = Arena::GetNodeValue<bool>(pDevice->GetNodeMap(), "PtpEnable");
+		initial.triggerMode = Arena::GetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "TriggerMode");
+	}
+
+	// Store chunk mode
+	const std::vector<const char*> chunks = GetChunkSelectors(settings);
+
+	GenApi::CBooleanPtr pChunkModeActive = pDevice->GetNodeMap()->GetNode("ChunkModeActive");
+
+	if (pChunkModeActive && GenApi::IsReadable(pChunkModeActive))
+		initial.chunkModeActive = pChunkModeActive->GetValue();
+
+	if (!chunks.empty())
+	{
+		for (size_t c = 0; c < chunks.size(); c++)
+		{
+			Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "ChunkSelector", chunks[c]);
+			initial.chunkEnables.push_back(Arena::GetNodeValue<bool>(pDevice->GetNodeMap(), "ChunkEnable"));
+		}
+	}
+
+	// Store throughput limit and packet delay
+	if (settings.throughputLimit != 0)
+	{
+		initial.throughputLimitMode = Arena::GetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "DeviceLinkThroughputLimitMode");
+		initial.throughputLimit = Arena::GetNodeValue<int64_t>(pDevice->GetNodeMap(), "DeviceLinkThroughputLimit");
+	}
+
+	if (settings.packetDelay >= 0)
+		initial.packetDelay = Arena::GetNodeValue<int64_t>(pDevice->GetNodeMap(), "GevSCPD");
+
+	return initial;
+}
+
+// the requested settings a cache entry is kept for, as one word
+//    The throughput limit and packet delay are part of it, since they change
+//    the frame rates the camera accepts.
+std::string GetRequestedNodes(const RecordSettings& settings)
+{
+	std::ostringstream requested;
+	requested.precision(17);
+	requested << GetPixelFormatName(settings.format) << "," << settings.width << "," << settings.height << "," << settings.offsetX << "," << settings.offsetY << ","
+			<< settings.binning << "," << settings.subsampling << "," << settings.fps << "," << settings.throughputLimit << "," << settings.linkShares << "," << settings.packetDelay;
+
+	return requested.str();
+}
+
+// tells whether a camera sends exactly the chunks a recording wants
+//    A camera without chunk nodes sends none.
+bool HoldsChunkSettings(GenApi::INodeMap* pNodeMap, const RecordSettings& settings)
+{
+	const std::vector<const char*> chunks = GetChunkSelectors(settings);
+
+	GenApi::CBooleanPtr pChunkModeActive = pNodeMap->GetNode("ChunkModeActive");
+	const bool active = pChunkModeActive && GenApi::IsReadable(pChunkModeActive) && pChunkModeActive->GetValue();
+
+	if (active != !chunks.empty())
+		return false;
+
+	for (size_t c = 0; c < chunks.size(); c++)
+	{
+		Arena::SetNodeValue<GenICam::gcstring>(pNodeMap, "ChunkSelector", chunks[c]);
+
+		if (!Arena::GetNodeValue<bool>(pNodeMap, "ChunkEnable"))
+			return false;
+	}
+
+	return true;
+}
+
+// tells whether a camera still holds the settings it accepted last time
+//    One read per node, where setting them again reads each node's range
+//    and writes it. Another tool may have left the camera triggered or
+//    sending other chunks, neither of which the cache records, so both are
+//    checked against what a free running recording needs. -calibrate moves
+//    the frame rate off the cached one and sets it again anyway, so the
+//    frame rate is only checked without it.
+bool HoldsCachedSettings(GenApi::INodeMap* pNodeMap, const RecordSettings& settings, const CachedNodeSettings& cached)
+{
+	// a camera without binning or decimation nodes reads as 0 and has 1
+	return Arena::GetNodeValue<GenICam::gcstring>(pNodeMap, "AcquisitionMode") == "Continuous"
+		&& Arena::GetNodeValue<GenICam::gcstring>(pNodeMap, "TriggerMode") == "Off"
+		&& HoldsChunkSettings(pNodeMap, settings)
+		&& Arena::GetNodeValue<GenICam::gcstring>(pNodeMap, "PixelFormat") == GetPixelFormatName(settings.format)
+		&& std::max<int64_t>(GetOptionalIntValue(pNodeMap, "BinningHorizontal"), 1) == cached.binning
+		&& std::max<int64_t>(GetOptionalIntValue(pNodeMap, "BinningVertical"), 1) == cached.binning
+		&& std::max<int64_t>(GetOptionalIntValue(pNodeMap, "DecimationHorizontal"), 1) == cached.subsampling
+		&& std::max<int64_t>(GetOptionalIntValue(pNodeMap, "DecimationVertical"), 1) == cached.subsampling
+		&& Arena::GetNodeValue<int64_t>(pNodeMap, "Width") == cached.width
+		&& Arena::GetNodeValue<int64_t>(pNodeMap, "Height") == cached.height
+		&& Arena::GetNodeValue<int64_t>(pNodeMap, "OffsetX") == cached.offsetX
+		&& Arena::GetNodeValue<int64_t>(pNodeMap, "OffsetY") == cached.offsetY
+		&& Arena::GetNodeValue<bool>(pNodeMap, "AcquisitionFrameRateEnable")
+		&& (settings.calibrate || std::fabs(Arena::GetNodeValue<double>(pNodeMap, "AcquisitionFrameRate") - cached.fps) <= 1e-3 * cached.fps);
+}
+
+// prepares a camera for recording
+//    Returns the settings with the window, binning and frame rate the
+//    camera actually accepted, which may differ between cameras. With a
+//    node cache, a camera that still holds what it accepted for the same
+//    request last time is left as it is; -sync always sets every node.
+RecordSettings ConfigureDevice(Arena::IDevice* pDevice, const RecordSettings& requested, NodeCache* pCache, const std::string& serial)
+{
+	RecordSettings settings = requested;
+
+	// Set throughput limit and packet delay
+	//    Both lower the highest frame rate the camera allows, so they are set
+	//    before it. An even share of the link is taken from the range of the
+	//    limit, whose maximum is what the link carries.
+	if (settings.throughputLimit != 0)
+	{
+		Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "DeviceLinkThroughputLimitMode", "On");
+
+		GenApi::CIntegerPtr pLimit = pDevice->GetNodeMap()->GetNode("DeviceLinkThroughputLimit");
+		const int64_t limit = settings.throughputLimit > 0 ? settings.throughputLimit : pLimit->GetMax() / static_cast<int64_t>(settings.linkShares);
+
+		settings.throughputLimit = SetIntValue(pDevice->GetNodeMap(), "DeviceLinkThroughputLimit", limit);
+	}
+
+	if (settings.packetDelay >= 0)
+		settings.packetDelay = SetIntValue(pDevice->GetNodeMap(), "GevSCPD", settings.packetDelay);
+
+	// Look up node cache
+	CachedNodeSettings cached;
+	const bool useCache = pCache != NULL && !settings.sync;
+
+	cached.requested = GetRequestedNodes(requested);
+
+	if (useCache && pCache->Find(serial, cached.requested, cached) && HoldsCachedSettings(pDevice->GetNodeMap(), settings, cached))
+	{
+		settings.width = cached.width;
+		settings.height = cached.height;
+		settings.offsetX = cached.offsetX;
+		settings.offsetY = cached.offsetY;
+		settings.binning = cached.binning;
+		settings.subsampling = cached.subsampling;
+		settings.fps = cached.fps;
+
+		std::cout << "Camera " << serial << " still holds the settings in " << pCache->GetFileName() << "\n";
+	}
+	else
+	{
+		// Set acquisition mode
+		Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "AcquisitionMode", "Continuous");
+
+		// ['Mono8', 'Mono10', 'Mono10p', 'Mono10Packed', 'Mono12', 
+		// 'Mono12p', 'Mono12Packed', 'Mono16', 'PolarizeMono8', 
+		// 'PolarizeMono12', 'PolarizeMono12p', 'PolarizeMono12Packed', 
+		// 'PolarizeMono16', 'PolarizedAngles_0d_45d_90d_135d_Mono8', 
+		// 'PolarizedStokes_S0_S1_S2_S3_Mono8', 'PolarizedDolpAolp_Mono8', 
+		// 'PolarizedDolpAolp_Mono12p', 'PolarizedDolp_Mono8', 
+		// 'PolarizedDolp_Mono12p', 'PolarizedAolp_Mono8', 'PolarizedAolp_Mono12p']
+		Arena::SetNodeValue<GenICam::gcstring>(
+			pDevice->GetNodeMap(),
+			"PixelFormat",
+			GetPixelFormatName(settings.format));
+		// PolarizedAolp_Mono8
+
+		// Set binning and decimation
+		//    Both shrink the sensor before the window is placed on it, and the
+		//    offsets are cleared first so the window may grow to the new limits.
+		SetIntValue(pDevice->GetNodeMap(), "OffsetX", 0);
+		SetIntValue(pDevice->GetNodeMap(), "OffsetY", 0);
+
+		settings.binning = SetFactorPair(pDevice->GetNodeMap(), "BinningHorizontal", "BinningVertical", settings.binning);
+		settings.subsampling = SetFactorPair(pDevice->GetNodeMap(), "DecimationHorizontal", "DecimationVertical", settings.subsampling);
+
+		// Set width and height
+		//    Reducing the size of an image reduces the amount of bandwidth
+		//    required for each image. The less bandwidth required per image, the
+		//    more images can be sent over the same bandwidth.
+		settings.width = SetIntValue(pDevice->GetNodeMap(), "Width", settings.width);
+		settings.height = SetIntValue(pDevice->GetNodeMap(), "Height", settings.height);
+
+		// Set offsets
+		//    Their maximum is what the window leaves of the sensor.
+		settings.offsetX = SetIntValue(pDevice->GetNodeMap(), "OffsetX", settings.offsetX);
+		settings.offsetY = SetIntValue(pDevice->GetNodeMap(), "OffsetY", settings.offsetY);
+
+		// Set framerate
+		//    Triggered cameras take a frame per action command, so the frame
+		//    rate limit is turned off and the scheduler sets the pace instead.
+		if (settings.sync)
+		{
+			Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "AcquisitionFrameRateEnable", false);
+			EnableActionTrigger(pDevice);
+		}
+		else
+		{
+			Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "AcquisitionFrameRateEnable", true);
+
+			settings.fps = SetFloatValue(pDevice->GetNodeMap(), "AcquisitionFrameRate", settings.fps);
+		}
+
+		// Store accepted settings
+		if (useCache)
+		{
+			cached.width = settings.width;
+			cached.height = settings.height;
+			cached.offsetX = settings.offsetX;
+			cached.offsetY = settings.offsetY;
+			cached.binning = settings.binning;
+			cached.subsampling = settings.subsampling;
+			cached.fps = settings.fps;
+
+			pCache->Store(serial, cached);
+		}
+	}
+
+	// Enable chunks
+	//    A line trigger reads the input lines sent with every image, so it
+	//    sees them at the exposure rather than whenever the host polls; the
+	//    metadata file gets them with the exposure time and gain.
+	const std::vector<const char*> chunks = GetChunkSelectors(settings);
+
+	if (!chunks.empty())
+	{
+		Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "ChunkModeActive", true);
+
+		for (size_t c = 0; c < chunks.size(); c++)
+		{
+			Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "ChunkSelector", chunks[c]);
+			Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "ChunkEnable", true);
+		}
+	}
+	else
+	{
+		// chunks another tool left on would grow every payload
+		GenApi::CBooleanPtr pChunkModeActive = pDevice->GetNodeMap()->GetNode("ChunkModeActive");
+
+		if (pChunkModeActive && GenApi::IsWritable(pChunkModeActive))
+			pChunkModeActive->SetValue(false);
+	}
+
+	// enable stream auto negotiate packet size
+	Arena::SetNodeValue<bool>(pDevice->GetTLStreamNodeMap(), "StreamAutoNegotiatePacketSize", true);
+
+	// enable stream packet resend
+	Arena::SetNodeValue<bool>(pDevice->GetTLStreamNodeMap(), "StreamPacketResendEnable", true);
+
+	// Set buffer handling mode
+	//    Which buffer the driver hands out next: the oldest, the oldest but
+	//    overwritten by new frames when none is free, or only the newest.
+	if (!settings.bufferHandling.empty())
+		Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetTLStreamNodeMap(), "StreamBufferHandlingMode", settings.bufferHandling.c_str());
+
+	return settings;
+}
+
+void RestoreInitialSettings(Arena::IDevice* pDevice, const InitialSettings& initial, const RecordSettings& settings)
+{
+	// Restore PTP and trigger mode
+	if (settings.sync)
+	{
+		Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "TriggerMode", initial.triggerMode);
+		Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "PtpEnable", initial.ptpEnable);
+	}
+
+	// Restore throughput limit and packet delay
+	//    before the frame rate they limit
+	if (settings.throughputLimit != 0)
+	{
+		SetIntValue(pDevice->GetNodeMap(), "DeviceLinkThroughputLimit", initial.throughputLimit);
+		Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "DeviceLinkThroughputLimitMode", initial.throughputLimitMode);
+	}
+
+	if (settings.packetDelay >= 0)
+		SetIntValue(pDevice->GetNodeMap(), "GevSCPD", initial.packetDelay);
+
+	// Restore chunk mode
+	const std::vector<const char*> chunks = GetChunkSelectors(settings);
+
+	if (!chunks.empty())
+	{
+		for (size_t c = 0; c < chunks.size(); c++)
+		{
+			Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "ChunkSelector", chunks[c]);
+			Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "ChunkEnable", initial.chunkEnables[c]);
+		}
+
+		Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "ChunkModeActive", initial.chunkModeActive);
+	}
+	else if (initial.chunkModeActive)
+		Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "ChunkModeActive", true);
+
+	// Restore pixel format
+	Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "PixelFormat", initial.pixelFormat);
+
+	// Restore binning and decimation
+	//    The offsets are cleared first so the window may grow back.
+	SetIntValue(pDevice->GetNodeMap(), "OffsetX", 0);
+	SetIntValue(pDevice->GetNodeMap(), "OffsetY", 0);
+
+	if (initial.binningHorizontal > 0 && initial.binningVertical > 0)
+	{
+		SetIntValue(pDevice->GetNodeMap(), "BinningHorizontal", initial.binningHorizontal);
+		SetIntValue(pDevice->GetNodeMap(), "BinningVertical", initial.binningVertical);
+	}
+
+	if (initial.decimationHorizontal > 0 && initial.decimationVertical > 0)
+	{
+		SetIntValue(pDevice->GetNodeMap(), "DecimationHorizontal", initial.decimationHorizontal);
+		SetIntValue(pDevice->GetNodeMap(), "DecimationVertical", initial.decimationVertical);
+	}
+
+	// Restore width, height and offsets
+	SetIntValue(pDevice->GetNodeMap(), "Width", initial.width);
+	SetIntValue(pDevice->GetNodeMap(), "Height", initial.height);
+	SetIntValue(pDevice->GetNodeMap(), "OffsetX", initial.offsetX);
+	SetIntValue(pDevice->GetNodeMap(), "OffsetY", initial.offsetY);
+
+	// Restore acquisition mode
+	Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "AcquisitionMode", initial.acquisitionMode);
+
+	// Restore framerate
+	Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "AcquisitionFrameRateEnable", initial.frameRateEnable);
+
+	if (initial.frameRateEnable)
+	{
+		SetFloatValue(pDevice->GetNodeMap(), "AcquisitionFrameRate", initial.frameRate);
+	}
+}
+
+// picks the cameras to record from those found
+//    Serials are taken in the order given; one that is not connected is an
+//    error rather than a silently smaller rig.
+std::vector<Arena::DeviceInfo> SelectDevices(const std::vector<Arena::DeviceInfo>& deviceInfos, const RecordSettings& settings)
+{
+	if (settings.allDevices)
+		return deviceInfos;
+
+	if (settings.serials.empty())
+		return std::vector<Arena::DeviceInfo>(1, deviceInfos[0]);
+
+	std::vector<Arena::DeviceInfo> selected;
+
+	for (size_t i = 0; i < settings.serials.size(); i++)
+	{
+		size_t d = 0;
+		while (d < deviceInfos.size() && settings.serials[i] != deviceInfos[d].SerialNumber().c_str())
+			d++;
+
+		if (d == deviceInfos.size())
+			throw std::runtime_error("No camera with serial number " + settings.serials[i] + " connected");
+
+		selected.push_back(deviceInfos[d]);
+	}
+
+	return selected;
+}
+
+// records one camera, on a thread of its own when several cameras record
+//    A failure is kept for main() and stops the other cameras too.
+void RecordDevice(Arena::IDevice* pDevice, RecordSettings settings, EncoderPool* pEncoders, CountdownLatch* pStarted, std::exception_ptr* pError)
+{
+	try
+	{
+		if (settings.calibrate)
+			settings.fps = CalibrateFrameRate(pDevice, settings);
+
+		StreamAndRecord(pDevice, settings, pEncoders, pStarted);
+	}
+	catch (...)
+	{
+		*pError = std::current_exception();
+		g_stopRequested = true;
+	}
+}
+
+// summarizes a raw recording without a camera
+// (1) maps recording
+// (2) walks frame headers for ID gaps and incomplete frames
+// (3) reports the capture rate from the timestamps
+// (4) reports each plane's mean of the first frame
+void InspectRaw(const char* fileName)
+{
+	RawReader reader(fileName);
+	const RawFileHeader& header = reader.GetHeader();
+	uint64_t numFrames = reader.GetFrameCount();
+
+	std::cout << fileName << ": " << header.width << "x" << header.height << ", "
+			<< (header.bitsPerSample > 8 ? header.bitsPerSample : 8) << "-bit "
+			<< (header.codec == RAW_CODEC_LOSSLESS ? "lossless" : header.layout == RAW_LAYOUT_PLANAR ? "planar" : "interleaved") << ", "
+			<< numFrames << " frames" << (header.frameCount == 0 ? " (recovered, recording was not closed)\n" : "\n");
+
+	if (numFrames == 0)
+		return;
+
+	// Find frame ID gaps
+	//    The camera numbers frames consecutively, so a jump means frames were
+	//    lost before they reached the recording.
+	uint64_t missing = 0;
+	uint64_t incomplete = 0;
+	uint64_t recordBytes = 0;
+
+	for (uint64_t i = 0; i < numFrames; i++)
+	{
+		const RawFrameHeader& frame = reader.GetFrameHeader(i);
+		recordBytes += frame.recordSize;
+
+		if (i > 0 && frame.frameId > reader.GetFrameHeader(i - 1).frameId + 1)
+			missing += frame.frameId - reader.GetFrameHeader(i - 1).frameId - 1;
+
+		if (frame.flags & RAW_FRAME_INCOMPLETE)
+			incomplete++;
+	}
+
+	const RawFrameHeader& first = reader.GetFrameHeader(0);
+	const RawFrameHeader& last = reader.GetFrameHeader(numFrames - 1);
+
+	std::cout << "Frame IDs " << first.frameId << " to " << last.frameId << ", " << missing << " missing, " << incomplete << " incomplete\n";
+
+	if (numFrames > 1 && last.timestampNs > first.timestampNs)
+		std::cout << "Captured at " << (numFrames - 1) * 1e9 / (last.timestampNs - first.timestampNs) << " fps\n";
+
+	if (header.codec == RAW_CODEC_LOSSLESS && recordBytes > 0)
+		std::cout << "Compressed " << static_cast<double>(numFrames * header.payloadSize) / recordBytes << ":1 in " << header.numSlices << " slices\n";
+
+	// Average first frame
+	//    8-bit angles are summarized in either layout and 12-bit planes from
+	//    their 16-bit little endian samples; the views read straight from the
+	//    mapping, or from the decoded frame of a lossless recording.
+	const bool planar = header.layout == RAW_LAYOUT_PLANAR;
+	const size_t sampleBytes = planar ? header.bytesPerPixel : header.bytesPerPixel / NUM_ANGLES;
+	const size_t numPlanes = planar ? header.numPlanes : NUM_ANGLES;
+
+	if (sampleBytes != 1 && sampleBytes != 2)
+		return;
+
+	for (size_t p = 0; p < numPlanes; p++)
+	{
+		RawPlaneView plane = reader.GetPlane(0, p);
+		uint64_t sum = 0;
+
+		for (uint32_t y = 0; y < plane.height; y++)
+		{
+			const uint8_t* pRow = plane.pData + y * plane.rowStride;
+
+			for (uint32_t x = 0; x < plane.width; x++)
+			{
+				const uint8_t* pSample = pRow + x * plane.pixelStride;
+
+				sum += sampleBytes == 2 ? pSample[0] | (pSample[1] << 8) : pSample[0];
+			}
+		}
+
+		// DoLP and AoLP recordings have two planes
+		if (numPlanes == NUM_ANGLES)
+			std::cout << "Angle " << p * 45;
+		else
+			std::cout << (p == 0 ? "DoLP" : "AoLP");
+
+		std::cout << " mean " << static_cast<double>(sum) / (static_cast<uint64_t>(plane.width) * plane.height) << "\n";
+	}
+}
+
+// summarizes a -metadata file
+// (1) reads header and records
+// (2) walks records for ID gaps and incomplete frames
+// (3) reports the capture rate and the exposure time and gain ranges
+void InspectMetadata(const char* fileName)
+{
+	// (1)
+	std::ifstream file(fileName, std::ios::binary);
+	MetadataFileHeader header;
+
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		memcmp(header.magic, METADATA_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+		header.version != METADATA_FILE_VERSION || header.recordSize < sizeof(FrameMetadata))
+		throw std::runtime_error(std::string("not a metadata file: ") + fileName);
+
+	file.seekg(header.headerSize);
+
+	std::vector<FrameMetadata> frames;
+	std::vector<char> record(header.recordSize);
+
+	while ((header.frameCount == 0 || frames.size() < header.frameCount) && file.read(record.data(), record.size()))
+	{
+		FrameMetadata frame;
+		memcpy(&frame, record.data(), sizeof(frame));
+		frames.push_back(frame);
+	}
+
+	std::cout << fileName << ": " << frames.size() << " frames" << (header.frameCount == 0 ? " (recovered, recording was not closed)\n" : "\n");
+
+	if (frames.empty())
+		return;
+
+	// (2)
+	uint64_t missing = 0;
+	uint64_t incomplete = 0;
+	double minExposure = 0.0, maxExposure = 0.0, minGain = 0.0, maxGain = 0.0;
+	uint64_t withExposure = 0, withGain = 0;
+
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		const FrameMetadata& frame = frames[i];
+
+		if (i > 0 && frame.frameId > frames[i - 1].frameId + 1)
+			missing += frame.frameId - frames[i - 1].frameId - 1;
+
+		if (frame.flags & METADATA_FRAME_INCOMPLETE)
+			incomplete++;
+
+		if (frame.flags & METADATA_HAS_EXPOSURE)
+		{
+			minExposure = withExposure == 0 ? frame.exposureTime : std::min(minExposure, frame.exposureTime);
+			maxExposure = withExposure == 0 ? frame.exposureTime : std::max(maxExposure, frame.exposureTime);
+			withExposure++;
+		}
+
+		if (frame.flags & METADATA_HAS_GAIN)
+		{
+			minGain = withGain == 0 ? frame.gain : std::min(minGain, frame.gain);
+			maxGain = withGain == 0 ? frame.gain : std::max(maxGain, frame.gain);
+			withGain++;
+		}
+	}
+
+	const FrameMetadata& first = frames.front();
+	const FrameMetadata& last = frames.back();
+
+	std::cout << "Frame IDs " << first.frameId << " to " << last.frameId << ", " << missing << " missing, " << incomplete << " incomplete\n";
+
+	// (3)
+	if (frames.size() > 1 && last.timestampNs > first.timestampNs)
+		std::cout << "Captured at " << (frames.size() - 1) * 1e9 / (last.timestampNs - first.timestampNs) << " fps, recorded at " << header.fps << " fps\n";
+
+	if (withExposure > 0)
+		std::cout << "Exposure time " << minExposure << " to " << maxExposure << " us in " << withExposure << " frames\n";
+
+	if (withGain > 0)
+		std::cout << "Gain " << minGain << " to " << maxGain << " dB in " << withGain << " frames\n";
+}
+
+// tells a metadata file from a raw recording by its magic
+bool IsMetadataFile(const char* fileName)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	char magic[sizeof(METADATA_FILE_MAGIC) - 1];
+
+	return file.read(magic, sizeof(magic)) && memcmp(magic, METADATA_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+// reads the frames a recorder publishes with -shm, as a downstream process
+// would, until Ctrl+C or the recorder stops
+// (1) opens ring
+// (2) follows the newest frames, skipping to the newest when it falls a
+//     whole ring behind
+// (3) averages each frame's first plane in place, then checks that the
+//     frame was not overwritten meanwhile
+// (4) reports once a second
+void SubscribeFrames(const std::string& name)
+{
+	// (1)
+	SharedFrameReader reader(name);
+	const SharedFramesHeader& header = reader.GetHeader();
+
+	std::cout << name << ": " << header.width << "x" << header.height << ", " << header.bitsPerSample << "-bit";
+	for (uint32_t p = 0; p < header.numPlanes; p++)
+		std::cout << (p == 0 ? ", planes " : " ") << GetSharedPlaneName(static_cast<SharedPlaneKind>(header.planeKinds[p]));
+	std::cout << ", " << header.numSlots << " frame ring written by process " << header.writerPid << "\n";
+	std::cout << "Reading frames; press Ctrl+C to stop\n";
+
+	const size_t numSamples = static_cast<size_t>(header.width) * header.height;
+	uint64_t next = reader.GetPublished();
+	uint64_t read = 0;
+	uint64_t skipped = 0;
+	uint64_t torn = 0;
+	uint64_t lastFrameId = 0;
+	double lastMean = 0.0;
+	uint64_t reportRead = 0;
+	double reportStart = FrameStats::Now();
+
+	while (!g_stopRequested)
+	{
+		if (reader.Wait(next, 100))
+		{
+			// (2)
+			const uint64_t published = reader.GetPublished();
+
+			if (published - next > header.numSlots)
+			{
+				skipped += published - 1 - next;
+				next = published - 1;
+			}
+
+			// (3)
+			SharedFrameView view;
+
+			if (reader.Get(next, view))
+			{
+				uint64_t sum = 0;
+
+				for (size_t i = 0; i < numSamples; i++)
+					sum += header.bytesPerSample == 2 ? reinterpret_cast<const uint16_t*>(view.pPlanes[0])[i] : view.pPlanes[0][i];
+
+				if (reader.IsIntact(view))
+				{
+					read++;
+					lastFrameId = view.frameId;
+					lastMean = static_cast<double>(sum) / numSamples;
+				}
+				else
+				{
+					torn++;
+				}
+			}
+			else
+			{
+				skipped++;
+			}
+
+			next++;
+		}
+		else if (reader.IsClosed())
+		{
+			break;
+		}
+
+		// (4)
+		const double now = FrameStats::Now();
+
+		if (now - reportStart >= 1.0)
+		{
+			std::cout << TAB1 << "Read " << read << " frames (" << (read - reportRead) / (now - reportStart) << " fps), " << skipped << " skipped, " << torn << " torn, frame ID "
+					<< lastFrameId << ", plane " << GetSharedPlaneName(static_cast<SharedPlaneKind>(header.planeKinds[0])) << " mean " << lastMean << "\n";
+
+			reportRead = read;
+			reportStart = now;
+		}
+	}
+
+	std::cout << (reader.IsClosed() ? "Recorder stopped" : "Stopped") << " after " << read << " frames, " << skipped << " skipped, " << torn << " torn\n";
+}
+
+// =-=-=-=-=-=-=-=-=-
+// =- PREPARATION -=-
+// =- & CLEAN UP =-=-
+// =-=-=-=-=-=-=-=-=-
+
+int main(int argc, char** argv)
+{
+	// flag to track when an exception has been thrown
+	bool exceptionThrown = false;
+
+	std::cout << "\nCpp_Record\n\n";
+
+	// Expand config files
+	//    The options of a -config file take its place on the command line,
+	//    so the options after it override those in it.
+	std::vector<std::string> argStrings(1, argv[0]);
+
+	for (int32_t i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-config") == 0) && (i + 1 < argc))
+		{
+			if (!ReadConfigFile(argv[++i], argStrings))
+			{
+				std::cout << "Cannot read config file [" << argv[i] << "]\n";
+				return -1;
+			}
+		}
+		else
+		{
+			argStrings.push_back(argv[i]);
+		}
+	}
+
+	std::vector<char*> args;
+
+	for (size_t i = 0; i < argStrings.size(); i++)
+		args.push_back(const_cast<char*>(argStrings[i].c_str()));
+
+	args.push_back(NULL);
+	argc = static_cast<int>(argStrings.size());
+	argv = &args[0];
+
+	// Parse command line args
+	RecordSettings settings;
+
+	for (int32_t i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "-w") == 0) && (i + 1 < argc))
+		{
+			settings.width = strtol(argv[++i], NULL, 10);
+		}
+		else if ((strcmp(argv[i], "-h") == 0) && (i + 1 < argc))
+		{
+			settings.height = strtol(argv[++i], NULL, 10);
+		}
+		else if ((strcmp(argv[i], "-offset") == 0) && (i + 1 < argc))
+		{
+			size_t offset[2];
+
+			if (!ParseNumberList(argv[++i], 2, offset))
+			{
+				std::cout << "Invalid offset [" << argv[i] << "]\n";
+				return -1;
+			}
+
+			settings.offsetX = static_cast<int64_t>(offset[0]);
+			settings.offsetY = static_cast<int64_t>(offset[1]);
+		}
+		else if ((strcmp(argv[i], "-binning") == 0) && (i + 1 < argc))
+		{
+			settings.binning = strtol(argv[++i], NULL, 10);
+
+			if (settings.binning < 1)
+			{
+				std::cout << "Binning must be at least 1.\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-subsample") == 0) && (i + 1 < argc))
+		{
+			settings.subsampling = strtol(argv[++i], NULL, 10);
+
+			if (settings.subsampling < 1)
+			{
+				std::cout << "Subsampling must be at least 1.\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-crop") == 0) && (i + 1 < argc))
+		{
+			size_t crop[4];
+
+			if (!ParseNumberList(argv[++i], 4, crop) || crop[2] == 0 || crop[3] == 0)
+			{
+				std::cout << "Invalid crop [" << argv[i] << "]\n";
+				return -1;
+			}
+
+			settings.crop.x = crop[0];
+			settings.crop.y = crop[1];
+			settings.crop.width = crop[2];
+			settings.crop.height = crop[3];
+		}
+		else if ((strcmp(argv[i], "-scale") == 0) && (i + 1 < argc))
+		{
+			settings.scale = strtoul(argv[++i], NULL, 10);
+
+			if (settings.scale < 1)
+			{
+				std::cout << "Scale must be at least 1.\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc))
+		{
+			settings.numImages = strtol(argv[++i], NULL, 10);
+		}
+		else if ((strcmp(argv[i], "-fps") == 0) && (i + 1 < argc))
+		{
+			settings.fps = strtof(argv[++i], NULL);
+
+			if (settings.fps <= 0)
+			{
+				std::cout << "Framerate must be greater than 0.\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-q") == 0) && (i + 1 < argc))
+		{
+			settings.queueDepth = strtol(argv[++i], NULL, 10);
+
+			if (settings.queueDepth == 0)
+			{
+				std::cout << "Queue depth must be greater than 0.\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-b") == 0) && (i + 1 < argc))
+		{
+			settings.numBuffers = strtol(argv[++i], NULL, 10);
+		}
+		else if ((strcmp(argv[i], "-format") == 0) && (i + 1 < argc))
+		{
+			i++;
+
+			if (strcmp(argv[i], "angles8") == 0)
+				settings.format = CAMERA_FORMAT_ANGLES8;
+			else if (strcmp(argv[i], "mono12p") == 0)
+				settings.format = CAMERA_FORMAT_MONO12P;
+			else if (strcmp(argv[i], "mono12packed") == 0)
+				settings.format = CAMERA_FORMAT_MONO12PACKED;
+			else if (strcmp(argv[i], "dolpaolp12p") == 0)
+				settings.format = CAMERA_FORMAT_DOLPAOLP12P;
+			else
+			{
+				std::cout << "Invalid pixel format [" << argv[i] << "]\n";
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "-zerocopy") == 0)
+		{
+			settings.zeroCopy = true;
+		}
+		else if ((strcmp(argv[i], "-backpressure") == 0) && (i + 1 < argc))
+		{
+			i++;
+
+			if (strcmp(argv[i], "block") == 0)
+				settings.backpressure = BACKPRESSURE_BLOCK;
+			else if (strcmp(argv[i], "dropoldest") == 0)
+				settings.backpressure = BACKPRESSURE_DROP_OLDEST;
+			else if (strcmp(argv[i], "dropnewest") == 0)
+				settings.backpressure = BACKPRESSURE_DROP_NEWEST;
+			else if (strcmp(argv[i], "throttle") == 0)
+				settings.backpressure = BACKPRESSURE_THROTTLE;
+			else if (strcmp(argv[i], "decimate") == 0)
+			{
+				settings.backpressure = BACKPRESSURE_DECIMATE;
+
+				// the factor is optional
+				if (i + 1 < argc && argv[i + 1][0] != '-')
+					settings.decimation = strtol(argv[++i], NULL, 10);
+
+				if (settings.decimation < 2)
+				{
+					std::cout << "Decimation must be at least 2.\n";
+					return -1;
+				}
+			}
+			else
+			{
+				std::cout << "Invalid backpressure policy [" << argv[i] << "]\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-pin") == 0) && (i + 1 < argc))
+		{
+			if (!ParseCpuList(argv[++i], settings.cpus))
+			{
+				std::cout << "Invalid CPU list [" << argv[i] << "]\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-bufferhandling") == 0) && (i + 1 < argc))
+		{
+			const char* mode = argv[++i];
+
+			if (strcmp(mode, "oldest") == 0)
+				settings.bufferHandling = "OldestFirst";
+			else if (strcmp(mode, "overwrite") == 0)
+				settings.bufferHandling = "OldestFirstOverwrite";
+			else if (strcmp(mode, "newest") == 0)
+				settings.bufferHandling = "NewestOnly";
+			else
+			{
+				std::cout << "Invalid buffer handling mode [" << mode << "]\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-throughput") == 0) && (i + 1 < argc))
+		{
+			const char* limit = argv[++i];
+
+			// bytes per second, which the camera rounds to its increment
+			if (strcmp(limit, "auto") == 0)
+				settings.throughputLimit = -1;
+			else
+				settings.throughputLimit = static_cast<int64_t>(strtod(limit, NULL) * 1e6);
+
+			if (settings.throughputLimit == 0)
+			{
+				std::cout << "Invalid throughput limit [" << limit << "]\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-packetdelay") == 0) && (i + 1 < argc))
+		{
+			settings.packetDelay = strtol(argv[++i], NULL, 10);
+
+			if (settings.packetDelay < 0)
+			{
+				std::cout << "The packet delay cannot be negative.\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-rxcpu") == 0) && (i + 1 < argc))
+		{
+			if (!ParseCpuList(argv[++i], settings.rxCpus))
+			{
+				std::cout << "Invalid CPU list [" << argv[i] << "]\n";
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "-rxrealtime") == 0)
+		{
+			settings.rxRealtime = true;
+		}
+		else if (strcmp(argv[i], "-metadata") == 0)
+		{
+			settings.metadata = true;
+		}
+		else if (strcmp(argv[i], "-calibrate") == 0)
+		{
+			settings.calibrate = true;
+		}
+		else if ((strcmp(argv[i], "-encoders") == 0) && (i + 1 < argc))
+		{
+			settings.encoderThreads = strtol(argv[++i], NULL, 10);
+		}
+		else if ((strcmp(argv[i], "-devices") == 0) && (i + 1 < argc))
+		{
+			i++;
+
+			if (strcmp(argv[i], "all") == 0)
+				settings.allDevices = true;
+			else if (!ParseSerialList(argv[i], settings.serials))
+			{
+				std::cout << "Invalid device list [" << argv[i] << "]\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-backend") == 0) && (i + 1 < argc))
+		{
+			if (!ParseEncoderBackend(argv[++i], settings.encoderBackend))
+			{
+				std::cout << "Invalid encoder back end [" << argv[i] << "]\n";
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "-mono") == 0)
+		{
+			settings.encoderBackend = ENCODER_BACKEND_X264;
+		}
+		else if (strcmp(argv[i], "-stats") == 0)
+		{
+			settings.statsInterval = STATS_INTERVAL_S;
+
+			// the interval is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				settings.statsInterval = strtod(argv[++i], NULL);
+		}
+		else if ((strcmp(argv[i], "-statsfile") == 0) && (i + 1 < argc))
+		{
+			settings.statsFile = argv[++i];
+		}
+		else if (strcmp(argv[i], "-mosaic") == 0)
+		{
+			settings.mosaic = true;
+		}
+		else if (strcmp(argv[i], "-cuda") == 0)
+		{
+#ifdef USE_CUDA
+			settings.cuda = true;
+#else
+			std::cout << "-cuda needs a USE_CUDA build.\n";
+			return -1;
+#endif
+		}
+		else if ((strcmp(argv[i], "-raw") == 0) && (i + 1 < argc))
+		{
+			i++;
+
+			if (strcmp(argv[i], "planar") == 0)
+				settings.rawLayout = RAW_LAYOUT_PLANAR;
+			else if (strcmp(argv[i], "interleaved") == 0)
+				settings.rawLayout = RAW_LAYOUT_INTERLEAVED;
+			else if (strcmp(argv[i], "lossless") == 0)
+			{
+				settings.rawLayout = RAW_LAYOUT_PLANAR;
+				settings.rawCodec = RAW_CODEC_LOSSLESS;
+			}
+			else
+			{
+				std::cout << "Invalid raw layout [" << argv[i] << "]\n";
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "-stokes") == 0)
+		{
+			settings.stokes = true;
+
+			if (i + 1 < argc && strcmp(argv[i + 1], "fast") == 0)
+			{
+				settings.stokesFast = true;
+				i++;
+			}
+		}
+		else if (strcmp(argv[i], "-denoise") == 0 || strcmp(argv[i], "-integrate") == 0)
+		{
+			const bool denoise = strcmp(argv[i], "-denoise") == 0;
+
+			settings.temporalFilter = denoise ? TEMPORAL_FILTER_RECURSIVE : TEMPORAL_FILTER_WINDOW;
+			settings.temporalFrames = denoise ? DENOISE_FRAMES : INTEGRATE_FRAMES;
+
+			// the frames, and the gate of -denoise, are optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				settings.temporalFrames = static_cast<unsigned int>(strtoul(argv[++i], NULL, 10));
+
+			if (denoise && i + 1 < argc && argv[i + 1][0] != '-')
+				settings.denoiseThreshold = static_cast<unsigned int>(strtoul(argv[++i], NULL, 10));
+
+			const unsigned int frames = settings.temporalFrames;
+
+			if (frames < 2 || frames > TEMPORAL_FILTER_MAX_FRAMES || (frames & (frames - 1)) != 0)
+			{
+				std::cout << "Temporal filter frames must be a power of two from 2 to " << TEMPORAL_FILTER_MAX_FRAMES << ".\n";
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "-sync") == 0)
+		{
+			settings.sync = true;
+		}
+		else if ((strcmp(argv[i], "-pretrigger") == 0) && (i + 1 < argc))
+		{
+			settings.preTrigger = strtod(argv[++i], NULL);
+
+			// the post-trigger window is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				settings.postTrigger = strtod(argv[++i], NULL);
+
+			if (settings.preTrigger <= 0.0 || settings.postTrigger < 0.0)
+			{
+				std::cout << "Pre-trigger history must be longer than 0 seconds.\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-trigger") == 0) && (i + 1 < argc))
+		{
+			i++;
+
+			if (strcmp(argv[i], "signal") == 0)
+				settings.triggerSource = TRIGGER_SOURCE_SIGNAL;
+			else if (strcmp(argv[i], "line") == 0 && i + 1 < argc)
+			{
+				settings.triggerSource = TRIGGER_SOURCE_LINE;
+				settings.triggerLine = strtol(argv[++i], NULL, 10);
+
+				if (settings.triggerLine < 0 || settings.triggerLine > 63)
+				{
+					std::cout << "Invalid trigger line [" << argv[i] << "]\n";
+					return -1;
+				}
+			}
+			else if (strcmp(argv[i], "dolp") == 0 && i + 1 < argc)
+			{
+				settings.triggerSource = TRIGGER_SOURCE_DOLP;
+				settings.triggerDolp = strtod(argv[++i], NULL);
+
+				if (settings.triggerDolp <= 0.0 || settings.triggerDolp > 1.0)
+				{
+					std::cout << "DoLP threshold must be greater than 0 and at most 1.\n";
+					return -1;
+				}
+			}
+			else
+			{
+				std::cout << "Invalid trigger [" << argv[i] << "]\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-shm") == 0) && (i + 1 < argc))
+		{
+			settings.shmName = argv[++i];
+
+			// the ring size is optional
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				settings.shmSlots = static_cast<size_t>(strtoul(argv[++i], NULL, 10));
+
+			if (settings.shmName.find('/') != std::string::npos || settings.shmSlots < 2)
+			{
+				std::cout << "Shared memory names have no slashes, and the ring holds at least 2 frames.\n";
+				return -1;
+			}
+		}
+		else if ((strcmp(argv[i], "-subscribe") == 0) && (i + 1 < argc))
+		{
+			try
+			{
+				std::signal(SIGINT, SignalHandler);
+				std::signal(SIGTERM, SignalHandler);
+
+				const std::string name = argv[++i];
+				SubscribeFrames(name[0] == '/' ? name : "/" + name);
+				return 0;
+			}
+			catch (std::exception& ex)
+			{
+				std::cout << "Standard exception thrown: " << ex.what() << std::endl;
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "-daemon") == 0)
+		{
+			settings.daemon = true;
+		}
+		else if ((strcmp(argv[i], "-nodecache") == 0) && (i + 1 < argc))
+		{
+			settings.nodeCacheFile = argv[++i];
+		}
+		else if ((strcmp(argv[i], "-inspect") == 0) && (i + 1 < argc))
+		{
+			try
+			{
+				const char* fileName = argv[++i];
+
+				if (IsMetadataFile(fileName))
+					InspectMetadata(fileName);
+				else
+					InspectRaw(fileName);
+				return 0;
+			}
+			catch (std::exception& ex)
+			{
+				std::cout << "Standard exception thrown: " << ex.what() << std::endl;
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "-selftest") == 0)
+		{
+			std::cout << "Checking demux, unpack, Stokes and temporal filter kernels, the lossless codec, raw recordings and shared frames\n";
+			bool passed = VerifyDeinterleaveKernels();
+			passed = VerifyUnpack12Kernels() && passed;
+			passed = VerifyStokesKernels() && passed;
+			passed = VerifyTemporalFilterKernels() && passed;
+			passed = VerifyPlaneCodec() && passed;
+			passed = VerifyRawWriter() && passed;
+			passed = VerifySharedFrames() && passed;
+#ifdef USE_CUDA
+			passed = VerifyCudaStage() && passed;
+#endif
+			return passed ? 0 : -1;
+		}
+		else if (strcmp(argv[i], "--help") == 0)
+		{
+			usage(argv[0]);
+			return 0;
+		}
+		else
+		{
+			std::cout << "Invalid argument [" << argv[i] << "]\n";
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if (settings.height == 0 || settings.width == 0)
+	{
+		std::cout << "Invalid with or height specified!\n";
+		return -1;
+	}
+
+	// the GPU writes whole planes, not mosaic quadrants
+	if (settings.cuda && settings.mosaic)
+	{
+		std::cout << "-cuda cannot be combined with -mosaic.\n";
+		return -1;
+	}
+
+	// the host crops and scales while demuxing 8-bit angles on the CPU
+	if (settings.crop.width != 0 || settings.scale > 1)
+	{
+		const char* error = NULL;
+
+		if (settings.format != CAMERA_FORMAT_ANGLES8)
+			error = "-crop and -scale need the angles8 format; use -offset with -w and -h for a camera window.";
+		else if (settings.cuda)
+			error = "-crop and -scale cannot be combined with -cuda.";
+		else if (settings.rawLayout == RAW_LAYOUT_INTERLEAVED)
+			error = "-crop and -scale apply to angle planes, which -raw interleaved does not have.";
+
+		if (error != NULL)
+		{
+			std::cout << error << "\n";
+			return -1;
+		}
+	}
+
+	// 12-bit planes only go to the raw writer and HEVC encoders
+	if (settings.format != CAMERA_FORMAT_ANGLES8)
+	{
+		const char* error = NULL;
+
+		if (settings.stokes)
+			error = "-stokes needs the angles8 format; dolpaolp12p records the camera's own DoLP and AoLP.";
+		else if (settings.cuda)
+			error = "-cuda needs the angles8 format.";
+		else if (settings.format == CAMERA_FORMAT_DOLPAOLP12P && settings.mosaic)
+			error = "-mosaic needs angle planes, which dolpaolp12p does not have.";
+		else if (settings.rawLayout == RAW_LAYOUT_INTERLEAVED)
+			error = "12-bit formats are recorded with -raw planar.";
+		else if (settings.rawLayout < 0 && settings.encoderBackend == ENCODER_BACKEND_SAVE)
+			error = "12-bit formats are encoded as HEVC, which the Save library cannot do.";
+#ifndef USE_FFMPEG
+		else if (settings.rawLayout < 0)
+			error = "12-bit formats need -raw planar, or a USE_FFMPEG build for HEVC.";
+#endif
+
+		if (error != NULL)
+		{
+			std::cout << error << "\n";
+			return -1;
+		}
+	}
+
+	// the history is held as video planes, sampled from 8-bit angles
+	if (settings.preTrigger > 0.0 || settings.triggerSource != TRIGGER_SOURCE_SIGNAL)
+	{
+		const char* error = NULL;
+
+		if (settings.preTrigger <= 0.0)
+			error = "-trigger needs -pretrigger.";
+		else if (settings.rawLayout >= 0)
+			error = "-pretrigger records videos, not -raw.";
+		else if (settings.triggerSource == TRIGGER_SOURCE_DOLP && settings.format != CAMERA_FORMAT_ANGLES8)
+			error = "-trigger dolp needs the angles8 format.";
+#ifndef SIGUSR1
+		else if (settings.triggerSource == TRIGGER_SOURCE_SIGNAL)
+			error = "This platform has no SIGUSR1; use -trigger line or dolp.";
+#endif
+
+		if (error != NULL)
+		{
+			std::cout << error << "\n";
+			return -1;
+		}
+
+		// the trigger ends the recording instead
+		settings.numImages = 0;
+	}
+
+	// the filter works on the angle planes of the host's video demux
+	if (settings.temporalFrames > 0)
+	{
+		const char* error = NULL;
+
+		if (settings.rawLayout >= 0)
+			error = "-denoise and -integrate filter video recordings, not -raw.";
+		else if (settings.cuda)
+			error = "-denoise and -integrate filter host planes and cannot be combined with -cuda.";
+		else if (settings.format == CAMERA_FORMAT_DOLPAOLP12P)
+			error = "-denoise and -integrate need angle planes, not the camera's DoLP and AoLP.";
+
+		if (error != NULL)
+		{
+			std::cout << error << "\n";
+			return -1;
+		}
+	}
+
+	// the ring is fed by the video recorder's demux
+	if (!settings.shmName.empty() && settings.rawLayout >= 0)
+	{
+		std::cout << "-shm publishes the planes of video recordings, not -raw.\n";
+		return -1;
+	}
+
+	// only a service leaves its cameras configured for the cache to hold
+	if (settings.nodeCacheFile != NODE_CACHE_FILE && !settings.daemon)
+	{
+		std::cout << "-nodecache needs -daemon.\n";
+		return -1;
+	}
+
+	// triggered cameras have no frame rate of their own to lower
+	if (settings.sync && settings.backpressure == BACKPRESSURE_THROTTLE)
+	{
+		std::cout << "-backpressure throttle cannot be combined with -sync.\n";
+		return -1;
+	}
+
+	// nor one to calibrate
+	if (settings.sync && settings.calibrate)
+	{
+		std::cout << "-calibrate cannot be combined with -sync.\n";
+		return -1;
+	}
+
+	// Run unattended
+	//    A service has no one to answer the prompts, and its log is a pipe
+	//    that would otherwise only see output in large blocks.
+	if (settings.daemon)
+	{
+		std::cout << std::unitbuf;
+	}
+	else
+	{
+		std::cout << "While the recorder is running, up to " << settings.queueDepth << " images are buffered to memory.\n";
+		std::cout << "To reduce the chance of problems when running on platforms with lower\n"
+				<< "performance and/or lower amounts of memory, this example will use a\n"
+				<< "default resolution of " << WIDTH << "x" << HEIGHT << std::endl;
+		std::cout << "The default resolution can be overridden with command line arguments.\n"
+				<< "Use: " << argv[0] << " --help for more info.\n";
+
+		std::cout << "\nProceed with example? ('y' to continue) ";
+
+		char continueExample = 'a';
+		std::cin >> continueExample;
+
+		if (continueExample != 'y')
+		{
+			std::cout << "\nPress enter to complete\n";
+
+			// clear input
+			while (std::cin.get() != '\n')
+				continue;
+
+			std::getchar();
+			return -1;
+		}
+	}
+
+	try
+	{
+		// prepare example
+		Arena::ISystem* pSystem = Arena::OpenSystem();
+		pSystem->UpdateDevices(100);
+		std::vector<Arena::DeviceInfo> deviceInfos = pSystem->GetDevices();
+		if (deviceInfos.size() == 0)
+		{
+			// a service fails, to be started again once a camera is found
+			if (settings.daemon)
+			{
+				std::cout << "\nNo camera connected\n";
+				Arena::CloseSystem(pSystem);
+				return -1;
+			}
+
+			std::cout << "\nNo camera connected\nPress enter to complete\n";
+			std::getchar();
+			return 0;
+		}
+		// Select cameras
+		//    By default only the first camera found records, to the plain
+		//    file names. With -devices every selected camera records on its
+		//    own thread, to file names prefixed with its serial number.
+		std::vector<Arena::DeviceInfo> selectedInfos = SelectDevices(deviceInfos, settings);
+		const bool multiCamera = settings.allDevices || !settings.serials.empty();
+
+		// Load node cache
+		//    A service leaves its cameras configured instead of restoring
+		//    their initial settings, so it has none to store either.
+		std::unique_ptr<NodeCache> pNodeCache;
+
+		if (settings.daemon)
+		{
+			pNodeCache.reset(new NodeCache(settings.nodeCacheFile));
+			pNodeCache->Load();
+		}
+
+		std::vector<Arena::IDevice*> devices;
+		std::vector<InitialSettings> initialSettings;
+		std::vector<RecordSettings> deviceSettings;
+
+		// -throughput auto shares the link between the cameras
+		settings.linkShares = selectedInfos.size();
+
+		// Configure cameras
+		//    A camera that fails to configure leaves every camera configured
+		//    so far, itself included, restored and released before the
+		//    error goes on.
+		try
+		{
+			for (size_t d = 0; d < selectedInfos.size(); d++)
+			{
+				Arena::IDevice* pDevice = pSystem->CreateDevice(selectedInfos[d]);
+				devices.push_back(pDevice);
+
+				if (!settings.daemon)
+					initialSettings.push_back(StoreInitialSettings(pDevice, settings));
+
+				deviceSettings.push_back(ConfigureDevice(pDevice, settings, pNodeCache.get(), selectedInfos[d].SerialNumber().c_str()));
+
+				if (!settings.rxCpus.empty())
+					deviceSettings[d].rxCpu = settings.rxCpus[d % settings.rxCpus.size()];
+
+				if (multiCamera)
+				{
+					deviceSettings[d].filePrefix = std::string(selectedInfos[d].SerialNumber().c_str()) + "_";
+
+					std::cout << "Camera " << selectedInfos[d].SerialNumber() << "\n";
+				}
+
+				std::cout << "Using: \nwidth: " << deviceSettings[d].width
+						<< "\nheight: " << deviceSettings[d].height
+						<< "\noffset: " << deviceSettings[d].offsetX << "," << deviceSettings[d].offsetY
+						<< "\nbinning: " << deviceSettings[d].binning
+						<< "\nsubsampling: " << deviceSettings[d].subsampling
+						<< "\nnumImages: " << deviceSettings[d].numImages
+						<< "\nfps: " << deviceSettings[d].fps
+						<< std::endl;
+
+				if (deviceSettings[d].throughputLimit > 0)
+					std::cout << "throughput limit: " << deviceSettings[d].throughputLimit / 1e6 << " MB/s\n";
+
+				if (deviceSettings[d].packetDelay >= 0)
+					std::cout << "packet delay: " << deviceSettings[d].packetDelay << " ticks\n";
+
+				std::cout << std::endl;
+			}
+		}
+		catch (...)
+		{
+			for (size_t d = 0; d < devices.size(); d++)
+			{
+				try
+				{
+					if (!settings.daemon && d < initialSettings.size())
+						RestoreInitialSettings(devices[d], initialSettings[d], settings);
+					else if (settings.daemon && settings.sync)
+						DisableActionTrigger(devices[d]);
+				}
+				catch (...)
+				{
+					// the error that got here is the one to report
+				}
+
+				pSystem->DestroyDevice(devices[d]);
+			}
+
+			Arena::CloseSystem(pSystem);
+			throw;
+		}
+
+		// a cache that cannot be written only costs the next start time
+		if (pNodeCache && !pNodeCache->Save())
+			std::cout << "Cannot write node cache [" << pNodeCache->GetFileName() << "]\n";
+
+		// Prepare encoder threads
+		//    One pool serves every stream of every camera. It is sized to the
+		//    cores rather than to the streams, since a thread per stream would
+		//    oversubscribe the CPUs of a rig with several cameras.
+		const size_t numStreams = devices.size() * GetNumVideoStreams(settings);
+		unsigned int numEncoderThreads = settings.encoderThreads;
+
+		if (numEncoderThreads == 0)
+			numEncoderThreads = static_cast<unsigned int>(std::min<size_t>(GetCpuCount(), numStreams));
+
+		std::unique_ptr<EncoderPool> pEncoders(new EncoderPool(numEncoderThreads, settings.cpus));
+
+		std::cout << "Encoding " << numStreams << " streams on " << pEncoders->GetNumThreads() << " threads\n";
+
+		// Synchronize cameras
+		//    The scheduler fires the first action once every camera streams,
+		//    timed by the PTP clock of the first camera.
+		std::unique_ptr<ActionScheduler> pScheduler;
+		std::unique_ptr<CountdownLatch> pStarted;
+
+		if (settings.sync)
+		{
+			EnablePtp(devices);
+
+			pStarted.reset(new CountdownLatch(devices.size()));
+			pScheduler.reset(new ActionScheduler(pSystem, devices[0], settings.fps));
+			pScheduler->Start(pStarted.get());
+
+			std::cout << "Triggering " << devices.size() << " cameras by PTP scheduled action commands at " << settings.fps << " FPS\n";
+		}
+
+		// stop open-ended recordings cleanly on Ctrl+C, or when a service
+		// manager stops the recorder
+		std::signal(SIGINT, SignalHandler);
+		std::signal(SIGTERM, SignalHandler);
+#ifdef SIGUSR1
+		std::signal(SIGUSR1, TriggerHandler);
+#endif
 
 		// run example
+		//    A camera that fails stops the others, which still finish their
+		//    videos; the first failure is reported once all have stopped.
 		std::cout << "Commence example\n\n";
-		RecordVideo(images, fps);
-		std::cout << "\nExample complete\n";
 
-		// clean up example
-		for (size_t i = 0; i < images.size(); i++)
+		std::vector<std::exception_ptr> errors(devices.size());
+
+		if (devices.size() == 1)
 		{
-			Arena::ImageFactory::Destroy(images[i]);
+			RecordDevice(devices[0], deviceSettings[0], pEncoders.get(), pStarted.get(), &errors[0]);
 		}
+		else
+		{
+			std::vector<std::thread> deviceThreads;
 
-		// Restore initial settings
+			for (size_t d = 0; d < devices.size(); d++)
+				deviceThreads.push_back(std::thread(RecordDevice, devices[d], deviceSettings[d], pEncoders.get(), pStarted.get(), &errors[d]));
+
+			for (size_t d = 0; d < deviceThreads.size(); d++)
+				deviceThreads[d].join();
+		}
+
+		pEncoders.reset();
 
-		// Restore width and height
-		SetIntValue(pDevice->GetNodeMap(), "Width", imageWidthInitial);
-		SetIntValue(pDevice->GetNodeMap(), "Height", imageHeightInitial);
+		// the scheduler's error, if any, is reported after the cameras' own
+		std::exception_ptr schedulerError;
 
-		// Restore acquisition mode
-		Arena::SetNodeValue<GenICam::gcstring>(pDevice->GetNodeMap(), "AcquisitionMode", acquisitionModeInitial);
+		if (pScheduler)
+		{
+			try
+			{
+				pScheduler->Stop();
+			}
+			catch (...)
+			{
+				schedulerError = std::current_exception();
+			}
 
-		// Restore framerate
-		Arena::SetNodeValue<bool>(pDevice->GetNodeMap(), "AcquisitionFrameRateEnable", frameRateEnableInitial);
+			std::cout << "Fired " << pScheduler->GetFiredCount() << " action commands, " << pScheduler->GetLateCount() << " late\n";
+		}
 
-		if (frameRateEnableInitial)
+		// Restore initial settings
+		//    A service leaves its cameras as configured, except that
+		//    triggered cameras run free again, as the next start may not
+		//    synchronize them.
+		for (size_t d = 0; d < devices.size(); d++)
 		{
-			SetFloatValue(pDevice->GetNodeMap(), "AcquisitionFrameRate", frameRateInitial);
+			if (!settings.daemon)
+				RestoreInitialSettings(devices[d], initialSettings[d], settings);
+			else if (settings.sync)
+				DisableActionTrigger(devices[d]);
+
+			pSystem->DestroyDevice(devices[d]);
 		}
 
-		pSystem->DestroyDevice(pDevice);
 		Arena::CloseSystem(pSystem);
+
+		for (size_t d = 0; d < errors.size(); d++)
+			if (errors[d])
+				std::rethrow_exception(errors[d]);
+
+		if (schedulerError)
+			std::rethrow_exception(schedulerError);
+
+		std::cout << "\nExample complete\n";
 	}
 	catch (GenICam::GenericException& ge)
 	{
@@ -530,13 +3887,18 @@ int main(int argc, char** argv)
 		exceptionThrown = true;
 	}
 
-	std::cout << "Press enter to complete\n";
+	// a service's stdin is usually /dev/null, where the wait below would
+	// never end
+	if (!settings.daemon)
+	{
+		std::cout << "Press enter to complete\n";
 
-	// clear input
-	while (std::cin.get() != '\n')
-		continue;
+		// clear input
+		while (std::cin.get() != '\n')
+			continue;
 
-	std::getchar();
+		std::getchar();
+	}
 
 	if (exceptionThrown)
 		return -1;